@@ -0,0 +1,246 @@
+#include "MaschineChannel.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+// Timbres (FIFOs) por dirección: /tmp/<nombre>-to-host y -to-driver
+#define MASCHINE_DOORBELL_DIR        "/tmp"
+#define MASCHINE_DOORBELL_TO_HOST    "-to-host"
+#define MASCHINE_DOORBELL_TO_DRIVER  "-to-driver"
+
+static bool processAlive(int32_t pid) {
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+MaschineChannel::MaschineChannel() {
+    role = ROLE_DRIVER;
+    header = NULL;
+    shmFd = -1;
+    wakeReadFd = -1;
+    wakeWriteFd = -1;
+    shmName[0] = '\0';
+    dropped = 0;
+}
+
+MaschineChannel::~MaschineChannel() {
+    close();
+}
+
+bool MaschineChannel::open(Role newRole, const char* name) {
+    close();
+    role = newRole;
+    snprintf(shmName, sizeof(shmName), "%s", name);
+
+    if (role == ROLE_DRIVER) {
+        // Un segmento previo puede venir de un driver caído: empezar de cero,
+        // pero nunca quitárselo a un driver que sigue vivo
+        if (ownerAlive(shmName)) {
+            errno = EBUSY;
+            return false;
+        }
+        shm_unlink(shmName);
+        shmFd = shm_open(shmName, O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (shmFd < 0 || ftruncate(shmFd, sizeof(MaschineChannelHeader)) != 0) {
+            close();
+            return false;
+        }
+    } else {
+        shmFd = shm_open(shmName, O_RDWR, 0600);
+        if (shmFd < 0) {
+            return false;
+        }
+    }
+
+    void* memory = mmap(NULL, sizeof(MaschineChannelHeader), PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0);
+    if (memory == MAP_FAILED) {
+        close();
+        return false;
+    }
+    header = (MaschineChannelHeader*)memory;
+
+    if (role == ROLE_DRIVER) {
+        // ftruncate deja el segmento a cero: solo falta la cabecera
+        header->version = MASCHINE_CHANNEL_VERSION;
+        header->driverPid.store(getpid());
+        header->magic = MASCHINE_CHANNEL_MAGIC;
+    } else {
+        if (header->magic != MASCHINE_CHANNEL_MAGIC || header->version != MASCHINE_CHANNEL_VERSION) {
+            close();
+            return false;
+        }
+        // Reconexión: descartar lo que quedó para un host anterior
+        header->toHost.head.store(header->toHost.tail.load(std::memory_order_acquire), std::memory_order_release);
+        header->hostPid.store(getpid());
+        header->hostGeneration.fetch_add(1);
+    }
+
+    if (!openDoorbells()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+// ¿Hay un segmento con ese nombre cuyo driver sigue vivo?
+bool MaschineChannel::ownerAlive(const char* name) {
+    int fd = shm_open(name, O_RDONLY, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    bool alive = false;
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(MaschineChannelHeader)) {
+        void* memory = mmap(NULL, sizeof(MaschineChannelHeader), PROT_READ, MAP_SHARED, fd, 0);
+        if (memory != MAP_FAILED) {
+            const MaschineChannelHeader* existing = (const MaschineChannelHeader*)memory;
+            int32_t pid = existing->driverPid.load();
+            alive = existing->magic == MASCHINE_CHANNEL_MAGIC && pid != getpid() && processAlive(pid);
+            munmap(memory, sizeof(MaschineChannelHeader));
+        }
+    }
+    ::close(fd);
+    return alive;
+}
+
+bool MaschineChannel::openDoorbells() {
+    // El nombre POSIX empieza por '/': "/maschine-mikro" -> /tmp/maschine-mikro-to-host
+    const char* base = (shmName[0] == '/') ? shmName + 1 : shmName;
+    char toHost[128];
+    char toDriver[128];
+    snprintf(toHost, sizeof(toHost), "%s/%s%s", MASCHINE_DOORBELL_DIR, base, MASCHINE_DOORBELL_TO_HOST);
+    snprintf(toDriver, sizeof(toDriver), "%s/%s%s", MASCHINE_DOORBELL_DIR, base, MASCHINE_DOORBELL_TO_DRIVER);
+    mkfifo(toHost, 0600);
+    mkfifo(toDriver, 0600);
+
+    const char* readPath = (role == ROLE_DRIVER) ? toDriver : toHost;
+    const char* writePath = (role == ROLE_DRIVER) ? toHost : toDriver;
+
+    // O_RDWR evita bloquear en open() y SIGPIPE si el otro extremo no existe
+    wakeReadFd = ::open(readPath, O_RDWR | O_NONBLOCK);
+    wakeWriteFd = ::open(writePath, O_RDWR | O_NONBLOCK);
+    return wakeReadFd >= 0 && wakeWriteFd >= 0;
+}
+
+void MaschineChannel::close() {
+    if (header) {
+        if (role == ROLE_DRIVER) {
+            header->driverPid.store(0);
+        } else {
+            header->hostPid.store(0);
+        }
+        munmap(header, sizeof(MaschineChannelHeader));
+        header = NULL;
+    }
+    if (shmFd >= 0) {
+        ::close(shmFd);
+        shmFd = -1;
+        if (role == ROLE_DRIVER) {
+            shm_unlink(shmName);
+        }
+    }
+    if (wakeReadFd >= 0) {
+        ::close(wakeReadFd);
+        wakeReadFd = -1;
+    }
+    if (wakeWriteFd >= 0) {
+        ::close(wakeWriteFd);
+        wakeWriteFd = -1;
+    }
+}
+
+MaschineRing* MaschineChannel::outgoing() {
+    return (role == ROLE_DRIVER) ? &header->toHost : &header->toDriver;
+}
+
+MaschineRing* MaschineChannel::incoming() {
+    return (role == ROLE_DRIVER) ? &header->toDriver : &header->toHost;
+}
+
+bool MaschineChannel::isPeerAlive() const {
+    if (!header) {
+        return false;
+    }
+    return processAlive(role == ROLE_DRIVER ? header->hostPid.load() : header->driverPid.load());
+}
+
+bool MaschineChannel::send(const uint8_t* command) {
+    if (!header) {
+        return false;
+    }
+
+    // Un solo productor a la vez sobre tail (entrada MIDI, planificador,
+    // encoders, bucle de eventos...)
+    std::lock_guard<std::mutex> lock(sendMutex);
+    MaschineRing* ring = outgoing();
+    uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint32_t head = ring->head.load(std::memory_order_acquire);
+
+    if (tail - head >= MASCHINE_CHANNEL_SLOTS) {
+        // Camino lento: si el consumidor murió, vaciar el anillo y seguir
+        if (role == ROLE_DRIVER && !isPeerAlive()) {
+            ring->head.store(tail, std::memory_order_release);
+            head = tail;
+        } else {
+            dropped++;
+            return false;
+        }
+    }
+
+    memcpy(ring->slots[tail % MASCHINE_CHANNEL_SLOTS], command, MASCHINE_COMMAND_SIZE);
+    ring->tail.store(tail + 1, std::memory_order_release);
+
+    // Solo hay syscall si el consumidor anunció que iba a dormir
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ring->consumerWaiting.load(std::memory_order_relaxed) &&
+        ring->consumerWaiting.exchange(0)) {
+        uint8_t bell = 1;
+        ssize_t ignored = write(wakeWriteFd, &bell, 1);
+        (void)ignored;
+    }
+    return true;
+}
+
+bool MaschineChannel::receive(uint8_t* command) {
+    if (!header) {
+        return false;
+    }
+
+    MaschineRing* ring = incoming();
+    uint32_t head = ring->head.load(std::memory_order_relaxed);
+    uint32_t tail = ring->tail.load(std::memory_order_acquire);
+    if (head == tail) {
+        return false;
+    }
+
+    memcpy(command, ring->slots[head % MASCHINE_CHANNEL_SLOTS], MASCHINE_COMMAND_SIZE);
+    ring->head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+bool MaschineChannel::prepareWait() {
+    if (!header) {
+        return false;
+    }
+
+    MaschineRing* ring = incoming();
+    ring->consumerWaiting.store(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    // Volver a mirar: el productor pudo publicar antes de ver la marca
+    if (ring->head.load(std::memory_order_relaxed) != ring->tail.load(std::memory_order_acquire)) {
+        ring->consumerWaiting.store(0);
+        return false;
+    }
+    return true;
+}
+
+void MaschineChannel::drainWake() {
+    uint8_t buffer[64];
+    while (read(wakeReadFd, buffer, sizeof(buffer)) > 0) {
+    }
+}
@@ -0,0 +1,91 @@
+#ifndef MASCHINE_CHANNEL_H
+#define MASCHINE_CHANNEL_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include "MaschineProtocol.h"
+
+// Canal de memoria compartida con la aplicación host
+#define MASCHINE_CHANNEL_NAME      "/maschine-mikro"
+#define MASCHINE_CHANNEL_MAGIC     0x4D4B4348  // 'MKCH'
+#define MASCHINE_CHANNEL_VERSION   1
+#define MASCHINE_CHANNEL_SLOTS     1024        // potencia de 2
+
+// Anillo SPSC de comandos de 8 bytes. head lo escribe solo el consumidor y
+// tail solo el productor; cada uno en su propia línea de caché. Dentro de
+// cada proceso los productores se serializan antes de tocar tail.
+struct MaschineRing {
+    alignas(64) std::atomic<uint32_t> head;
+    alignas(64) std::atomic<uint32_t> tail;
+    alignas(64) std::atomic<uint32_t> consumerWaiting;
+    uint8_t slots[MASCHINE_CHANNEL_SLOTS][MASCHINE_COMMAND_SIZE];
+};
+
+struct MaschineChannelHeader {
+    uint32_t magic;
+    uint32_t version;
+    std::atomic<int32_t> driverPid;
+    std::atomic<int32_t> hostPid;
+    std::atomic<uint32_t> hostGeneration;
+    MaschineRing toHost;
+    MaschineRing toDriver;
+};
+
+// Canal bidireccional driver <-> host.
+//
+// El driver crea el segmento POSIX shm y el host se adjunta. Los comandos
+// viajan por dos anillos lock-free sin syscalls; solo cuando el consumidor
+// anuncia que va a dormir el productor toca un "timbre" (una FIFO con
+// nombre, que a diferencia de eventfd existe también en macOS y se puede
+// vigilar desde el bucle de eventos; su ruta sale del nombre del canal). Si
+// el host muere, el anillo hacia él se llena, se detecta con kill(pid, 0) y
+// se vacía; al volver a adjuntarse descarta lo pendiente y sigue. Si el
+// driver reinicia, recrea el segmento y el host debe volver a abrirlo; un
+// segundo driver no lo recrea mientras el dueño anterior siga vivo (EBUSY).
+class MaschineChannel {
+public:
+    enum Role {
+        ROLE_DRIVER,
+        ROLE_HOST
+    };
+
+    MaschineChannel();
+    ~MaschineChannel();
+
+    bool open(Role role, const char* name = MASCHINE_CHANNEL_NAME);
+    void close();
+    bool isOpen() const { return header != NULL; }
+    bool isPeerAlive() const;
+
+    // Devuelven false si el anillo está lleno / vacío. send() admite varios
+    // hilos productores
+    bool send(const uint8_t* command);
+    bool receive(uint8_t* command);
+
+    // Descriptor a vigilar para datos entrantes (poll/epoll/CFRunLoop).
+    // Antes de dormir hay que llamar a prepareWait(): si devuelve false ya
+    // hay datos y no se debe esperar.
+    int getWakeFd() const { return wakeReadFd; }
+    bool prepareWait();
+    void drainWake();
+
+    uint64_t getDroppedCount() const { return dropped; }
+
+private:
+    bool openDoorbells();
+    static bool ownerAlive(const char* name);
+    MaschineRing* outgoing();
+    MaschineRing* incoming();
+
+    Role role;
+    MaschineChannelHeader* header;
+    int shmFd;
+    int wakeReadFd;
+    int wakeWriteFd;
+    char shmName[64];
+    std::mutex sendMutex;
+    std::atomic<uint64_t> dropped;
+};
+
+#endif // MASCHINE_CHANNEL_H
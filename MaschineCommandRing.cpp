@@ -0,0 +1,123 @@
+#include "MaschineCommandRing.h"
+
+MaschineCommandDispatcher::MaschineCommandDispatcher() {
+    sendFunction = 0;
+    context = 0;
+    tail = 0;
+    sent = 0;
+    invalid = 0;
+    stalls = 0;
+}
+
+void MaschineCommandDispatcher::configure(SendFunction send, void* newContext) {
+    sendFunction = send;
+    context = newContext;
+}
+
+void MaschineCommandDispatcher::initializeRing(MaschineCommandRing* ring) {
+    tail = 0;
+    __builtin_memset(ring, 0, sizeof(*ring));
+    ring->version = MASCHINE_COMMAND_RING_VERSION;
+    ring->capacity = MASCHINE_COMMAND_RING_ENTRIES;
+    __atomic_store_n(&ring->magic, MASCHINE_COMMAND_RING_MAGIC, __ATOMIC_RELEASE);
+}
+
+bool MaschineCommandDispatcher::validate(const uint8_t* message, uint32_t length) {
+    if (length == 0 || length > 3 || !(message[0] & 0x80)) {
+        return false;
+    }
+    for (uint32_t i = 1; i < length; ++i) {
+        if (message[i] & 0x80) {
+            return false;
+        }
+    }
+
+    // Longitud que corresponde al byte de estado
+    uint8_t status = message[0];
+    uint32_t expected;
+    if (status < 0xF0) {
+        uint8_t type = status & 0xF0;
+        expected = (type == 0xC0 || type == 0xD0) ? 2 : 3;
+    } else if (status == 0xF1 || status == 0xF3) {
+        expected = 2;
+    } else if (status == 0xF2) {
+        expected = 3;
+    } else if (status == 0xF6 || status >= 0xF8) {
+        expected = 1;
+    } else {
+        // SysEx (F0/F7) y estados indefinidos (F4/F5)
+        return false;
+    }
+    return length == expected;
+}
+
+int MaschineCommandDispatcher::dispatchOne(const MaschineMIDICommand& command) {
+    if (!validate(command.data, command.length)) {
+        invalid++;
+        return 0;
+    }
+    if (sendFunction(context, command.data, command.length) != 0) {
+        stalls++;
+        return -1;
+    }
+    sent++;
+    return 1;
+}
+
+uint32_t MaschineCommandDispatcher::dispatch(const MaschineMIDICommand* commands, uint32_t count) {
+    if (!sendFunction) {
+        return 0;
+    }
+    uint32_t consumed = 0;
+    while (consumed < count) {
+        MaschineMIDICommand command = commands[consumed];
+        if (dispatchOne(command) < 0) {
+            break;
+        }
+        consumed++;
+    }
+    return consumed;
+}
+
+uint32_t MaschineCommandDispatcher::drain(MaschineCommandRing* ring) {
+    if (!sendFunction) {
+        return 0;
+    }
+
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint32_t pending = head - tail;
+    if (pending > MASCHINE_COMMAND_RING_ENTRIES) {
+        // El productor escribió un head imposible: se descarta todo
+        invalid += 1;
+        ring->rejected++;
+        tail = head;
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+        return 0;
+    }
+
+    uint32_t consumed = 0;
+    while (consumed < pending) {
+        // Una sola lectura de la memoria compartida por entrada
+        const uint32_t* entry = (const uint32_t*)&ring->entries[(tail + consumed) & (MASCHINE_COMMAND_RING_ENTRIES - 1)];
+        uint32_t raw = __atomic_load_n(entry, __ATOMIC_RELAXED);
+        MaschineMIDICommand command;
+        __builtin_memcpy(&command, &raw, sizeof(command));
+        int result = dispatchOne(command);
+        if (result < 0) {
+            break;
+        }
+        if (result == 0) {
+            ring->rejected++;
+        }
+        consumed++;
+    }
+
+    tail += consumed;
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    return consumed;
+}
+
+uint32_t MaschineCommandDispatcher::pending(const MaschineCommandRing* ring) const {
+    uint32_t count = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - tail;
+    return count > MASCHINE_COMMAND_RING_ENTRIES ? 0 : count;
+}
@@ -0,0 +1,123 @@
+#ifndef MASCHINE_COMMAND_RING_H
+#define MASCHINE_COMMAND_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Envío de mensajes MIDI de user-space al kext sin una llamada Mach por
+// mensaje. Dos caminos:
+//
+// - kSendMIDIBatch: un array de MaschineMIDICommand en structureInput
+//   (hasta MASCHINE_COMMAND_BATCH_MAX por llamada).
+// - Anillo compartido: el cliente mapea MaschineCommandRing con
+//   clientMemoryForType(MASCHINE_COMMAND_RING_TYPE), encola con
+//   maschineCommandRingPush() y llama una sola vez a kRingDoorbell.
+//
+// En ambos casos el kext devuelve cuántos mensajes consumió. Si la cola de
+// salida USB se llena, deja de consumir: en el lote el resto se reintenta
+// desde user-space; en el anillo los mensajes siguen encolados y el kext
+// los vacía solo a medida que terminan las escrituras. Los mensajes
+// inválidos se descartan y se cuentan en "rejected". SysEx no va por aquí
+// (usar kSendMIDISysex).
+//
+// El anillo es SPSC: un único hilo productor por cliente. head lo escribe
+// solo user-space y tail solo el kext, cada uno en su propia línea de caché.
+#define MASCHINE_COMMAND_RING_TYPE     1           // tipo para clientMemoryForType
+#define MASCHINE_COMMAND_RING_MAGIC    0x4D4B4352  // 'MKCR'
+#define MASCHINE_COMMAND_RING_VERSION  1
+#define MASCHINE_COMMAND_RING_ENTRIES  4096        // potencia de 2
+#define MASCHINE_COMMAND_BATCH_MAX     1024
+
+struct MaschineMIDICommand {
+    uint8_t length;         // 1-3
+    uint8_t data[3];
+};
+
+struct MaschineCommandRing {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t reserved;
+
+    // Productor (user-space)
+    uint32_t head;
+    uint8_t producerPad[60];
+
+    // Consumidor (kext)
+    uint32_t tail;
+    uint32_t rejected;
+    uint8_t consumerPad[56];
+
+    struct MaschineMIDICommand entries[MASCHINE_COMMAND_RING_ENTRIES];
+};
+
+// Devuelve 0 si el anillo está lleno (llamar a kRingDoorbell y reintentar)
+static inline int maschineCommandRingPush(struct MaschineCommandRing* ring, const uint8_t* message, uint32_t length) {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+    if (length == 0 || length > 3 || head - tail >= ring->capacity) {
+        return 0;
+    }
+    struct MaschineMIDICommand* entry = &ring->entries[head & (ring->capacity - 1)];
+    entry->length = (uint8_t)length;
+    for (uint32_t i = 0; i < 3; ++i) {
+        entry->data[i] = i < length ? message[i] : 0;
+    }
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static inline uint32_t maschineCommandRingPending(const struct MaschineCommandRing* ring) {
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+}
+
+#ifdef __cplusplus
+
+// Lado consumidor: valida y reparte los mensajes a la salida del driver.
+// No depende de IOKit; la función de envío es la única conexión con el
+// driver real. Devuelve distinto de 0 para rechazar un mensaje por falta
+// de sitio, lo que detiene el consumo. El anillo viene de user-space: el
+// tail de verdad es el del dispatcher (en el anillo solo se publica), cada
+// entrada se lee una sola vez antes de validarla y un head imposible se
+// descarta. Un dispatcher atiende un único anillo.
+class MaschineCommandDispatcher {
+public:
+    typedef int (*SendFunction)(void* context, const uint8_t* message, uint32_t length);
+
+    MaschineCommandDispatcher();
+
+    void configure(SendFunction send, void* context);
+
+    // Ambas devuelven cuántos mensajes se consumieron (enviados o descartados)
+    uint32_t dispatch(const MaschineMIDICommand* commands, uint32_t count);
+    uint32_t drain(MaschineCommandRing* ring);
+
+    // Mensajes por consumir según el tail propio; el del anillo lo puede
+    // pisar user-space. Un head imposible cuenta como vacío (el próximo
+    // drain() lo descarta)
+    uint32_t pending(const MaschineCommandRing* ring) const;
+
+    void initializeRing(MaschineCommandRing* ring);
+    static bool validate(const uint8_t* message, uint32_t length);
+
+    // Estadísticas
+    uint64_t getSent() const { return sent; }
+    uint64_t getInvalid() const { return invalid; }
+    uint64_t getStalls() const { return stalls; }
+
+private:
+    // 1 enviado, 0 descartado, -1 rechazado por la salida
+    int dispatchOne(const MaschineMIDICommand& command);
+
+    SendFunction sendFunction;
+    void* context;
+    uint32_t tail;
+
+    uint64_t sent;
+    uint64_t invalid;
+    uint64_t stalls;
+};
+
+#endif // __cplusplus
+
+#endif // MASCHINE_COMMAND_RING_H
@@ -0,0 +1,179 @@
+#include "MaschineConfig.h"
+#include "MaschineEventServer.h"
+#include "MaschineStatePage.h"
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <sched.h>
+
+static const char* logLevelNames[] = { "error", "warning", "info", "events" };
+
+MaschineDaemonConfig::MaschineDaemonConfig() {
+    transports = MASCHINE_TRANSPORT_CHANNEL | MASCHINE_TRANSPORT_SOCKET;
+    eventSocket = MASCHINE_EVENT_SOCKET;
+    statePage = MASCHINE_STATE_PAGE_NAME;
+    logLevel = MASCHINE_LOG_INFO;
+    ledRefreshHz = 0;
+    statsInterval = 60;
+    schedulerPriority = 0;
+    encoderPriority = 0;
+    eventLoopPriority = 0;
+    for (int i = 0; i < MASCHINE_CONFIG_PADS; ++i) {
+        padMap[i] = (uint8_t)i;
+    }
+    for (int i = 0; i < MASCHINE_CONFIG_BUTTONS; ++i) {
+        buttonMap[i] = (uint8_t)i;
+    }
+}
+
+const char* maschineLogLevelName(int level) {
+    if (level < MASCHINE_LOG_ERROR || level > MASCHINE_LOG_EVENTS) {
+        return "?";
+    }
+    return logLevelNames[level];
+}
+
+static std::string trim(const std::string& text) {
+    size_t start = text.find_first_not_of(" \t\r");
+    if (start == std::string::npos) {
+        return "";
+    }
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(start, end - start + 1);
+}
+
+// Entero completo dentro de [minimum, maximum]
+static bool parseInt(const std::string& text, int minimum, int maximum, int* value) {
+    if (text.empty()) {
+        return false;
+    }
+    char* end = NULL;
+    long parsed = strtol(text.c_str(), &end, 10);
+    if (*end != '\0' || parsed < minimum || parsed > maximum) {
+        return false;
+    }
+    *value = (int)parsed;
+    return true;
+}
+
+// "pad.3" -> 3 si el prefijo coincide y el índice está en rango
+static bool parseIndexedKey(const std::string& key, const char* prefix, int count, int* index) {
+    size_t length = strlen(prefix);
+    if (key.compare(0, length, prefix) != 0) {
+        return false;
+    }
+    return parseInt(key.substr(length), 0, count - 1, index);
+}
+
+static bool applyKey(MaschineDaemonConfig* config, const std::string& key, const std::string& value) {
+    int number = 0;
+    int index = 0;
+
+    if (key == "transport") {
+        if (value == "channel") config->transports = MASCHINE_TRANSPORT_CHANNEL;
+        else if (value == "socket") config->transports = MASCHINE_TRANSPORT_SOCKET;
+        else if (value == "both") config->transports = MASCHINE_TRANSPORT_CHANNEL | MASCHINE_TRANSPORT_SOCKET;
+        else if (value == "none") config->transports = 0;
+        else return false;
+        return true;
+    }
+    if (key == "event_socket") {
+        config->eventSocket = value;
+        return !value.empty();
+    }
+    if (key == "state_page") {
+        config->statePage = (value == "off") ? "" : value;
+        return !value.empty();
+    }
+    if (key == "log_level") {
+        for (int level = MASCHINE_LOG_ERROR; level <= MASCHINE_LOG_EVENTS; ++level) {
+            if (value == logLevelNames[level]) {
+                config->logLevel = level;
+                return true;
+            }
+        }
+        return false;
+    }
+    if (key == "led_refresh_hz") {
+        return parseInt(value, 0, 60, &config->ledRefreshHz);
+    }
+    if (key == "stats_interval") {
+        return parseInt(value, 0, 86400, &config->statsInterval);
+    }
+    if (key == "scheduler_priority") {
+        return parseInt(value, 0, 99, &config->schedulerPriority);
+    }
+    if (key == "encoder_priority") {
+        return parseInt(value, 0, 99, &config->encoderPriority);
+    }
+    if (key == "event_loop_priority") {
+        return parseInt(value, 0, 99, &config->eventLoopPriority);
+    }
+    if (parseIndexedKey(key, "pad.", MASCHINE_CONFIG_PADS, &index)) {
+        if (!parseInt(value, 0, MASCHINE_CONFIG_PADS - 1, &number)) {
+            return false;
+        }
+        config->padMap[index] = (uint8_t)number;
+        return true;
+    }
+    if (parseIndexedKey(key, "button.", MASCHINE_CONFIG_BUTTONS, &index)) {
+        if (!parseInt(value, 0, MASCHINE_CONFIG_BUTTONS - 1, &number)) {
+            return false;
+        }
+        config->buttonMap[index] = (uint8_t)number;
+        return true;
+    }
+    return false;
+}
+
+bool loadMaschineDaemonConfig(const char* path, MaschineDaemonConfig* config, std::string* error) {
+    std::ifstream file(path);
+    if (!file) {
+        *error = std::string("no se pudo abrir ") + path;
+        return false;
+    }
+
+    // Se rellena una copia: un fichero inválido no deja nada a medias
+    MaschineDaemonConfig parsed;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        line = trim(line);
+        if (line.empty()) {
+            continue;
+        }
+
+        size_t equals = line.find('=');
+        std::string key = trim(line.substr(0, equals));
+        std::string value = (equals == std::string::npos) ? "" : trim(line.substr(equals + 1));
+        if (equals == std::string::npos || !applyKey(&parsed, key, value)) {
+            std::ostringstream message;
+            message << path << ":" << lineNumber << ": valor inválido o clave desconocida \"" << line << "\"";
+            *error = message.str();
+            return false;
+        }
+    }
+
+    *config = parsed;
+    return true;
+}
+
+bool setMaschineThreadPriority(pthread_t thread, int priority) {
+    struct sched_param param;
+    memset(&param, 0, sizeof(param));
+    int policy = SCHED_OTHER;
+    if (priority > 0) {
+        policy = SCHED_FIFO;
+        int minimum = sched_get_priority_min(SCHED_FIFO);
+        int maximum = sched_get_priority_max(SCHED_FIFO);
+        param.sched_priority = std::min(std::max(priority, minimum), maximum);
+    }
+    return pthread_setschedparam(thread, policy, &param) == 0;
+}
@@ -0,0 +1,66 @@
+#ifndef MASCHINE_CONFIG_H
+#define MASCHINE_CONFIG_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <string>
+
+// Fichero de configuración del modo daemon (--daemon).
+//
+// Una clave por línea, "clave = valor"; '#' empieza un comentario. Las
+// claves desconocidas o los valores fuera de rango son un error: el daemon
+// no arranca, y si llegan con SIGHUP se conserva la configuración anterior.
+//
+//   transport        = both            # channel | socket | both | none
+//   event_socket     = /tmp/maschine-mikro.sock
+//   state_page       = /maschine-mikro-state   # "off" para no publicarla
+//   log_level        = info            # error | warning | info | events
+//   led_refresh_hz   = 2               # reenvío periódico de LEDs (0 = nunca)
+//   stats_interval   = 60              # segundos entre líneas de estadísticas
+//   scheduler_priority  = 0            # 0 = normal, 1-99 = SCHED_FIFO
+//   encoder_priority    = 0
+//   event_loop_priority = 0
+//   pad.0 = 12                         # pad físico -> pad lógico
+//   button.4 = 5                       # botón físico -> botón lógico
+//
+// transport, event_socket y state_page solo se aplican al arrancar; el
+// resto se recarga en caliente con SIGHUP.
+#define MASCHINE_DAEMON_CONFIG  "/usr/local/etc/maschine-mikro.conf"
+
+// Niveles de log; "events" añade el eco de cada pad, botón y encoder
+#define MASCHINE_LOG_ERROR    0
+#define MASCHINE_LOG_WARNING  1
+#define MASCHINE_LOG_INFO     2
+#define MASCHINE_LOG_EVENTS   3
+
+#define MASCHINE_TRANSPORT_CHANNEL  1
+#define MASCHINE_TRANSPORT_SOCKET   2
+
+#define MASCHINE_CONFIG_PADS     16
+#define MASCHINE_CONFIG_BUTTONS  8
+
+struct MaschineDaemonConfig {
+    int transports;             // máscara de MASCHINE_TRANSPORT_*
+    std::string eventSocket;
+    std::string statePage;      // vacío = sin página de estado
+    int logLevel;
+    int ledRefreshHz;
+    int statsInterval;
+    int schedulerPriority;
+    int encoderPriority;
+    int eventLoopPriority;
+    uint8_t padMap[MASCHINE_CONFIG_PADS];
+    uint8_t buttonMap[MASCHINE_CONFIG_BUTTONS];
+
+    MaschineDaemonConfig();
+};
+
+// Devuelve false y describe la primera línea inválida en error
+bool loadMaschineDaemonConfig(const char* path, MaschineDaemonConfig* config, std::string* error);
+
+// 0 vuelve a la política normal; 1-99 pide SCHED_FIFO (puede requerir permisos)
+bool setMaschineThreadPriority(pthread_t thread, int priority);
+
+const char* maschineLogLevelName(int level);
+
+#endif // MASCHINE_CONFIG_H
@@ -0,0 +1,385 @@
+#include "MaschineEventLoop.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#ifndef __APPLE__
+#include <sys/epoll.h>
+#endif
+
+// Máximo de eventos recogidos por cada epoll_wait
+#define EVENT_LOOP_BATCH  16
+
+// Extremo de escritura del pipe de parada para los manejadores de señal
+static volatile sig_atomic_t signalStopFd = -1;
+
+// Extremo de escritura del pipe de señales atendidas dentro del bucle
+static volatile sig_atomic_t signalForwardFd = -1;
+
+static void stopSignalHandler(int) {
+    if (signalStopFd >= 0) {
+        int savedErrno = errno;
+        char byte = 1;
+        ssize_t ignored = write(signalStopFd, &byte, 1);
+        (void)ignored;
+        errno = savedErrno;
+    }
+}
+
+static void forwardSignalHandler(int signum) {
+    if (signalForwardFd >= 0) {
+        int savedErrno = errno;
+        unsigned char byte = (unsigned char)signum;
+        ssize_t ignored = write(signalForwardFd, &byte, 1);
+        (void)ignored;
+        errno = savedErrno;
+    }
+}
+
+uint64_t MaschineEventLoop::nowNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+MaschineEventLoop::MaschineEventLoop() {
+    nextTimerId = 1;
+    running = false;
+    wakeups = 0;
+    runStartNs = 0;
+    runEndNs = 0;
+    stopPipe[0] = -1;
+    stopPipe[1] = -1;
+    signalPipe[0] = -1;
+    signalPipe[1] = -1;
+
+#ifdef __APPLE__
+    runLoop = CFRunLoopGetCurrent();
+    // Un único temporizador de CF reprogramado al vencimiento más próximo
+    CFRunLoopTimerContext context = { 0, this, NULL, NULL, NULL };
+    runLoopTimer = CFRunLoopTimerCreate(NULL, CFAbsoluteTimeGetCurrent() + 1.0e10, 1.0e10, 0, 0,
+                                        timerCallback, &context);
+    CFRunLoopAddTimer(runLoop, runLoopTimer, kCFRunLoopDefaultMode);
+#else
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+#endif
+
+    if (pipe(stopPipe) == 0) {
+        fcntl(stopPipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(stopPipe[1], F_SETFL, O_NONBLOCK);
+        addDescriptor(stopPipe[0], std::bind(&MaschineEventLoop::handleStop, this));
+    }
+}
+
+MaschineEventLoop::~MaschineEventLoop() {
+    if (signalStopFd == stopPipe[1]) {
+        signalStopFd = -1;
+    }
+    if (signalPipe[1] >= 0 && signalForwardFd == signalPipe[1]) {
+        signalForwardFd = -1;
+    }
+    while (!descriptors.empty()) {
+        removeDescriptor(descriptors.back()->fd);
+    }
+
+#ifdef __APPLE__
+    CFRunLoopRemoveTimer(runLoop, runLoopTimer, kCFRunLoopDefaultMode);
+    CFRunLoopTimerInvalidate(runLoopTimer);
+    CFRelease(runLoopTimer);
+#else
+    if (epollFd >= 0) {
+        close(epollFd);
+    }
+#endif
+
+    for (int i = 0; i < 2; ++i) {
+        if (stopPipe[i] >= 0) {
+            close(stopPipe[i]);
+        }
+        if (signalPipe[i] >= 0) {
+            close(signalPipe[i]);
+        }
+    }
+}
+
+bool MaschineEventLoop::addDescriptor(int fd, Handler handler) {
+    if (fd < 0) {
+        return false;
+    }
+
+    Descriptor* descriptor = new Descriptor();
+    descriptor->fd = fd;
+    descriptor->handler = handler;
+    descriptor->loop = this;
+
+#ifdef __APPLE__
+    CFFileDescriptorContext context = { 0, descriptor, NULL, NULL, NULL };
+    descriptor->fileDescriptor = CFFileDescriptorCreate(NULL, fd, false, descriptorCallback, &context);
+    if (!descriptor->fileDescriptor) {
+        delete descriptor;
+        return false;
+    }
+    CFFileDescriptorEnableCallBacks(descriptor->fileDescriptor, kCFFileDescriptorReadCallBack);
+    descriptor->source = CFFileDescriptorCreateRunLoopSource(NULL, descriptor->fileDescriptor, 0);
+    CFRunLoopAddSource(runLoop, descriptor->source, kCFRunLoopDefaultMode);
+#else
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+        delete descriptor;
+        return false;
+    }
+#endif
+
+    descriptors.push_back(descriptor);
+    return true;
+}
+
+void MaschineEventLoop::removeDescriptor(int fd) {
+    for (size_t i = 0; i < descriptors.size(); ++i) {
+        if (descriptors[i]->fd == fd) {
+            Descriptor* descriptor = descriptors[i];
+            descriptors.erase(descriptors.begin() + i);
+            releaseDescriptor(descriptor);
+            return;
+        }
+    }
+}
+
+void MaschineEventLoop::releaseDescriptor(Descriptor* descriptor) {
+#ifdef __APPLE__
+    CFRunLoopRemoveSource(runLoop, descriptor->source, kCFRunLoopDefaultMode);
+    CFFileDescriptorInvalidate(descriptor->fileDescriptor);
+    CFRelease(descriptor->source);
+    CFRelease(descriptor->fileDescriptor);
+#else
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, descriptor->fd, NULL);
+#endif
+    delete descriptor;
+}
+
+int MaschineEventLoop::addTimer(uint64_t delayNs, uint64_t intervalNs, Handler handler) {
+    Timer timer;
+    timer.id = nextTimerId++;
+    timer.deadlineNs = nowNanos() + delayNs;
+    timer.intervalNs = intervalNs;
+    timer.handler = handler;
+    timers.push_back(timer);
+#ifdef __APPLE__
+    armTimer();
+#endif
+    return timer.id;
+}
+
+void MaschineEventLoop::removeTimer(int timerId) {
+    for (size_t i = 0; i < timers.size(); ++i) {
+        if (timers[i].id == timerId) {
+            timers.erase(timers.begin() + i);
+            break;
+        }
+    }
+#ifdef __APPLE__
+    armTimer();
+#endif
+}
+
+bool MaschineEventLoop::nextTimerDeadline(uint64_t* deadlineNs) const {
+    bool found = false;
+    for (size_t i = 0; i < timers.size(); ++i) {
+        if (!found || timers[i].deadlineNs < *deadlineNs) {
+            *deadlineNs = timers[i].deadlineNs;
+            found = true;
+        }
+    }
+    return found;
+}
+
+void MaschineEventLoop::dispatchDescriptor(int fd) {
+    for (size_t i = 0; i < descriptors.size(); ++i) {
+        if (descriptors[i]->fd == fd) {
+            // Copia: el manejador puede quitar su propio descriptor
+            Handler handler = descriptors[i]->handler;
+            handler();
+            return;
+        }
+    }
+}
+
+void MaschineEventLoop::dispatchTimers() {
+    uint64_t now = nowNanos();
+    // Recoger primero: los manejadores pueden añadir o quitar temporizadores
+    std::vector<Handler> due;
+    for (size_t i = 0; i < timers.size(); ) {
+        if (timers[i].deadlineNs > now) {
+            ++i;
+            continue;
+        }
+        due.push_back(timers[i].handler);
+        if (timers[i].intervalNs > 0) {
+            // Sin ráfagas de recuperación si el bucle estuvo ocupado
+            do {
+                timers[i].deadlineNs += timers[i].intervalNs;
+            } while (timers[i].deadlineNs <= now);
+            ++i;
+        } else {
+            timers.erase(timers.begin() + i);
+        }
+    }
+    for (size_t i = 0; i < due.size(); ++i) {
+        due[i]();
+    }
+}
+
+void MaschineEventLoop::handleStop() {
+    char buffer[16];
+    while (read(stopPipe[0], buffer, sizeof(buffer)) > 0) {
+    }
+    running = false;
+#ifdef __APPLE__
+    CFRunLoopStop(runLoop);
+#endif
+}
+
+void MaschineEventLoop::stop() {
+    char byte = 1;
+    ssize_t ignored = write(stopPipe[1], &byte, 1);
+    (void)ignored;
+}
+
+void MaschineEventLoop::stopOnSignal(int signum) {
+    signalStopFd = stopPipe[1];
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stopSignalHandler;
+    sigemptyset(&action.sa_mask);
+    sigaction(signum, &action, NULL);
+}
+
+void MaschineEventLoop::onSignal(int signum, Handler handler) {
+    if (signalPipe[0] < 0) {
+        // El pipe se crea con el primer manejador: la mayoría de bucles no lo usan
+        if (pipe(signalPipe) != 0) {
+            return;
+        }
+        fcntl(signalPipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(signalPipe[1], F_SETFL, O_NONBLOCK);
+        addDescriptor(signalPipe[0], std::bind(&MaschineEventLoop::handleSignals, this));
+    }
+    signalForwardFd = signalPipe[1];
+    signalHandlers.push_back(std::make_pair(signum, handler));
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = forwardSignalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(signum, &action, NULL);
+}
+
+void MaschineEventLoop::handleSignals() {
+    unsigned char buffer[16];
+    ssize_t count;
+    while ((count = read(signalPipe[0], buffer, sizeof(buffer))) > 0) {
+        for (ssize_t i = 0; i < count; ++i) {
+            for (size_t h = 0; h < signalHandlers.size(); ++h) {
+                if (signalHandlers[h].first == buffer[i]) {
+                    // Copia: el manejador puede registrar otros
+                    Handler handler = signalHandlers[h].second;
+                    handler();
+                }
+            }
+        }
+    }
+}
+
+double MaschineEventLoop::getWakeupsPerSecond() const {
+    uint64_t end = running ? nowNanos() : runEndNs;
+    if (end <= runStartNs) {
+        return 0.0;
+    }
+    return (double)wakeups.load() * 1.0e9 / (double)(end - runStartNs);
+}
+
+#ifdef __APPLE__
+
+void MaschineEventLoop::armTimer() {
+    uint64_t deadline = 0;
+    if (!nextTimerDeadline(&deadline)) {
+        CFRunLoopTimerSetNextFireDate(runLoopTimer, CFAbsoluteTimeGetCurrent() + 1.0e10);
+        return;
+    }
+    uint64_t now = nowNanos();
+    double delay = (deadline > now) ? (double)(deadline - now) / 1.0e9 : 0.0;
+    CFRunLoopTimerSetNextFireDate(runLoopTimer, CFAbsoluteTimeGetCurrent() + delay);
+}
+
+void MaschineEventLoop::descriptorCallback(CFFileDescriptorRef fileDescriptor, CFOptionFlags, void* info) {
+    Descriptor* descriptor = (Descriptor*)info;
+    MaschineEventLoop* loop = descriptor->loop;
+    int fd = descriptor->fd;
+    loop->wakeups++;
+    loop->dispatchDescriptor(fd);
+
+    // Las callbacks de CFFileDescriptor son de un solo disparo
+    for (size_t i = 0; i < loop->descriptors.size(); ++i) {
+        if (loop->descriptors[i] == descriptor) {
+            CFFileDescriptorEnableCallBacks(fileDescriptor, kCFFileDescriptorReadCallBack);
+            break;
+        }
+    }
+}
+
+void MaschineEventLoop::timerCallback(CFRunLoopTimerRef, void* info) {
+    MaschineEventLoop* loop = (MaschineEventLoop*)info;
+    loop->wakeups++;
+    loop->dispatchTimers();
+    loop->armTimer();
+}
+
+void MaschineEventLoop::run() {
+    running = true;
+    wakeups = 0;
+    runStartNs = nowNanos();
+    armTimer();
+    while (running) {
+        CFRunLoopRun();
+    }
+    runEndNs = nowNanos();
+}
+
+#else
+
+void MaschineEventLoop::run() {
+    running = true;
+    wakeups = 0;
+    runStartNs = nowNanos();
+
+    struct epoll_event events[EVENT_LOOP_BATCH];
+    while (running) {
+        int timeoutMs = -1;
+        uint64_t deadline = 0;
+        if (nextTimerDeadline(&deadline)) {
+            uint64_t now = nowNanos();
+            // Redondear hacia arriba: despertar antes de tiempo es un despertar perdido
+            timeoutMs = (deadline <= now) ? 0 : (int)((deadline - now + 999999) / 1000000);
+        }
+
+        int count = epoll_wait(epollFd, events, EVENT_LOOP_BATCH, timeoutMs);
+        if (count < 0 && errno != EINTR) {
+            break;
+        }
+        wakeups++;
+
+        for (int i = 0; i < count; ++i) {
+            dispatchDescriptor(events[i].data.fd);
+        }
+        dispatchTimers();
+    }
+    runEndNs = nowNanos();
+}
+
+#endif
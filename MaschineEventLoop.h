@@ -0,0 +1,101 @@
+#ifndef MASCHINE_EVENT_LOOP_H
+#define MASCHINE_EVENT_LOOP_H
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <utility>
+#ifdef __APPLE__
+#include <CoreFoundation/CoreFoundation.h>
+#endif
+
+// Bucle de eventos del driver.
+//
+// Multiplexa descriptores (el timbre del canal con el host, sockets...) y
+// temporizadores sin sondeo: el hilo solo despierta cuando hay trabajo o
+// vence un temporizador. En Linux usa epoll; en macOS se monta sobre el
+// CFRunLoop del hilo que lo crea, de modo que las notificaciones de CoreMIDI
+// y demás fuentes de CoreFoundation se atienden en el mismo bucle. stop() se
+// puede llamar desde otro hilo o desde un manejador de señal (escribe en un
+// pipe propio). Las señales de onSignal() pasan por otro pipe y su manejador
+// corre en el hilo del bucle. El resto de métodos deben usarse desde el
+// hilo del bucle.
+class MaschineEventLoop {
+public:
+    typedef std::function<void()> Handler;
+
+    MaschineEventLoop();
+    ~MaschineEventLoop();
+
+    // El manejador se llama cuando el descriptor tiene datos para leer
+    bool addDescriptor(int fd, Handler handler);
+    void removeDescriptor(int fd);
+
+    // Temporizador periódico (intervalNs > 0) o de un solo disparo
+    int addTimer(uint64_t delayNs, uint64_t intervalNs, Handler handler);
+    void removeTimer(int timerId);
+
+    void run();
+    void stop();
+
+    // SIGINT / SIGTERM detienen el bucle limpiamente
+    void stopOnSignal(int signum);
+    // SIGHUP, SIGUSR1...: el manejador se ejecuta dentro del bucle, no en la señal
+    void onSignal(int signum, Handler handler);
+
+    // Despertares atendidos y su tasa durante el último run()
+    uint64_t getWakeups() const { return wakeups.load(); }
+    double getWakeupsPerSecond() const;
+
+    static uint64_t nowNanos();
+
+private:
+    struct Descriptor {
+        int fd;
+        Handler handler;
+        MaschineEventLoop* loop;
+#ifdef __APPLE__
+        CFFileDescriptorRef fileDescriptor;
+        CFRunLoopSourceRef source;
+#endif
+    };
+
+    struct Timer {
+        int id;
+        uint64_t deadlineNs;
+        uint64_t intervalNs;
+        Handler handler;
+    };
+
+    void dispatchDescriptor(int fd);
+    void dispatchTimers();
+    bool nextTimerDeadline(uint64_t* deadlineNs) const;
+    void handleStop();
+    void handleSignals();
+    void releaseDescriptor(Descriptor* descriptor);
+
+    std::vector<Descriptor*> descriptors;
+    std::vector<Timer> timers;
+    int nextTimerId;
+    int stopPipe[2];
+    int signalPipe[2];
+    std::vector<std::pair<int, Handler> > signalHandlers;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> wakeups;
+    uint64_t runStartNs;
+    uint64_t runEndNs;
+
+#ifdef __APPLE__
+    void armTimer();
+    static void descriptorCallback(CFFileDescriptorRef fileDescriptor, CFOptionFlags flags, void* info);
+    static void timerCallback(CFRunLoopTimerRef timer, void* info);
+
+    CFRunLoopRef runLoop;
+    CFRunLoopTimerRef runLoopTimer;
+#else
+    int epollFd;
+#endif
+};
+
+#endif // MASCHINE_EVENT_LOOP_H
@@ -0,0 +1,409 @@
+#include "MaschineEventServer.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+#define EVENT_BUFFER_MASK    (MASCHINE_EVENT_BUFFER_SIZE - 1)
+#define EVENT_NO_FLOOR       UINT64_MAX
+
+// iovecs por writev y reintento para suscriptores con el socket lleno
+#define EVENT_IOV_BATCH      64
+#define EVENT_RETRY_NS       10000000ULL
+
+// Un suscriptor más atrasado que medio buffer se marca como retrasado; la
+// otra mitad es el margen para que publish() no alcance lo que se envía
+#define EVENT_LAG_WINDOW     (MASCHINE_EVENT_BUFFER_SIZE / 2)
+
+#ifdef MSG_NOSIGNAL
+#define EVENT_SEND_FLAGS     MSG_NOSIGNAL
+#else
+#define EVENT_SEND_FLAGS     0
+#endif
+
+static void setNonBlocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+MaschineEventServer::MaschineEventServer() {
+    head = 0;
+    sendFloor = EVENT_NO_FLOOR;
+    listenFd = -1;
+    wakePipe[0] = -1;
+    wakePipe[1] = -1;
+    wakePending = false;
+    socketPath[0] = '\0';
+    loop = NULL;
+    retryTimer = 0;
+    subscriberCount = 0;
+    published = 0;
+    overruns = 0;
+    writeCalls = 0;
+    lagMarks = 0;
+    evicted = 0;
+}
+
+MaschineEventServer::~MaschineEventServer() {
+    stop();
+}
+
+bool MaschineEventServer::start(const char* path) {
+    if (isRunning()) {
+        return true;
+    }
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        return false;
+    }
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", path);
+    snprintf(socketPath, sizeof(socketPath), "%s", path);
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        return false;
+    }
+    // Un socket previo puede venir de un driver caído
+    unlink(socketPath);
+    if (bind(listenFd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd, 16) != 0 ||
+        pipe(wakePipe) != 0) {
+        stop();
+        return false;
+    }
+    setNonBlocking(listenFd);
+    setNonBlocking(wakePipe[0]);
+    setNonBlocking(wakePipe[1]);
+
+    head = 0;
+    sendFloor = EVENT_NO_FLOOR;
+    wakePending = false;
+
+    // El bucle se crea en el hilo del servidor (en macOS se ata a su CFRunLoop)
+    std::unique_lock<std::mutex> lock(startMutex);
+    serverThread = std::thread(&MaschineEventServer::run, this);
+    startCondition.wait(lock, [this]() { return loop.load() != NULL; });
+    return true;
+}
+
+void MaschineEventServer::stop() {
+    {
+        std::lock_guard<std::mutex> lock(startMutex);
+        if (loop.load()) {
+            loop.load()->stop();
+        }
+    }
+    if (serverThread.joinable()) {
+        serverThread.join();
+    }
+
+    if (listenFd >= 0) {
+        close(listenFd);
+        listenFd = -1;
+        unlink(socketPath);
+    }
+    for (int i = 0; i < 2; ++i) {
+        if (wakePipe[i] >= 0) {
+            close(wakePipe[i]);
+            wakePipe[i] = -1;
+        }
+    }
+}
+
+void MaschineEventServer::run() {
+    MaschineEventLoop eventLoop;
+    eventLoop.addDescriptor(listenFd, [this]() { acceptSubscriber(); });
+    eventLoop.addDescriptor(wakePipe[0], [this]() {
+        char drain[64];
+        while (read(wakePipe[0], drain, sizeof(drain)) > 0) {
+        }
+        flush();
+    });
+
+    {
+        std::lock_guard<std::mutex> lock(startMutex);
+        loop = &eventLoop;
+    }
+    startCondition.notify_all();
+
+    eventLoop.run();
+
+    while (!subscribers.empty()) {
+        removeSubscriber(subscribers.back().fd);
+    }
+    retryTimer = 0;
+
+    std::lock_guard<std::mutex> lock(startMutex);
+    loop = NULL;
+}
+
+void MaschineEventServer::publish(const uint8_t* command) {
+    if (!isRunning()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(publishMutex);
+        // No pisar lo que el servidor está enviando en este momento
+        if (sendFloor != EVENT_NO_FLOOR && head + MASCHINE_COMMAND_SIZE - sendFloor > MASCHINE_EVENT_BUFFER_SIZE) {
+            overruns++;
+            return;
+        }
+        memcpy(buffer + (head & EVENT_BUFFER_MASK), command, MASCHINE_COMMAND_SIZE);
+        head += MASCHINE_COMMAND_SIZE;
+    }
+    published++;
+
+    // Un solo timbre por ráfaga: el servidor lo rearma al vaciar
+    if (!wakePending.exchange(true)) {
+        char byte = 1;
+        ssize_t ignored = write(wakePipe[1], &byte, 1);
+        (void)ignored;
+    }
+}
+
+void MaschineEventServer::acceptSubscriber() {
+    while (true) {
+        int fd = accept(listenFd, NULL, NULL);
+        if (fd < 0) {
+            return;
+        }
+        setNonBlocking(fd);
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+        Subscriber subscriber;
+        memset(&subscriber, 0, sizeof(subscriber));
+        subscriber.fd = fd;
+        subscriber.mask = ~0ULL;
+        subscriber.markerSent = MASCHINE_COMMAND_SIZE;
+        {
+            // Empieza en el presente: sin historial
+            std::lock_guard<std::mutex> lock(publishMutex);
+            subscriber.position = head;
+        }
+
+        subscribers.push_back(subscriber);
+        subscriberCount++;
+        loop.load()->addDescriptor(fd, [this, fd]() { readSubscriber(fd); });
+    }
+}
+
+void MaschineEventServer::readSubscriber(int fd) {
+    for (size_t i = 0; i < subscribers.size(); ++i) {
+        Subscriber& subscriber = subscribers[i];
+        if (subscriber.fd != fd) {
+            continue;
+        }
+
+        ssize_t received = recv(fd, subscriber.request + subscriber.requestLength,
+                                sizeof(subscriber.request) - subscriber.requestLength, 0);
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            removeSubscriber(fd);
+            return;
+        }
+        if (received < 0) {
+            return;
+        }
+
+        subscriber.requestLength += (uint32_t)received;
+        if (subscriber.requestLength == sizeof(subscriber.request)) {
+            uint64_t mask = 0;
+            for (int b = 7; b >= 0; --b) {
+                mask = (mask << 8) | subscriber.request[b];
+            }
+            subscriber.mask = mask;
+            subscriber.requestLength = 0;
+        }
+        return;
+    }
+}
+
+void MaschineEventServer::removeSubscriber(int fd) {
+    for (size_t i = 0; i < subscribers.size(); ++i) {
+        if (subscribers[i].fd == fd) {
+            loop.load()->removeDescriptor(fd);
+            close(fd);
+            subscribers.erase(subscribers.begin() + i);
+            subscriberCount--;
+            return;
+        }
+    }
+}
+
+bool MaschineEventServer::wanted(const Subscriber& subscriber, uint64_t position) const {
+    uint8_t opcode = buffer[position & EVENT_BUFFER_MASK];
+    return opcode < 64 && (subscriber.mask & (1ULL << opcode)) != 0;
+}
+
+void MaschineEventServer::flush() {
+    // Rearmar el timbre antes de mirar: lo publicado desde aquí vuelve a avisar
+    wakePending = false;
+
+    uint64_t current;
+    {
+        std::lock_guard<std::mutex> lock(publishMutex);
+        current = head;
+    }
+
+    std::vector<int> evictions;
+    bool pending = false;
+    for (size_t i = 0; i < subscribers.size(); ++i) {
+        Subscriber& subscriber = subscribers[i];
+        if (!flushSubscriber(subscriber, current)) {
+            evictions.push_back(subscriber.fd);
+        } else if (subscriber.position != current || subscriber.markerSent < MASCHINE_COMMAND_SIZE) {
+            pending = true;
+        }
+    }
+
+    for (size_t i = 0; i < evictions.size(); ++i) {
+        removeSubscriber(evictions[i]);
+        evicted++;
+    }
+
+    // Sockets llenos: reintentar aunque no se publique nada más
+    if (pending && retryTimer == 0) {
+        retryTimer = loop.load()->addTimer(EVENT_RETRY_NS, 0, [this]() {
+            retryTimer = 0;
+            flush();
+        });
+    }
+}
+
+bool MaschineEventServer::flushSubscriber(Subscriber& subscriber, uint64_t current) {
+    uint64_t oldest = (current > EVENT_LAG_WINDOW) ? current - EVENT_LAG_WINDOW : 0;
+
+    if (subscriber.position < oldest) {
+        // Un evento a medias o una marca a medias no se pueden recuperar
+        if (subscriber.partial != 0 || (subscriber.markerSent > 0 && subscriber.markerSent < MASCHINE_COMMAND_SIZE)) {
+            return false;
+        }
+        if (++subscriber.stalls >= MASCHINE_EVENT_MAX_STALLS) {
+            return false;
+        }
+
+        subscriber.lost += (uint32_t)((oldest - subscriber.position) / MASCHINE_COMMAND_SIZE);
+        MaschineCommand marker = { CMD_SUBSCRIBER_LAG, 0, 0, 0, (int32_t)subscriber.lost };
+        encodeMaschineCommand(marker, subscriber.marker);
+        subscriber.markerSent = 0;
+        subscriber.position = oldest;
+        lagMarks++;
+    }
+
+    while (true) {
+        struct iovec iov[EVENT_IOV_BATCH];
+        int count = 0;
+        int firstEvent = 0;
+        if (subscriber.markerSent < MASCHINE_COMMAND_SIZE) {
+            iov[count].iov_base = subscriber.marker + subscriber.markerSent;
+            iov[count].iov_len = MASCHINE_COMMAND_SIZE - subscriber.markerSent;
+            count++;
+            firstEvent = 1;
+        }
+
+        // Recorrer lo pendiente y agrupar los tramos contiguos que pasan el filtro
+        uint64_t position = subscriber.position;
+        uint32_t offset = subscriber.partial;
+        uint64_t scanEnd = position;
+        size_t total = 0;
+        while (position < current) {
+            if (offset > 0 || wanted(subscriber, position)) {
+                uint8_t* start = buffer + (position & EVENT_BUFFER_MASK) + offset;
+                size_t length = MASCHINE_COMMAND_SIZE - offset;
+                if (count > firstEvent && (uint8_t*)iov[count - 1].iov_base + iov[count - 1].iov_len == start) {
+                    iov[count - 1].iov_len += length;
+                } else if (count < EVENT_IOV_BATCH) {
+                    iov[count].iov_base = start;
+                    iov[count].iov_len = length;
+                    count++;
+                } else {
+                    break;
+                }
+                total += length;
+            }
+            offset = 0;
+            position += MASCHINE_COMMAND_SIZE;
+            scanEnd = position;
+        }
+        if (firstEvent) {
+            total += iov[0].iov_len;
+        }
+
+        if (count == 0) {
+            // Nada que le interese: solo avanzar
+            subscriber.position = scanEnd;
+            subscriber.stalls = 0;
+            return true;
+        }
+
+        // publish() no puede adelantar la zona que lee este envío
+        {
+            std::lock_guard<std::mutex> lock(publishMutex);
+            sendFloor = subscriber.position;
+        }
+        struct msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+        ssize_t written = sendmsg(subscriber.fd, &message, EVENT_SEND_FLAGS);
+        int sendError = errno;
+        {
+            std::lock_guard<std::mutex> lock(publishMutex);
+            sendFloor = EVENT_NO_FLOOR;
+        }
+        writeCalls++;
+        if (written < 0) {
+            if (sendError != EAGAIN && sendError != EWOULDBLOCK) {
+                return false;
+            }
+            written = 0;
+        }
+
+        // Contabilizar lo escrito: primero la marca, luego los eventos filtrados
+        size_t remaining = (size_t)written;
+        if (subscriber.markerSent < MASCHINE_COMMAND_SIZE) {
+            size_t take = MASCHINE_COMMAND_SIZE - subscriber.markerSent;
+            if (remaining < take) {
+                subscriber.markerSent += (uint32_t)remaining;
+                return true;
+            }
+            subscriber.markerSent = MASCHINE_COMMAND_SIZE;
+            subscriber.lost = 0;
+            remaining -= take;
+        }
+
+        position = subscriber.position;
+        offset = subscriber.partial;
+        while (position < scanEnd) {
+            if (offset > 0 || wanted(subscriber, position)) {
+                size_t need = MASCHINE_COMMAND_SIZE - offset;
+                if (remaining < need) {
+                    offset += (uint32_t)remaining;
+                    break;
+                }
+                remaining -= need;
+                offset = 0;
+            }
+            position += MASCHINE_COMMAND_SIZE;
+        }
+        subscriber.position = position;
+        subscriber.partial = offset;
+
+        // Socket lleno: lo que quede sale en el próximo vaciado
+        if ((size_t)written < total) {
+            return true;
+        }
+        if (subscriber.position == current) {
+            subscriber.stalls = 0;
+            return true;
+        }
+    }
+}
@@ -0,0 +1,100 @@
+#ifndef MASCHINE_EVENT_SERVER_H
+#define MASCHINE_EVENT_SERVER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include "MaschineProtocol.h"
+#include "MaschineEventLoop.h"
+
+// Servidor local de eventos (socket Unix)
+#define MASCHINE_EVENT_SOCKET        "/tmp/maschine-mikro.sock"
+#define MASCHINE_EVENT_BUFFER_SIZE   65536   // bytes, potencia de 2
+#define MASCHINE_EVENT_MAX_STALLS    3       // marcas de retraso seguidas antes de expulsar
+
+// Publica el flujo de comandos del driver a N suscriptores locales.
+//
+// Protocolo: el cliente conecta a MASCHINE_EVENT_SOCKET y recibe comandos
+// de 8 bytes (MaschineProtocol.h). En cualquier momento puede enviar 8 bytes
+// con una máscara little endian de opcodes (bit n = opcode n); por defecto
+// recibe todo.
+//
+// publish() solo copia el comando en un buffer circular compartido y, si el
+// hilo del servidor dormía, toca su timbre: nunca hace E/S por suscriptor ni
+// espera a nadie. El hilo del servidor envía a cada suscriptor, con un único
+// writev no bloqueante, todos los eventos pendientes que pasan su filtro,
+// apuntando directamente al buffer compartido, de modo que el coste de una
+// ráfaga es una llamada al sistema por suscriptor y no por evento. Si un
+// suscriptor se queda tan atrás que el buffer lo adelanta, recibe un
+// CMD_SUBSCRIBER_LAG con los eventos perdidos y salta al más antiguo; tras
+// varias marcas seguidas sin vaciar su socket se le desconecta.
+class MaschineEventServer {
+public:
+    MaschineEventServer();
+    ~MaschineEventServer();
+
+    bool start(const char* path = MASCHINE_EVENT_SOCKET);
+    void stop();
+    bool isRunning() const { return loop.load() != NULL; }
+
+    // Seguro desde cualquier hilo; no bloquea
+    void publish(const uint8_t* command);
+
+    int getSubscriberCount() const { return subscriberCount.load(); }
+    uint64_t getPublishedCount() const { return published.load(); }
+    uint64_t getOverrunCount() const { return overruns.load(); }
+    uint64_t getWriteCalls() const { return writeCalls.load(); }
+    uint64_t getLagMarks() const { return lagMarks.load(); }
+    uint64_t getEvictedCount() const { return evicted.load(); }
+
+private:
+    struct Subscriber {
+        int fd;
+        uint64_t mask;
+        uint64_t position;      // posición absoluta del próximo evento
+        uint32_t partial;       // bytes ya enviados de ese evento
+        uint8_t marker[MASCHINE_COMMAND_SIZE];
+        uint32_t markerSent;    // MASCHINE_COMMAND_SIZE = sin marca pendiente
+        uint32_t lost;
+        int stalls;
+        uint8_t request[8];
+        uint32_t requestLength;
+    };
+
+    void run();
+    void acceptSubscriber();
+    void readSubscriber(int fd);
+    void removeSubscriber(int fd);
+    void flush();
+    bool flushSubscriber(Subscriber& subscriber, uint64_t head);
+    bool wanted(const Subscriber& subscriber, uint64_t position) const;
+
+    uint8_t buffer[MASCHINE_EVENT_BUFFER_SIZE];
+    std::mutex publishMutex;
+    uint64_t head;
+    uint64_t sendFloor;         // posición más antigua que el servidor está leyendo
+
+    std::vector<Subscriber> subscribers;
+    int listenFd;
+    int wakePipe[2];
+    std::atomic<bool> wakePending;
+    char socketPath[104];
+
+    std::thread serverThread;
+    std::atomic<MaschineEventLoop*> loop;
+    int retryTimer;
+    std::mutex startMutex;
+    std::condition_variable startCondition;
+
+    std::atomic<int> subscriberCount;
+    std::atomic<uint64_t> published;
+    std::atomic<uint64_t> overruns;
+    std::atomic<uint64_t> writeCalls;
+    std::atomic<uint64_t> lagMarks;
+    std::atomic<uint64_t> evicted;
+};
+
+#endif // MASCHINE_EVENT_SERVER_H
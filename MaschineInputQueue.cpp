@@ -0,0 +1,102 @@
+#include "MaschineInputQueue.h"
+
+MaschineInputProducer::MaschineInputProducer() {
+    queue = 0;
+    timestamp = 0;
+    head = 0;
+    staged = 0;
+    armed = 0;
+    published = 0;
+    notifications = 0;
+}
+
+void MaschineInputProducer::initialize(MaschineInputQueue* newQueue) {
+    queue = newQueue;
+    head = 0;
+    staged = 0;
+    armed = 0;
+    __builtin_memset(queue, 0, sizeof(*queue));
+    queue->version = MASCHINE_INPUT_QUEUE_VERSION;
+    queue->capacity = MASCHINE_INPUT_QUEUE_ENTRIES;
+    queue->eventSize = sizeof(MaschineInputEvent);
+    __atomic_store_n(&queue->magic, MASCHINE_INPUT_QUEUE_MAGIC, __ATOMIC_RELEASE);
+}
+
+void MaschineInputProducer::detach() {
+    if (queue) {
+        // Los consumidores que aún la tengan mapeada la ven inválida
+        __atomic_store_n(&queue->magic, 0, __ATOMIC_RELEASE);
+        queue = 0;
+    }
+    __atomic_store_n(&armed, 0, __ATOMIC_SEQ_CST);
+}
+
+void MaschineInputProducer::begin(uint64_t newTimestamp) {
+    timestamp = newTimestamp;
+    staged = 0;
+}
+
+bool MaschineInputProducer::push(uint8_t cable, const uint8_t* message, uint32_t length) {
+    if (!queue) {
+        return false;
+    }
+    if (length == 0 || length > 3) {
+        queue->skipped++;
+        return false;
+    }
+
+    // Un tail imposible (más allá de head) da un uso enorme: cola llena
+    uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+    uint32_t position = head + staged;
+    if (position - tail >= MASCHINE_INPUT_QUEUE_ENTRIES) {
+        queue->overflows++;
+        return false;
+    }
+
+    MaschineInputEvent* event = &queue->events[position & (MASCHINE_INPUT_QUEUE_ENTRIES - 1)];
+    event->timestamp = timestamp;
+    event->length = (uint8_t)length;
+    event->cable = cable;
+    for (uint32_t i = 0; i < 3; ++i) {
+        event->data[i] = i < length ? message[i] : 0;
+    }
+    staged++;
+    return true;
+}
+
+bool MaschineInputProducer::commit() {
+    if (!queue || staged == 0) {
+        return false;
+    }
+
+    head += staged;
+    published += staged;
+    staged = 0;
+    queue->batches++;
+    __atomic_store_n(&queue->head, head, __ATOMIC_SEQ_CST);
+
+    // seq_cst con arm(): o el consumidor ve el head nuevo o aquí se ve armed
+    if (__atomic_exchange_n(&armed, 0, __ATOMIC_SEQ_CST)) {
+        notifications++;
+        return true;
+    }
+    return false;
+}
+
+uint32_t MaschineInputProducer::arm() {
+    if (!queue) {
+        return 0;
+    }
+
+    __atomic_store_n(&armed, 1, __ATOMIC_SEQ_CST);
+    uint32_t pending = __atomic_load_n(&queue->head, __ATOMIC_SEQ_CST) - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+    if (pending != 0) {
+        // Ya hay eventos: no hace falta aviso, el consumidor vuelve a vaciar
+        __atomic_store_n(&armed, 0, __ATOMIC_SEQ_CST);
+    }
+    return pending;
+}
+
+void MaschineInputProducer::disarm() {
+    __atomic_store_n(&armed, 0, __ATOMIC_SEQ_CST);
+}
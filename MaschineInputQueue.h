@@ -0,0 +1,121 @@
+#ifndef MASCHINE_INPUT_QUEUE_H
+#define MASCHINE_INPUT_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Cola de eventos de entrada del kext hacia user-space, sin pasar por el
+// endpoint virtual de CoreMIDI.
+//
+// El kext decodifica cada transfer USB en completeUSBRead y escribe un
+// MaschineInputEvent por mensaje, con el timestamp (mach_absolute_time) de
+// la lectura. Todos los eventos de un transfer se publican juntos, con un
+// único store de head.
+//
+// El consumidor mapea la cola con
+// clientMemoryForType(MASCHINE_INPUT_QUEUE_TYPE) y sigue este ciclo:
+//
+// 1. Vaciar con maschineInputQueuePop() hasta que devuelva 0.
+// 2. Armar la notificación con kArmInputNotification (llamada asíncrona).
+//    Si scalarOutput[0] (eventos pendientes) es distinto de 0, volver a 1.
+// 3. Esperar el mensaje del wake port. Llega uno por transfer publicado
+//    mientras la notificación estaba armada, y cada aviso la desarma.
+//
+// Formato:
+// - Eventos de 16 bytes en un anillo SPSC de MASCHINE_INPUT_QUEUE_ENTRIES.
+// - head lo escribe solo el kext y tail solo el consumidor, cada uno en su
+//   propia línea de caché. Hay un único consumidor por dispositivo.
+// - Con la cola llena el kext no espera: descarta el evento y suma
+//   "overflows". La entrada MIDI no se frena por un consumidor lento.
+// - Solo viajan mensajes de 1-3 bytes. Los SysEx siguen llegando por
+//   CoreMIDI y aquí solo se cuentan en "skipped".
+#define MASCHINE_INPUT_QUEUE_TYPE      2           // tipo para clientMemoryForType
+#define MASCHINE_INPUT_QUEUE_MAGIC     0x4D4B4951  // 'MKIQ'
+#define MASCHINE_INPUT_QUEUE_VERSION   1
+#define MASCHINE_INPUT_QUEUE_ENTRIES   4096        // potencia de 2
+
+struct MaschineInputEvent {
+    uint64_t timestamp;     // mach_absolute_time del transfer USB
+    uint8_t length;         // 1-3
+    uint8_t cable;
+    uint8_t data[3];
+    uint8_t reserved[3];
+};
+
+struct MaschineInputQueue {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;
+    uint32_t eventSize;
+
+    // Productor (kext)
+    uint32_t head;
+    uint32_t overflows;
+    uint32_t skipped;
+    uint32_t batches;
+    uint8_t producerPad[48];
+
+    // Consumidor (user-space)
+    uint32_t tail;
+    uint8_t consumerPad[60];
+
+    struct MaschineInputEvent events[MASCHINE_INPUT_QUEUE_ENTRIES];
+};
+
+// Devuelve 0 si la cola está vacía
+static inline int maschineInputQueuePop(struct MaschineInputQueue* queue, struct MaschineInputEvent* event) {
+    uint32_t tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+    uint32_t head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return 0;
+    }
+    *event = queue->events[tail & (queue->capacity - 1)];
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static inline uint32_t maschineInputQueuePending(const struct MaschineInputQueue* queue) {
+    return __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+}
+
+#ifdef __cplusplus
+
+// Lado productor (kext). Sin IOKit: el aviso al consumidor lo hace quien
+// llama cuando commit() devuelve true. El tail viene de user-space; un
+// valor imposible se trata como cola llena.
+class MaschineInputProducer {
+public:
+    MaschineInputProducer();
+
+    void initialize(MaschineInputQueue* queue);
+    void detach();
+
+    // Eventos de un transfer: begin, push por mensaje, commit
+    void begin(uint64_t timestamp);
+    bool push(uint8_t cable, const uint8_t* message, uint32_t length);
+    // true si se publicó algo con la notificación armada (queda desarmada)
+    bool commit();
+
+    // Llamado desde el hilo del cliente; devuelve los eventos pendientes.
+    // Si hay pendientes no se espera aviso: el consumidor vuelve a vaciar.
+    uint32_t arm();
+    void disarm();
+
+    // Estadísticas
+    uint64_t getPublished() const { return published; }
+    uint64_t getNotifications() const { return notifications; }
+
+private:
+    MaschineInputQueue* queue;
+    uint64_t timestamp;
+    uint32_t head;
+    uint32_t staged;
+    uint32_t armed;
+
+    uint64_t published;
+    uint64_t notifications;
+};
+
+#endif // __cplusplus
+
+#endif // MASCHINE_INPUT_QUEUE_H
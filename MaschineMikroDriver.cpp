@@ -10,9 +10,12 @@
 #include <IOKit/IOLib.h>
 #include <IOKit/IOBufferMemoryDescriptor.h>
 #include <IOKit/IOCommandGate.h>
+#include <IOKit/IOSubMemoryDescriptor.h>
+#include <IOKit/IOTimerEventSource.h>
 #include <IOKit/usb/IOUSBHostFamily.h>
 #include <CoreMIDI/MIDIServices.h>
 #include <mach/mach_time.h>
+#include <kern/clock.h>
 
 // Define the superclass
 #define super IOService
@@ -22,6 +25,13 @@ OSDefineMetaClassAndStructors(MaschineMikroDriver, IOService);
 // User client meta class
 OSDefineMetaClassAndStructors(MaschineMikroUserClient, IOUserClient);
 
+static UInt64 currentNanoseconds()
+{
+    uint64_t nanoseconds;
+    absolutetime_to_nanoseconds(mach_absolute_time(), &nanoseconds);
+    return nanoseconds;
+}
+
 #pragma mark - MaschineMikroDriver Implementation
 
 bool MaschineMikroDriver::init(OSDictionary* dictionary)
@@ -44,10 +54,32 @@ bool MaschineMikroDriver::init(OSDictionary* dictionary)
     fMIDIInitialized = false;
     fDeviceID = 0;
     fWorkLoop = NULL;
-    fTimer = NULL;
+    fFlushTimer = NULL;
+    fWriteMemory = NULL;
+    fWriteLock = NULL;
+    fSysExPool = NULL;
+    fChunkMemory = NULL;
+    bzero(fChunkDescriptors, sizeof(fChunkDescriptors));
+    bzero(fChunkCompletions, sizeof(fChunkCompletions));
+    bzero(fWriteDescriptors, sizeof(fWriteDescriptors));
+    bzero(fWriteCompletions, sizeof(fWriteCompletions));
+    bzero(fCommandClients, sizeof(fCommandClients));
+    fReadMemory = NULL;
+    fReadTimestamp = 0;
+    fInputState = NULL;
+    bzero(fReadDescriptors, sizeof(fReadDescriptors));
+    bzero(fReadCompletions, sizeof(fReadCompletions));
+    fStatePageMemory = NULL;
+    fStatePage = NULL;
+    fStateLock = NULL;
+    fInputQueueMemory = NULL;
+    fInputQueue = NULL;
+    fInputLock = NULL;
+    fInputClient = NULL;
+    fInputProducing = false;
+    bzero(fInputReference, sizeof(fInputReference));
     
     // Clear buffers
-    bzero(fInputBuffer, sizeof(fInputBuffer));
     bzero(fOutputBuffer, sizeof(fOutputBuffer));
     
     IOLog("MaschineMikroDriver: Initialized\n");
@@ -81,32 +113,51 @@ bool MaschineMikroDriver::start(IOService* provider)
         return false;
     }
     
+    // Publish the live state page before any input can arrive
+    if (!initializeStatePage()) {
+        IOLog("MaschineMikroDriver: Failed to allocate state page\n");
+        return false;
+    }
+    
+    if (!initializeInputQueue()) {
+        IOLog("MaschineMikroDriver: Failed to allocate input queue\n");
+        return false;
+    }
+    
     // Initialize MIDI
     if (!initializeMIDI()) {
         IOLog("MaschineMikroDriver: Failed to initialize MIDI\n");
         return false;
     }
     
-    // Create work loop and timer
+    // Get work loop
     fWorkLoop = getWorkLoop();
     if (!fWorkLoop) {
         IOLog("MaschineMikroDriver: Failed to get work loop\n");
         return false;
     }
     
-    fTimer = IOTimerEventSource::timerEventSource(this, OSMemberFunctionCast(IOTimerEventSource::Action, this, &MaschineMikroDriver::timerFired));
-    if (!fTimer) {
-        IOLog("MaschineMikroDriver: Failed to create timer\n");
+    // Output buffers and the flush deadline timer
+    if (!initializeWriteQueue()) {
+        IOLog("MaschineMikroDriver: Failed to allocate write buffers\n");
         return false;
     }
     
-    if (fWorkLoop->addEventSource(fTimer) != kIOReturnSuccess) {
-        IOLog("MaschineMikroDriver: Failed to add timer to work loop\n");
+    if (!initializeSysExSender()) {
+        IOLog("MaschineMikroDriver: Failed to allocate SysEx pool\n");
         return false;
     }
     
-    // Start polling timer (1ms interval)
-    fTimer->setTimeoutMS(1);
+    // Queue the input reads; completions keep them queued from here on
+    if (!initializeReadPipeline()) {
+        IOLog("MaschineMikroDriver: Failed to allocate read buffers\n");
+        return false;
+    }
+    
+    if (startUSBRead() != kIOReturnSuccess) {
+        IOLog("MaschineMikroDriver: Failed to queue USB reads\n");
+        return false;
+    }
     
     // Register for power management
     registerService();
@@ -119,28 +170,34 @@ void MaschineMikroDriver::stop(IOService* provider)
 {
     IOLog("MaschineMikroDriver: Stopping driver\n");
     
-    // Stop timer
-    if (fTimer) {
-        fTimer->cancelTimeout();
-        if (fWorkLoop) {
-            fWorkLoop->removeEventSource(fTimer);
-        }
-        fTimer->release();
-        fTimer = NULL;
+    // Stop resubmitting reads before the pipe is aborted
+    fReadPipeline.stop();
+    
+    // No more deadline flushes
+    if (fFlushTimer) {
+        fFlushTimer->cancelTimeout();
+    }
+    
+    // Pending SysEx sends report kIOReturnAborted to their callers
+    if (fWriteLock) {
+        IORecursiveLockLock(fWriteLock);
+        fSysExSender.abort(currentNanoseconds());
+        bzero(fCommandClients, sizeof(fCommandClients));
+        IORecursiveLockUnlock(fWriteLock);
     }
     
     // Cleanup MIDI
     cleanupMIDI();
     
-    // Close USB pipes
+    // Close USB pipes (synchronous abort: no read completion runs after this)
     if (fInPipe) {
-        fInPipe->abort();
+        fInPipe->abort(IOUSBHostIOSource::kAbortSynchronous);
         fInPipe->release();
         fInPipe = NULL;
     }
     
     if (fOutPipe) {
-        fOutPipe->abort();
+        fOutPipe->abort(IOUSBHostIOSource::kAbortSynchronous);
         fOutPipe->release();
         fOutPipe = NULL;
     }
@@ -151,6 +208,12 @@ void MaschineMikroDriver::stop(IOService* provider)
         fInterface = NULL;
     }
     
+    cleanupReadPipeline();
+    cleanupSysExSender();
+    cleanupWriteQueue();
+    cleanupInputQueue();
+    cleanupStatePage();
+    
     super::stop(provider);
 }
 
@@ -316,154 +379,752 @@ void MaschineMikroDriver::cleanupMIDI()
     fMIDIInitialized = false;
 }
 
+#pragma mark - Live State Page
+
+bool MaschineMikroDriver::initializeStatePage()
+{
+    fStateLock = IOSimpleLockAlloc();
+    if (!fStateLock) {
+        return false;
+    }
+    
+    // One page, mappable into user tasks
+    fStatePageMemory = IOBufferMemoryDescriptor::withOptions(kIODirectionInOut | kIOMemoryKernelUserShared,
+                                                            PAGE_SIZE, PAGE_SIZE);
+    if (!fStatePageMemory) {
+        return false;
+    }
+    
+    fStatePage = (MaschineStatePage*)fStatePageMemory->getBytesNoCopy();
+    bzero(fStatePage, PAGE_SIZE);
+    fStatePage->version = MASCHINE_STATE_VERSION;
+    fStatePage->size = sizeof(MaschineStateSnapshot);
+    fStatePage->state.flags = fDeviceOpen ? MASCHINE_STATE_DEVICE_OPEN : 0;
+    __atomic_store_n(&fStatePage->magic, MASCHINE_STATE_MAGIC, __ATOMIC_RELEASE);
+    return true;
+}
+
+void MaschineMikroDriver::cleanupStatePage()
+{
+    if (fStatePage) {
+        // Clients that still have it mapped see the page as invalid
+        __atomic_store_n(&fStatePage->magic, 0, __ATOMIC_RELEASE);
+        fStatePage = NULL;
+    }
+    
+    if (fStatePageMemory) {
+        fStatePageMemory->release();
+        fStatePageMemory = NULL;
+    }
+    
+    if (fStateLock) {
+        IOSimpleLockFree(fStateLock);
+        fStateLock = NULL;
+    }
+}
+
+MaschineStateSnapshot* MaschineMikroDriver::beginStateUpdate()
+{
+    if (!fStatePage) {
+        return NULL;
+    }
+    
+    // Writers come from USB completions and user client calls; readers never lock
+    IOSimpleLockLock(fStateLock);
+    maschineStateBeginWrite(fStatePage);
+    return &fStatePage->state;
+}
+
+void MaschineMikroDriver::endStateUpdate()
+{
+    fStatePage->state.timestampNs = currentNanoseconds();
+    
+    maschineStateEndWrite(fStatePage);
+    IOSimpleLockUnlock(fStateLock);
+}
+
+#pragma mark - Input Event Queue
+
+bool MaschineMikroDriver::initializeInputQueue()
+{
+    fInputLock = IOLockAlloc();
+    if (!fInputLock) {
+        return false;
+    }
+    
+    // Mapped read-write: the consumer advances tail (see MaschineInputQueue.h)
+    fInputQueueMemory = IOBufferMemoryDescriptor::withOptions(kIODirectionInOut | kIOMemoryKernelUserShared,
+                                                             round_page(sizeof(MaschineInputQueue)), PAGE_SIZE);
+    if (!fInputQueueMemory) {
+        return false;
+    }
+    
+    fInputQueue = (MaschineInputQueue*)fInputQueueMemory->getBytesNoCopy();
+    fInputProducer.initialize(fInputQueue);
+    return true;
+}
+
+void MaschineMikroDriver::cleanupInputQueue()
+{
+    if (fInputLock) {
+        IOLockLock(fInputLock);
+        fInputClient = NULL;
+        fInputProducer.detach();
+        IOLockUnlock(fInputLock);
+    }
+    fInputQueue = NULL;
+    
+    if (fInputQueueMemory) {
+        fInputQueueMemory->release();
+        fInputQueueMemory = NULL;
+    }
+    
+    if (fInputLock) {
+        IOLockFree(fInputLock);
+        fInputLock = NULL;
+    }
+}
+
+// Called with fInputLock held. A new consumer starts from an empty queue:
+// nothing was produced while detached, and leftovers of the last one are dropped
+IOReturn MaschineMikroDriver::attachInputClientLocked(MaschineMikroUserClient* client)
+{
+    if (fInputClient && fInputClient != client) {
+        return kIOReturnExclusiveAccess;
+    }
+    if (!fInputClient) {
+        fInputProducer.initialize(fInputQueue);
+        fInputClient = client;
+    }
+    return kIOReturnSuccess;
+}
+
+IOReturn MaschineMikroDriver::attachInputClient(MaschineMikroUserClient* client)
+{
+    if (!fInputLock || !fInputQueue) {
+        return kIOReturnNotOpen;
+    }
+    
+    IOLockLock(fInputLock);
+    IOReturn result = attachInputClientLocked(client);
+    IOLockUnlock(fInputLock);
+    return result;
+}
+
+IOReturn MaschineMikroDriver::armInputNotification(MaschineMikroUserClient* client, io_user_reference_t* asyncReference,
+                                                   UInt32* pending)
+{
+    if (!fInputLock || !fInputQueue) {
+        return kIOReturnNotOpen;
+    }
+    
+    IOLockLock(fInputLock);
+    IOReturn result = attachInputClientLocked(client);
+    if (result != kIOReturnSuccess) {
+        IOLockUnlock(fInputLock);
+        return result;
+    }
+    
+    // Reference stored before arming so a notification never sees a stale one
+    bcopy(asyncReference, fInputReference, sizeof(OSAsyncReference64));
+    *pending = fInputProducer.arm();
+    IOLockUnlock(fInputLock);
+    
+    return kIOReturnSuccess;
+}
+
+void MaschineMikroDriver::releaseInputClient(MaschineMikroUserClient* client)
+{
+    if (!fInputLock) {
+        return;
+    }
+    
+    IOLockLock(fInputLock);
+    if (fInputClient == client) {
+        fInputClient = NULL;
+        fInputProducer.disarm();
+        // Reset so the next consumer starts clean
+        if (fInputQueue) {
+            fInputProducer.initialize(fInputQueue);
+        }
+    }
+    IOLockUnlock(fInputLock);
+}
+
+void MaschineMikroDriver::notifyInputClient()
+{
+    // One wake-up per published transfer while the consumer is waiting
+    IOLockLock(fInputLock);
+    if (fInputClient && fInputQueue) {
+        io_user_reference_t args[2] = { maschineInputQueuePending(fInputQueue), fInputQueue->overflows };
+        MaschineMikroUserClient::sendAsyncResult64(fInputReference, kIOReturnSuccess, args, 2);
+    }
+    IOLockUnlock(fInputLock);
+}
+
 #pragma mark - USB Data Handling
 
-void MaschineMikroDriver::timerFired(OSObject* owner, IOTimerEventSource* sender)
+bool MaschineMikroDriver::initializeReadPipeline()
+{
+    // One allocation for all read buffers, split into per-slot sub-ranges
+    fReadMemory = IOBufferMemoryDescriptor::withCapacity(MASCHINE_READ_PIPELINE_DEPTH * MASCHINE_MIKRO_EP_SIZE,
+                                                         kIODirectionIn);
+    if (!fReadMemory) {
+        return false;
+    }
+    
+    UInt8* buffers = (UInt8*)fReadMemory->getBytesNoCopy();
+    bzero(buffers, MASCHINE_READ_PIPELINE_DEPTH * MASCHINE_MIKRO_EP_SIZE);
+    
+    for (int slot = 0; slot < MASCHINE_READ_PIPELINE_DEPTH; slot++) {
+        fReadDescriptors[slot] = IOSubMemoryDescriptor::withSubRange(fReadMemory, slot * MASCHINE_MIKRO_EP_SIZE,
+                                                                     MASCHINE_MIKRO_EP_SIZE, kIODirectionIn);
+        if (!fReadDescriptors[slot]) {
+            return false;
+        }
+        
+        fReadCompletions[slot].owner = this;
+        fReadCompletions[slot].action = &MaschineMikroDriver::readCompleted;
+        fReadCompletions[slot].parameter = (void*)(uintptr_t)slot;
+    }
+    
+    return fReadPipeline.configure(buffers, MASCHINE_MIKRO_EP_SIZE, MASCHINE_READ_PIPELINE_DEPTH,
+                                   &MaschineMikroDriver::submitRead, &MaschineMikroDriver::deliverRead, this);
+}
+
+void MaschineMikroDriver::cleanupReadPipeline()
 {
-    // Start USB read for next data
-    startUSBRead();
+    for (int slot = 0; slot < MASCHINE_READ_PIPELINE_DEPTH; slot++) {
+        if (fReadDescriptors[slot]) {
+            fReadDescriptors[slot]->release();
+            fReadDescriptors[slot] = NULL;
+        }
+    }
     
-    // Reschedule timer
-    fTimer->setTimeoutMS(1);
+    if (fReadMemory) {
+        fReadMemory->release();
+        fReadMemory = NULL;
+    }
 }
 
 IOReturn MaschineMikroDriver::startUSBRead()
 {
-    if (!fInPipe || !fDeviceOpen) {
+    if (!fInPipe || !fDeviceOpen || !fReadMemory) {
         return kIOReturnNotOpen;
     }
     
-    // Create memory descriptor for the read
-    IOMemoryDescriptor* memory = IOBufferMemoryDescriptor::withBytes(fInputBuffer, MASCHINE_MIKRO_EP_SIZE, kIODirectionIn);
-    if (!memory) {
-        return kIOReturnNoMemory;
+    // A SysEx cut short by a previous stop must not swallow the next one
+    fInputDecoder.reset();
+    
+    int queued = fReadPipeline.start();
+    IOLog("MaschineMikroDriver: %d of %d USB reads queued\n", queued, MASCHINE_READ_PIPELINE_DEPTH);
+    
+    return queued > 0 ? kIOReturnSuccess : kIOReturnError;
+}
+
+int MaschineMikroDriver::submitRead(void* context, int slot)
+{
+    MaschineMikroDriver* driver = (MaschineMikroDriver*)context;
+    if (!driver->fInPipe) {
+        return kIOReturnNotOpen;
     }
     
-    // Submit the read request
-    IOReturn result = fInPipe->io(memory, MASCHINE_MIKRO_EP_SIZE, this, NULL);
-    memory->release();
+    return driver->fInPipe->io(driver->fReadDescriptors[slot], MASCHINE_MIKRO_EP_SIZE,
+                               &driver->fReadCompletions[slot]);
+}
+
+void MaschineMikroDriver::deliverRead(void* context, const uint8_t* data, uint32_t length)
+{
+    MaschineMikroDriver* driver = (MaschineMikroDriver*)context;
+    driver->completeUSBRead((void*)data, length, kIOReturnSuccess);
+}
+
+void MaschineMikroDriver::readCompleted(void* owner, void* parameter, IOReturn status, uint32_t bytesTransferred)
+{
+    MaschineMikroDriver* driver = (MaschineMikroDriver*)owner;
+    int slot = (int)(uintptr_t)parameter;
+    
+    // Completion time, shared by every message decoded from this transfer
+    driver->fReadTimestamp = mach_absolute_time();
     
-    return result;
+    MaschineReadStatus result = MASCHINE_READ_OK;
+    if (status == kIOReturnAborted || status == kIOReturnNotResponding) {
+        result = MASCHINE_READ_ABORTED;
+    } else if (status != kIOReturnSuccess) {
+        // Count the failed transfer; the pipeline decides whether to resubmit
+        driver->completeUSBRead(NULL, 0, status);
+        result = MASCHINE_READ_ERROR;
+    }
+    
+    // Delivers the data through completeUSBRead, then requeues the same buffer
+    driver->fReadPipeline.complete(slot, result, bytesTransferred);
 }
 
 IOReturn MaschineMikroDriver::completeUSBRead(void* data, UInt32 length, IOReturn status)
 {
+    if (status == kIOReturnSuccess) {
+        fCounters.readCompleted(length);
+    } else {
+        fCounters.readFailed();
+    }
+    
+    MaschineStateSnapshot* state = beginStateUpdate();
+    if (state) {
+        state->usbReads++;
+        if (status != kIOReturnSuccess) {
+            state->usbErrors++;
+        }
+        endStateUpdate();
+    }
+    
     if (status == kIOReturnSuccess && length > 0) {
         // Process the received data
-        processMIDIInput((const UInt8*)data, length);
+        processMIDIInput((const UInt8*)data, length, fReadTimestamp);
     }
     
     return kIOReturnSuccess;
 }
 
-IOReturn MaschineMikroDriver::sendUSBData(const UInt8* data, UInt32 length)
+#pragma mark - Output Queue
+
+bool MaschineMikroDriver::initializeWriteQueue()
+{
+    fWriteLock = IORecursiveLockAlloc();
+    if (!fWriteLock) {
+        return false;
+    }
+    
+    // Same layout as the read side: one allocation, per-slot sub-ranges
+    fWriteMemory = IOBufferMemoryDescriptor::withCapacity(MASCHINE_WRITE_QUEUE_DEPTH * MASCHINE_MIKRO_EP_SIZE,
+                                                          kIODirectionOut);
+    if (!fWriteMemory) {
+        return false;
+    }
+    
+    for (int slot = 0; slot < MASCHINE_WRITE_QUEUE_DEPTH; slot++) {
+        fWriteDescriptors[slot] = IOSubMemoryDescriptor::withSubRange(fWriteMemory, slot * MASCHINE_MIKRO_EP_SIZE,
+                                                                      MASCHINE_MIKRO_EP_SIZE, kIODirectionOut);
+        if (!fWriteDescriptors[slot]) {
+            return false;
+        }
+        
+        fWriteCompletions[slot].owner = this;
+        fWriteCompletions[slot].action = &MaschineMikroDriver::writeCompleted;
+        fWriteCompletions[slot].parameter = (void*)(uintptr_t)slot;
+    }
+    
+    fFlushTimer = IOTimerEventSource::timerEventSource(this, OSMemberFunctionCast(IOTimerEventSource::Action, this, &MaschineMikroDriver::flushTimerFired));
+    if (!fFlushTimer) {
+        return false;
+    }
+    
+    if (fWorkLoop->addEventSource(fFlushTimer) != kIOReturnSuccess) {
+        fFlushTimer->release();
+        fFlushTimer = NULL;
+        return false;
+    }
+    
+    return fWriteQueue.configure((UInt8*)fWriteMemory->getBytesNoCopy(), MASCHINE_MIKRO_EP_SIZE,
+                                 MASCHINE_WRITE_QUEUE_DEPTH, &MaschineMikroDriver::submitWrite, this);
+}
+
+void MaschineMikroDriver::cleanupWriteQueue()
 {
-    if (!fOutPipe || !fDeviceOpen) {
+    if (fFlushTimer) {
+        fFlushTimer->cancelTimeout();
+        if (fWorkLoop) {
+            fWorkLoop->removeEventSource(fFlushTimer);
+        }
+        fFlushTimer->release();
+        fFlushTimer = NULL;
+    }
+    
+    fWriteQueue.reset();
+    
+    for (int slot = 0; slot < MASCHINE_WRITE_QUEUE_DEPTH; slot++) {
+        if (fWriteDescriptors[slot]) {
+            fWriteDescriptors[slot]->release();
+            fWriteDescriptors[slot] = NULL;
+        }
+    }
+    
+    if (fWriteMemory) {
+        fWriteMemory->release();
+        fWriteMemory = NULL;
+    }
+    
+    if (fWriteLock) {
+        IORecursiveLockFree(fWriteLock);
+        fWriteLock = NULL;
+    }
+}
+
+IOReturn MaschineMikroDriver::queueUSBData(const UInt8* data, UInt32 length)
+{
+    if (!fOutPipe || !fDeviceOpen || !fWriteLock) {
         return kIOReturnNotOpen;
     }
     
-    // Create memory descriptor for the write
-    IOMemoryDescriptor* memory = IOBufferMemoryDescriptor::withBytes((void*)data, length, kIODirectionOut);
-    if (!memory) {
-        return kIOReturnNoMemory;
+    // The queue frames each message as 4-byte USB-MIDI event packets.
+    // Recursive: a failed io() may complete synchronously on this thread
+    IORecursiveLockLock(fWriteLock);
+    bool armTimer;
+    bool queued = fWriteQueue.append(data, length, &armTimer);
+    IORecursiveLockUnlock(fWriteLock);
+    
+    if (!queued) {
+        fCounters.outputOverflow();
     }
     
-    // Submit the write request
-    IOReturn result = fOutPipe->io(memory, length, NULL, NULL);
-    memory->release();
+    if (armTimer) {
+        fFlushTimer->setTimeoutUS(MASCHINE_WRITE_FLUSH_US);
+    }
     
-    return result;
+    MaschineStateSnapshot* state = beginStateUpdate();
+    if (state) {
+        if (queued) {
+            state->midiMessagesOut++;
+        } else {
+            state->usbErrors++;
+        }
+        endStateUpdate();
+    }
+    
+    return queued ? kIOReturnSuccess : kIOReturnNoResources;
 }
 
-#pragma mark - MIDI Processing
+void MaschineMikroDriver::flushTimerFired(OSObject* owner, IOTimerEventSource* sender)
+{
+    // Deadline reached with a partly filled transfer: send what we have
+    IORecursiveLockLock(fWriteLock);
+    fWriteQueue.flush();
+    IORecursiveLockUnlock(fWriteLock);
+}
+
+int MaschineMikroDriver::submitWrite(void* context, int slot, uint32_t length)
+{
+    MaschineMikroDriver* driver = (MaschineMikroDriver*)context;
+    if (!driver->fOutPipe) {
+        return kIOReturnNotOpen;
+    }
+    
+    return driver->fOutPipe->io(driver->fWriteDescriptors[slot], length, &driver->fWriteCompletions[slot]);
+}
 
-void MaschineMikroDriver::processMIDIInput(const UInt8* data, UInt32 length)
+void MaschineMikroDriver::writeCompleted(void* owner, void* parameter, IOReturn status, uint32_t bytesTransferred)
 {
-    if (!fMIDIInitialized || !data || length == 0) {
+    MaschineMikroDriver* driver = (MaschineMikroDriver*)owner;
+    int slot = (int)(uintptr_t)parameter;
+    
+    if (status == kIOReturnSuccess) {
+        driver->fCounters.written(bytesTransferred);
+    } else if (status != kIOReturnAborted) {
+        driver->fCounters.writeFailed();
+    }
+    
+    IORecursiveLockLock(driver->fWriteLock);
+    driver->fWriteQueue.complete(slot, status == kIOReturnSuccess);
+    
+    // A slot is free again: refill it from rings that were waiting for room
+    driver->drainCommandRings();
+    IORecursiveLockUnlock(driver->fWriteLock);
+    
+    if (status != kIOReturnSuccess && status != kIOReturnAborted) {
+        MaschineStateSnapshot* state = driver->beginStateUpdate();
+        if (state) {
+            state->usbErrors++;
+            driver->endStateUpdate();
+        }
+    }
+}
+
+#pragma mark - Command Rings
+
+void MaschineMikroDriver::lockOutput()
+{
+    IORecursiveLockLock(fWriteLock);
+}
+
+void MaschineMikroDriver::unlockOutput()
+{
+    IORecursiveLockUnlock(fWriteLock);
+}
+
+bool MaschineMikroDriver::registerCommandClient(MaschineMikroUserClient* client)
+{
+    // Caller holds the output lock
+    int freeSlot = -1;
+    for (int i = 0; i < MASCHINE_COMMAND_CLIENTS; i++) {
+        if (fCommandClients[i] == client) {
+            return true;
+        }
+        if (!fCommandClients[i] && freeSlot < 0) {
+            freeSlot = i;
+        }
+    }
+    
+    if (freeSlot < 0) {
+        return false;
+    }
+    
+    fCommandClients[freeSlot] = client;
+    return true;
+}
+
+void MaschineMikroDriver::unregisterCommandClient(MaschineMikroUserClient* client)
+{
+    if (!fWriteLock) {
         return;
     }
     
-    // Parse MIDI messages from USB data
-    for (UInt32 i = 0; i < length; i++) {
-        UInt8 byte = data[i];
+    IORecursiveLockLock(fWriteLock);
+    for (int i = 0; i < MASCHINE_COMMAND_CLIENTS; i++) {
+        if (fCommandClients[i] == client) {
+            fCommandClients[i] = NULL;
+        }
+    }
+    IORecursiveLockUnlock(fWriteLock);
+}
+
+void MaschineMikroDriver::drainCommandRings()
+{
+    // Called with fWriteLock held; a ring leaves the list once it is empty
+    for (int i = 0; i < MASCHINE_COMMAND_CLIENTS; i++) {
+        if (fCommandClients[i] && fCommandClients[i]->drainCommandRing() == 0) {
+            fCommandClients[i] = NULL;
+        }
+    }
+}
+
+#pragma mark - SysEx Output
+
+bool MaschineMikroDriver::initializeSysExSender()
+{
+    // Message pool: plain kernel memory, chunks are copied into the DMA buffers below
+    fSysExPool = (UInt8*)IOMalloc(MASCHINE_SYSEX_POOL * MASCHINE_SYSEX_OUT_MAX);
+    if (!fSysExPool) {
+        return false;
+    }
+    
+    fChunkMemory = IOBufferMemoryDescriptor::withCapacity(MASCHINE_SYSEX_WINDOW * MASCHINE_MIKRO_EP_SIZE,
+                                                          kIODirectionOut);
+    if (!fChunkMemory) {
+        return false;
+    }
+    
+    for (int chunk = 0; chunk < MASCHINE_SYSEX_WINDOW; chunk++) {
+        fChunkDescriptors[chunk] = IOSubMemoryDescriptor::withSubRange(fChunkMemory, chunk * MASCHINE_MIKRO_EP_SIZE,
+                                                                       MASCHINE_MIKRO_EP_SIZE, kIODirectionOut);
+        if (!fChunkDescriptors[chunk]) {
+            return false;
+        }
         
-        // Check for MIDI status byte
-        if (byte & 0x80) {
-            UInt8 status = byte & 0xF0;
-            UInt8 channel = byte & 0x0F;
-            
-            // Handle different MIDI message types
-            switch (status) {
-                case MIDI_NOTE_ON:
-                    if (i + 2 < length) {
-                        UInt8 note = data[i + 1];
-                        UInt8 velocity = data[i + 2];
-                        sendMIDIMessage(byte, note, velocity);
-                        i += 2;
-                    }
-                    break;
-                    
-                case MIDI_NOTE_OFF:
-                    if (i + 2 < length) {
-                        UInt8 note = data[i + 1];
-                        UInt8 velocity = data[i + 2];
-                        sendMIDIMessage(byte, note, velocity);
-                        i += 2;
-                    }
-                    break;
-                    
-                case MIDI_CONTROL_CHANGE:
-                    if (i + 2 < length) {
-                        UInt8 controller = data[i + 1];
-                        UInt8 value = data[i + 2];
-                        sendMIDIMessage(byte, controller, value);
-                        i += 2;
-                    }
-                    break;
-                    
-                case MIDI_PROGRAM_CHANGE:
-                    if (i + 1 < length) {
-                        UInt8 program = data[i + 1];
-                        sendMIDIMessage(byte, program, 0);
-                        i += 1;
-                    }
-                    break;
-                    
-                case MIDI_PITCH_BEND:
-                    if (i + 2 < length) {
-                        UInt8 lsb = data[i + 1];
-                        UInt8 msb = data[i + 2];
-                        UInt16 value = (msb << 7) | lsb;
-                        sendMIDIMessage(byte, lsb, msb);
-                        i += 2;
-                    }
-                    break;
-            }
+        fChunkCompletions[chunk].owner = this;
+        fChunkCompletions[chunk].action = &MaschineMikroDriver::sysexChunkCompleted;
+        fChunkCompletions[chunk].parameter = (void*)(uintptr_t)chunk;
+    }
+    
+    return fSysExSender.configure(fSysExPool, MASCHINE_SYSEX_OUT_MAX, MASCHINE_SYSEX_POOL, MASCHINE_MIKRO_EP_SIZE,
+                                  MASCHINE_SYSEX_WINDOW, &MaschineMikroDriver::submitSysExChunk,
+                                  &MaschineMikroDriver::sysexDone, &MaschineMikroDriver::sysexExclusive, this);
+}
+
+void MaschineMikroDriver::cleanupSysExSender()
+{
+    for (int chunk = 0; chunk < MASCHINE_SYSEX_WINDOW; chunk++) {
+        if (fChunkDescriptors[chunk]) {
+            fChunkDescriptors[chunk]->release();
+            fChunkDescriptors[chunk] = NULL;
+        }
+    }
+    
+    if (fChunkMemory) {
+        fChunkMemory->release();
+        fChunkMemory = NULL;
+    }
+    
+    if (fSysExPool) {
+        IOFree(fSysExPool, MASCHINE_SYSEX_POOL * MASCHINE_SYSEX_OUT_MAX);
+        fSysExPool = NULL;
+    }
+}
+
+int MaschineMikroDriver::submitSysExChunk(void* context, int chunk, const uint8_t* data, uint32_t length)
+{
+    MaschineMikroDriver* driver = (MaschineMikroDriver*)context;
+    if (!driver->fOutPipe) {
+        return kIOReturnNotOpen;
+    }
+    
+    UInt8* buffer = (UInt8*)driver->fChunkMemory->getBytesNoCopy() + chunk * MASCHINE_MIKRO_EP_SIZE;
+    memcpy(buffer, data, length);
+    return driver->fOutPipe->io(driver->fChunkDescriptors[chunk], length, &driver->fChunkCompletions[chunk]);
+}
+
+void MaschineMikroDriver::sysexChunkCompleted(void* owner, void* parameter, IOReturn status, uint32_t bytesTransferred)
+{
+    MaschineMikroDriver* driver = (MaschineMikroDriver*)owner;
+    int chunk = (int)(uintptr_t)parameter;
+    
+    if (status == kIOReturnSuccess) {
+        driver->fCounters.written(bytesTransferred);
+    } else if (status != kIOReturnAborted) {
+        driver->fCounters.writeFailed();
+    }
+    
+    // Each completion frees a chunk buffer and sends the next piece
+    IORecursiveLockLock(driver->fWriteLock);
+    driver->fSysExSender.complete(chunk, status == kIOReturnSuccess, currentNanoseconds());
+    IORecursiveLockUnlock(driver->fWriteLock);
+}
+
+void MaschineMikroDriver::sysexExclusive(void* context, bool exclusive)
+{
+    MaschineMikroDriver* driver = (MaschineMikroDriver*)context;
+    
+    // Hold back coalesced messages so they are not interleaved into the SysEx
+    if (exclusive) {
+        driver->fWriteQueue.flush();
+        driver->fWriteQueue.hold();
+    } else {
+        driver->fWriteQueue.release();
+    }
+}
+
+void MaschineMikroDriver::sysexDone(void* context, uint32_t id, MaschineSysExStatus status,
+                                    uint32_t bytes, uint64_t durationNs, void* reference)
+{
+    MaschineMikroDriver* driver = (MaschineMikroDriver*)context;
+    
+    MaschineStateSnapshot* state = driver->beginStateUpdate();
+    if (state) {
+        if (status == MASCHINE_SYSEX_OK) {
+            state->midiMessagesOut++;
+        } else if (status == MASCHINE_SYSEX_FAILED) {
+            state->usbErrors++;
         }
+        driver->endStateUpdate();
+    }
+    
+    MaschineMikroUserClient::SysExRequest* request = (MaschineMikroUserClient::SysExRequest*)reference;
+    if (request) {
+        IOReturn result = kIOReturnSuccess;
+        if (status == MASCHINE_SYSEX_FAILED) {
+            result = kIOReturnIOError;
+        } else if (status == MASCHINE_SYSEX_ABORTED) {
+            result = kIOReturnAborted;
+        }
+        
+        MaschineMikroUserClient* client = request->client;
+        client->sysexCompleted(request, id, result, bytes, durationNs);
+        client->release();
     }
 }
 
-void MaschineMikroDriver::sendMIDIMessage(UInt8 status, UInt8 data1, UInt8 data2)
+#pragma mark - MIDI Processing
+
+void MaschineMikroDriver::processMIDIInput(const UInt8* data, UInt32 length, UInt64 timestamp)
 {
-    if (!fMIDIInitialized || !fMIDIInputEndpoint) {
+    if (!data || length == 0) {
         return;
     }
     
-    // Create MIDI packet list
-    MIDIPacketList packetList;
-    MIDIPacket* packet = MIDIPacketListInit(&packetList);
+    // One state update, one MIDIReceived and one queue publish for the whole transfer.
+    // The queue is only fed while a consumer is attached: with nobody draining it
+    // every event would count as an overflow
+    fInputBatch.begin(timestamp);
+    IOLockLock(fInputLock);
+    fInputProducing = fInputClient != NULL;
+    if (fInputProducing) {
+        fInputProducer.begin(timestamp);
+    }
+    fInputState = beginStateUpdate();
+    
+    // Decode USB-MIDI event packets (4 bytes each, padding skipped)
+    UInt64 messagesBefore = fInputDecoder.getMessages();
+    UInt64 errorsBefore = fInputDecoder.getInvalidPackets() + fInputDecoder.getSysExDropped();
+    fInputDecoder.decode(data, length, &MaschineMikroDriver::decodedMessage, this);
+    UInt64 messages = fInputDecoder.getMessages() - messagesBefore;
+    fCounters.decoded(messages, fInputDecoder.getInvalidPackets() + fInputDecoder.getSysExDropped() - errorsBefore);
+    
+    if (fInputState) {
+        endStateUpdate();
+        fInputState = NULL;
+    }
+    
+    bool notify = fInputProducing && fInputProducer.commit();
+    fInputProducing = false;
+    IOLockUnlock(fInputLock);
+    if (notify) {
+        notifyInputClient();
+    }
+    
+    if (fMIDIInitialized) {
+        deliverMIDIBatch();
+    }
+    
+    // Completion-to-deliver latency, once per transfer that carried messages
+    if (messages > 0) {
+        uint64_t nanoseconds;
+        absolutetime_to_nanoseconds(mach_absolute_time() - timestamp, &nanoseconds);
+        fCounters.latency(nanoseconds);
+    }
+}
+
+void MaschineMikroDriver::decodedMessage(void* context, uint8_t cable, const uint8_t* message, uint32_t length)
+{
+    MaschineMikroDriver* driver = (MaschineMikroDriver*)context;
+    driver->queueMIDIMessage(driver->fInputState, message, length);
+    if (driver->fInputProducing && !driver->fInputProducer.push(cable, message, length) && length <= 3) {
+        driver->fCounters.inputOverflow();
+    }
+}
+
+void MaschineMikroDriver::queueMIDIMessage(MaschineStateSnapshot* state, const UInt8* message, UInt32 length)
+{
+    UInt8 type = message[0] & 0xF0;
     
-    UInt8 midiData[3] = { status, data1, data2 };
-    UInt32 dataLength = 3;
+    // Mirror pad and encoder activity into the state page
+    if (state) {
+        state->midiMessagesIn++;
+        
+        UInt8 data1 = length > 1 ? message[1] : 0;
+        UInt8 data2 = length > 2 ? message[2] : 0;
+        int pad = (int)data1 - MASCHINE_MIKRO_NOTE_BASE;
+        if ((type == MIDI_NOTE_ON || type == MIDI_NOTE_OFF) && pad >= 0 && pad < 16) {
+            bool pressed = (type == MIDI_NOTE_ON && data2 > 0);
+            state->padEvents++;
+            state->padVelocities[pad] = pressed ? data2 : 0;
+            if (pressed) {
+                state->padStates |= (uint16_t)(1 << pad);
+            } else {
+                state->padStates &= (uint16_t)~(1 << pad);
+            }
+        } else if (type == MIDI_CONTROL_CHANGE) {
+            state->encoderEvents++;
+        }
+    }
     
-    // Adjust length for 1-byte messages
-    if (status == MIDI_PROGRAM_CHANGE || status == MIDI_CHANNEL_PRESSURE) {
-        dataLength = 2;
+    fInputBatch.add(message, length);
+}
+
+void MaschineMikroDriver::deliverMIDIBatch()
+{
+    if (!fMIDIInputEndpoint || !fInputBatch.finish()) {
+        return;
     }
     
-    packet = MIDIPacketListAdd(&packetList, sizeof(packetList), packet, mach_absolute_time(), dataLength, midiData);
+    // Messages sharing a timestamp share a packet; each SysEx gets its own
+    MIDIPacketList* packetList = (MIDIPacketList*)fPacketListBuffer;
+    MIDIPacket* packet = MIDIPacketListInit(packetList);
+    for (UInt32 i = 0; packet && i < fInputBatch.getSegmentCount(); i++) {
+        UInt32 segmentLength;
+        const UInt8* segment = fInputBatch.getSegment(i, &segmentLength);
+        packet = MIDIPacketListAdd(packetList, sizeof(fPacketListBuffer), packet, fInputBatch.getTimestamp(),
+                                   segmentLength, segment);
+    }
     if (packet) {
-        MIDIReceived(fMIDIInputEndpoint, &packetList);
+        MIDIReceived(fMIDIInputEndpoint, packetList);
     }
 }
 
@@ -473,28 +1134,28 @@ void MaschineMikroDriver::sendMIDINoteOn(UInt8 note, UInt8 velocity, UInt8 chann
 {
     UInt8 status = MIDI_NOTE_ON | (channel & 0x0F);
     UInt8 data[3] = { status, note, velocity };
-    sendUSBData(data, 3);
+    queueUSBData(data, 3);
 }
 
 void MaschineMikroDriver::sendMIDINoteOff(UInt8 note, UInt8 velocity, UInt8 channel)
 {
     UInt8 status = MIDI_NOTE_OFF | (channel & 0x0F);
     UInt8 data[3] = { status, note, velocity };
-    sendUSBData(data, 3);
+    queueUSBData(data, 3);
 }
 
 void MaschineMikroDriver::sendMIDIControlChange(UInt8 controller, UInt8 value, UInt8 channel)
 {
     UInt8 status = MIDI_CONTROL_CHANGE | (channel & 0x0F);
     UInt8 data[3] = { status, controller, value };
-    sendUSBData(data, 3);
+    queueUSBData(data, 3);
 }
 
 void MaschineMikroDriver::sendMIDIProgramChange(UInt8 program, UInt8 channel)
 {
     UInt8 status = MIDI_PROGRAM_CHANGE | (channel & 0x0F);
     UInt8 data[2] = { status, program };
-    sendUSBData(data, 2);
+    queueUSBData(data, 2);
 }
 
 void MaschineMikroDriver::sendMIDIPitchBend(UInt16 value, UInt8 channel)
@@ -503,23 +1164,112 @@ void MaschineMikroDriver::sendMIDIPitchBend(UInt16 value, UInt8 channel)
     UInt8 lsb = value & 0x7F;
     UInt8 msb = (value >> 7) & 0x7F;
     UInt8 data[3] = { status, lsb, msb };
-    sendUSBData(data, 3);
+    queueUSBData(data, 3);
 }
 
-void MaschineMikroDriver::sendMIDISysex(const UInt8* data, UInt32 length)
+IOReturn MaschineMikroDriver::sendMIDISysex(const UInt8* data, UInt32 length, void* request, UInt32* messageID)
 {
     if (!data || length == 0) {
-        return;
+        return kIOReturnBadArgument;
     }
     
-    // Create sysex message with start and end bytes
-    UInt8* sysexData = new UInt8[length + 2];
-    sysexData[0] = MIDI_SYSEX_START;
-    memcpy(&sysexData[1], data, length);
-    sysexData[length + 1] = MIDI_SYSEX_END;
+    if (!fOutPipe || !fDeviceOpen || !fWriteLock) {
+        return kIOReturnNotOpen;
+    }
+    
+    if (length > MASCHINE_SYSEX_PAYLOAD_MAX) {
+        return kIOReturnMessageTooLarge;
+    }
+    
+    // Status bytes (F0/F7 included) inside the payload would split the message
+    if (!MaschineSysExSender::validate(data, length)) {
+        return kIOReturnBadArgument;
+    }
+    
+    // Framed into USB-MIDI packets in the pool; chunks go out as completions arrive
+    IORecursiveLockLock(fWriteLock);
+    UInt32 id = fSysExSender.enqueue(data, length, request, currentNanoseconds());
+    IORecursiveLockUnlock(fWriteLock);
+    
+    if (messageID) {
+        *messageID = id;
+    }
+    
+    return id ? kIOReturnSuccess : kIOReturnNoResources;
+}
+
+IOReturn MaschineMikroDriver::sendMIDIMessage(const UInt8* message, UInt32 length)
+{
+    if (!message || length == 0 || length > 3) {
+        return kIOReturnBadArgument;
+    }
     
-    sendUSBData(sysexData, length + 2);
-    delete[] sysexData;
+    return queueUSBData(message, length);
+}
+
+IOReturn MaschineMikroDriver::setLED(UInt8 target, UInt8 index, UInt8 value)
+{
+    if ((target == MASCHINE_MIKRO_LED_PAD && index >= 16) ||
+        (target == MASCHINE_MIKRO_LED_BUTTON && index >= 8) ||
+        (target != MASCHINE_MIKRO_LED_PAD && target != MASCHINE_MIKRO_LED_BUTTON)) {
+        return kIOReturnBadArgument;
+    }
+    
+    // Four USB-MIDI packets: up to four LED updates share a transfer
+    UInt8 message[10] = { MIDI_SYSEX_START, 0x00, 0x20, 0x3C, 0x02, MASCHINE_MIKRO_CMD_LED,
+                          target, index, (UInt8)(value & 0x7F), MIDI_SYSEX_END };
+    IOReturn result = queueUSBData(message, sizeof(message));
+    if (result != kIOReturnSuccess) {
+        return result;
+    }
+    
+    MaschineStateSnapshot* state = beginStateUpdate();
+    if (state) {
+        if (target == MASCHINE_MIKRO_LED_PAD) {
+            if (value) {
+                state->padLEDs |= (uint16_t)(1 << index);
+            } else {
+                state->padLEDs &= (uint16_t)~(1 << index);
+            }
+        } else {
+            if (value) {
+                state->buttonLEDs |= (uint8_t)(1 << index);
+            } else {
+                state->buttonLEDs &= (uint8_t)~(1 << index);
+            }
+        }
+        endStateUpdate();
+    }
+    
+    return kIOReturnSuccess;
+}
+
+IOReturn MaschineMikroDriver::setDisplay(UInt8 line, const UInt8* text, UInt32 length)
+{
+    if (line >= MASCHINE_MIKRO_DISPLAY_LINES || (length > 0 && !text)) {
+        return kIOReturnBadArgument;
+    }
+    
+    if (length > MASCHINE_MIKRO_DISPLAY_TEXT) {
+        length = MASCHINE_MIKRO_DISPLAY_TEXT;
+    }
+    
+    // One line per message, sized to fit a single transfer of the output queue
+    UInt8 message[MASCHINE_MIKRO_EP_SIZE];
+    UInt32 position = 0;
+    message[position++] = MIDI_SYSEX_START;
+    message[position++] = 0x00;
+    message[position++] = 0x20;
+    message[position++] = 0x3C;
+    message[position++] = 0x02;
+    message[position++] = MASCHINE_MIKRO_CMD_DISPLAY;
+    message[position++] = line;
+    for (UInt32 i = 0; i < length; i++) {
+        message[position++] = text[i] & 0x7F;
+    }
+    message[position++] = MIDI_SYSEX_END;
+    
+    return queueUSBData(message, position);
 }
 
 #pragma mark - MaschineMikroUserClient Implementation
@@ -533,12 +1283,17 @@ bool MaschineMikroUserClient::initWithTask(task_t owningTask, void* securityToke
     fDriver = NULL;
     fTask = owningTask;
     fStarted = false;
+    bzero(fSysExRequests, sizeof(fSysExRequests));
+    fCommandRingMemory = NULL;
+    fCommandRing = NULL;
+    fDraining = false;
     
     return true;
 }
 
 void MaschineMikroUserClient::free()
 {
+    cleanupCommandRing();
     super::free();
 }
 
@@ -553,6 +1308,11 @@ bool MaschineMikroUserClient::start(IOService* provider)
         return false;
     }
     
+    if (!initializeCommandRing()) {
+        IOLog("MaschineMikroDriver: Failed to allocate command ring\n");
+        return false;
+    }
+    
     fStarted = true;
     return true;
 }
@@ -560,10 +1320,70 @@ bool MaschineMikroUserClient::start(IOService* provider)
 void MaschineMikroUserClient::stop(IOService* provider)
 {
     fStarted = false;
+    if (fDriver) {
+        fDriver->unregisterCommandClient(this);
+        fDriver->releaseInputClient(this);
+    }
     fDriver = NULL;
     super::stop(provider);
 }
 
+bool MaschineMikroUserClient::initializeCommandRing()
+{
+    // Mapped read-write into the client task: the kext never trusts its contents
+    fCommandRingMemory = IOBufferMemoryDescriptor::withOptions(kIODirectionInOut | kIOMemoryKernelUserShared,
+                                                              round_page(sizeof(MaschineCommandRing)), PAGE_SIZE);
+    if (!fCommandRingMemory) {
+        return false;
+    }
+    
+    fCommandRing = (MaschineCommandRing*)fCommandRingMemory->getBytesNoCopy();
+    fDispatcher.initializeRing(fCommandRing);
+    fDispatcher.configure(&MaschineMikroUserClient::sendCommand, this);
+    return true;
+}
+
+void MaschineMikroUserClient::cleanupCommandRing()
+{
+    fCommandRing = NULL;
+    if (fCommandRingMemory) {
+        fCommandRingMemory->release();
+        fCommandRingMemory = NULL;
+    }
+}
+
+int MaschineMikroUserClient::sendCommand(void* context, const uint8_t* message, uint32_t length)
+{
+    MaschineMikroUserClient* client = (MaschineMikroUserClient*)context;
+    if (!client->fDriver) {
+        return kIOReturnNotOpen;
+    }
+    
+    // Non-zero (queue full) stops the dispatcher; the rest stays pending
+    return client->fDriver->sendMIDIMessage(message, length);
+}
+
+UInt32 MaschineMikroUserClient::drainCommandRing(UInt32* consumed)
+{
+    if (!fCommandRing) {
+        return 0;
+    }
+    
+    // A submit that fails synchronously completes on this thread and drains again
+    UInt32 count = 0;
+    if (!fDraining) {
+        fDraining = true;
+        count = fDispatcher.drain(fCommandRing);
+        fDraining = false;
+    }
+    
+    if (consumed) {
+        *consumed = count;
+    }
+    // From the dispatcher's own tail: the one in the ring is user-writable
+    return fDispatcher.pending(fCommandRing);
+}
+
 IOReturn MaschineMikroUserClient::externalMethod(uint32_t selector, IOUserClientMethodArguments* arguments,
                                                 IOUserClientMethodDispatch* dispatch, OSObject* target, void* reference)
 {
@@ -615,13 +1435,142 @@ IOReturn MaschineMikroUserClient::externalMethod(uint32_t selector, IOUserClient
             }
             break;
             
-        case kSendMIDISysex:
-            if (arguments->structureInput && arguments->structureInputSize > 0) {
-                fDriver->sendMIDISysex((const UInt8*)arguments->structureInput, 
-                                      arguments->structureInputSize);
-                return kIOReturnSuccess;
+        case kSendMIDISysex: {
+            // Messages over 4 KB arrive as a memory descriptor
+            const UInt8* payload = (const UInt8*)arguments->structureInput;
+            UInt32 length = arguments->structureInputSize;
+            IOMemoryMap* map = NULL;
+            if (arguments->structureInputDescriptor) {
+                map = arguments->structureInputDescriptor->createMappingInTask(kernel_task, 0,
+                                                                               kIOMapAnywhere | kIOMapReadOnly);
+                if (!map) {
+                    return kIOReturnVMError;
+                }
+                payload = (const UInt8*)map->getVirtualAddress();
+                length = (UInt32)map->getLength();
+            }
+            
+            if (!payload || length == 0) {
+                if (map) {
+                    map->release();
+                }
+                break;
+            }
+            
+            // Asynchronous callers get id, bytes and duration through sendAsyncResult64
+            SysExRequest* request = NULL;
+            if (arguments->asyncWakePort != MACH_PORT_NULL) {
+                request = reserveSysExRequest(arguments->asyncReference);
+                if (!request) {
+                    if (map) {
+                        map->release();
+                    }
+                    return kIOReturnNoResources;
+                }
+            }
+            
+            UInt32 messageID = 0;
+            IOReturn result = fDriver->sendMIDISysex(payload, length, request, &messageID);
+            if (map) {
+                map->release();
+            }
+            
+            // Rejected before queueing: no completion will release the request
+            if (request && messageID == 0) {
+                request->active = 0;
+                release();
+            }
+            
+            if (arguments->scalarOutputCount >= 1) {
+                arguments->scalarOutput[0] = messageID;
+            }
+            return result;
+        }
+            
+        case kGetDeviceStatus: {
+            // Truncated to the caller's buffer; "size" tells how much is valid
+            if (!arguments->structureOutput || arguments->structureOutputSize == 0) {
+                break;
+            }
+            
+            MaschineDeviceStatus status;
+            fDriver->getDeviceStatus(&status);
+            UInt32 size = arguments->structureOutputSize < sizeof(status) ? arguments->structureOutputSize
+                                                                          : (UInt32)sizeof(status);
+            bcopy(&status, arguments->structureOutput, size);
+            arguments->structureOutputSize = size;
+            return kIOReturnSuccess;
+        }
+            
+        case kSetLED:
+            // target (pad/button), index, value
+            if (arguments->scalarInputCount >= 3) {
+                return fDriver->setLED((UInt8)arguments->scalarInput[0],
+                                       (UInt8)arguments->scalarInput[1],
+                                       (UInt8)arguments->scalarInput[2]);
+            }
+            break;
+            
+        case kSetDisplay:
+            // line in scalarInput[0], ASCII text in structureInput
+            if (arguments->scalarInputCount >= 1) {
+                return fDriver->setDisplay((UInt8)arguments->scalarInput[0],
+                                           (const UInt8*)arguments->structureInput,
+                                           arguments->structureInputSize);
             }
             break;
+            
+        case kSendMIDIBatch: {
+            // Array of MaschineMIDICommand; stops early when the output queue is full
+            UInt32 size = arguments->structureInputSize;
+            UInt32 count = size / sizeof(MaschineMIDICommand);
+            if (!arguments->structureInput || size == 0 || size % sizeof(MaschineMIDICommand) != 0 ||
+                count > MASCHINE_COMMAND_BATCH_MAX) {
+                break;
+            }
+            
+            fDriver->lockOutput();
+            UInt32 consumed = fDispatcher.dispatch((const MaschineMIDICommand*)arguments->structureInput, count);
+            fDriver->unlockOutput();
+            
+            if (arguments->scalarOutputCount >= 1) {
+                arguments->scalarOutput[0] = consumed;
+            }
+            return kIOReturnSuccess;
+        }
+            
+        case kRingDoorbell: {
+            // Drain what fits now; the rest goes out as write completions free slots
+            fDriver->lockOutput();
+            UInt32 consumed = 0;
+            UInt32 pending = drainCommandRing(&consumed);
+            bool registered = pending == 0 || fDriver->registerCommandClient(this);
+            fDriver->unlockOutput();
+            
+            if (arguments->scalarOutputCount >= 1) {
+                arguments->scalarOutput[0] = consumed;
+            }
+            if (arguments->scalarOutputCount >= 2) {
+                arguments->scalarOutput[1] = pending;
+            }
+            
+            // Too many rings waiting: the caller rings again later
+            return registered ? kIOReturnSuccess : kIOReturnBusy;
+        }
+            
+        case kArmInputNotification: {
+            // Async only: the wake port gets { pending, overflows } once events are published
+            if (arguments->asyncWakePort == MACH_PORT_NULL) {
+                break;
+            }
+            
+            UInt32 pending = 0;
+            IOReturn result = fDriver->armInputNotification(this, arguments->asyncReference, &pending);
+            if (arguments->scalarOutputCount >= 1) {
+                arguments->scalarOutput[0] = pending;
+            }
+            return result;
+        }
     }
     
     return kIOReturnBadArgument;
@@ -629,12 +1578,90 @@ IOReturn MaschineMikroUserClient::externalMethod(uint32_t selector, IOUserClient
 
 IOReturn MaschineMikroUserClient::clientMemoryForType(UInt32 type, IOOptionBits* options, IOMemoryDescriptor** memory)
 {
-    return kIOReturnUnsupported;
+    if (!fStarted || !fDriver) {
+        return kIOReturnNotOpen;
+    }
+    
+    switch (type) {
+        case kStatePageMemory: {
+            // Read-only mapping of the live state page (see MaschineStatePage.h)
+            IOMemoryDescriptor* page = fDriver->getStatePageMemory();
+            if (!page) {
+                return kIOReturnNoMemory;
+            }
+            page->retain();
+            *options = kIOMapReadOnly;
+            *memory = page;
+            return kIOReturnSuccess;
+        }
+            
+        case kCommandRingMemory: {
+            // Read-write: the client produces into it (see MaschineCommandRing.h)
+            if (!fCommandRingMemory) {
+                return kIOReturnNoMemory;
+            }
+            fCommandRingMemory->retain();
+            *options = 0;
+            *memory = fCommandRingMemory;
+            return kIOReturnSuccess;
+        }
+            
+        case kInputQueueMemory: {
+            // Read-write: the consumer advances tail (see MaschineInputQueue.h).
+            // Mapping attaches this client as the consumer, so events start flowing
+            IOMemoryDescriptor* queue = fDriver->getInputQueueMemory();
+            if (!queue) {
+                return kIOReturnNoMemory;
+            }
+            IOReturn attached = fDriver->attachInputClient(this);
+            if (attached != kIOReturnSuccess) {
+                return attached;
+            }
+            queue->retain();
+            *options = 0;
+            *memory = queue;
+            return kIOReturnSuccess;
+        }
+    }
+    
+    return kIOReturnBadArgument;
+}
+
+MaschineMikroUserClient::SysExRequest* MaschineMikroUserClient::reserveSysExRequest(io_user_reference_t* asyncReference)
+{
+    for (int i = 0; i < MASCHINE_SYSEX_POOL; i++) {
+        SysExRequest* request = &fSysExRequests[i];
+        if (OSCompareAndSwap(0, 1, &request->active)) {
+            request->client = this;
+            bcopy(asyncReference, request->asyncReference, sizeof(OSAsyncReference64));
+            
+            // Released by the driver once the send finishes
+            retain();
+            return request;
+        }
+    }
+    
+    return NULL;
+}
+
+void MaschineMikroUserClient::sysexCompleted(SysExRequest* request, UInt32 messageID, IOReturn status,
+                                             UInt32 bytes, UInt64 durationNs)
+{
+    if (fStarted) {
+        io_user_reference_t args[3] = { messageID, bytes, durationNs };
+        sendAsyncResult64(request->asyncReference, status, args, 3);
+    }
+    
+    request->active = 0;
 }
 
 IOReturn MaschineMikroUserClient::clientClose()
 {
     fStarted = false;
+    if (fDriver) {
+        fDriver->unregisterCommandClient(this);
+        fDriver->releaseInputClient(this);
+    }
     fDriver = NULL;
     return kIOReturnSuccess;
 } 
\ No newline at end of file
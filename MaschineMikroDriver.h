@@ -16,6 +16,13 @@
 #include <IOKit/usb/USB.h>
 #include <CoreMIDI/MIDIServices.h>
 #include <mach/mach_time.h>
+#include "MaschineStatePage.h"
+#include "MaschineUSB.h"
+#include "MaschineCommandRing.h"
+#include "MaschineInputQueue.h"
+
+class IOBufferMemoryDescriptor;
+class MaschineMikroUserClient;
 
 // Maschine Mikro USB VID/PID constants
 #define MASCHINE_MIKRO_VID        0x17CC
@@ -27,6 +34,9 @@
 #define MASCHINE_MIKRO_EP_OUT     0x02
 #define MASCHINE_MIKRO_EP_SIZE    64
 
+// User clients whose command rings are drained as output transfers complete
+#define MASCHINE_COMMAND_CLIENTS  4
+
 // MIDI Constants
 #define MIDI_NOTE_OFF             0x80
 #define MIDI_NOTE_ON              0x90
@@ -50,6 +60,14 @@
 #define MASCHINE_MIKRO_CC_KNOB7   0x17
 #define MASCHINE_MIKRO_CC_KNOB8   0x18
 
+// LED and display SysEx: F0 00 20 3C 02 <command> <target/line> ... F7
+#define MASCHINE_MIKRO_CMD_LED        0x00
+#define MASCHINE_MIKRO_CMD_DISPLAY    0x01
+#define MASCHINE_MIKRO_LED_PAD        0x00
+#define MASCHINE_MIKRO_LED_BUTTON     0x01
+#define MASCHINE_MIKRO_DISPLAY_LINES  4
+#define MASCHINE_MIKRO_DISPLAY_TEXT   (MASCHINE_MIKRO_EP_SIZE / 4 * 3 - 8)  // one line per transfer (16 USB-MIDI packets)
+
 class MaschineMikroDriver : public IOService
 {
     OSDeclareDefaultStructors(MaschineMikroDriver);
@@ -73,26 +91,101 @@ private:
     UInt32                fDeviceID;
     
     // Buffer for USB transfers
-    UInt8                 fInputBuffer[MASCHINE_MIKRO_EP_SIZE];
     UInt8                 fOutputBuffer[MASCHINE_MIKRO_EP_SIZE];
     
-    // Work loop and timer for polling
+    // Input reads: preallocated buffers kept queued on fInPipe, resubmitted on completion
+    IOBufferMemoryDescriptor* fReadMemory;
+    IOMemoryDescriptor*   fReadDescriptors[MASCHINE_READ_PIPELINE_DEPTH];
+    IOUSBHostCompletion   fReadCompletions[MASCHINE_READ_PIPELINE_DEPTH];
+    MaschineReadPipeline  fReadPipeline;
+    UInt64                fReadTimestamp;
+    
+    // USB-MIDI event packets decoded from the current transfer, delivered with one MIDIReceived
+    MaschineUSBMIDIDecoder fInputDecoder;
+    MaschineMIDIBatch     fInputBatch;
+    MaschineStateSnapshot* fInputState;
+    Byte                  fPacketListBuffer[sizeof(MIDIPacketList) + MASCHINE_MIDI_BATCH_SIZE +
+                                            MASCHINE_MIDI_BATCH_SEGMENTS * (offsetof(MIDIPacket, data) + 4)];
+    
+    // Output: messages coalesced into full transfers over preallocated buffers
+    IOBufferMemoryDescriptor* fWriteMemory;
+    IOMemoryDescriptor*   fWriteDescriptors[MASCHINE_WRITE_QUEUE_DEPTH];
+    IOUSBHostCompletion   fWriteCompletions[MASCHINE_WRITE_QUEUE_DEPTH];
+    MaschineWriteQueue    fWriteQueue;
+    IORecursiveLock*      fWriteLock;
+    
+    // Large SysEx: pooled messages sent in endpoint-sized chunks, paced by write completions
+    UInt8*                fSysExPool;
+    IOBufferMemoryDescriptor* fChunkMemory;
+    IOMemoryDescriptor*   fChunkDescriptors[MASCHINE_SYSEX_WINDOW];
+    IOUSBHostCompletion   fChunkCompletions[MASCHINE_SYSEX_WINDOW];
+    MaschineSysExSender   fSysExSender;
+    
+    // Command rings with entries left over after a doorbell (guarded by fWriteLock)
+    MaschineMikroUserClient* fCommandClients[MASCHINE_COMMAND_CLIENTS];
+    
+    // Work loop and output flush deadline
     IOWorkLoop*           fWorkLoop;
-    IOTimerEventSource*   fTimer;
+    IOTimerEventSource*   fFlushTimer;
+    
+    // Live state page shared read-only with user clients (seqlock)
+    IOBufferMemoryDescriptor* fStatePageMemory;
+    MaschineStatePage*    fStatePage;
+    IOSimpleLock*         fStateLock;
+    
+    // Decoded input events for one user-space consumer, one notification per transfer.
+    // Only produced while a client is attached (mapped the queue or armed); fInputLock
+    // covers each transfer's produce step so attach/detach can reset the queue
+    IOBufferMemoryDescriptor* fInputQueueMemory;
+    MaschineInputQueue*   fInputQueue;
+    MaschineInputProducer fInputProducer;
+    IOLock*               fInputLock;
+    MaschineMikroUserClient* fInputClient;
+    bool                  fInputProducing;
+    OSAsyncReference64    fInputReference;
+    
+    // Transfer, decode and latency counters for kGetDeviceStatus
+    MaschineDeviceCounters fCounters;
     
     // Methods
     bool                  initializeDevice();
     bool                  initializeMIDI();
     void                  cleanupMIDI();
     void                  handleUSBData();
-    void                  sendMIDIMessage(UInt8 status, UInt8 data1, UInt8 data2);
-    void                  processMIDIInput(const UInt8* data, UInt32 length);
-    void                  timerFired(OSObject* owner, IOTimerEventSource* sender);
+    void                  queueMIDIMessage(MaschineStateSnapshot* state, const UInt8* message, UInt32 length);
+    static void           decodedMessage(void* context, uint8_t cable, const uint8_t* message, uint32_t length);
+    void                  deliverMIDIBatch();
+    void                  processMIDIInput(const UInt8* data, UInt32 length, UInt64 timestamp);
+    bool                  initializeStatePage();
+    void                  cleanupStatePage();
+    MaschineStateSnapshot* beginStateUpdate();
+    void                  endStateUpdate();
+    bool                  initializeInputQueue();
+    void                  cleanupInputQueue();
+    void                  notifyInputClient();
     
     // USB transfer methods
+    bool                  initializeReadPipeline();
+    void                  cleanupReadPipeline();
     IOReturn              startUSBRead();
     IOReturn              completeUSBRead(void* data, UInt32 length, IOReturn status);
-    IOReturn              sendUSBData(const UInt8* data, UInt32 length);
+    bool                  initializeWriteQueue();
+    void                  cleanupWriteQueue();
+    IOReturn              queueUSBData(const UInt8* data, UInt32 length);
+    void                  flushTimerFired(OSObject* owner, IOTimerEventSource* sender);
+    static int            submitWrite(void* context, int slot, uint32_t length);
+    static void           writeCompleted(void* owner, void* parameter, IOReturn status, uint32_t bytesTransferred);
+    bool                  initializeSysExSender();
+    void                  cleanupSysExSender();
+    static int            submitSysExChunk(void* context, int chunk, const uint8_t* data, uint32_t length);
+    static void           sysexChunkCompleted(void* owner, void* parameter, IOReturn status, uint32_t bytesTransferred);
+    static void           sysexDone(void* context, uint32_t id, MaschineSysExStatus status,
+                                    uint32_t bytes, uint64_t durationNs, void* reference);
+    static void           sysexExclusive(void* context, bool exclusive);
+    void                  drainCommandRings();
+    static void           readCompleted(void* owner, void* parameter, IOReturn status, uint32_t bytesTransferred);
+    static int            submitRead(void* context, int slot);
+    static void           deliverRead(void* context, const uint8_t* data, uint32_t length);
     
 public:
     // IOService overrides
@@ -111,7 +204,29 @@ public:
     void                  sendMIDIControlChange(UInt8 controller, UInt8 value, UInt8 channel = 0);
     void                  sendMIDIProgramChange(UInt8 program, UInt8 channel = 0);
     void                  sendMIDIPitchBend(UInt16 value, UInt8 channel = 0);
-    void                  sendMIDISysex(const UInt8* data, UInt32 length);
+    IOReturn              sendMIDISysex(const UInt8* data, UInt32 length, void* request = NULL, UInt32* messageID = NULL);
+    IOReturn              sendMIDIMessage(const UInt8* message, UInt32 length);
+    
+    // Device control over the batched output queue
+    IOReturn              setLED(UInt8 target, UInt8 index, UInt8 value);
+    IOReturn              setDisplay(UInt8 line, const UInt8* text, UInt32 length);
+    void                  getDeviceStatus(MaschineDeviceStatus* status) const { fCounters.snapshot(status); }
+    
+    // Batched output from user clients; drain under lockOutput() so rings and completions don't race
+    void                  lockOutput();
+    void                  unlockOutput();
+    bool                  registerCommandClient(MaschineMikroUserClient* client);
+    void                  unregisterCommandClient(MaschineMikroUserClient* client);
+    
+    // Shared memory for user clients
+    IOMemoryDescriptor*   getStatePageMemory() const { return (IOMemoryDescriptor*)fStatePageMemory; }
+    IOMemoryDescriptor*   getInputQueueMemory() const { return (IOMemoryDescriptor*)fInputQueueMemory; }
+    
+    // Input queue consumer: the first client to map it or arm owns it until it closes
+    IOReturn              attachInputClient(MaschineMikroUserClient* client);
+    IOReturn              armInputNotification(MaschineMikroUserClient* client, io_user_reference_t* asyncReference,
+                                               UInt32* pending);
+    void                  releaseInputClient(MaschineMikroUserClient* client);
 };
 
 // User client class for user space communication
@@ -124,6 +239,28 @@ private:
     task_t                fTask;
     bool                  fStarted;
     
+public:
+    // Pending asynchronous SysEx sends (see sysexCompleted)
+    struct SysExRequest {
+        MaschineMikroUserClient* client;
+        volatile UInt32   active;
+        OSAsyncReference64 asyncReference;
+    };
+    
+private:
+    SysExRequest          fSysExRequests[MASCHINE_SYSEX_POOL];
+    
+    // Shared command ring (read-write mapping) and the dispatcher feeding the output queue
+    IOBufferMemoryDescriptor* fCommandRingMemory;
+    MaschineCommandRing*  fCommandRing;
+    MaschineCommandDispatcher fDispatcher;
+    bool                  fDraining;
+    
+    SysExRequest*         reserveSysExRequest(io_user_reference_t* asyncReference);
+    bool                  initializeCommandRing();
+    void                  cleanupCommandRing();
+    static int            sendCommand(void* context, const uint8_t* message, uint32_t length);
+    
 public:
     virtual bool          initWithTask(task_t owningTask, void* securityToken, UInt32 type, OSDictionary* properties);
     virtual void          free();
@@ -136,6 +273,13 @@ public:
     virtual IOReturn      clientMemoryForType(UInt32 type, IOOptionBits* options, IOMemoryDescriptor** memory);
     virtual IOReturn      clientClose();
     
+    // Called by the driver when an asynchronous SysEx send finishes
+    void                  sysexCompleted(SysExRequest* request, UInt32 messageID, IOReturn status,
+                                         UInt32 bytes, UInt64 durationNs);
+    
+    // Called by the driver with the output lock held; returns the entries still pending
+    UInt32                drainCommandRing(UInt32* consumed = NULL);
+    
     // External method selectors
     enum {
         kSendMIDINoteOn = 0,
@@ -146,7 +290,17 @@ public:
         kSendMIDISysex,
         kGetDeviceStatus,
         kSetLED,
-        kSetDisplay
+        kSetDisplay,
+        kSendMIDIBatch,
+        kRingDoorbell,
+        kArmInputNotification
+    };
+    
+    // clientMemoryForType memory types
+    enum {
+        kStatePageMemory = MASCHINE_STATE_PAGE_TYPE,
+        kCommandRingMemory = MASCHINE_COMMAND_RING_TYPE,
+        kInputQueueMemory = MASCHINE_INPUT_QUEUE_TYPE
     };
 };
 
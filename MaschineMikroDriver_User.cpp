@@ -2,6 +2,58 @@
 #include <iostream>
 #include <thread>
 #include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <fstream>
+#include <cstdlib>
+#include <cerrno>
+#include <mach/mach_time.h>
+
+// Convierte host time de CoreMIDI a nanosegundos (0 significa "ahora")
+static uint64_t hostTimeToNanos(MIDITimeStamp timeStamp) {
+    static mach_timebase_info_data_t timebase = { 0, 0 };
+    if (timebase.denom == 0) {
+        mach_timebase_info(&timebase);
+    }
+    if (timeStamp == 0) {
+        timeStamp = mach_absolute_time();
+    }
+    return timeStamp * timebase.numer / timebase.denom;
+}
+
+// Referencia para el tiempo de conexión desde el arranque del proceso
+static const uint64_t processStartNs = hostTimeToNanos(0);
+
+// Refresco de la página de estado desde el bucle de eventos (50 Hz)
+static const uint64_t statePageIntervalNs = 20000000ULL;
+
+// Posiciones dentro del SysEx NI: F0 00 20 3C <dispositivo> <comando> <datos...> F7
+#define MASCHINE_SYSEX_COMMAND 5
+#define MASCHINE_SYSEX_DATA    6
+
+// Byte de datos del SysEx en esa posición, o fallback si no llega (el F7 final no es un dato)
+static int sysexData(const MIDIPacket* packet, int index, int fallback) {
+    if (packet->length > index && !(packet->data[index] & 0x80)) return packet->data[index];
+    return fallback;
+}
+
+// Reloj por defecto: host time de CoreMIDI y esperas reales
+class MaschineHostClock : public MaschineClock {
+public:
+    virtual uint64_t now() { return hostTimeToNanos(0); }
+    virtual void sleepFor(uint64_t ns) { std::this_thread::sleep_for(std::chrono::nanoseconds(ns)); }
+    virtual void waitUntil(std::unique_lock<std::mutex>& lock, std::condition_variable& condition,
+                           uint64_t deadlineNs) {
+        uint64_t nowNs = now();
+        if (deadlineNs == UINT64_MAX) {
+            condition.wait(lock);
+        } else if (deadlineNs > nowNs) {
+            condition.wait_for(lock, std::chrono::nanoseconds(deadlineNs - nowNs));
+        }
+    }
+};
+
+static MaschineHostClock hostClock;
 
 MaschineMikroDriverUser::MaschineMikroDriverUser() {
     maschineSoftwareConnected = false;
@@ -10,22 +62,66 @@ MaschineMikroDriverUser::MaschineMikroDriverUser() {
     midiOutPort = NULL;
     midiInPort = NULL;
     numDestinations = 0;
+    deviceConnected = false;
+    deviceSource = 0;
+    deviceUniqueID = 0;
+    deviceEverConnected = false;
+    plugNoticedNs = 0;
+    startupProfiling = false;
+    firstEventSeen = false;
+    logLevel = MASCHINE_LOG_EVENTS;
+    for (int i = 0; i < NUM_PADS; ++i) {
+        padMap[i] = (uint8_t)i;
+    }
+    for (int i = 0; i < NUM_BUTTONS; ++i) {
+        buttonMap[i] = (uint8_t)i;
+    }
+    schedulerPriority = 0;
+    encoderPriority = 0;
+    clock = &hostClock;
+    maschineInput = false;
+    clockSlaveMode = false;
+    playStartNs = 0;
+    playStartTick = 0.0;
+    positionTempo = 120.0;
+    quantizeMode = false;
+    schedulerRunning = false;
+    schedulerWake = false;
+    automationPlayback = false;
+    automationControlRate = 100;
+    automationThinTolerance = 0;
+    debugCommands = false;
+    commandsSent = 0;
+    statePageDirty = false;
+    statePageTimer = 0;
+    encoderFlushRunning = false;
+    encoderReadyCount = 0;
+    padEventCount = 0;
+    buttonEventCount = 0;
+    encoderEventCount = 0;
+    midiMessagesIn = 0;
+    midiMessagesOut = 0;
     initializeMaschineState();
 }
 
 MaschineMikroDriverUser::~MaschineMikroDriverUser() {
+    stopScheduler();
+    stopEncoderFlush();
+    stopEventServer();
     disconnectDevice();
 }
 
 bool MaschineMikroDriverUser::initialize() {
     std::cout << "[Maschine] Inicializando driver en modo Maschine nativo..." << std::endl;
     
-    // Inicializar CoreMIDI
-    OSStatus status = MIDIClientCreate(CFSTR("Maschine Mikro Driver"), NULL, NULL, &midiClient);
+    // Inicializar CoreMIDI; las altas y bajas de dispositivos llegan a midiNotifyProc
+    OSStatus status = MIDIClientCreate(CFSTR("Maschine Mikro Driver"), &MaschineMikroDriverUser::midiNotifyProc,
+                                       this, &midiClient);
     if (status != noErr) {
         std::cout << "[Error] No se pudo crear cliente MIDI: " << status << std::endl;
         return false;
     }
+    markStartup("cliente MIDI");
     
     // Crear puerto de salida MIDI
     status = MIDIOutputPortCreate(midiClient, CFSTR("Maschine Output"), &midiOutPort);
@@ -33,13 +129,25 @@ bool MaschineMikroDriverUser::initialize() {
         std::cout << "[Error] No se pudo crear puerto de salida MIDI: " << status << std::endl;
         return false;
     }
+    markStartup("puerto de salida");
     
-    // Encontrar destinos MIDI
-    numDestinations = MIDIGetNumberOfDestinations();
+    // Solo las referencias: los nombres (conversión de CFString) se piden en modo debug
+    refreshDestinations(debugCommands);
     std::cout << "[Maschine] Destinos MIDI encontrados: " << numDestinations << std::endl;
+    markStartup("destinos");
     
-    for (int i = 0; i < numDestinations && i < 10; ++i) {
+    return true;
+}
+
+void MaschineMikroDriverUser::refreshDestinations(bool printNames) {
+    ItemCount count = MIDIGetNumberOfDestinations();
+    numDestinations = (int)std::min<ItemCount>(count, 10);
+    
+    for (int i = 0; i < numDestinations; ++i) {
         midiDestinations[i] = MIDIGetDestination(i);
+        if (!printNames) {
+            continue;
+        }
         CFStringRef name;
         MIDIObjectGetStringProperty(midiDestinations[i], kMIDIPropertyName, &name);
         char nameStr[256];
@@ -47,13 +155,36 @@ bool MaschineMikroDriverUser::initialize() {
         std::cout << "[Maschine] Destino " << i << ": " << nameStr << std::endl;
         CFRelease(name);
     }
-    
-    return true;
 }
 
 bool MaschineMikroDriverUser::connectDevice() {
     std::cout << "[Maschine] Conectando dispositivo Maschine Mikro..." << std::endl;
     
+    std::lock_guard<std::mutex> lock(deviceMutex);
+    if (findDeviceSource()) {
+        return true;
+    }
+    
+    // Sin dispositivo no es un error: se conectará al enchufarlo
+    std::cout << "[Warning] No se encontró dispositivo Maschine Mikro Input" << std::endl;
+    std::cout << "[Maschine] Esperando a que se conecte el dispositivo..." << std::endl;
+    return true;
+}
+
+bool MaschineMikroDriverUser::findDeviceSource() {
+    // Camino rápido: el endpoint de la sesión anterior, una sola búsqueda
+    MIDIUniqueID cached = loadCachedEndpoint();
+    if (cached != 0) {
+        MIDIObjectRef object = 0;
+        MIDIObjectType type;
+        if (MIDIObjectFindByUniqueID(cached, &object, &type) == noErr && object != 0 &&
+            type == kMIDIObjectType_Source && isSourceOnline((MIDIEndpointRef)object) &&
+            connectSource((MIDIEndpointRef)object, "Maschine Mikro Input (caché)")) {
+            markStartup("fuente (caché)");
+            return true;
+        }
+    }
+    
     // Buscar dispositivo Maschine Mikro usando la misma lógica que Rebellion
     ItemCount numSources = MIDIGetNumberOfSources();
     std::cout << "[Maschine] Fuentes MIDI encontradas: " << numSources << std::endl;
@@ -61,56 +192,208 @@ bool MaschineMikroDriverUser::connectDevice() {
     for (ItemCount i = 0; i < numSources; ++i) {
         MIDIEndpointRef source = MIDIGetSource(i);
         CFStringRef name;
-        MIDIObjectGetStringProperty(source, kMIDIPropertyName, &name);
-        char nameStr[256];
-        CFStringGetCString(name, nameStr, sizeof(nameStr), kCFStringEncodingUTF8);
+        if (MIDIObjectGetStringProperty(source, kMIDIPropertyName, &name) != noErr) {
+            continue;
+        }
+        
+        // Se compara sobre el CFString; solo se convierte a UTF-8 lo que se imprime
+        bool isMikro = CFStringFind(name, CFSTR("Maschine Mikro Input"), 0).location != kCFNotFound;
+        char nameStr[256] = "";
+        if (isMikro || debugCommands) {
+            CFStringGetCString(name, nameStr, sizeof(nameStr), kCFStringEncodingUTF8);
+        }
+        CFRelease(name);
         
-        std::cout << "[Maschine] Dispositivo encontrado: " << nameStr << std::endl;
+        if (debugCommands) {
+            std::cout << "[Maschine] Dispositivo encontrado: " << nameStr << std::endl;
+        }
         
         // Buscar específicamente "Maschine Mikro Input"
-        if (strstr(nameStr, "Maschine Mikro Input")) {
+        if (isMikro && isSourceOnline(source)) {
             std::cout << "[Maschine] ¡Maschine Mikro encontrada!" << std::endl;
-            
-            // Crear puerto de entrada MIDI
-            OSStatus status = MIDIInputPortCreate(midiClient, CFSTR("Maschine Input"), 
-                [](const MIDIPacketList *pktlist, void *readProcRefCon, void *srcConnRefCon) {
-                    MaschineMikroDriverUser* driver = static_cast<MaschineMikroDriverUser*>(readProcRefCon);
-                    driver->handleMIDIInput(pktlist);
-                }, this, &midiInPort);
-            
-            if (status != noErr) {
-                std::cout << "[Error] No se pudo crear puerto de entrada MIDI: " << status << std::endl;
-                CFRelease(name);
-                continue;
+            if (connectSource(source, nameStr)) {
+                saveCachedEndpoint(deviceUniqueID);
+                markStartup("fuente (búsqueda)");
+                return true;
             }
-            
-            // Conectar fuente MIDI
-            status = MIDIPortConnectSource(midiInPort, source, NULL);
-            if (status != noErr) {
-                std::cout << "[Error] No se pudo conectar fuente MIDI: " << status << std::endl;
-                CFRelease(name);
-                continue;
-            }
-            
-            std::cout << "[Maschine] ✅ Conectado a: " << nameStr << std::endl;
-            CFRelease(name);
-            return true;
         }
-        CFRelease(name);
     }
     
-    std::cout << "[Warning] No se encontró dispositivo Maschine Mikro Input" << std::endl;
-    std::cout << "[Maschine] Usando modo simulación para inputs" << std::endl;
+    return false;
+}
+
+bool MaschineMikroDriverUser::connectSource(MIDIEndpointRef source, const char* name) {
+    // El puerto de entrada se crea una vez y sobrevive a las reconexiones
+    if (!midiInPort) {
+        OSStatus status = MIDIInputPortCreate(midiClient, CFSTR("Maschine Input"), 
+            [](const MIDIPacketList *pktlist, void *readProcRefCon, void *srcConnRefCon) {
+                MaschineMikroDriverUser* driver = static_cast<MaschineMikroDriverUser*>(readProcRefCon);
+                driver->handleMIDIInput(pktlist);
+            }, this, &midiInPort);
+        
+        if (status != noErr) {
+            std::cout << "[Error] No se pudo crear puerto de entrada MIDI: " << status << std::endl;
+            midiInPort = NULL;
+            return false;
+        }
+    }
+    
+    // Conectar fuente MIDI
+    OSStatus status = MIDIPortConnectSource(midiInPort, source, NULL);
+    if (status != noErr) {
+        std::cout << "[Error] No se pudo conectar fuente MIDI: " << status << std::endl;
+        return false;
+    }
+    
+    SInt32 uniqueID = 0;
+    MIDIObjectGetIntegerProperty(source, kMIDIPropertyUniqueID, &uniqueID);
+    deviceSource = source;
+    deviceUniqueID = uniqueID;
+    deviceConnected = true;
+    
+    // El destino del dispositivo también es nuevo tras enchufarlo
+    refreshDestinations(false);
+    
+    uint64_t now = hostTimeToNanos(0);
+    std::cout << "[Maschine] ✅ Conectado a: " << name << " ("
+              << (now - processStartNs) / 1000000.0 << " ms desde el arranque";
+    if (plugNoticedNs != 0) {
+        std::cout << ", " << (now - plugNoticedNs) / 1000000.0 << " ms desde el aviso de CoreMIDI";
+    }
+    std::cout << ")" << std::endl;
+    
+    if (deviceEverConnected) {
+        restoreDeviceState();
+    }
+    deviceEverConnected = true;
+    markStatePageDirty();
     return true;
 }
 
+bool MaschineMikroDriverUser::isSourceOnline(MIDIEndpointRef source) {
+    // Un dispositivo USB desenchufado suele quedar en la configuración como "offline"
+    SInt32 offline = 0;
+    if (MIDIObjectGetIntegerProperty(source, kMIDIPropertyOffline, &offline) != noErr) {
+        // Sin la propiedad (p. ej. fuentes virtuales) se da por conectado
+        return true;
+    }
+    return offline == 0;
+}
+
+void MaschineMikroDriverUser::midiNotifyProc(const MIDINotification* notification, void* refCon) {
+    static_cast<MaschineMikroDriverUser*>(refCon)->handleMIDINotification(notification);
+}
+
+void MaschineMikroDriverUser::handleMIDINotification(const MIDINotification* notification) {
+    std::lock_guard<std::mutex> lock(deviceMutex);
+    switch (notification->messageID) {
+        case kMIDIMsgObjectRemoved: {
+            const MIDIObjectAddRemoveNotification* change = (const MIDIObjectAddRemoveNotification*)notification;
+            if (deviceConnected && change->child == deviceSource) {
+                deviceRemoved();
+            }
+            break;
+        }
+        
+        case kMIDIMsgObjectAdded:
+        case kMIDIMsgSetupChanged:
+            if (deviceConnected) {
+                // Desenchufar un dispositivo USB lo marca offline sin eliminarlo
+                if (!isSourceOnline(deviceSource)) {
+                    deviceRemoved();
+                }
+                refreshDestinations(false);
+            } else {
+                plugNoticedNs = hostTimeToNanos(0);
+                findDeviceSource();
+                plugNoticedNs = 0;
+            }
+            break;
+    }
+}
+
+void MaschineMikroDriverUser::deviceRemoved() {
+    if (midiInPort && deviceSource) {
+        MIDIPortDisconnectSource(midiInPort, deviceSource);
+    }
+    deviceSource = 0;
+    deviceConnected = false;
+    
+    std::cout << "[Warning] Maschine Mikro desconectada; esperando reconexión..." << std::endl;
+    markStatePageDirty();
+}
+
+void MaschineMikroDriverUser::restoreDeviceState() {
+    // Tras reconectar, el dispositivo arranca sin nuestro estado
+    sendLEDState();
+    std::cout << "[Maschine] LEDs restaurados tras la reconexión" << std::endl;
+    setMaschineMode(maschineState.currentMode);
+}
+
+void MaschineMikroDriverUser::sendLEDState() {
+    // LEDs de pads y botones en una sola lista de paquetes
+    Byte buffer[1024];
+    MIDIPacketList* packetList = (MIDIPacketList*)buffer;
+    MIDIPacket* packet = MIDIPacketListInit(packetList);
+    for (int i = 0; i < 16 + 8 && packet; ++i) {
+        bool pad = i < 16;
+        int index = pad ? i : i - 16;
+        bool state = pad ? maschineState.padLEDs[index] : maschineState.buttonLEDs[index];
+        Byte sysex[10] = { 0xF0, 0x00, 0x20, 0x3C, 0x02, 0x00, (Byte)(pad ? 0x00 : 0x01),
+                           (Byte)index, (Byte)(state ? 0x7F : 0x00), 0xF7 };
+        packet = MIDIPacketListAdd(packetList, sizeof(buffer), packet, 0, sizeof(sysex), sysex);
+    }
+    
+    if (packet) {
+        sendPacketList(packetList);
+        midiMessagesOut += 16 + 8;
+    }
+}
+
+void MaschineMikroDriverUser::refreshLEDs() {
+    // Refresco periódico del daemon: recupera LEDs perdidos sin esperar a
+    // una reconexión
+    if (deviceConnected) {
+        sendLEDState();
+    }
+}
+
+MIDIUniqueID MaschineMikroDriverUser::loadCachedEndpoint() {
+    const char* home = getenv("HOME");
+    if (!home) {
+        return 0;
+    }
+    
+    std::ifstream file(std::string(home) + "/" + MASCHINE_ENDPOINT_CACHE);
+    long long uniqueID = 0;
+    if (!(file >> uniqueID)) {
+        return 0;
+    }
+    return (MIDIUniqueID)uniqueID;
+}
+
+void MaschineMikroDriverUser::saveCachedEndpoint(MIDIUniqueID uniqueID) {
+    const char* home = getenv("HOME");
+    if (!home || uniqueID == 0 || uniqueID == loadCachedEndpoint()) {
+        return;
+    }
+    
+    std::ofstream file(std::string(home) + "/" + MASCHINE_ENDPOINT_CACHE, std::ios::trunc);
+    if (file) {
+        file << uniqueID << std::endl;
+    }
+}
+
 void MaschineMikroDriverUser::disconnectDevice() {
     std::cout << "[Maschine] Desconectando dispositivo..." << std::endl;
     
+    std::lock_guard<std::mutex> lock(deviceMutex);
     if (midiInPort) {
         MIDIPortDispose(midiInPort);
         midiInPort = NULL;
     }
+    deviceSource = 0;
+    deviceConnected = false;
     
     if (midiOutPort) {
         MIDIPortDispose(midiOutPort);
@@ -124,10 +407,25 @@ void MaschineMikroDriverUser::disconnectDevice() {
 }
 
 void MaschineMikroDriverUser::handleMIDIInput(const MIDIPacketList* packetList) {
+    if (startupProfiling && !firstEventSeen.exchange(true)) {
+        markStartup("primer evento");
+        printStartupProfile();
+    }
+    
     const MIDIPacket* packet = &packetList->packet[0];
+    midiMessagesIn += packetList->numPackets;
     
     for (int i = 0; i < packetList->numPackets; ++i) {
-        if (packet->length >= 3) {
+        if (packet->length >= 1 && packet->data[0] >= MIDI_TIMING_CLOCK) {
+            // Mensajes de tiempo real (1 byte): reloj, start, continue, stop
+            for (int b = 0; b < packet->length; ++b) {
+                handleMIDIClock(packet->data[b], packet->timeStamp);
+            }
+        } else if (packet->length >= 3 && packet->data[0] == MIDI_SONG_POSITION) {
+            if (clockSlaveMode) {
+                clockTracker.setSongPosition(packet->data[1] | (packet->data[2] << 7));
+            }
+        } else if (packet->length >= 3) {
             unsigned char status = packet->data[0];
             unsigned char data1 = packet->data[1];
             unsigned char data2 = packet->data[2];
@@ -143,37 +441,60 @@ void MaschineMikroDriverUser::handleMIDIInput(const MIDIPacketList* packetList)
                 // Note On - posible input de pad
                 if (data2 > 0) {
                     if (data1 >= 36 && data1 <= 51) {
-                        int pad = data1 - 36;
-                        std::cout << "🥁 PAD " << pad << " presionado (velocity: " << (int)data2 << ")" << std::endl;
-                        handlePadPress(pad, data2);
+                        int pad = padMap[data1 - 36];
+                        if (logEvents()) std::cout << "🥁 PAD " << pad << " presionado (velocity: " << (int)data2 << ")" << std::endl;
+                        if (maschineInput) {
+                            handlePadPressMaschine(pad, data2);
+                        } else {
+                            handlePadPress(pad, data2);
+                        }
                     }
                 }
             } else if ((status & 0xF0) == 0x80) {
                 // Note Off - liberación de pad
                 if (data1 >= 36 && data1 <= 51) {
-                    int pad = data1 - 36;
-                    std::cout << "🥁 PAD " << pad << " liberado" << std::endl;
-                    handlePadRelease(pad);
+                    int pad = padMap[data1 - 36];
+                    if (logEvents()) std::cout << "🥁 PAD " << pad << " liberado" << std::endl;
+                    if (maschineInput) {
+                        handlePadReleaseMaschine(pad);
+                    } else {
+                        handlePadRelease(pad);
+                    }
                 }
             } else if ((status & 0xF0) == 0xB0) {
                 // Control Change - botones y encoders
                 if (data1 >= 16 && data1 <= 23) {
-                    int button = data1 - 16;
+                    int button = buttonMap[data1 - 16];
                     if (data2 > 0) {
-                        std::cout << "🔘 BOTÓN " << button << " presionado (value: " << (int)data2 << ")" << std::endl;
-                        handleButtonPress(button, data2);
+                        if (logEvents()) std::cout << "🔘 BOTÓN " << button << " presionado (value: " << (int)data2 << ")" << std::endl;
+                        if (maschineInput) {
+                            // SHIFT + SELECT es el tap tempo: cuenta el instante
+                            // del paquete, no el de este hilo
+                            uint64_t eventNs = packet->timeStamp ? hostTimeToNanos(packet->timeStamp) : clock->now();
+                            handleButtonPressMaschine(button, eventNs);
+                        } else {
+                            handleButtonPress(button, data2);
+                        }
                     } else {
-                        std::cout << "🔘 BOTÓN " << button << " liberado" << std::endl;
-                        handleButtonRelease(button);
+                        if (logEvents()) std::cout << "🔘 BOTÓN " << button << " liberado" << std::endl;
+                        if (maschineInput) {
+                            handleButtonReleaseMaschine(button);
+                        } else {
+                            handleButtonRelease(button);
+                        }
                     }
                 } else if (data1 >= 24 && data1 <= 25) {
                     int encoder = data1 - 24;
-                    std::cout << "🎛️ ENCODER " << encoder << " girado (value: " << (int)data2 << ")" << std::endl;
-                    handleEncoderTurn(encoder, data2);
+                    if (logEvents()) std::cout << "🎛️ ENCODER " << encoder << " girado (value: " << (int)data2 << ")" << std::endl;
+                    if (maschineInput) {
+                        handleEncoderTurnMaschine(encoder, data2 > 64 ? 1 : -1);
+                    } else {
+                        handleEncoderTurn(encoder, data2);
+                    }
                 }
             } else {
                 // Otros mensajes MIDI
-                std::cout << "📥 MIDI: " << std::hex << (int)status << " " << (int)data1 << " " << (int)data2 << std::dec << std::endl;
+                if (logEvents()) std::cout << "📥 MIDI: " << std::hex << (int)status << " " << (int)data1 << " " << (int)data2 << std::dec << std::endl;
             }
         }
         
@@ -181,15 +502,65 @@ void MaschineMikroDriverUser::handleMIDIInput(const MIDIPacketList* packetList)
     }
 }
 
+void MaschineMikroDriverUser::handleMIDIClock(unsigned char status, MIDITimeStamp timeStamp) {
+    if (!clockSlaveMode) {
+        return;
+    }
+    
+    switch (status) {
+        case MIDI_TIMING_CLOCK:
+            // Sin timestamp (inyectado) cuenta la hora del reloj del driver
+            clockTracker.clockTick(timeStamp ? hostTimeToNanos(timeStamp) : clock->now());
+            // La posición esclava avanza con cada pulso: el planificador la sigue
+            if (schedulerRunning) {
+                wakeScheduler();
+            }
+            if (clockTracker.isLocked()) {
+                // Un maestro fuera de rango deja el tempo en el límite
+                double bpm = std::min(std::max(clockTracker.getTempo(), MASCHINE_MIN_TEMPO), MASCHINE_MAX_TEMPO);
+                // Solo propagar cambios de al menos 0.1 BPM
+                if (std::fabs(bpm - maschineState.tempo) >= 0.1) {
+                    setTempo(bpm);
+                }
+            }
+            break;
+        case MIDI_CLOCK_START:
+            if (logEvents()) std::cout << "⏱️ Reloj MIDI: Start" << std::endl;
+            clockTracker.start();
+            play();
+            break;
+        case MIDI_CLOCK_CONTINUE:
+            if (logEvents()) std::cout << "⏱️ Reloj MIDI: Continue" << std::endl;
+            clockTracker.resume();
+            play();
+            break;
+        case MIDI_CLOCK_STOP:
+            if (logEvents()) std::cout << "⏱️ Reloj MIDI: Stop" << std::endl;
+            clockTracker.stop();
+            stop();
+            break;
+        default:
+            // Active sensing / reset: ignorados
+            break;
+    }
+}
+
 void MaschineMikroDriverUser::handleMaschineSysEx(const MIDIPacket* packet) {
-    // Analizar SysEx específico de Maschine Mikro MK1
-    if (packet->length >= 4) {
-        unsigned char manufacturer = packet->data[1];
-        unsigned char deviceId = packet->data[2];
-        unsigned char command = packet->data[3];
+    // SysEx de la Maschine Mikro MK1, con la misma cabecera que los de LED:
+    // F0 00 20 3C <dispositivo> <comando> <datos...> F7
+    if (packet->length > MASCHINE_SYSEX_COMMAND) {
+        const unsigned char* data = packet->data;
+        if (data[1] != 0x00 || data[2] != 0x20 || data[3] != 0x3C) {
+            if (logEvents()) std::cout << "🎹 SysEx de otro fabricante ignorado" << std::endl;
+            return;
+        }
+        unsigned char deviceId = data[4];
+        unsigned char command = data[MASCHINE_SYSEX_COMMAND];
         
-        std::cout << "🎹 SysEx MK1: Manufacturer=" << std::hex << (int)manufacturer 
-                  << " Device=" << (int)deviceId << " Command=" << (int)command << std::dec << std::endl;
+        if (logEvents()) {
+            std::cout << "🎹 SysEx MK1: Device=" << std::hex << (int)deviceId
+                      << " Command=" << (int)command << std::dec << std::endl;
+        }
         
         // Procesar comandos específicos de Maschine
         switch (command) {
@@ -209,7 +580,7 @@ void MaschineMikroDriverUser::handleMaschineSysEx(const MIDIPacket* packet) {
                 handleEncoderInput(packet);
                 break;
             default:
-                std::cout << "🎹 SysEx desconocido: " << std::hex << (int)command << std::dec << std::endl;
+                if (logEvents()) std::cout << "🎹 SysEx desconocido: " << std::hex << (int)command << std::dec << std::endl;
                 break;
         }
     }
@@ -221,7 +592,7 @@ void MaschineMikroDriverUser::handleMaschineStatus(const MIDIPacket* packet) {
         unsigned char data1 = packet->data[1];
         unsigned char data2 = packet->data[2];
         
-        std::cout << "🎹 Status MK1: " << std::hex << (int)data1 << " " << (int)data2 << std::dec << std::endl;
+        if (logEvents()) std::cout << "🎹 Status MK1: " << std::hex << (int)data1 << " " << (int)data2 << std::dec << std::endl;
         
         // Interpretar estados específicos
         if (data1 == 0x10) {
@@ -235,32 +606,32 @@ void MaschineMikroDriverUser::handleMaschineStatus(const MIDIPacket* packet) {
 }
 
 void MaschineMikroDriverUser::handleDeviceStatus(const MIDIPacket* packet) {
-    std::cout << "🎹 Estado del dispositivo recibido" << std::endl;
+    if (logEvents()) std::cout << "🎹 Estado del dispositivo recibido" << std::endl;
     // Actualizar estado interno del dispositivo
     deviceConnected = true;
 }
 
 void MaschineMikroDriverUser::handleDeviceConfig(const MIDIPacket* packet) {
-    std::cout << "🎹 Configuración del dispositivo recibida" << std::endl;
+    if (logEvents()) std::cout << "🎹 Configuración del dispositivo recibida" << std::endl;
     // Procesar configuración
 }
 
 void MaschineMikroDriverUser::handlePadInput(const MIDIPacket* packet) {
-    if (packet->length >= 5) {
-        int pad = packet->data[4];
-        int velocity = (packet->length >= 6) ? packet->data[5] : 127;
+    int pad = sysexData(packet, MASCHINE_SYSEX_DATA, -1);
+    if (pad >= 0) {
+        int velocity = sysexData(packet, MASCHINE_SYSEX_DATA + 1, 127);
         
-        std::cout << "🥁 PAD " << pad << " (SysEx) - velocity: " << velocity << std::endl;
+        if (logEvents()) std::cout << "🥁 PAD " << pad << " (SysEx) - velocity: " << velocity << std::endl;
         handlePadPress(pad, velocity);
     }
 }
 
 void MaschineMikroDriverUser::handleButtonInput(const MIDIPacket* packet) {
-    if (packet->length >= 5) {
-        int button = packet->data[4];
-        int value = (packet->length >= 6) ? packet->data[5] : 127;
+    int button = sysexData(packet, MASCHINE_SYSEX_DATA, -1);
+    if (button >= 0) {
+        int value = sysexData(packet, MASCHINE_SYSEX_DATA + 1, 127);
         
-        std::cout << "🔘 BOTÓN " << button << " (SysEx) - value: " << value << std::endl;
+        if (logEvents()) std::cout << "🔘 BOTÓN " << button << " (SysEx) - value: " << value << std::endl;
         if (value > 0) {
             handleButtonPress(button, value);
         } else {
@@ -270,27 +641,27 @@ void MaschineMikroDriverUser::handleButtonInput(const MIDIPacket* packet) {
 }
 
 void MaschineMikroDriverUser::handleEncoderInput(const MIDIPacket* packet) {
-    if (packet->length >= 5) {
-        int encoder = packet->data[4];
-        int value = (packet->length >= 6) ? packet->data[5] : 64;
+    int encoder = sysexData(packet, MASCHINE_SYSEX_DATA, -1);
+    if (encoder >= 0) {
+        int value = sysexData(packet, MASCHINE_SYSEX_DATA + 1, 64);
         
-        std::cout << "🎛️ ENCODER " << encoder << " (SysEx) - value: " << value << std::endl;
+        if (logEvents()) std::cout << "🎛️ ENCODER " << encoder << " (SysEx) - value: " << value << std::endl;
         handleEncoderTurn(encoder, value);
     }
 }
 
 void MaschineMikroDriverUser::handleButtonStatus(unsigned char status) {
-    std::cout << "🔘 Estado de botones: " << std::hex << (int)status << std::dec << std::endl;
+    if (logEvents()) std::cout << "🔘 Estado de botones: " << std::hex << (int)status << std::dec << std::endl;
     // Procesar estado de botones
 }
 
 void MaschineMikroDriverUser::handlePadStatus(int pad, unsigned char status) {
-    std::cout << "🥁 Estado de pad " << pad << ": " << std::hex << (int)status << std::dec << std::endl;
+    if (logEvents()) std::cout << "🥁 Estado de pad " << pad << ": " << std::hex << (int)status << std::dec << std::endl;
     // Procesar estado de pad
 }
 
 void MaschineMikroDriverUser::handlePadPress(int pad, int velocity) {
-    std::cout << "🎹 PAD " << pad << " presionado en modo Maschine (velocity: " << velocity << ")" << std::endl;
+    if (logEvents()) std::cout << "🎹 PAD " << pad << " presionado en modo Maschine (velocity: " << velocity << ")" << std::endl;
     
     // Actualizar estado interno
     if (pad >= 0 && pad < NUM_PADS) {
@@ -301,22 +672,22 @@ void MaschineMikroDriverUser::handlePadPress(int pad, int velocity) {
     // Lógica específica de Maschine
     switch (pad) {
         case 0: // Pad 0 - Group A
-            std::cout << "🎹 Activando Group A" << std::endl;
+            if (logEvents()) std::cout << "🎹 Activando Group A" << std::endl;
             break;
         case 1: // Pad 1 - Group B
-            std::cout << "🎹 Activando Group B" << std::endl;
+            if (logEvents()) std::cout << "🎹 Activando Group B" << std::endl;
             break;
         case 2: // Pad 2 - Group C
-            std::cout << "🎹 Activando Group C" << std::endl;
+            if (logEvents()) std::cout << "🎹 Activando Group C" << std::endl;
             break;
         case 3: // Pad 3 - Group D
-            std::cout << "🎹 Activando Group D" << std::endl;
+            if (logEvents()) std::cout << "🎹 Activando Group D" << std::endl;
             break;
         default:
             // Pads 4-15 son sonidos
             int sound = pad - 4;
             if (sound >= 0 && sound < NUM_SOUNDS) {
-                std::cout << "🎹 Sonido " << sound << " activado" << std::endl;
+                if (logEvents()) std::cout << "🎹 Sonido " << sound << " activado" << std::endl;
                 maschineState.currentSound = sound;
             }
             break;
@@ -324,7 +695,7 @@ void MaschineMikroDriverUser::handlePadPress(int pad, int velocity) {
 }
 
 void MaschineMikroDriverUser::handlePadRelease(int pad) {
-    std::cout << "🎹 PAD " << pad << " liberado en modo Maschine" << std::endl;
+    if (logEvents()) std::cout << "🎹 PAD " << pad << " liberado en modo Maschine" << std::endl;
     
     // Actualizar estado interno
     if (pad >= 0 && pad < NUM_PADS) {
@@ -334,7 +705,7 @@ void MaschineMikroDriverUser::handlePadRelease(int pad) {
 }
 
 void MaschineMikroDriverUser::handleButtonPress(int button, int value) {
-    std::cout << "🎹 BOTÓN " << button << " presionado en modo Maschine (value: " << value << ")" << std::endl;
+    if (logEvents()) std::cout << "🎹 BOTÓN " << button << " presionado en modo Maschine (value: " << value << ")" << std::endl;
     
     // Actualizar estado interno
     if (button >= 0 && button < NUM_BUTTONS) {
@@ -344,37 +715,37 @@ void MaschineMikroDriverUser::handleButtonPress(int button, int value) {
     // Lógica específica de Maschine
     switch (button) {
         case 0: // Shift
-            std::cout << "🎹 Shift activado" << std::endl;
+            if (logEvents()) std::cout << "🎹 Shift activado" << std::endl;
             maschineState.shiftPressed = true;
             break;
         case 1: // Select
-            std::cout << "🎹 Select activado" << std::endl;
+            if (logEvents()) std::cout << "🎹 Select activado" << std::endl;
             break;
         case 2: // Solo
-            std::cout << "🎹 Solo activado" << std::endl;
+            if (logEvents()) std::cout << "🎹 Solo activado" << std::endl;
             break;
         case 3: // Mute
-            std::cout << "🎹 Mute activado" << std::endl;
+            if (logEvents()) std::cout << "🎹 Mute activado" << std::endl;
             break;
         case 4: // Play
-            std::cout << "🎹 Play activado" << std::endl;
+            if (logEvents()) std::cout << "🎹 Play activado" << std::endl;
             maschineState.isPlaying = !maschineState.isPlaying;
             break;
         case 5: // Record
-            std::cout << "🎹 Record activado" << std::endl;
+            if (logEvents()) std::cout << "🎹 Record activado" << std::endl;
             maschineState.isRecording = !maschineState.isRecording;
             break;
         case 6: // Erase
-            std::cout << "🎹 Erase activado" << std::endl;
+            if (logEvents()) std::cout << "🎹 Erase activado" << std::endl;
             break;
         case 7: // Automation
-            std::cout << "🎹 Automation activado" << std::endl;
+            if (logEvents()) std::cout << "🎹 Automation activado" << std::endl;
             break;
     }
 }
 
 void MaschineMikroDriverUser::handleButtonRelease(int button) {
-    std::cout << "🎹 BOTÓN " << button << " liberado en modo Maschine" << std::endl;
+    if (logEvents()) std::cout << "🎹 BOTÓN " << button << " liberado en modo Maschine" << std::endl;
     
     // Actualizar estado interno
     if (button >= 0 && button < NUM_BUTTONS) {
@@ -384,14 +755,14 @@ void MaschineMikroDriverUser::handleButtonRelease(int button) {
     // Lógica específica de Maschine
     switch (button) {
         case 0: // Shift
-            std::cout << "🎹 Shift desactivado" << std::endl;
+            if (logEvents()) std::cout << "🎹 Shift desactivado" << std::endl;
             maschineState.shiftPressed = false;
             break;
     }
 }
 
 void MaschineMikroDriverUser::handleEncoderTurn(int encoder, int value) {
-    std::cout << "🎹 ENCODER " << encoder << " girado en modo Maschine (value: " << value << ")" << std::endl;
+    if (logEvents()) std::cout << "🎹 ENCODER " << encoder << " girado en modo Maschine (value: " << value << ")" << std::endl;
     
     // Lógica específica de Maschine
     switch (encoder) {
@@ -401,7 +772,7 @@ void MaschineMikroDriverUser::handleEncoderTurn(int encoder, int value) {
                 maschineState.tempo += delta;
                 if (maschineState.tempo < 60) maschineState.tempo = 60;
                 if (maschineState.tempo > 200) maschineState.tempo = 200;
-                std::cout << "🎹 Tempo ajustado a: " << maschineState.tempo << " BPM" << std::endl;
+                if (logEvents()) std::cout << "🎹 Tempo ajustado a: " << maschineState.tempo << " BPM" << std::endl;
             }
             break;
         case 1: // Swing
@@ -410,12 +781,52 @@ void MaschineMikroDriverUser::handleEncoderTurn(int encoder, int value) {
                 maschineState.swing += delta;
                 if (maschineState.swing < 0) maschineState.swing = 0;
                 if (maschineState.swing > 100) maschineState.swing = 100;
-                std::cout << "🎹 Swing ajustado a: " << maschineState.swing << "%" << std::endl;
+                swingEngine.setAmount(maschineState.swing / 100.0);
+                if (logEvents()) std::cout << "🎹 Swing ajustado a: " << maschineState.swing << "%" << std::endl;
             }
             break;
     }
 }
 
+// Las tablas de nombres no hacen falta para arrancar: se rellenan la
+// primera vez que algo las consulta
+void MaschineMikroDriverUser::ensureNameTables() {
+    std::call_once(nameTablesOnce, [this]() {
+        setupGroupNames();
+        setupSoundNames();
+        setupPatternNames();
+        setupSceneNames();
+    });
+}
+
+void MaschineMikroDriverUser::setupGroupNames() {
+    for (int group = 0; group < MASCHINE_GROUPS; ++group) {
+        groupNames[group] = std::string("Group ") + (char)('A' + group);
+    }
+}
+
+void MaschineMikroDriverUser::setupSoundNames() {
+    for (int group = 0; group < MASCHINE_GROUPS; ++group) {
+        for (int sound = 0; sound < MASCHINE_SOUNDS_PER_GROUP; ++sound) {
+            soundNames[group * MASCHINE_SOUNDS_PER_GROUP + sound] = "Sound " + std::to_string(sound + 1);
+        }
+    }
+}
+
+void MaschineMikroDriverUser::setupPatternNames() {
+    for (int group = 0; group < MASCHINE_GROUPS; ++group) {
+        for (int pattern = 0; pattern < MASCHINE_PATTERNS_PER_GROUP; ++pattern) {
+            patternNames[group * MASCHINE_PATTERNS_PER_GROUP + pattern] = "Pattern " + std::to_string(pattern + 1);
+        }
+    }
+}
+
+void MaschineMikroDriverUser::setupSceneNames() {
+    for (int scene = 0; scene < MASCHINE_SCENES; ++scene) {
+        sceneNames[scene] = "Scene " + std::to_string(scene + 1);
+    }
+}
+
 void MaschineMikroDriverUser::initializeMaschineState() {
     maschineState.currentMode = MASCHINE_MODE_NATIVE;
     maschineState.currentGroup = 0;
@@ -436,21 +847,38 @@ void MaschineMikroDriverUser::initializeMaschineState() {
     for (int i = 0; i < 2; ++i) maschineState.encoderLEDs[i] = 0;
 }
 
-// Handshake con el software Maschine (stub)
+// Canal de memoria compartida con el software Maschine
 bool MaschineMikroDriverUser::connectMaschineSoftware() {
     std::cout << "[Maschine] Realizando handshake con el software Maschine..." << std::endl;
-    // Aquí iría la lógica de handshake USB nativo
+    if (hostChannel.isOpen()) {
+        return true;
+    }
+    
+    if (!hostChannel.open(MaschineChannel::ROLE_DRIVER)) {
+        if (errno == EBUSY) {
+            std::cout << "[Error] El canal compartido " << MASCHINE_CHANNEL_NAME
+                      << " pertenece a otro driver en marcha" << std::endl;
+        } else {
+            std::cout << "[Error] No se pudo crear el canal compartido " << MASCHINE_CHANNEL_NAME << std::endl;
+        }
+        maschineSoftwareConnected = false;
+        return false;
+    }
+    
+    std::cout << "[Maschine] Canal compartido listo: " << MASCHINE_CHANNEL_NAME << std::endl;
     maschineSoftwareConnected = true;
     return true;
 }
 
 void MaschineMikroDriverUser::disconnectMaschineSoftware() {
     std::cout << "[Maschine] Desconectando del software Maschine..." << std::endl;
+    hostChannel.close();
     maschineSoftwareConnected = false;
 }
 
 bool MaschineMikroDriverUser::isMaschineSoftwareConnected() {
-    return maschineSoftwareConnected;
+    // El canal existe; conectado de verdad solo si hay un host vivo al otro lado
+    return maschineSoftwareConnected && hostChannel.isPeerAlive();
 }
 
 void MaschineMikroDriverUser::sendToMaschineSoftware(const std::string& command) {
@@ -458,20 +886,364 @@ void MaschineMikroDriverUser::sendToMaschineSoftware(const std::string& command)
     // Aquí se enviaría el comando real por USB nativo
 }
 
+void MaschineMikroDriverUser::sendCommand(int opcode, int arg0, int arg1, int32_t value) {
+    MaschineCommand command;
+    command.opcode = (uint8_t)opcode;
+    command.arg0 = (uint8_t)arg0;
+    command.arg1 = (uint8_t)arg1;
+    command.reserved = 0;
+    command.value = value;
+    
+    uint8_t encoded[MASCHINE_COMMAND_SIZE];
+    encodeMaschineCommand(command, encoded);
+    commandsSent++;
+    
+    if (hostChannel.isOpen()) {
+        hostChannel.send(encoded);
+    }
+    // Copia al buffer compartido de los suscriptores locales; nunca espera
+    eventServer.publish(encoded);
+    
+    // Todo cambio de estado acaba aquí: el bucle de eventos refresca la
+    // página en vivo; aquí solo se marca, sin locks en el camino caliente
+    markStatePageDirty();
+    
+    // La forma de texto solo se genera en modo depuración
+    if (debugCommands) {
+        char text[64];
+        formatMaschineCommand(command, text, sizeof(text));
+        std::cout << "[Maschine] Enviando comando al software Maschine: " << text << std::endl;
+    }
+}
+
+void MaschineMikroDriverUser::setDebugMode(bool enabled) {
+    debugCommands = enabled;
+}
+
+void MaschineMikroDriverUser::enableStartupProfile() {
+    std::lock_guard<std::mutex> lock(startupMutex);
+    startupProfiling = true;
+    startupMarks.clear();
+    startupMarks.push_back(std::make_pair(std::string("inicio del proceso"), processStartNs));
+}
+
+void MaschineMikroDriverUser::markStartup(const std::string& phase) {
+    if (!startupProfiling) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(startupMutex);
+    startupMarks.push_back(std::make_pair(phase, hostTimeToNanos(0)));
+}
+
+void MaschineMikroDriverUser::printStartupProfile() {
+    std::lock_guard<std::mutex> lock(startupMutex);
+    if (startupMarks.empty()) {
+        return;
+    }
+    
+    std::cout << "⏱️  Perfil de arranque:" << std::endl;
+    uint64_t previous = startupMarks[0].second;
+    for (size_t i = 1; i < startupMarks.size(); ++i) {
+        uint64_t at = startupMarks[i].second;
+        std::cout << "   " << startupMarks[i].first << ": +" << (at - previous) / 1000000.0 << " ms ("
+                  << (at - startupMarks[0].second) / 1000000.0 << " ms desde el inicio)" << std::endl;
+        previous = at;
+    }
+    if (!firstEventSeen) {
+        std::cout << "   (todavía sin eventos del dispositivo)" << std::endl;
+    }
+}
+
+void MaschineMikroDriverUser::setLogLevel(int level) {
+    logLevel = level;
+}
+
+void MaschineMikroDriverUser::setInputMapping(const uint8_t* pads, const uint8_t* buttons) {
+    // Entrada a entrada: un evento concurrente ve el mapeo viejo o el nuevo
+    for (int i = 0; i < NUM_PADS; ++i) {
+        padMap[i].store(pads[i] % NUM_PADS, std::memory_order_relaxed);
+    }
+    for (int i = 0; i < NUM_BUTTONS; ++i) {
+        buttonMap[i].store(buttons[i] % NUM_BUTTONS, std::memory_order_relaxed);
+    }
+}
+
+void MaschineMikroDriverUser::setThreadPriorities(int scheduler, int encoder) {
+    schedulerPriority = scheduler;
+    encoderPriority = encoder;
+    // Los hilos ya en marcha cambian ahora; los demás, al crearse
+    if (schedulerThread.joinable() && !setMaschineThreadPriority(schedulerThread.native_handle(), scheduler)) {
+        std::cout << "[Warning] No se pudo fijar la prioridad del planificador (" << scheduler << ")" << std::endl;
+    }
+    std::lock_guard<std::mutex> lock(encoderMutex);
+    if (encoderFlushThread.joinable() && !setMaschineThreadPriority(encoderFlushThread.native_handle(), encoder)) {
+        std::cout << "[Warning] No se pudo fijar la prioridad del hilo de encoders (" << encoder << ")" << std::endl;
+    }
+}
+
+void MaschineMikroDriverUser::setMaschineInput(bool enabled) {
+    maschineInput = enabled;
+}
+
+void MaschineMikroDriverUser::setClock(MaschineClock* newClock) {
+    clock = newClock ? newClock : &hostClock;
+}
+
+void MaschineMikroDriverUser::setOutputSink(MaschineOutputSink sink) {
+    outputSink = sink;
+}
+
+void MaschineMikroDriverUser::injectMIDIInput(const MIDIPacketList* packetList) {
+    // Mismo camino que el read proc de CoreMIDI
+    handleMIDIInput(packetList);
+}
+
+void MaschineMikroDriverUser::sendPacketList(const MIDIPacketList* packetList) {
+    if (outputSink) {
+        outputSink(packetList);
+        return;
+    }
+    // Enviar a todos los destinos MIDI
+    for (int i = 0; i < numDestinations; ++i) {
+        MIDISend(midiOutPort, midiDestinations[i], packetList);
+    }
+}
+
+void MaschineMikroDriverUser::sleepMillis(int ms) {
+    clock->sleepFor((uint64_t)ms * 1000000ULL);
+}
+
+void MaschineMikroDriverUser::printStats() {
+    std::cout << "[Maschine] Estadísticas: dispositivo " << (deviceConnected ? "conectado" : "desconectado")
+              << ", pads " << padEventCount << ", botones " << buttonEventCount
+              << ", encoders " << encoderEventCount << ", MIDI in " << midiMessagesIn
+              << ", MIDI out " << midiMessagesOut << ", comandos " << commandsSent
+              << ", descartados por el host " << hostChannel.getDroppedCount() << std::endl;
+}
+
 void MaschineMikroDriverUser::receiveFromMaschineSoftware() {
-    std::cout << "[Maschine] Esperando mensajes del software Maschine..." << std::endl;
-    // Aquí se recibirían mensajes reales
+    if (!hostChannel.isOpen()) {
+        return;
+    }
+    
+    uint8_t encoded[MASCHINE_COMMAND_SIZE];
+    MaschineCommand command;
+    
+    // Vaciar hasta que el canal quede armado para dormir sin perder nada
+    do {
+        hostChannel.drainWake();
+        while (hostChannel.receive(encoded)) {
+            if (decodeMaschineCommand(encoded, &command)) {
+                handleHostCommand(command);
+            }
+        }
+    } while (!hostChannel.prepareWait());
+}
+
+void MaschineMikroDriverUser::attachEventLoop(MaschineEventLoop& loop) {
+    if (stateExport.isOpen()) {
+        statePageTimer = loop.addTimer(statePageIntervalNs, statePageIntervalNs, [this]() {
+            if (statePageDirty.exchange(false, std::memory_order_acq_rel)) {
+                publishStatePage();
+            }
+        });
+    }
+    if (!hostChannel.isOpen()) {
+        return;
+    }
+    loop.addDescriptor(hostChannel.getWakeFd(), [this]() { receiveFromMaschineSoftware(); });
+    // Lo que llegó antes de registrarse no hará sonar el timbre
+    receiveFromMaschineSoftware();
+}
+
+void MaschineMikroDriverUser::detachEventLoop(MaschineEventLoop& loop) {
+    if (statePageTimer) {
+        loop.removeTimer(statePageTimer);
+        statePageTimer = 0;
+    }
+    if (hostChannel.isOpen()) {
+        loop.removeDescriptor(hostChannel.getWakeFd());
+    }
+}
+
+bool MaschineMikroDriverUser::startEventServer(const char* path) {
+    if (!eventServer.start(path)) {
+        std::cout << "[Error] No se pudo abrir el socket de eventos " << path << std::endl;
+        return false;
+    }
+    std::cout << "[Maschine] Servidor de eventos escuchando en " << path << std::endl;
+    return true;
+}
+
+void MaschineMikroDriverUser::stopEventServer() {
+    eventServer.stop();
+}
+
+// Desde el hilo del bucle de eventos, antes de attachEventLoop()
+bool MaschineMikroDriverUser::startStateExport(const char* name) {
+    if (!stateExport.isOpen() && !stateExport.open(name)) {
+        std::cout << "[Error] No se pudo crear la página de estado " << name << std::endl;
+        return false;
+    }
+    std::cout << "[Maschine] Página de estado publicada en " << name << std::endl;
+    publishStatePage();
+    return true;
+}
+
+// Solo desde el hilo del bucle de eventos
+void MaschineMikroDriverUser::publishStatePage() {
+    MaschineStateSnapshot* page = stateExport.beginWrite();
+    if (!page) {
+        return;
+    }
+    
+    page->timestampNs = hostTimeToNanos(0);
+    page->mode = maschineState.currentMode;
+    page->group = maschineState.currentGroup;
+    page->sound = maschineState.currentSound;
+    page->pattern = maschineState.currentPattern;
+    page->scene = maschineState.currentScene;
+    page->tempoMilli = (int32_t)(maschineState.tempo * 1000.0 + 0.5);
+    page->swing = maschineState.swing;
+    
+    uint32_t flags = 0;
+    if (maschineState.isPlaying) flags |= MASCHINE_STATE_PLAYING;
+    if (maschineState.isRecording) flags |= MASCHINE_STATE_RECORDING;
+    if (maschineState.shiftPressed) flags |= MASCHINE_STATE_SHIFT;
+    if (maschineState.soloMode) flags |= MASCHINE_STATE_SOLO;
+    if (maschineState.muteMode) flags |= MASCHINE_STATE_MUTE;
+    if (maschineState.automationMode) flags |= MASCHINE_STATE_AUTOMATION;
+    if (clockSlaveMode) flags |= MASCHINE_STATE_CLOCK_SLAVE;
+    if (clockSlaveMode && clockTracker.isLocked()) flags |= MASCHINE_STATE_CLOCK_LOCKED;
+    if (maschineSoftwareConnected && hostChannel.isPeerAlive()) flags |= MASCHINE_STATE_HOST_CONNECTED;
+    if (deviceConnected) flags |= MASCHINE_STATE_DEVICE_OPEN;
+    page->flags = flags;
+    
+    uint16_t padStates = 0, padLEDs = 0;
+    for (int i = 0; i < 16; ++i) {
+        if (maschineState.padStates[i]) padStates |= (uint16_t)(1 << i);
+        if (maschineState.padLEDs[i]) padLEDs |= (uint16_t)(1 << i);
+        page->padVelocities[i] = (uint8_t)maschineState.padVelocities[i];
+    }
+    page->padStates = padStates;
+    page->padLEDs = padLEDs;
+    
+    uint8_t buttonStates = 0, buttonLEDs = 0;
+    for (int i = 0; i < 8; ++i) {
+        if (maschineState.buttonStates[i]) buttonStates |= (uint8_t)(1 << i);
+        if (maschineState.buttonLEDs[i]) buttonLEDs |= (uint8_t)(1 << i);
+    }
+    page->buttonStates = buttonStates;
+    page->buttonLEDs = buttonLEDs;
+    page->encoderLEDs[0] = (uint8_t)maschineState.encoderLEDs[0];
+    page->encoderLEDs[1] = (uint8_t)maschineState.encoderLEDs[1];
+    
+    page->padEvents = padEventCount;
+    page->buttonEvents = buttonEventCount;
+    page->encoderEvents = encoderEventCount;
+    page->midiMessagesIn = midiMessagesIn;
+    page->midiMessagesOut = midiMessagesOut;
+    page->commandsSent = commandsSent;
+    page->hostDropped = hostChannel.getDroppedCount();
+    
+    stateExport.endWrite();
+}
+
+void MaschineMikroDriverUser::handleHostCommand(const MaschineCommand& command) {
+    if (debugCommands) {
+        char text[64];
+        formatMaschineCommand(command, text, sizeof(text));
+        std::cout << "[Maschine] Comando del software Maschine: " << text << std::endl;
+    }
+    
+    // Realimentación y control remoto desde el host
+    switch (command.opcode) {
+        case CMD_LED_PAD:
+            setPadLED(command.arg0, command.arg1 != 0);
+            break;
+        case CMD_LED_BUTTON:
+            setButtonLED(command.arg0, command.arg1 != 0);
+            break;
+        case CMD_LED_ENCODER:
+            setEncoderLED(command.arg0, command.arg1);
+            break;
+        case CMD_SELECT_GROUP:
+            selectGroup(command.arg0);
+            break;
+        case CMD_SELECT_SOUND:
+            selectSound(command.arg0);
+            break;
+        case CMD_SELECT_PATTERN:
+            selectPattern(command.arg0);
+            break;
+        case CMD_SELECT_SCENE:
+            selectScene(command.arg0);
+            break;
+        case CMD_PLAY:
+            play();
+            break;
+        case CMD_STOP:
+            stop();
+            break;
+        case CMD_RECORD:
+            record();
+            break;
+        case CMD_SET_TEMPO:
+            changeTempo(command.value / 1000.0);
+            break;
+        case CMD_SET_SWING:
+            changeSwing(command.arg0);
+            break;
+        default:
+            break;
+    }
 }
 
 void MaschineMikroDriverUser::printMaschineStatus() {
     std::cout << "[Maschine] Estado actual:" << std::endl;
     std::cout << "  Modo: " << (maschineState.currentMode == MASCHINE_MODE_NATIVE ? "Maschine" : "MIDI") << std::endl;
-    std::cout << "  Grupo: " << maschineState.currentGroup << std::endl;
-    std::cout << "  Sonido: " << maschineState.currentSound << std::endl;
-    std::cout << "  Patrón: " << maschineState.currentPattern << std::endl;
-    std::cout << "  Escena: " << maschineState.currentScene << std::endl;
+    ensureNameTables();
+    int group = maschineState.currentGroup;
+    std::cout << "  Grupo: " << group << " (" << groupNames[group] << ")" << std::endl;
+    std::cout << "  Sonido: " << maschineState.currentSound << " ("
+              << soundNames[group * MASCHINE_SOUNDS_PER_GROUP + maschineState.currentSound] << ")" << std::endl;
+    std::cout << "  Patrón: " << maschineState.currentPattern << " ("
+              << patternNames[group * MASCHINE_PATTERNS_PER_GROUP + maschineState.currentPattern] << ")" << std::endl;
+    std::cout << "  Escena: " << maschineState.currentScene << " ("
+              << sceneNames[maschineState.currentScene] << ")" << std::endl;
     std::cout << "  Tempo: " << maschineState.tempo << std::endl;
     std::cout << "  Swing: " << maschineState.swing << std::endl;
+    
+    if (clockSlaveMode) {
+        std::cout << "  Reloj MIDI: " << (clockTracker.isLocked() ? "enganchado" : "adquiriendo")
+                  << " a " << clockTracker.getTempo() << " BPM" << std::endl;
+        std::cout << "  Posición: " << clockTracker.getSongPositionBeats() << " negras" << std::endl;
+        std::cout << "  Convergencia: " << clockTracker.getConvergenceTicks() << " pulsos" << std::endl;
+        std::cout << "  Error de fase RMS: " << clockTracker.getSteadyStateErrorUs() << " µs" << std::endl;
+        std::cout << "  Pulsos rechazados: " << clockTracker.getRejectedTicks() << std::endl;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(encoderMutex);
+        std::cout << "  Encoders: " << encoderCoalescer.getInputCount() << " pasos -> "
+                  << encoderCoalescer.getOutputCount() << " eventos (compresión "
+                  << encoderCoalescer.getCompressionRatio() << ":1)" << std::endl;
+    }
+    
+    if (eventServer.isRunning()) {
+        uint64_t writes = eventServer.getWriteCalls();
+        std::cout << "  Suscriptores: " << eventServer.getSubscriberCount()
+                  << " (" << eventServer.getPublishedCount() << " eventos, " << writes << " writev";
+        if (writes > 0) {
+            std::cout << ", " << (double)eventServer.getPublishedCount() / writes << " eventos/llamada";
+        }
+        std::cout << ")" << std::endl;
+        std::cout << "  Retrasos: " << eventServer.getLagMarks() << " marcas, "
+                  << eventServer.getEvictedCount() << " expulsados, "
+                  << eventServer.getOverrunCount() << " desbordes" << std::endl;
+    }
+    
+    printAutomationStats();
 }
 
 // Stub para mostrar menú Maschine
@@ -500,7 +1272,12 @@ void MaschineMikroDriverUser::showMaschineMenu() {
 
 // === PADS EN MODO MASCHINE ===
 void MaschineMikroDriverUser::handlePadPressMaschine(int pad, int velocity) {
-    std::cout << "[Maschine] Pad " << pad << " presionado con velocidad " << velocity << std::endl;
+    if (logEvents()) std::cout << "[Maschine] Pad " << pad << " presionado con velocidad " << velocity << std::endl;
+    padEventCount++;
+    if (pad >= 0 && pad < 16) {
+        maschineState.padStates[pad] = true;
+        maschineState.padVelocities[pad] = velocity;
+    }
     
     if (maschineState.shiftPressed) {
         // Modo Shift: seleccionar grupo/sonido/patrón
@@ -513,8 +1290,11 @@ void MaschineMikroDriverUser::handlePadPressMaschine(int pad, int velocity) {
         // Modo normal: reproducir sonido
         if (pad < 16) {
             selectSound(pad);
+            if (maschineState.isRecording && maschineState.isPlaying) {
+                recordPadEvent(pad, velocity);
+            }
             // Enviar comando de reproducción al software Maschine
-            sendToMaschineSoftware("pad_press:" + std::to_string(pad) + ":" + std::to_string(velocity));
+            sendCommand(CMD_PAD_PRESS, pad, velocity);
         }
     }
     
@@ -523,32 +1303,38 @@ void MaschineMikroDriverUser::handlePadPressMaschine(int pad, int velocity) {
 }
 
 void MaschineMikroDriverUser::handlePadReleaseMaschine(int pad) {
-    std::cout << "[Maschine] Pad " << pad << " liberado" << std::endl;
+    if (logEvents()) std::cout << "[Maschine] Pad " << pad << " liberado" << std::endl;
+    padEventCount++;
+    if (pad >= 0 && pad < 16) {
+        maschineState.padStates[pad] = false;
+        maschineState.padVelocities[pad] = 0;
+    }
     
     // Enviar comando de liberación al software Maschine
-    sendToMaschineSoftware("pad_release:" + std::to_string(pad));
+    sendCommand(CMD_PAD_RELEASE, pad);
     
     // Apagar LED del pad
     setPadLED(pad, false);
 }
 
 void MaschineMikroDriverUser::handlePadLongPressMaschine(int pad) {
-    std::cout << "[Maschine] Pad " << pad << " presionado largo" << std::endl;
+    if (logEvents()) std::cout << "[Maschine] Pad " << pad << " presionado largo" << std::endl;
     
     // Acción de presionado largo (ej: borrar, duplicar, etc.)
-    sendToMaschineSoftware("pad_long_press:" + std::to_string(pad));
+    sendCommand(CMD_PAD_LONG_PRESS, pad);
 }
 
 void MaschineMikroDriverUser::handlePadDoublePressMaschine(int pad) {
-    std::cout << "[Maschine] Pad " << pad << " doble presionado" << std::endl;
+    if (logEvents()) std::cout << "[Maschine] Pad " << pad << " doble presionado" << std::endl;
     
     // Acción de doble presionado (ej: solo, mute, etc.)
-    sendToMaschineSoftware("pad_double_press:" + std::to_string(pad));
+    sendCommand(CMD_PAD_DOUBLE_PRESS, pad);
 }
 
 // === BOTONES EN MODO MASCHINE ===
-void MaschineMikroDriverUser::handleButtonPressMaschine(int button) {
-    std::cout << "[Maschine] Botón " << button << " presionado" << std::endl;
+void MaschineMikroDriverUser::handleButtonPressMaschine(int button, uint64_t timestampNs) {
+    if (logEvents()) std::cout << "[Maschine] Botón " << button << " presionado" << std::endl;
+    buttonEventCount++;
     
     switch (button) {
         case BUTTON_SHIFT:
@@ -556,7 +1342,12 @@ void MaschineMikroDriverUser::handleButtonPressMaschine(int button) {
             setButtonLED(BUTTON_SHIFT, true);
             break;
         case BUTTON_SELECT:
-            selectAll();
+            // Con SHIFT pulsado, SELECT marca el tap tempo
+            if (maschineState.shiftPressed) {
+                tapTempo(timestampNs ? timestampNs : clock->now());
+            } else {
+                selectAll();
+            }
             break;
         case BUTTON_SOLO:
             toggleSoloMode();
@@ -578,125 +1369,212 @@ void MaschineMikroDriverUser::handleButtonPressMaschine(int button) {
             break;
     }
     
-    sendToMaschineSoftware("button_press:" + std::to_string(button));
+    sendCommand(CMD_BUTTON_PRESS, button);
 }
 
 void MaschineMikroDriverUser::handleButtonReleaseMaschine(int button) {
-    std::cout << "[Maschine] Botón " << button << " liberado" << std::endl;
+    if (logEvents()) std::cout << "[Maschine] Botón " << button << " liberado" << std::endl;
     
     if (button == BUTTON_SHIFT) {
         maschineState.shiftPressed = false;
         setButtonLED(BUTTON_SHIFT, false);
     }
     
-    sendToMaschineSoftware("button_release:" + std::to_string(button));
+    sendCommand(CMD_BUTTON_RELEASE, button);
 }
 
 void MaschineMikroDriverUser::handleButtonLongPressMaschine(int button) {
-    std::cout << "[Maschine] Botón " << button << " presionado largo" << std::endl;
-    sendToMaschineSoftware("button_long_press:" + std::to_string(button));
+    if (logEvents()) std::cout << "[Maschine] Botón " << button << " presionado largo" << std::endl;
+    sendCommand(CMD_BUTTON_LONG_PRESS, button);
 }
 
 // === ENCODERS EN MODO MASCHINE ===
 void MaschineMikroDriverUser::handleEncoderTurnMaschine(int encoder, int direction) {
-    std::cout << "[Maschine] Encoder " << encoder << " girado dirección " << direction << std::endl;
+    // Los pasos se acumulan y salen como una sola delta por período de
+    // control. Este hilo (el de entrada, también el de los pads) nunca
+    // aplica: lo vaciado se encola para el hilo de encoders
+    encoderEventCount++;
+    std::lock_guard<std::mutex> lock(encoderMutex);
+    int delta = 0;
+    if (encoderCoalescer.add(encoder, direction, clock->now(), &delta)) {
+        if (encoderReadyCount < MASCHINE_ENCODER_READY_MAX) {
+            encoderReady[encoderReadyCount++] = std::make_pair(encoder, delta);
+        } else {
+            // Cola llena (vaivén muy rápido sin que el hilo despierte): se
+            // suma a la última delta encolada
+            encoderReady[encoderReadyCount - 1].second += delta;
+        }
+    }
+    
+    if (!encoderFlushThread.joinable()) {
+        encoderFlushRunning = true;
+        clock->addWaiter(encoderMutex, encoderCondition);
+        encoderFlushThread = std::thread(&MaschineMikroDriverUser::runEncoderFlush, this);
+        if (encoderPriority > 0) {
+            setMaschineThreadPriority(encoderFlushThread.native_handle(), encoderPriority);
+        }
+    }
+    encoderCondition.notify_one();
+}
+
+void MaschineMikroDriverUser::stopEncoderFlush() {
+    {
+        std::lock_guard<std::mutex> lock(encoderMutex);
+        encoderFlushRunning = false;
+        encoderCondition.notify_one();
+    }
+    if (encoderFlushThread.joinable()) {
+        encoderFlushThread.join();
+    }
+    clock->removeWaiter(encoderCondition);
+}
+
+void MaschineMikroDriverUser::runEncoderFlush() {
+    std::unique_lock<std::mutex> lock(encoderMutex);
+    while (encoderFlushRunning) {
+        uint64_t deadline = 0;
+        bool pending = encoderCoalescer.nextDeadline(&deadline);
+        uint64_t now = clock->now();
+        if (encoderReadyCount == 0 && (!pending || now < deadline)) {
+            clock->waitUntil(lock, encoderCondition, pending ? deadline : UINT64_MAX);
+            continue;
+        }
+        
+        lock.unlock();
+        flushEncoders(now);
+        lock.lock();
+    }
+}
+
+// Sin encoderMutex: lo toma solo para recoger las deltas y aplica fuera de
+// él. encoderApplyMutex mantiene un único aplicador, así las deltas de un
+// mismo encoder nunca salen desordenadas
+void MaschineMikroDriverUser::flushEncoders(uint64_t now) {
+    std::lock_guard<std::mutex> applyLock(encoderApplyMutex);
+    std::pair<int, int> deltas[MASCHINE_ENCODER_READY_MAX + MASCHINE_COALESCE_ENCODERS];
+    int count = 0;
+    {
+        std::lock_guard<std::mutex> lock(encoderMutex);
+        for (int i = 0; i < encoderReadyCount; ++i) {
+            deltas[count++] = encoderReady[i];
+        }
+        encoderReadyCount = 0;
+        for (int i = 0; i < MASCHINE_COALESCE_ENCODERS; ++i) {
+            int delta = 0;
+            if (encoderCoalescer.poll(i, now, &delta)) {
+                deltas[count++] = std::make_pair(i, delta);
+            }
+        }
+    }
+    for (int i = 0; i < count; ++i) {
+        applyEncoderDelta(deltas[i].first, deltas[i].second);
+    }
+}
+
+void MaschineMikroDriverUser::applyEncoderDelta(int encoder, int delta) {
+    if (logEvents()) std::cout << "[Maschine] Encoder " << encoder << " girado " << delta << " pasos" << std::endl;
     
     switch (encoder) {
         case ENCODER_TEMPO:
-            changeTempo(maschineState.tempo + (direction * 1.0));
+            changeTempo(maschineState.tempo + (delta * 1.0));
             break;
         case ENCODER_SWING:
-            changeSwing(maschineState.swing + (direction * 0.1));
+            changeSwing(maschineState.swing + delta);
             break;
     }
     
-    sendToMaschineSoftware("encoder_turn:" + std::to_string(encoder) + ":" + std::to_string(direction));
+    // Escritura de automatización: el valor normalizado del parámetro
+    if (maschineState.automationMode && maschineState.isRecording) {
+        if (encoder == ENCODER_TEMPO) {
+            recordAutomation(encoder, (maschineState.tempo - MASCHINE_MIN_TEMPO) / (MASCHINE_MAX_TEMPO - MASCHINE_MIN_TEMPO));
+        } else if (encoder == ENCODER_SWING) {
+            recordAutomation(encoder, maschineState.swing / 100.0);
+        }
+    }
+    
+    sendCommand(CMD_ENCODER_TURN, encoder, 0, delta);
 }
 
 void MaschineMikroDriverUser::handleEncoderPressMaschine(int encoder) {
-    std::cout << "[Maschine] Encoder " << encoder << " presionado" << std::endl;
+    if (logEvents()) std::cout << "[Maschine] Encoder " << encoder << " presionado" << std::endl;
     
     if (encoder == ENCODER_TEMPO) {
         tapTempo();
     }
     
-    sendToMaschineSoftware("encoder_press:" + std::to_string(encoder));
+    sendCommand(CMD_ENCODER_PRESS, encoder);
 }
 
 // === CONTROL DE LEDS ===
+void MaschineMikroDriverUser::sendLEDSysEx(int target, int index, bool state) {
+    // Comando SysEx específico de Maschine para LEDs (protocolo de
+    // Rebellion); buffer fijo, nada se reserva por LED
+    Byte sysex[10] = {
+        0xF0,                   // SysEx Start
+        0x00, 0x20, 0x3C,       // Manufacturer ID (NI)
+        0x02,                   // Device ID (Maschine Mikro)
+        0x00,                   // Command: LED Control
+        (Byte)target,           // Subcommand: 0x00 pad, 0x01 botón
+        (Byte)(index & 0x7F),
+        (Byte)(state ? 0x7F : 0x00),
+        0xF7                    // SysEx End
+    };
+    
+    MIDIPacketList packetList;
+    MIDIPacket* packet = MIDIPacketListInit(&packetList);
+    MIDIPacketListAdd(&packetList, sizeof(packetList), packet, 0, sizeof(sysex), sysex);
+    
+    sendPacketList(&packetList);
+    midiMessagesOut++;
+}
+
 void MaschineMikroDriverUser::setPadLED(int pad, bool state) {
     if (pad >= 0 && pad < 16) {
         maschineState.padLEDs[pad] = state;
-        std::cout << "[Maschine] LED Pad " << pad << " " << (state ? "ON" : "OFF") << std::endl;
-        
-        // Comando SysEx específico de Maschine para LEDs
-        // Basado en el protocolo de Rebellion
-        std::vector<unsigned char> sysexData;
-        sysexData.push_back(0xF0); // SysEx Start
-        sysexData.push_back(0x00); // Manufacturer ID (NI)
-        sysexData.push_back(0x20); // Manufacturer ID (NI)
-        sysexData.push_back(0x3C); // Manufacturer ID (NI)
-        sysexData.push_back(0x02); // Device ID (Maschine Mikro)
-        sysexData.push_back(0x00); // Command: LED Control
-        sysexData.push_back(0x00); // Subcommand: Pad LED
-        sysexData.push_back(pad & 0x7F); // Pad number
-        sysexData.push_back(state ? 0x7F : 0x00); // LED state
-        sysexData.push_back(0xF7); // SysEx End
-        
-        // Enviar SysEx
-        MIDIPacketList packetList;
-        MIDIPacket* packet = MIDIPacketListInit(&packetList);
-        
-        packet = MIDIPacketListAdd(&packetList, sizeof(packetList), packet, 0, sysexData.size(), sysexData.data());
-        
-        // Enviar a todos los destinos MIDI
-        for (int i = 0; i < numDestinations; ++i) {
-            MIDISend(midiOutPort, midiDestinations[i], &packetList);
-        }
+        if (logEvents()) std::cout << "[Maschine] LED Pad " << pad << " " << (state ? "ON" : "OFF") << std::endl;
         
-        sendToMaschineSoftware("led_pad:" + std::to_string(pad) + ":" + std::to_string(state));
+        sendLEDSysEx(0x00, pad, state);
+        sendCommand(CMD_LED_PAD, pad, state);
     }
 }
 
 void MaschineMikroDriverUser::setButtonLED(int button, bool state) {
     if (button >= 0 && button < 8) {
         maschineState.buttonLEDs[button] = state;
-        std::cout << "[Maschine] LED Botón " << button << " " << (state ? "ON" : "OFF") << std::endl;
+        if (logEvents()) std::cout << "[Maschine] LED Botón " << button << " " << (state ? "ON" : "OFF") << std::endl;
         
-        // Comando SysEx específico de Maschine para LEDs de botones
-        std::vector<unsigned char> sysexData;
-        sysexData.push_back(0xF0); // SysEx Start
-        sysexData.push_back(0x00); // Manufacturer ID (NI)
-        sysexData.push_back(0x20); // Manufacturer ID (NI)
-        sysexData.push_back(0x3C); // Manufacturer ID (NI)
-        sysexData.push_back(0x02); // Device ID (Maschine Mikro)
-        sysexData.push_back(0x00); // Command: LED Control
-        sysexData.push_back(0x01); // Subcommand: Button LED
-        sysexData.push_back(button & 0x7F); // Button number
-        sysexData.push_back(state ? 0x7F : 0x00); // LED state
-        sysexData.push_back(0xF7); // SysEx End
-        
-        // Enviar SysEx
-        MIDIPacketList packetList;
-        MIDIPacket* packet = MIDIPacketListInit(&packetList);
-        
-        packet = MIDIPacketListAdd(&packetList, sizeof(packetList), packet, 0, sysexData.size(), sysexData.data());
-        
-        // Enviar a todos los destinos MIDI
-        for (int i = 0; i < numDestinations; ++i) {
-            MIDISend(midiOutPort, midiDestinations[i], &packetList);
-        }
-        
-        sendToMaschineSoftware("led_button:" + std::to_string(button) + ":" + std::to_string(state));
+        sendLEDSysEx(0x01, button, state);
+        sendCommand(CMD_LED_BUTTON, button, state);
     }
 }
 
 void MaschineMikroDriverUser::setEncoderLED(int encoder, int value) {
     if (encoder >= 0 && encoder < 2) {
         maschineState.encoderLEDs[encoder] = value;
-        std::cout << "[Maschine] LED Encoder " << encoder << " valor " << value << std::endl;
-        sendToMaschineSoftware("led_encoder:" + std::to_string(encoder) + ":" + std::to_string(value));
+        if (logEvents()) std::cout << "[Maschine] LED Encoder " << encoder << " valor " << value << std::endl;
+        sendCommand(CMD_LED_ENCODER, encoder, value);
+    }
+}
+
+// Encender durante duration ms y volver al estado anterior
+void MaschineMikroDriverUser::flashPadLED(int pad, int duration) {
+    if (pad < 0 || pad >= 16) {
+        return;
     }
+    bool previous = maschineState.padLEDs[pad];
+    setPadLED(pad, true);
+    sleepMillis(duration);
+    setPadLED(pad, previous);
+}
+
+void MaschineMikroDriverUser::flashButtonLED(int button, int duration) {
+    if (button < 0 || button >= 8) {
+        return;
+    }
+    bool previous = maschineState.buttonLEDs[button];
+    setButtonLED(button, true);
+    sleepMillis(duration);
+    setButtonLED(button, previous);
 }
 
 void MaschineMikroDriverUser::setAllPadLEDs(bool state) {
@@ -715,98 +1593,111 @@ void MaschineMikroDriverUser::setAllButtonLEDs(bool state) {
 void MaschineMikroDriverUser::selectGroup(int group) {
     if (group >= 0 && group < MASCHINE_GROUPS) {
         maschineState.currentGroup = group;
-        std::cout << "[Maschine] Grupo seleccionado: " << group << std::endl;
+        wakeScheduler();
+        if (logEvents()) std::cout << "[Maschine] Grupo seleccionado: " << group << std::endl;
         
         // Actualizar LEDs de grupos
         setAllPadLEDs(false);
         setPadLED(group, true);
         
-        sendToMaschineSoftware("select_group:" + std::to_string(group));
+        sendCommand(CMD_SELECT_GROUP, group);
     }
 }
 
 void MaschineMikroDriverUser::createGroup(int group) {
-    std::cout << "[Maschine] Creando grupo " << group << std::endl;
+    if (logEvents()) std::cout << "[Maschine] Creando grupo " << group << std::endl;
     maschineState.groupActive[group] = true;
-    sendToMaschineSoftware("create_group:" + std::to_string(group));
+    sendCommand(CMD_CREATE_GROUP, group);
 }
 
 void MaschineMikroDriverUser::deleteGroup(int group) {
-    std::cout << "[Maschine] Eliminando grupo " << group << std::endl;
+    if (logEvents()) std::cout << "[Maschine] Eliminando grupo " << group << std::endl;
     maschineState.groupActive[group] = false;
-    sendToMaschineSoftware("delete_group:" + std::to_string(group));
+    sendCommand(CMD_DELETE_GROUP, group);
 }
 
 // === GESTIÓN DE SONIDOS ===
 void MaschineMikroDriverUser::selectSound(int sound) {
     if (sound >= 0 && sound < MASCHINE_SOUNDS_PER_GROUP) {
         maschineState.currentSound = sound;
-        std::cout << "[Maschine] Sonido seleccionado: " << sound << std::endl;
-        sendToMaschineSoftware("select_sound:" + std::to_string(sound));
+        if (logEvents()) std::cout << "[Maschine] Sonido seleccionado: " << sound << std::endl;
+        sendCommand(CMD_SELECT_SOUND, sound);
     }
 }
 
 void MaschineMikroDriverUser::createSound(int group, int sound) {
-    std::cout << "[Maschine] Creando sonido " << sound << " en grupo " << group << std::endl;
+    if (logEvents()) std::cout << "[Maschine] Creando sonido " << sound << " en grupo " << group << std::endl;
     maschineState.soundActive[group][sound] = true;
-    sendToMaschineSoftware("create_sound:" + std::to_string(group) + ":" + std::to_string(sound));
+    sendCommand(CMD_CREATE_SOUND, group, sound);
 }
 
 // === GESTIÓN DE PATRONES ===
 void MaschineMikroDriverUser::selectPattern(int pattern) {
     if (pattern >= 0 && pattern < MASCHINE_PATTERNS_PER_GROUP) {
         maschineState.currentPattern = pattern;
-        std::cout << "[Maschine] Patrón seleccionado: " << pattern << std::endl;
-        sendToMaschineSoftware("select_pattern:" + std::to_string(pattern));
+        wakeScheduler();
+        if (logEvents()) std::cout << "[Maschine] Patrón seleccionado: " << pattern << std::endl;
+        sendCommand(CMD_SELECT_PATTERN, pattern);
     }
 }
 
 void MaschineMikroDriverUser::createPattern(int group, int pattern) {
-    std::cout << "[Maschine] Creando patrón " << pattern << " en grupo " << group << std::endl;
+    if (logEvents()) std::cout << "[Maschine] Creando patrón " << pattern << " en grupo " << group << std::endl;
     maschineState.patternActive[group][pattern] = true;
-    sendToMaschineSoftware("create_pattern:" + std::to_string(group) + ":" + std::to_string(pattern));
+    sendCommand(CMD_CREATE_PATTERN, group, pattern);
 }
 
 // === GESTIÓN DE ESCENAS ===
 void MaschineMikroDriverUser::selectScene(int scene) {
     if (scene >= 0 && scene < MASCHINE_SCENES) {
         maschineState.currentScene = scene;
-        std::cout << "[Maschine] Escena seleccionada: " << scene << std::endl;
-        sendToMaschineSoftware("select_scene:" + std::to_string(scene));
+        if (logEvents()) std::cout << "[Maschine] Escena seleccionada: " << scene << std::endl;
+        sendCommand(CMD_SELECT_SCENE, scene);
     }
 }
 
 void MaschineMikroDriverUser::createScene(int scene) {
-    std::cout << "[Maschine] Creando escena " << scene << std::endl;
+    if (logEvents()) std::cout << "[Maschine] Creando escena " << scene << std::endl;
     maschineState.sceneActive[scene] = true;
-    sendToMaschineSoftware("create_scene:" + std::to_string(scene));
+    sendCommand(CMD_CREATE_SCENE, scene);
 }
 
 // === CONTROLES DE TRANSPORT ===
 void MaschineMikroDriverUser::play() {
+    {
+        std::lock_guard<std::mutex> lock(positionMutex);
+        playStartNs = clock->now();
+        playStartTick = 0.0;
+        positionTempo = maschineState.tempo;
+    }
     maschineState.isPlaying = true;
-    std::cout << "[Maschine] Reproduciendo..." << std::endl;
+    startScheduler();
+    // Play con el transporte ya en marcha re-ancla la posición: el
+    // planificador duerme con un plazo calculado sobre la anterior
+    wakeScheduler();
+    if (logEvents()) std::cout << "[Maschine] Reproduciendo..." << std::endl;
     setButtonLED(BUTTON_PLAY, true);
-    sendToMaschineSoftware("play");
+    sendCommand(CMD_PLAY);
 }
 
 void MaschineMikroDriverUser::stop() {
     maschineState.isPlaying = false;
-    std::cout << "[Maschine] Detenido" << std::endl;
+    stopScheduler();
+    if (logEvents()) std::cout << "[Maschine] Detenido" << std::endl;
     setButtonLED(BUTTON_PLAY, false);
-    sendToMaschineSoftware("stop");
+    sendCommand(CMD_STOP);
 }
 
 void MaschineMikroDriverUser::record() {
     maschineState.isRecording = true;
-    std::cout << "[Maschine] Grabando..." << std::endl;
+    if (logEvents()) std::cout << "[Maschine] Grabando..." << std::endl;
     setButtonLED(BUTTON_RECORD, true);
-    sendToMaschineSoftware("record");
+    sendCommand(CMD_RECORD);
 }
 
 void MaschineMikroDriverUser::pause() {
-    std::cout << "[Maschine] Pausado" << std::endl;
-    sendToMaschineSoftware("pause");
+    if (logEvents()) std::cout << "[Maschine] Pausado" << std::endl;
+    sendCommand(CMD_PAUSE);
 }
 
 void MaschineMikroDriverUser::startStopPlayback() {
@@ -821,7 +1712,7 @@ void MaschineMikroDriverUser::startStopRecording() {
     if (maschineState.isRecording) {
         maschineState.isRecording = false;
         setButtonLED(BUTTON_RECORD, false);
-        sendToMaschineSoftware("stop_record");
+        sendCommand(CMD_STOP_RECORD);
     } else {
         record();
     }
@@ -829,9 +1720,21 @@ void MaschineMikroDriverUser::startStopRecording() {
 
 // === TEMPO Y TIMING ===
 void MaschineMikroDriverUser::setTempo(double bpm) {
+    {
+        // Re-anclar: lo transcurrido cuenta al tempo anterior y solo lo que
+        // queda por delante cambia de velocidad
+        std::lock_guard<std::mutex> lock(positionMutex);
+        uint64_t now = clock->now();
+        if (now > playStartNs) {
+            playStartTick += (double)(now - playStartNs) * positionTempo * SEQUENCER_PPQN / 60.0e9;
+        }
+        playStartNs = now;
+        positionTempo = bpm;
+    }
     maschineState.tempo = bpm;
-    std::cout << "[Maschine] Tempo: " << bpm << " BPM" << std::endl;
-    sendToMaschineSoftware("set_tempo:" + std::to_string(bpm));
+    wakeScheduler();
+    if (logEvents()) std::cout << "[Maschine] Tempo: " << bpm << " BPM" << std::endl;
+    sendCommand(CMD_SET_TEMPO, 0, 0, (int32_t)lround(bpm * 1000.0));
 }
 
 double MaschineMikroDriverUser::getTempo() {
@@ -839,9 +1742,11 @@ double MaschineMikroDriverUser::getTempo() {
 }
 
 void MaschineMikroDriverUser::setSwing(double swing) {
-    maschineState.swing = swing;
-    std::cout << "[Maschine] Swing: " << swing << std::endl;
-    sendToMaschineSoftware("set_swing:" + std::to_string(swing));
+    maschineState.swing = (int)lround(swing);
+    swingEngine.setAmount(swing / 100.0);
+    wakeScheduler();
+    if (logEvents()) std::cout << "[Maschine] Swing: " << swing << "%" << std::endl;
+    sendCommand(CMD_SET_SWING, maschineState.swing);
 }
 
 double MaschineMikroDriverUser::getSwing() {
@@ -849,70 +1754,529 @@ double MaschineMikroDriverUser::getSwing() {
 }
 
 void MaschineMikroDriverUser::tapTempo() {
-    std::cout << "[Maschine] Tap tempo detectado" << std::endl;
-    sendToMaschineSoftware("tap_tempo");
+    tapTempo(clock->now());
 }
 
+void MaschineMikroDriverUser::tapTempo(uint64_t timestampNs) {
+    if (logEvents()) std::cout << "[Maschine] Tap tempo detectado" << std::endl;
+    
+    if (tapTempoEstimator.tap(timestampNs)) {
+        changeTempo(tapTempoEstimator.getTempo());
+    }
+    
+    sendCommand(CMD_TAP_TEMPO);
+}
+
+// === RELOJ MIDI ESCLAVO ===
+void MaschineMikroDriverUser::enableClockSlaveMode() {
+    clockTracker.reset();
+    clockSlaveMode = true;
+    if (logInfo()) std::cout << "[Maschine] Modo esclavo de reloj MIDI: ON" << std::endl;
+    sendCommand(CMD_CLOCK_SLAVE, 1);
+}
+
+void MaschineMikroDriverUser::disableClockSlaveMode() {
+    clockSlaveMode = false;
+    if (logInfo()) std::cout << "[Maschine] Modo esclavo de reloj MIDI: OFF" << std::endl;
+    sendCommand(CMD_CLOCK_SLAVE, 0);
+}
+
+bool MaschineMikroDriverUser::isClockSlaveMode() {
+    return clockSlaveMode;
+}
+
+// Fuera de rango se lleva al límite (un giro rápido a 198 BPM deja 200)
 void MaschineMikroDriverUser::changeTempo(double newTempo) {
-    if (newTempo >= 60.0 && newTempo <= 200.0) {
+    newTempo = std::min(std::max(newTempo, MASCHINE_MIN_TEMPO), MASCHINE_MAX_TEMPO);
+    if (newTempo != maschineState.tempo) {
         setTempo(newTempo);
     }
 }
 
 void MaschineMikroDriverUser::changeSwing(double newSwing) {
-    if (newSwing >= 0.0 && newSwing <= 1.0) {
+    newSwing = std::min(std::max(newSwing, 0.0), 100.0);
+    if (newSwing != maschineState.swing) {
         setSwing(newSwing);
     }
 }
 
+// === CUANTIZACIÓN ===
+uint32_t MaschineMikroDriverUser::currentSequencerTick() {
+    // Esclavo de reloj: posición del maestro; si no, tiempo desde play()
+    if (clockSlaveMode && clockTracker.isRunning()) {
+        return (uint32_t)(clockTracker.getSongPositionTicks() * (SEQUENCER_PPQN / MIDI_CLOCK_PPQN));
+    }
+    if (!maschineState.isPlaying) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(positionMutex);
+    uint64_t now = clock->now();
+    double elapsedNs = now > playStartNs ? (double)(now - playStartNs) : 0.0;
+    return (uint32_t)(playStartTick + elapsedNs * positionTempo * SEQUENCER_PPQN / 60.0e9);
+}
+
+// Instante del reloj en que la posición libre alcanza tick
+uint64_t MaschineMikroDriverUser::tickTimeNs(uint32_t tick) {
+    std::lock_guard<std::mutex> lock(positionMutex);
+    if (tick <= playStartTick) {
+        return playStartNs;
+    }
+    return playStartNs + (uint64_t)std::ceil((tick - playStartTick) * 60.0e9 / (positionTempo * SEQUENCER_PPQN));
+}
+
+void MaschineMikroDriverUser::recordPadEvent(int pad, int velocity) {
+    // Lo que se oye ya lleva swing y el patrón se guarda sin él: deshacerlo
+    // aquí evita que la reproducción lo aplique dos veces
+    uint32_t tick = swingEngine.unapply(currentSequencerTick()) % MASCHINE_PATTERN_LENGTH;
+    if (quantizeMode) {
+        tick = quantizer.quantize(tick) % MASCHINE_PATTERN_LENGTH;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(patternMutex);
+        patterns[maschineState.currentGroup][maschineState.currentPattern].addEvent(tick, pad, velocity);
+    }
+    wakeScheduler();
+}
+
+void MaschineMikroDriverUser::enableQuantizeMode() {
+    quantizeMode = true;
+    if (logEvents()) std::cout << "[Maschine] Cuantización: ON" << std::endl;
+    sendCommand(CMD_QUANTIZE, 1);
+}
+
+void MaschineMikroDriverUser::disableQuantizeMode() {
+    quantizeMode = false;
+    if (logEvents()) std::cout << "[Maschine] Cuantización: OFF" << std::endl;
+    sendCommand(CMD_QUANTIZE, 0);
+}
+
+void MaschineMikroDriverUser::setQuantizeGrid(int grid) {
+    // grid = subdivisión de la redonda (4 = negras, 16 = semicorcheas, 12 = tresillos...)
+    if (grid > 0 && (SEQUENCER_PPQN * 4) % grid == 0) {
+        quantizer.setGrid(SEQUENCER_PPQN * 4 / grid);
+        if (logInfo()) std::cout << "[Maschine] Rejilla de cuantización: 1/" << grid << std::endl;
+        sendCommand(CMD_QUANTIZE_GRID, grid);
+    }
+}
+
+void MaschineMikroDriverUser::setQuantizeStrength(double strength) {
+    if (strength >= 0.0 && strength <= 1.0) {
+        quantizer.setStrength(strength);
+        if (logInfo()) std::cout << "[Maschine] Fuerza de cuantización: " << strength << std::endl;
+        sendCommand(CMD_QUANTIZE_STRENGTH, 0, 0, (int32_t)lround(strength * 1000.0));
+    }
+}
+
+void MaschineMikroDriverUser::quantizePattern(int group, int pattern) {
+    if (group < 0 || group >= MASCHINE_GROUPS || pattern < 0 || pattern >= MASCHINE_PATTERNS_PER_GROUP) {
+        return;
+    }
+    
+    // Copiar la columna de ticks y cuantizar fuera del lock para no bloquear
+    // la grabación; los eventos añadidos mientras tanto quedan al final
+    std::vector<uint32_t> ticks;
+    uint32_t generation;
+    {
+        std::lock_guard<std::mutex> lock(patternMutex);
+        ticks = patterns[group][pattern].ticks;
+        generation = patterns[group][pattern].generation;
+    }
+    if (ticks.empty()) {
+        return;
+    }
+    
+    quantizer.quantizeTicks(ticks.data(), ticks.size());
+    
+    {
+        std::lock_guard<std::mutex> lock(patternMutex);
+        MaschinePattern& target = patterns[group][pattern];
+        if (target.generation != generation) {
+            // Borrado o regrabado entretanto: los índices ya no son los mismos eventos
+            std::cout << "[Warning] El patrón " << pattern << " del grupo " << group
+                      << " cambió durante la cuantización; sin cambios" << std::endl;
+            return;
+        }
+        for (size_t i = 0; i < ticks.size(); ++i) {
+            target.ticks[i] = ticks[i] % MASCHINE_PATTERN_LENGTH;
+        }
+    }
+    wakeScheduler();
+    
+    if (logEvents()) {
+        std::cout << "[Maschine] Patrón " << pattern << " del grupo " << group
+                  << " cuantizado (" << ticks.size() << " eventos)" << std::endl;
+    }
+    sendCommand(CMD_QUANTIZE_PATTERN, group, pattern);
+}
+
+void MaschineMikroDriverUser::quantizeProject() {
+    for (int group = 0; group < MASCHINE_GROUPS; ++group) {
+        for (int pattern = 0; pattern < MASCHINE_PATTERNS_PER_GROUP; ++pattern) {
+            quantizePattern(group, pattern);
+        }
+    }
+}
+
+// === SWING Y PLANIFICADOR ===
+void MaschineMikroDriverUser::enableSwingMode() {
+    swingEngine.setEnabled(true);
+    wakeScheduler();
+    if (logEvents()) std::cout << "[Maschine] Swing: ON" << std::endl;
+    sendCommand(CMD_SWING_MODE, 1);
+}
+
+void MaschineMikroDriverUser::disableSwingMode() {
+    swingEngine.setEnabled(false);
+    wakeScheduler();
+    if (logEvents()) std::cout << "[Maschine] Swing: OFF" << std::endl;
+    sendCommand(CMD_SWING_MODE, 0);
+}
+
+void MaschineMikroDriverUser::setSwingAmount(double amount) {
+    // amount en 0.0-1.0; el estado guarda el porcentaje
+    changeSwing(amount * 100.0);
+}
+
+void MaschineMikroDriverUser::setSwingGrid(int grid) {
+    if (grid > 0 && (SEQUENCER_PPQN * 4) % grid == 0) {
+        swingEngine.setGrid(SEQUENCER_PPQN * 4 / grid);
+        wakeScheduler();
+        if (swingEngine.getGrid() == (uint32_t)(SEQUENCER_PPQN * 4 / grid)) {
+            if (logInfo()) std::cout << "[Maschine] Rejilla de swing: 1/" << grid << std::endl;
+            sendCommand(CMD_SWING_GRID, grid);
+        }
+    }
+}
+
+void MaschineMikroDriverUser::startScheduler() {
+    if (schedulerRunning) {
+        return;
+    }
+    schedulerRunning = true;
+    clock->addWaiter(schedulerMutex, schedulerCondition);
+    schedulerThread = std::thread(&MaschineMikroDriverUser::runScheduler, this);
+    if (schedulerPriority > 0) {
+        setMaschineThreadPriority(schedulerThread.native_handle(), schedulerPriority);
+    }
+}
+
+void MaschineMikroDriverUser::stopScheduler() {
+    schedulerRunning = false;
+    wakeScheduler();
+    if (schedulerThread.joinable()) {
+        schedulerThread.join();
+    }
+    clock->removeWaiter(schedulerCondition);
+}
+
+void MaschineMikroDriverUser::wakeScheduler() {
+    std::lock_guard<std::mutex> lock(schedulerMutex);
+    schedulerWake = true;
+    schedulerCondition.notify_one();
+}
+
+// Primer tick (absoluto) en el que ha sonado el próximo evento del patrón
+// a partir de fromTick, o UINT32_MAX si el patrón está vacío
+uint32_t MaschineMikroDriverUser::nextPatternTick(uint32_t fromTick) {
+    std::lock_guard<std::mutex> lock(patternMutex);
+    const MaschinePattern& pattern = patterns[maschineState.currentGroup][maschineState.currentPattern];
+    if (pattern.size() == 0) {
+        return UINT32_MAX;
+    }
+    uint32_t from = fromTick % MASCHINE_PATTERN_LENGTH;
+    uint32_t nearest = MASCHINE_PATTERN_LENGTH;
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        uint32_t tick = swingEngine.apply(pattern.ticks[i]) % MASCHINE_PATTERN_LENGTH;
+        nearest = std::min(nearest, (tick + MASCHINE_PATTERN_LENGTH - from) % MASCHINE_PATTERN_LENGTH);
+    }
+    // Las ventanas son [desde, hasta): el evento sale cuando la posición lo supera
+    return fromTick + nearest + 1;
+}
+
+void MaschineMikroDriverUser::runScheduler() {
+    uint32_t lastTick = currentSequencerTick();
+    uint64_t nextAutomation = clock->now();
+    
+    while (schedulerRunning) {
+        // Dormir hasta el próximo evento del patrón o de automatización. Lo
+        // que cambia el plan (tempo, swing, patrón, grabación, pulsos del
+        // reloj esclavo, stop) despierta antes con wakeScheduler()
+        uint32_t target = nextPatternTick(lastTick);
+        uint64_t deadline = UINT64_MAX;
+        bool slave = clockSlaveMode && clockTracker.isRunning();
+        if (target != UINT32_MAX && !slave) {
+            deadline = tickTimeNs(target);
+        }
+        if (automationPlayback) {
+            deadline = std::min(deadline, nextAutomation);
+        }
+        {
+            std::unique_lock<std::mutex> lock(schedulerMutex);
+            if (!schedulerWake && schedulerRunning) {
+                clock->waitUntil(lock, schedulerCondition, deadline);
+            }
+            schedulerWake = false;
+        }
+        
+        // Solo se emite si se llegó al evento previsto; si se despertó antes,
+        // lo que haya entre medias es nuevo (grabado en vivo o de otro
+        // patrón) y ya pasó: se resincroniza sin tocarlo. Un cambio de
+        // tempo o del reloj que mueva la posición atrás tampoco repite nada
+        uint32_t tick = currentSequencerTick();
+        if (target != UINT32_MAX && tick >= target && tick > lastTick) {
+            scheduleSpan(lastTick, tick);
+        }
+        lastTick = tick;
+        
+        // La automatización se emite a su propia tasa de control
+        uint64_t now = clock->now();
+        if (automationPlayback && now >= nextAutomation) {
+            emitAutomation(tick);
+            nextAutomation = now + 1000000000ULL / automationControlRate;
+        }
+    }
+}
+
+void MaschineMikroDriverUser::scheduleSpan(uint32_t fromTick, uint32_t toTick) {
+    if (toTick - fromTick >= MASCHINE_PATTERN_LENGTH) {
+        scheduleWindow(0, MASCHINE_PATTERN_LENGTH);
+        return;
+    }
+    
+    uint32_t from = fromTick % MASCHINE_PATTERN_LENGTH;
+    uint32_t to = toTick % MASCHINE_PATTERN_LENGTH;
+    if (from <= to) {
+        scheduleWindow(from, to);
+    } else {
+        // La ventana cruza el final del patrón
+        scheduleWindow(from, MASCHINE_PATTERN_LENGTH);
+        scheduleWindow(0, to);
+    }
+}
+
+void MaschineMikroDriverUser::scheduleWindow(uint32_t fromTick, uint32_t toTick) {
+    scheduledEvents.clear();
+    {
+        std::lock_guard<std::mutex> lock(patternMutex);
+        const MaschinePattern& pattern = patterns[maschineState.currentGroup][maschineState.currentPattern];
+        for (size_t i = 0; i < pattern.size(); ++i) {
+            // El patrón está sin swing: se aplica aquí, un acceso a tabla por evento
+            uint32_t tick = swingEngine.apply(pattern.ticks[i]) % MASCHINE_PATTERN_LENGTH;
+            if (tick >= fromTick && tick < toTick) {
+                scheduledEvents.push_back(std::make_pair(pattern.pads[i], pattern.velocities[i]));
+            }
+        }
+    }
+    
+    // Emitir fuera del lock para no bloquear la grabación
+    for (size_t i = 0; i < scheduledEvents.size(); ++i) {
+        emitPatternEvent(scheduledEvents[i].first, scheduledEvents[i].second);
+    }
+}
+
+void MaschineMikroDriverUser::emitPatternEvent(int pad, int velocity) {
+    sendCommand(CMD_PATTERN_NOTE, pad, velocity);
+}
+
+// === AUTOMATIZACIÓN ===
+void MaschineMikroDriverUser::enableAutomationMode() {
+    if (!maschineState.automationMode) {
+        toggleAutomationMode();
+    }
+}
+
+void MaschineMikroDriverUser::disableAutomationMode() {
+    if (maschineState.automationMode) {
+        toggleAutomationMode();
+    }
+}
+
+void MaschineMikroDriverUser::recordAutomation(int parameter, double value) {
+    if (parameter < 0 || parameter >= AUTOMATION_PARAMETERS) {
+        return;
+    }
+    // Sin transporte en marcha no hay posición: todo caería en el tick 0
+    if (!maschineState.isPlaying && !(clockSlaveMode && clockTracker.isRunning())) {
+        return;
+    }
+    if (value < 0.0) value = 0.0;
+    if (value > 1.0) value = 1.0;
+    
+    uint32_t tick = currentSequencerTick();
+    std::lock_guard<std::mutex> lock(automationMutex);
+    MaschineAutomationLane& lane = automationLanes[parameter];
+    // Una toma nueva (la posición volvió atrás) reemplaza la anterior
+    if (lane.getPointCount() > 0 && tick < lane.getLastTick()) {
+        lane.clear();
+    }
+    lane.addPoint(tick, (uint16_t)(value * AUTOMATION_MAX_VALUE + 0.5));
+}
+
+void MaschineMikroDriverUser::playAutomation() {
+    {
+        std::lock_guard<std::mutex> lock(automationMutex);
+        for (std::map<int, MaschineAutomationLane>::iterator it = automationLanes.begin(); it != automationLanes.end(); ++it) {
+            it->second.rewind();
+        }
+        automationSent.clear();
+    }
+    automationPlayback = true;
+    wakeScheduler();
+    if (logEvents()) std::cout << "[Maschine] Reproduciendo automatización (" << automationControlRate << " Hz)" << std::endl;
+    sendCommand(CMD_PLAY_AUTOMATION);
+}
+
+void MaschineMikroDriverUser::clearAutomation() {
+    {
+        std::lock_guard<std::mutex> lock(automationMutex);
+        automationLanes.clear();
+        automationSent.clear();
+    }
+    automationPlayback = false;
+    if (logEvents()) std::cout << "[Maschine] Automatización borrada" << std::endl;
+    sendCommand(CMD_CLEAR_AUTOMATION);
+}
+
+void MaschineMikroDriverUser::setAutomationControlRate(int hz) {
+    if (hz >= 1 && hz <= 1000) {
+        automationControlRate = hz;
+        if (logInfo()) std::cout << "[Maschine] Tasa de control de automatización: " << hz << " Hz" << std::endl;
+    }
+}
+
+void MaschineMikroDriverUser::setAutomationThinning(double tolerance) {
+    // Tolerancia normalizada 0.0-1.0; 0 desactiva el aligerado
+    if (tolerance >= 0.0 && tolerance <= 1.0) {
+        automationThinTolerance = (uint16_t)(tolerance * AUTOMATION_MAX_VALUE + 0.5);
+    }
+}
+
+void MaschineMikroDriverUser::thinAutomation() {
+    size_t removed = 0;
+    {
+        std::lock_guard<std::mutex> lock(automationMutex);
+        for (std::map<int, MaschineAutomationLane>::iterator it = automationLanes.begin(); it != automationLanes.end(); ++it) {
+            removed += it->second.thin(automationThinTolerance);
+        }
+    }
+    if (logInfo()) std::cout << "[Maschine] Automatización aligerada: " << removed << " puntos eliminados" << std::endl;
+}
+
+void MaschineMikroDriverUser::emitAutomation(uint32_t tick) {
+    // Todos los CC del período de control van en un único paquete; cada
+    // valor sale como pareja MSB/LSB para conservar los 14 bits grabados
+    Byte buffer[1024];
+    Byte messages[768];
+    size_t length = 0;
+    {
+        std::lock_guard<std::mutex> lock(automationMutex);
+        for (std::map<int, MaschineAutomationLane>::iterator it = automationLanes.begin();
+             it != automationLanes.end() && length + 6 <= sizeof(messages); ++it) {
+            uint16_t value;
+            if (!it->second.valueAt(tick, &value)) {
+                continue;
+            }
+            std::map<int, int>::iterator sent = automationSent.find(it->first);
+            if (sent != automationSent.end() && sent->second == value) {
+                continue;
+            }
+            automationSent[it->first] = value;
+            int cc = AUTOMATION_CC_BASE + it->first;
+            messages[length++] = 0xB0;
+            messages[length++] = (Byte)cc;
+            messages[length++] = (Byte)(value >> 7);
+            messages[length++] = 0xB0;
+            messages[length++] = (Byte)(cc + AUTOMATION_CC_LSB_OFFSET);
+            messages[length++] = (Byte)(value & 0x7F);
+        }
+    }
+    if (length == 0) {
+        return;
+    }
+    
+    MIDIPacketList* packetList = (MIDIPacketList*)buffer;
+    MIDIPacket* packet = MIDIPacketListInit(packetList);
+    packet = MIDIPacketListAdd(packetList, sizeof(buffer), packet, 0, length, messages);
+    if (packet) {
+        sendPacketList(packetList);
+        midiMessagesOut += length / 3;
+    }
+}
+
+void MaschineMikroDriverUser::printAutomationStats() {
+    std::lock_guard<std::mutex> lock(automationMutex);
+    std::cout << "[Maschine] Automatización: " << automationLanes.size() << " carriles" << std::endl;
+    for (std::map<int, MaschineAutomationLane>::iterator it = automationLanes.begin(); it != automationLanes.end(); ++it) {
+        const MaschineAutomationLane& lane = it->second;
+        // Duración del carril en minutos al tempo actual
+        double minutes = lane.getLastTick() / (SEQUENCER_PPQN * maschineState.tempo);
+        std::cout << "  Parámetro " << it->first << ": " << lane.getPointCount() << " puntos, "
+                  << lane.getByteSize() << " bytes";
+        if (minutes > 0.0) {
+            std::cout << " (" << (size_t)(lane.getByteSize() / minutes) << " bytes/min)";
+        }
+        std::cout << std::endl;
+    }
+}
+
 // === FUNCIONES ESPECIALES ===
 void MaschineMikroDriverUser::toggleSoloMode() {
     maschineState.soloMode = !maschineState.soloMode;
-    std::cout << "[Maschine] Solo mode: " << (maschineState.soloMode ? "ON" : "OFF") << std::endl;
+    if (logEvents()) std::cout << "[Maschine] Solo mode: " << (maschineState.soloMode ? "ON" : "OFF") << std::endl;
     setButtonLED(BUTTON_SOLO, maschineState.soloMode);
-    sendToMaschineSoftware("toggle_solo");
+    sendCommand(CMD_TOGGLE_SOLO);
 }
 
 void MaschineMikroDriverUser::toggleMuteMode() {
     maschineState.muteMode = !maschineState.muteMode;
-    std::cout << "[Maschine] Mute mode: " << (maschineState.muteMode ? "ON" : "OFF") << std::endl;
+    if (logEvents()) std::cout << "[Maschine] Mute mode: " << (maschineState.muteMode ? "ON" : "OFF") << std::endl;
     setButtonLED(BUTTON_MUTE, maschineState.muteMode);
-    sendToMaschineSoftware("toggle_mute");
+    sendCommand(CMD_TOGGLE_MUTE);
 }
 
 void MaschineMikroDriverUser::toggleAutomationMode() {
     maschineState.automationMode = !maschineState.automationMode;
-    std::cout << "[Maschine] Automation mode: " << (maschineState.automationMode ? "ON" : "OFF") << std::endl;
+    if (!maschineState.automationMode && automationThinTolerance > 0) {
+        // Al salir de escritura, aligerar las curvas recién grabadas
+        thinAutomation();
+    }
+    if (logEvents()) std::cout << "[Maschine] Automation mode: " << (maschineState.automationMode ? "ON" : "OFF") << std::endl;
     setButtonLED(BUTTON_AUTOMATION, maschineState.automationMode);
-    sendToMaschineSoftware("toggle_automation");
+    sendCommand(CMD_TOGGLE_AUTOMATION);
 }
 
 void MaschineMikroDriverUser::erasePattern() {
-    std::cout << "[Maschine] Borrando patrón actual" << std::endl;
-    sendToMaschineSoftware("erase_pattern");
+    if (logEvents()) std::cout << "[Maschine] Borrando patrón actual" << std::endl;
+    {
+        std::lock_guard<std::mutex> lock(patternMutex);
+        patterns[maschineState.currentGroup][maschineState.currentPattern].clear();
+    }
+    wakeScheduler();
+    sendCommand(CMD_ERASE_PATTERN);
 }
 
 void MaschineMikroDriverUser::selectAll() {
-    std::cout << "[Maschine] Seleccionando todo" << std::endl;
-    sendToMaschineSoftware("select_all");
+    if (logEvents()) std::cout << "[Maschine] Seleccionando todo" << std::endl;
+    sendCommand(CMD_SELECT_ALL);
 }
 
 // === MÉTODOS DE COMPATIBILIDAD MIDI ===
 void MaschineMikroDriverUser::sendMIDINote(unsigned char note, unsigned char velocity, unsigned char channel) {
-    std::cout << "[MIDI] Note: " << (int)note << " Velocity: " << (int)velocity << " Channel: " << (int)channel << std::endl;
+    if (logEvents()) std::cout << "[MIDI] Note: " << (int)note << " Velocity: " << (int)velocity << " Channel: " << (int)channel << std::endl;
 }
 
 void MaschineMikroDriverUser::sendMIDICC(unsigned char controller, unsigned char value, unsigned char channel) {
-    std::cout << "[MIDI] CC: " << (int)controller << " Value: " << (int)value << " Channel: " << (int)channel << std::endl;
+    if (logEvents()) std::cout << "[MIDI] CC: " << (int)controller << " Value: " << (int)value << " Channel: " << (int)channel << std::endl;
 }
 
 void MaschineMikroDriverUser::testAllPads() {
     std::cout << "[Test] Probando todos los pads..." << std::endl;
     for (int i = 0; i < 16; ++i) {
         handlePadPressMaschine(i, 127);
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        sleepMillis(100);
         handlePadReleaseMaschine(i);
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        sleepMillis(100);
     }
 }
 
@@ -920,9 +2284,9 @@ void MaschineMikroDriverUser::testAllButtons() {
     std::cout << "[Test] Probando todos los botones..." << std::endl;
     for (int i = 0; i < 8; ++i) {
         handleButtonPressMaschine(i);
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        sleepMillis(100);
         handleButtonReleaseMaschine(i);
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        sleepMillis(100);
     }
 }
 
@@ -930,17 +2294,53 @@ void MaschineMikroDriverUser::testAllEncoders() {
     std::cout << "[Test] Probando todos los encoders..." << std::endl;
     for (int i = 0; i < 2; ++i) {
         handleEncoderTurnMaschine(i, 1);
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        sleepMillis(100);
         handleEncoderTurnMaschine(i, -1);
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        sleepMillis(100);
+    }
+    
+    // Barrido rápido (un detent por ms, ida y vuelta) para medir la coalescencia
+    uint64_t inputBefore, outputBefore;
+    {
+        std::lock_guard<std::mutex> lock(encoderMutex);
+        inputBefore = encoderCoalescer.getInputCount();
+        outputBefore = encoderCoalescer.getOutputCount();
+    }
+    for (int i = 0; i < 2; ++i) {
+        for (int step = 0; step < 40; ++step) {
+            handleEncoderTurnMaschine(i, step < 20 ? 1 : -1);
+            sleepMillis(1);
+        }
+    }
+    sleepMillis(50);
+    
+    // Las deltas listas que el hilo de encoders aún no aplicó salen aquí
+    flushEncoders(clock->now());
+    std::lock_guard<std::mutex> lock(encoderMutex);
+    uint64_t input = encoderCoalescer.getInputCount() - inputBefore;
+    uint64_t output = encoderCoalescer.getOutputCount() - outputBefore;
+    std::cout << "[Test] Barrido: " << input << " pasos -> " << output << " eventos";
+    if (output > 0) {
+        std::cout << " (compresión " << (double)input / output << ":1)";
+    }
+    std::cout << std::endl;
+}
+
+void MaschineMikroDriverUser::setEncoderCoalescePeriod(int ms) {
+    if (ms < 0) {
+        return;
     }
+    std::lock_guard<std::mutex> lock(encoderMutex);
+    // 0 desactiva la coalescencia: cada paso sale en el acto
+    encoderCoalescer.setPeriod((uint64_t)ms * 1000000ULL);
+    if (logInfo()) std::cout << "[Maschine] Período de coalescencia de encoders: " << ms << " ms" << std::endl;
 }
 
 void MaschineMikroDriverUser::testIndividualPad(int pad) {
     if (pad >= 0 && pad < 16) {
         std::cout << "[Test] Probando pad " << pad << std::endl;
         handlePadPressMaschine(pad, 127);
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        sleepMillis(500);
         handlePadReleaseMaschine(pad);
     }
 }
@@ -949,7 +2349,7 @@ void MaschineMikroDriverUser::testIndividualButton(int button) {
     if (button >= 0 && button < 8) {
         std::cout << "[Test] Probando botón " << button << std::endl;
         handleButtonPressMaschine(button);
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        sleepMillis(500);
         handleButtonReleaseMaschine(button);
     }
 }
@@ -958,7 +2358,7 @@ void MaschineMikroDriverUser::testIndividualEncoder(int encoder) {
     if (encoder >= 0 && encoder < 2) {
         std::cout << "[Test] Probando encoder " << encoder << std::endl;
         handleEncoderTurnMaschine(encoder, 1);
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        sleepMillis(500);
         handleEncoderTurnMaschine(encoder, -1);
     }
 }
@@ -993,12 +2393,13 @@ void MaschineMikroDriverUser::printStatus() {
 // === MÉTODOS STUB PARA FUNCIONES AVANZADAS ===
 void MaschineMikroDriverUser::initializeMaschine() {
     std::cout << "[Maschine] Inicializando modo Maschine..." << std::endl;
+    setMaschineInput(true);
     connectMaschineSoftware();
 }
 
 void MaschineMikroDriverUser::setMaschineMode(int mode) {
     maschineState.currentMode = mode;
-    std::cout << "[Maschine] Modo cambiado a: " << (mode == MASCHINE_MODE_NATIVE ? "Maschine" : "MIDI") << std::endl;
+    if (logInfo()) std::cout << "[Maschine] Modo cambiado a: " << (mode == MASCHINE_MODE_NATIVE ? "Maschine" : "MIDI") << std::endl;
 }
 
 int MaschineMikroDriverUser::getMaschineMode() {
@@ -1014,6 +2415,35 @@ void MaschineMikroDriverUser::runMaschineTestSuite() {
     printMaschineStatus();
 }
 
+// Nombres (las tablas se crean en el primer uso)
+void MaschineMikroDriverUser::renameGroup(int group, const std::string& name) {
+    ensureNameTables();
+    if (group >= 0 && group < MASCHINE_GROUPS) {
+        groupNames[group] = name;
+    }
+}
+
+void MaschineMikroDriverUser::renameSound(int group, int sound, const std::string& name) {
+    ensureNameTables();
+    if (group >= 0 && group < MASCHINE_GROUPS && sound >= 0 && sound < MASCHINE_SOUNDS_PER_GROUP) {
+        soundNames[group * MASCHINE_SOUNDS_PER_GROUP + sound] = name;
+    }
+}
+
+void MaschineMikroDriverUser::renamePattern(int group, int pattern, const std::string& name) {
+    ensureNameTables();
+    if (group >= 0 && group < MASCHINE_GROUPS && pattern >= 0 && pattern < MASCHINE_PATTERNS_PER_GROUP) {
+        patternNames[group * MASCHINE_PATTERNS_PER_GROUP + pattern] = name;
+    }
+}
+
+void MaschineMikroDriverUser::renameScene(int scene, const std::string& name) {
+    ensureNameTables();
+    if (scene >= 0 && scene < MASCHINE_SCENES) {
+        sceneNames[scene] = name;
+    }
+}
+
 // Métodos stub para funciones no implementadas
 void MaschineMikroDriverUser::launchMaschineSoftware() {}
 void MaschineMikroDriverUser::newProject() {}
@@ -1022,36 +2452,17 @@ void MaschineMikroDriverUser::saveProject(const std::string& path) {}
 void MaschineMikroDriverUser::exportProject(const std::string& path) {}
 void MaschineMikroDriverUser::rewind() {}
 void MaschineMikroDriverUser::fastForward() {}
-void MaschineMikroDriverUser::enableAutomationMode() {}
-void MaschineMikroDriverUser::disableAutomationMode() {}
-void MaschineMikroDriverUser::recordAutomation(int parameter, double value) {}
-void MaschineMikroDriverUser::playAutomation() {}
-void MaschineMikroDriverUser::clearAutomation() {}
-void MaschineMikroDriverUser::enableQuantizeMode() {}
-void MaschineMikroDriverUser::disableQuantizeMode() {}
-void MaschineMikroDriverUser::setQuantizeGrid(int grid) {}
-void MaschineMikroDriverUser::setQuantizeStrength(double strength) {}
-void MaschineMikroDriverUser::enableSwingMode() {}
-void MaschineMikroDriverUser::disableSwingMode() {}
-void MaschineMikroDriverUser::setSwingAmount(double amount) {}
-void MaschineMikroDriverUser::setSwingGrid(int grid) {}
 void MaschineMikroDriverUser::setDisplayText(const std::string& text) {}
 void MaschineMikroDriverUser::clearDisplay() {}
 void MaschineMikroDriverUser::setDisplayBrightness(int level) {}
-void MaschineMikroDriverUser::flashPadLED(int pad, int duration) {}
-void MaschineMikroDriverUser::flashButtonLED(int button, int duration) {}
 void MaschineMikroDriverUser::pulsePadLED(int pad, int speed) {}
 void MaschineMikroDriverUser::pulseButtonLED(int button, int speed) {}
-void MaschineMikroDriverUser::renameGroup(int group, const std::string& name) {}
 void MaschineMikroDriverUser::copyGroup(int fromGroup, int toGroup) {}
 void MaschineMikroDriverUser::deleteSound(int group, int sound) {}
-void MaschineMikroDriverUser::renameSound(int group, int sound, const std::string& name) {}
 void MaschineMikroDriverUser::copySound(int fromGroup, int fromSound, int toGroup, int toSound) {}
 void MaschineMikroDriverUser::deletePattern(int group, int pattern) {}
-void MaschineMikroDriverUser::renamePattern(int group, int pattern, const std::string& name) {}
 void MaschineMikroDriverUser::copyPattern(int fromGroup, int fromPattern, int toGroup, int toPattern) {}
 void MaschineMikroDriverUser::deleteScene(int scene) {}
-void MaschineMikroDriverUser::renameScene(int scene, const std::string& name) {}
 void MaschineMikroDriverUser::copyScene(int fromScene, int toScene) {}
 
 // Funciones para listar dispositivos MIDI
@@ -5,14 +5,33 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
 #include <CoreMIDI/CoreMIDI.h>
 #include <CoreFoundation/CoreFoundation.h>
+#include "MaschineTiming.h"
+#include "MaschineSequencer.h"
+#include "MaschineProtocol.h"
+#include "MaschineChannel.h"
+#include "MaschineEventLoop.h"
+#include "MaschineEventServer.h"
+#include "MaschineStatePage.h"
+#include "MaschineConfig.h"
 
 // Constantes para Maschine Mikro MK1
 #define NUM_PADS 16
 #define NUM_BUTTONS 8
 #define NUM_SOUNDS 12
 
+// Deltas de encoder vaciadas por cambios de sentido a la espera de aplicarse
+#define MASCHINE_ENCODER_READY_MAX 32
+
+// Identificador único del endpoint de la última sesión (relativo a $HOME)
+#define MASCHINE_ENDPOINT_CACHE "Library/Caches/com.maschine-mikro.endpoint"
+
 // Maschine Mode Constants
 #define MASCHINE_MODE_NATIVE 0
 #define MASCHINE_MODE_MIDI   1
@@ -50,8 +69,8 @@ struct MaschineState {
     int currentSound;
     int currentPattern;
     int currentScene;
-    int tempo;
-    int swing;
+    double tempo;
+    int swing;              // porcentaje 0-100
     bool isPlaying;
     bool isRecording;
     bool shiftPressed;
@@ -74,13 +93,18 @@ struct MaschineState {
     bool sceneActive[MASCHINE_SCENES];
 };
 
+// Salida MIDI alternativa a CoreMIDI (transporte loopback de las pruebas)
+typedef std::function<void(const MIDIPacketList*)> MaschineOutputSink;
+
 class MaschineMikroDriverUser {
 private:
     MIDIClientRef midiClient;
     MIDIPortRef midiOutPort;
     MIDIEndpointRef midiDestinations[10];
     int numDestinations;
-    bool deviceConnected;
+    // Lo escriben el hilo de las notificaciones de CoreMIDI y el de entrada;
+    // lo leen el menú, el bucle de eventos y la página de estado
+    std::atomic<bool> deviceConnected;
     
     // Maschine specific
     MaschineState maschineState;
@@ -88,15 +112,151 @@ private:
     std::map<int, std::string> soundNames;
     std::map<int, std::string> patternNames;
     std::map<int, std::string> sceneNames;
+    std::once_flag nameTablesOnce;
+    void ensureNameTables();
     
     // Maschine software communication
     bool maschineSoftwareConnected;
     std::string maschineSoftwarePath;
+    bool debugCommands;
+    std::atomic<uint64_t> commandsSent;
+    void sendCommand(int opcode, int arg0 = 0, int arg1 = 0, int32_t value = 0);
+    MaschineChannel hostChannel;
+    MaschineEventServer eventServer;
+    
+    // Página de estado en vivo para monitores externos. Los hilos de
+    // entrada y el planificador solo la marcan como sucia; la escribe
+    // únicamente el bucle de eventos (un solo escritor para el seqlock)
+    MaschineStateExport stateExport;
+    std::atomic<bool> statePageDirty;
+    int statePageTimer;
+    std::atomic<uint64_t> padEventCount;
+    std::atomic<uint64_t> buttonEventCount;
+    std::atomic<uint64_t> encoderEventCount;
+    std::atomic<uint64_t> midiMessagesIn;
+    std::atomic<uint64_t> midiMessagesOut;
+    void markStatePageDirty() { statePageDirty.store(true, std::memory_order_release); }
+    void publishStatePage();
+    void handleHostCommand(const MaschineCommand& command);
     
     // MIDI communication
     MIDIPortRef midiInPort;
     void handleMIDIInput(const MIDIPacketList* packetList);
     
+    // Descubrimiento por notificaciones de CoreMIDI (llegan al CFRunLoop del
+    // hilo que creó el cliente, el del bucle de eventos). deviceMutex
+    // serializa conectar y retirar la fuente frente a disconnectDevice()
+    std::mutex deviceMutex;
+    std::atomic<MIDIEndpointRef> deviceSource;
+    MIDIUniqueID deviceUniqueID;
+    bool deviceEverConnected;
+    uint64_t plugNoticedNs;
+    static void midiNotifyProc(const MIDINotification* notification, void* refCon);
+    void handleMIDINotification(const MIDINotification* notification);
+    void refreshDestinations(bool verbose);
+    bool findDeviceSource();
+    bool connectSource(MIDIEndpointRef source, const char* name);
+    bool isSourceOnline(MIDIEndpointRef source);
+    void deviceRemoved();
+    void restoreDeviceState();
+    MIDIUniqueID loadCachedEndpoint();
+    void saveCachedEndpoint(MIDIUniqueID uniqueID);
+    
+    // Modo daemon: nivel de log, mapeo de entradas y prioridades de hilos.
+    // Se cambian en caliente (SIGHUP) mientras llegan eventos, de ahí los atómicos
+    std::atomic<int> logLevel;
+    std::atomic<uint8_t> padMap[NUM_PADS];
+    std::atomic<uint8_t> buttonMap[NUM_BUTTONS];
+    std::atomic<int> schedulerPriority;
+    std::atomic<int> encoderPriority;
+    bool logInfo() const { return logLevel >= MASCHINE_LOG_INFO; }
+    bool logEvents() const { return logLevel >= MASCHINE_LOG_EVENTS; }
+    void sendLEDState();
+    void sendLEDSysEx(int target, int index, bool state);
+    
+    // Reloj inyectable y transporte loopback (pruebas en tiempo virtual)
+    MaschineClock* clock;
+    MaschineOutputSink outputSink;
+    
+    // Entrada del dispositivo hacia los manejadores del modo Maschine
+    // (LEDs y comandos al host) en vez del eco básico
+    std::atomic<bool> maschineInput;
+    void sendPacketList(const MIDIPacketList* packetList);
+    void sleepMillis(int ms);
+    
+    // Perfil de arranque (--startup-profile): fases hasta el primer evento
+    bool startupProfiling;
+    std::atomic<bool> firstEventSeen;
+    std::mutex startupMutex;
+    std::vector<std::pair<std::string, uint64_t> > startupMarks;
+    
+    // Reloj MIDI esclavo
+    bool clockSlaveMode;
+    MaschineClockTracker clockTracker;
+    
+    // Tap tempo
+    MaschineTapTempo tapTempoEstimator;
+    
+    // Secuenciador: patrones grabados y cuantización
+    MaschinePattern patterns[MASCHINE_GROUPS][MASCHINE_PATTERNS_PER_GROUP];
+    std::mutex patternMutex;
+    
+    // Posición libre: ancla (instante, tick) y tempo desde el ancla.
+    // setTempo() re-ancla para que un cambio de tempo no reescale lo ya tocado
+    std::mutex positionMutex;
+    uint64_t playStartNs;
+    double playStartTick;
+    double positionTempo;
+    uint64_t tickTimeNs(uint32_t tick);
+    bool quantizeMode;
+    MaschineQuantizer quantizer;
+    uint32_t currentSequencerTick();
+    void recordPadEvent(int pad, int velocity);
+    
+    // Planificador de salida: reproduce el patrón actual aplicando swing
+    MaschineSwing swingEngine;
+    std::thread schedulerThread;
+    std::atomic<bool> schedulerRunning;
+    std::vector<std::pair<int, int> > scheduledEvents;
+    std::mutex schedulerMutex;
+    std::condition_variable schedulerCondition;
+    bool schedulerWake;
+    void wakeScheduler();
+    uint32_t nextPatternTick(uint32_t fromTick);
+    void startScheduler();
+    void stopScheduler();
+    void runScheduler();
+    void scheduleSpan(uint32_t fromTick, uint32_t toTick);
+    void scheduleWindow(uint32_t fromTick, uint32_t toTick);
+    void emitPatternEvent(int pad, int velocity);
+    
+    // Automatización: un carril por parámetro
+    std::map<int, MaschineAutomationLane> automationLanes;
+    std::map<int, int> automationSent;
+    std::mutex automationMutex;
+    std::atomic<bool> automationPlayback;
+    std::atomic<int> automationControlRate;
+    uint16_t automationThinTolerance;
+    void emitAutomation(uint32_t tick);
+    void handleMIDIClock(unsigned char status, MIDITimeStamp timeStamp);
+    
+    // Coalescencia de encoders antes de reenviar al host / DAW. El hilo de
+    // entrada solo acumula bajo encoderMutex; las deltas se aplican fuera de
+    // él, bajo encoderApplyMutex, que el hilo de entrada nunca toma
+    MaschineEncoderCoalescer encoderCoalescer;
+    std::mutex encoderMutex;
+    std::mutex encoderApplyMutex;
+    std::condition_variable encoderCondition;
+    std::thread encoderFlushThread;
+    bool encoderFlushRunning;
+    // Deltas ya vaciadas por un cambio de sentido, en orden de llegada
+    std::pair<int, int> encoderReady[MASCHINE_ENCODER_READY_MAX];
+    int encoderReadyCount;
+    void stopEncoderFlush();
+    void runEncoderFlush();
+    void applyEncoderDelta(int encoder, int delta);
+    void flushEncoders(uint64_t now);
+    
     // Internal methods
     void initializeMaschineState();
     void setupGroupNames();
@@ -145,6 +305,7 @@ public:
     bool initialize();
     bool connectDevice();
     void disconnectDevice();
+    bool isDeviceConnected() const { return deviceConnected; }
     void printDeviceInfo();
     void printMIDIInfo();
     void printStatus();
@@ -164,7 +325,8 @@ public:
     void handlePadDoublePressMaschine(int pad);
     
     // Button handling in Maschine mode
-    void handleButtonPressMaschine(int button);
+    // timestampNs: instante del evento (0 = ahora)
+    void handleButtonPressMaschine(int button, uint64_t timestampNs = 0);
     void handleButtonReleaseMaschine(int button);
     void handleButtonLongPressMaschine(int button);
     
@@ -214,6 +376,12 @@ public:
     void setSwing(double swing);
     double getSwing();
     void tapTempo();
+    void tapTempo(uint64_t timestampNs);
+    
+    // MIDI clock slave
+    void enableClockSlaveMode();
+    void disableClockSlaveMode();
+    bool isClockSlaveMode();
     
     // Project management
     void newProject();
@@ -239,6 +407,24 @@ public:
     void launchMaschineSoftware();
     void sendToMaschineSoftware(const std::string& command);
     void receiveFromMaschineSoftware();
+    void attachEventLoop(MaschineEventLoop& loop);
+    void detachEventLoop(MaschineEventLoop& loop);
+    bool startEventServer(const char* path = MASCHINE_EVENT_SOCKET);
+    void stopEventServer();
+    bool startStateExport(const char* name = MASCHINE_STATE_PAGE_NAME);
+    void setDebugMode(bool enabled);
+    void enableStartupProfile();
+    void markStartup(const std::string& phase);
+    void printStartupProfile();
+    void setLogLevel(int level);
+    void setInputMapping(const uint8_t* pads, const uint8_t* buttons);
+    void setThreadPriorities(int scheduler, int encoder);
+    void refreshLEDs();
+    void printStats();
+    void setMaschineInput(bool enabled);
+    void setClock(MaschineClock* newClock);
+    void setOutputSink(MaschineOutputSink sink);
+    void injectMIDIInput(const MIDIPacketList* packetList);
     
     // LED control
     void setPadLED(int pad, bool state);
@@ -262,11 +448,18 @@ public:
     void recordAutomation(int parameter, double value);
     void playAutomation();
     void clearAutomation();
+    void setAutomationControlRate(int hz);
+    void setAutomationThinning(double tolerance);
+    void thinAutomation();
+    void printAutomationStats();
+    void setEncoderCoalescePeriod(int ms);
     
     void enableQuantizeMode();
     void disableQuantizeMode();
     void setQuantizeGrid(int grid);
     void setQuantizeStrength(double strength);
+    void quantizePattern(int group, int pattern);
+    void quantizeProject();
     
     void enableSwingMode();
     void disableSwingMode();
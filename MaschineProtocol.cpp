@@ -0,0 +1,190 @@
+#include "MaschineProtocol.h"
+#include <stdio.h>
+
+// Argumentos que se imprimen en la forma de texto
+enum {
+    FMT_NONE,       // "play"
+    FMT_A,          // "select_group:3"
+    FMT_AB,         // "pad_press:3:127"
+    FMT_A_VALUE,    // "encoder_turn:0:-1"
+    FMT_MILLI,      // "set_tempo:120.000"
+    FMT_VALUE       // "subscriber_lag:42"
+};
+
+struct MaschineOpcodeInfo {
+    const char* name;
+    int format;
+};
+
+static const MaschineOpcodeInfo opcodeInfo[CMD_COUNT] = {
+    { "none",               FMT_NONE },
+    { "pad_press",          FMT_AB },
+    { "pad_release",        FMT_A },
+    { "pad_long_press",     FMT_A },
+    { "pad_double_press",   FMT_A },
+    { "button_press",       FMT_A },
+    { "button_release",     FMT_A },
+    { "button_long_press",  FMT_A },
+    { "encoder_turn",       FMT_A_VALUE },
+    { "encoder_press",      FMT_A },
+    { "led_pad",            FMT_AB },
+    { "led_button",         FMT_AB },
+    { "led_encoder",        FMT_AB },
+    { "select_group",       FMT_A },
+    { "create_group",       FMT_A },
+    { "delete_group",       FMT_A },
+    { "select_sound",       FMT_A },
+    { "create_sound",       FMT_AB },
+    { "select_pattern",     FMT_A },
+    { "create_pattern",     FMT_AB },
+    { "select_scene",       FMT_A },
+    { "create_scene",       FMT_A },
+    { "select_all",         FMT_NONE },
+    { "erase_pattern",      FMT_NONE },
+    { "play",               FMT_NONE },
+    { "stop",               FMT_NONE },
+    { "record",             FMT_NONE },
+    { "stop_record",        FMT_NONE },
+    { "pause",              FMT_NONE },
+    { "toggle_solo",        FMT_NONE },
+    { "toggle_mute",        FMT_NONE },
+    { "toggle_automation",  FMT_NONE },
+    { "set_tempo",          FMT_MILLI },
+    { "set_swing",          FMT_A },
+    { "tap_tempo",          FMT_NONE },
+    { "clock_slave",        FMT_A },
+    { "quantize",           FMT_A },
+    { "quantize_grid",      FMT_A },
+    { "quantize_strength",  FMT_MILLI },
+    { "quantize_pattern",   FMT_AB },
+    { "swing_mode",         FMT_A },
+    { "swing_grid",         FMT_A },
+    { "pattern_note",       FMT_AB },
+    { "play_automation",    FMT_NONE },
+    { "clear_automation",   FMT_NONE },
+    { "subscriber_lag",     FMT_VALUE }
+};
+
+void encodeMaschineCommand(const MaschineCommand& command, uint8_t* out) {
+    uint32_t value = (uint32_t)command.value;
+    out[0] = command.opcode;
+    out[1] = command.arg0;
+    out[2] = command.arg1;
+    out[3] = 0;
+    out[4] = (uint8_t)(value & 0xFF);
+    out[5] = (uint8_t)((value >> 8) & 0xFF);
+    out[6] = (uint8_t)((value >> 16) & 0xFF);
+    out[7] = (uint8_t)((value >> 24) & 0xFF);
+}
+
+bool decodeMaschineCommand(const uint8_t* in, MaschineCommand* command) {
+    if (in[0] == CMD_NONE || in[0] >= CMD_COUNT) {
+        return false;
+    }
+    command->opcode = in[0];
+    command->arg0 = in[1];
+    command->arg1 = in[2];
+    command->reserved = 0;
+    command->value = (int32_t)((uint32_t)in[4] | ((uint32_t)in[5] << 8) |
+                               ((uint32_t)in[6] << 16) | ((uint32_t)in[7] << 24));
+    return true;
+}
+
+size_t formatMaschineCommand(const MaschineCommand& command, char* buffer, size_t size) {
+    if (command.opcode >= CMD_COUNT) {
+        return (size_t)snprintf(buffer, size, "unknown:%d", command.opcode);
+    }
+
+    const MaschineOpcodeInfo& info = opcodeInfo[command.opcode];
+    int written = 0;
+    switch (info.format) {
+        case FMT_A:
+            written = snprintf(buffer, size, "%s:%d", info.name, command.arg0);
+            break;
+        case FMT_AB:
+            written = snprintf(buffer, size, "%s:%d:%d", info.name, command.arg0, command.arg1);
+            break;
+        case FMT_A_VALUE:
+            written = snprintf(buffer, size, "%s:%d:%d", info.name, command.arg0, (int)command.value);
+            break;
+        case FMT_MILLI:
+            written = snprintf(buffer, size, "%s:%.3f", info.name, command.value / 1000.0);
+            break;
+        case FMT_VALUE:
+            written = snprintf(buffer, size, "%s:%d", info.name, (int)command.value);
+            break;
+        default:
+            written = snprintf(buffer, size, "%s", info.name);
+            break;
+    }
+    return written > 0 ? (size_t)written : 0;
+}
+
+MaschineEncoderCoalescer::MaschineEncoderCoalescer() {
+    for (int i = 0; i < MASCHINE_COALESCE_ENCODERS; ++i) {
+        pending[i] = 0;
+        firstNs[i] = 0;
+    }
+    period = MASCHINE_COALESCE_PERIOD_NS;
+    inputEvents = 0;
+    outputEvents = 0;
+}
+
+int MaschineEncoderCoalescer::take(int encoder) {
+    int delta = pending[encoder];
+    pending[encoder] = 0;
+    outputEvents++;
+    return delta;
+}
+
+bool MaschineEncoderCoalescer::add(int encoder, int direction, uint64_t nowNs, int* flushDelta) {
+    if (encoder < 0 || encoder >= MASCHINE_COALESCE_ENCODERS || direction == 0) {
+        return false;
+    }
+    inputEvents++;
+
+    // Cambio de sentido: sale lo acumulado y el nuevo paso abre otra ventana
+    if (pending[encoder] != 0 && (pending[encoder] > 0) != (direction > 0)) {
+        *flushDelta = take(encoder);
+        pending[encoder] = direction;
+        firstNs[encoder] = nowNs;
+        return true;
+    }
+
+    if (pending[encoder] == 0) {
+        firstNs[encoder] = nowNs;
+    }
+    pending[encoder] += direction;
+    return poll(encoder, nowNs, flushDelta);
+}
+
+bool MaschineEncoderCoalescer::poll(int encoder, uint64_t nowNs, int* flushDelta) {
+    if (encoder < 0 || encoder >= MASCHINE_COALESCE_ENCODERS || pending[encoder] == 0) {
+        return false;
+    }
+    // Un nowNs anterior al primer paso (otro hilo leyó el reloj antes) no
+    // debe desbordar la resta y vaciar antes de tiempo
+    if (nowNs < firstNs[encoder] + period) {
+        return false;
+    }
+    *flushDelta = take(encoder);
+    return true;
+}
+
+bool MaschineEncoderCoalescer::nextDeadline(uint64_t* deadlineNs) const {
+    bool found = false;
+    for (int i = 0; i < MASCHINE_COALESCE_ENCODERS; ++i) {
+        if (pending[i] != 0 && (!found || firstNs[i] + period < *deadlineNs)) {
+            *deadlineNs = firstNs[i] + period;
+            found = true;
+        }
+    }
+    return found;
+}
+
+double MaschineEncoderCoalescer::getCompressionRatio() const {
+    if (outputEvents == 0) {
+        return 1.0;
+    }
+    return (double)inputEvents / (double)outputEvents;
+}
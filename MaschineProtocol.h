@@ -0,0 +1,134 @@
+#ifndef MASCHINE_PROTOCOL_H
+#define MASCHINE_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Protocolo binario de comandos con el software Maschine.
+//
+// Cada comando ocupa 8 bytes fijos: opcode, dos argumentos de 8 bits, un
+// byte reservado y un valor de 32 bits con signo (little endian). Los
+// valores fraccionarios (tempo, fuerza) viajan en milésimas. La forma de
+// texto ("pad_press:3:127") solo se genera para depuración.
+#define MASCHINE_COMMAND_SIZE     8
+
+enum MaschineOpcode {
+    CMD_NONE = 0,
+
+    // Pads, botones y encoders
+    CMD_PAD_PRESS,
+    CMD_PAD_RELEASE,
+    CMD_PAD_LONG_PRESS,
+    CMD_PAD_DOUBLE_PRESS,
+    CMD_BUTTON_PRESS,
+    CMD_BUTTON_RELEASE,
+    CMD_BUTTON_LONG_PRESS,
+    CMD_ENCODER_TURN,
+    CMD_ENCODER_PRESS,
+
+    // LEDs
+    CMD_LED_PAD,
+    CMD_LED_BUTTON,
+    CMD_LED_ENCODER,
+
+    // Grupos, sonidos, patrones y escenas
+    CMD_SELECT_GROUP,
+    CMD_CREATE_GROUP,
+    CMD_DELETE_GROUP,
+    CMD_SELECT_SOUND,
+    CMD_CREATE_SOUND,
+    CMD_SELECT_PATTERN,
+    CMD_CREATE_PATTERN,
+    CMD_SELECT_SCENE,
+    CMD_CREATE_SCENE,
+    CMD_SELECT_ALL,
+    CMD_ERASE_PATTERN,
+
+    // Transport
+    CMD_PLAY,
+    CMD_STOP,
+    CMD_RECORD,
+    CMD_STOP_RECORD,
+    CMD_PAUSE,
+    CMD_TOGGLE_SOLO,
+    CMD_TOGGLE_MUTE,
+    CMD_TOGGLE_AUTOMATION,
+
+    // Tempo, swing, cuantización y automatización
+    CMD_SET_TEMPO,
+    CMD_SET_SWING,
+    CMD_TAP_TEMPO,
+    CMD_CLOCK_SLAVE,
+    CMD_QUANTIZE,
+    CMD_QUANTIZE_GRID,
+    CMD_QUANTIZE_STRENGTH,
+    CMD_QUANTIZE_PATTERN,
+    CMD_SWING_MODE,
+    CMD_SWING_GRID,
+    CMD_PATTERN_NOTE,
+    CMD_PLAY_AUTOMATION,
+    CMD_CLEAR_AUTOMATION,
+
+    // Servidor de eventos: el suscriptor perdió "value" eventos
+    CMD_SUBSCRIBER_LAG,
+
+    CMD_COUNT
+};
+
+struct MaschineCommand {
+    uint8_t opcode;
+    uint8_t arg0;
+    uint8_t arg1;
+    uint8_t reserved;
+    int32_t value;
+};
+
+void encodeMaschineCommand(const MaschineCommand& command, uint8_t* out);
+bool decodeMaschineCommand(const uint8_t* in, MaschineCommand* command);
+
+// Forma de texto para depuración; escribe en el buffer del llamador
+size_t formatMaschineCommand(const MaschineCommand& command, char* buffer, size_t size);
+
+// Coalescencia de encoders
+#define MASCHINE_COALESCE_ENCODERS   8
+#define MASCHINE_COALESCE_PERIOD_NS  10000000ULL  // 10 ms
+
+// Agrupa los pasos de cada encoder antes de reenviarlos al host y al DAW.
+//
+// Cada detent suma su dirección a la delta pendiente del encoder; la delta
+// se vacía como un único evento cuando vence el período de control contado
+// desde el primer paso acumulado, o en el acto si el giro cambia de sentido
+// (así un vaivén rápido no se cancela a cero). Solo pasan por aquí los
+// encoders: pads y botones siguen su camino sin retraso. No es thread-safe;
+// el llamador serializa add() y poll().
+class MaschineEncoderCoalescer {
+public:
+    MaschineEncoderCoalescer();
+
+    void setPeriod(uint64_t periodNs) { period = periodNs; }
+    uint64_t getPeriod() const { return period; }
+
+    // Acumula un paso. Devuelve true y la delta a emitir si hay que vaciar ya
+    bool add(int encoder, int direction, uint64_t nowNs, int* flushDelta);
+
+    // Vacía la delta del encoder si venció su período
+    bool poll(int encoder, uint64_t nowNs, int* flushDelta);
+
+    // Próximo vencimiento pendiente; false si no hay nada acumulado
+    bool nextDeadline(uint64_t* deadlineNs) const;
+
+    uint64_t getInputCount() const { return inputEvents; }
+    uint64_t getOutputCount() const { return outputEvents; }
+    double getCompressionRatio() const;
+
+private:
+    int take(int encoder);
+
+    int pending[MASCHINE_COALESCE_ENCODERS];
+    uint64_t firstNs[MASCHINE_COALESCE_ENCODERS];
+    uint64_t period;
+    uint64_t inputEvents;
+    uint64_t outputEvents;
+};
+
+#endif // MASCHINE_PROTOCOL_H
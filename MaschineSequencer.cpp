@@ -0,0 +1,251 @@
+#include "MaschineSequencer.h"
+#include <cmath>
+
+void MaschinePattern::addEvent(uint32_t tick, int pad, int velocity) {
+    ticks.push_back(tick);
+    pads.push_back((uint8_t)(pad & 0x7F));
+    velocities.push_back((uint8_t)(velocity & 0x7F));
+}
+
+void MaschinePattern::clear() {
+    ticks.clear();
+    pads.clear();
+    velocities.clear();
+    generation++;
+}
+
+MaschineSwing::MaschineSwing() {
+    gridTicks = SEQUENCER_PPQN / 4;
+    amount = 0.0;
+    enabled = true;
+    published.store(0);
+    std::lock_guard<std::mutex> lock(writerMutex);
+    rebuild();
+}
+
+void MaschineSwing::setGrid(uint32_t newGridTicks) {
+    if (newGridTicks == 0 || newGridTicks * 2 > SWING_MAX_PERIOD ||
+        MASCHINE_PATTERN_LENGTH % (newGridTicks * 2) != 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(writerMutex);
+    gridTicks = newGridTicks;
+    rebuild();
+}
+
+void MaschineSwing::setAmount(double newAmount) {
+    if (newAmount < 0.0) newAmount = 0.0;
+    if (newAmount > 1.0) newAmount = 1.0;
+    std::lock_guard<std::mutex> lock(writerMutex);
+    amount = newAmount;
+    rebuild();
+}
+
+void MaschineSwing::setEnabled(bool newEnabled) {
+    std::lock_guard<std::mutex> lock(writerMutex);
+    enabled = newEnabled;
+    rebuild();
+}
+
+void MaschineSwing::rebuild() {
+    // Construir en la tabla inactiva y publicarla al final
+    uint32_t version = published.load(std::memory_order_relaxed);
+    SwingTable& table = tables[(version + 1) & 1];
+    uint32_t grid32 = gridTicks;
+    table.period = grid32 * 2;
+
+    // Con 100% el paso débil se retrasa medio paso; el primer paso se estira
+    // y el segundo se comprime para que la pareja mantenga su duración
+    double grid = (double)grid32;
+    double delay = enabled ? amount * 0.5 * grid : 0.0;
+    for (uint32_t p = 0; p < table.period; ++p) {
+        double position = (double)p;
+        double swung;
+        if (p < grid32) {
+            swung = position * (grid + delay) / grid;
+        } else {
+            swung = (grid + delay) + (position - grid) * (grid - delay) / grid;
+        }
+        table.offsets[p] = (int32_t)std::lround(swung - position);
+
+        // Inversa: de la posición oída a la de la rejilla recta
+        double straight;
+        if (position < grid + delay) {
+            straight = position * grid / (grid + delay);
+        } else {
+            straight = grid + (position - grid - delay) * grid / (grid - delay);
+        }
+        table.inverse[p] = (int32_t)std::lround(straight - position);
+    }
+
+    published.store(version + 1, std::memory_order_release);
+}
+
+// Codificación varint (7 bits por byte, bit alto = continúa)
+static void putVarint(std::vector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+static bool getVarint(const std::vector<uint8_t>& in, size_t* pos, uint32_t* value) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35 && *pos < in.size(); shift += 7) {
+        uint8_t byte = in[(*pos)++];
+        result |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *value = result;
+            return true;
+        }
+    }
+    return false;
+}
+
+MaschineAutomationLane::MaschineAutomationLane() {
+    clear();
+}
+
+void MaschineAutomationLane::clear() {
+    data.clear();
+    points = 0;
+    lastTick = 0;
+    lastValue = 0;
+    rewind();
+}
+
+void MaschineAutomationLane::rewind() {
+    cursorPos = 0;
+    cursorValid = false;
+    hasNext = false;
+    prevTick = nextTick = 0;
+    prevValue = nextValue = 0;
+}
+
+void MaschineAutomationLane::addPoint(uint32_t tick, uint16_t value) {
+    if (value > AUTOMATION_MAX_VALUE) {
+        value = AUTOMATION_MAX_VALUE;
+    }
+    if (points > 0 && tick < lastTick) {
+        return;
+    }
+
+    int32_t delta = (int32_t)value - (int32_t)lastValue;
+    putVarint(data, tick - lastTick);
+    putVarint(data, ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31));
+
+    lastTick = tick;
+    lastValue = value;
+    points++;
+}
+
+bool MaschineAutomationLane::readPoint(size_t* pos, uint32_t* tick, uint16_t* value) const {
+    uint32_t tickDelta, zigzag;
+    if (!getVarint(data, pos, &tickDelta) || !getVarint(data, pos, &zigzag)) {
+        return false;
+    }
+    int32_t valueDelta = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+    *tick += tickDelta;
+    *value = (uint16_t)((int32_t)*value + valueDelta);
+    return true;
+}
+
+bool MaschineAutomationLane::valueAt(uint32_t tick, uint16_t* value) {
+    if (points == 0) {
+        return false;
+    }
+
+    // Volver al principio si la reproducción saltó hacia atrás
+    if (!cursorValid || tick < prevTick) {
+        rewind();
+        readPoint(&cursorPos, &prevTick, &prevValue);
+        cursorValid = true;
+    }
+
+    while (true) {
+        if (!hasNext) {
+            nextTick = prevTick;
+            nextValue = prevValue;
+            if (!readPoint(&cursorPos, &nextTick, &nextValue)) {
+                break;
+            }
+            hasNext = true;
+        }
+        if (nextTick > tick) {
+            break;
+        }
+        prevTick = nextTick;
+        prevValue = nextValue;
+        hasNext = false;
+    }
+
+    if (!hasNext || tick <= prevTick) {
+        *value = prevValue;
+    } else {
+        double fraction = (double)(tick - prevTick) / (double)(nextTick - prevTick);
+        *value = (uint16_t)(prevValue + ((double)nextValue - prevValue) * fraction + 0.5);
+    }
+    return true;
+}
+
+size_t MaschineAutomationLane::thin(uint16_t tolerance) {
+    if (points < 3) {
+        return 0;
+    }
+
+    // Decodificar la curva completa
+    std::vector<uint32_t> ticks;
+    std::vector<uint16_t> values;
+    ticks.reserve(points);
+    values.reserve(points);
+    size_t pos = 0;
+    uint32_t tick = 0;
+    uint16_t value = 0;
+    while (readPoint(&pos, &tick, &value)) {
+        ticks.push_back(tick);
+        values.push_back(value);
+    }
+
+    // Douglas-Peucker iterativo con error vertical (el que produce la
+    // interpolación lineal de la reproducción)
+    std::vector<bool> keep(ticks.size(), false);
+    keep.front() = true;
+    keep.back() = true;
+    std::vector<std::pair<size_t, size_t> > stack;
+    stack.push_back(std::make_pair((size_t)0, ticks.size() - 1));
+    while (!stack.empty()) {
+        size_t first = stack.back().first;
+        size_t last = stack.back().second;
+        stack.pop_back();
+
+        double span = (double)ticks[last] - ticks[first];
+        double worst = 0.0;
+        size_t worstIndex = first;
+        for (size_t i = first + 1; i < last; ++i) {
+            double expected = values[first];
+            if (span > 0.0) {
+                expected += ((double)values[last] - values[first]) * (ticks[i] - ticks[first]) / span;
+            }
+            double error = std::fabs(values[i] - expected);
+            if (error > worst) {
+                worst = error;
+                worstIndex = i;
+            }
+        }
+        if (worst > tolerance) {
+            keep[worstIndex] = true;
+            stack.push_back(std::make_pair(first, worstIndex));
+            stack.push_back(std::make_pair(worstIndex, last));
+        }
+    }
+
+    size_t before = points;
+    clear();
+    for (size_t i = 0; i < ticks.size(); ++i) {
+        if (keep[i]) {
+            addPoint(ticks[i], values[i]);
+        }
+    }
+    return before - points;
+}
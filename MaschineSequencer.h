@@ -0,0 +1,149 @@
+#ifndef MASCHINE_SEQUENCER_H
+#define MASCHINE_SEQUENCER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include "MaschineTiming.h"
+
+// Longitud de los patrones: 4 compases de 4/4
+#define MASCHINE_PATTERN_LENGTH   (4 * 4 * SEQUENCER_PPQN)
+
+// Automatización: valores de 14 bits (resolución completa del encoder)
+#define AUTOMATION_MAX_VALUE      16383
+
+// Salida de automatización como CC de 14 bits: MSB en el CC 20 + parámetro
+// y LSB 32 controladores más arriba (20-31 no tienen uso asignado)
+#define AUTOMATION_CC_BASE        20
+#define AUTOMATION_CC_LSB_OFFSET  32
+#define AUTOMATION_PARAMETERS     12
+
+// Período máximo de swing (dos pasos de negra)
+#define SWING_MAX_PERIOD          (2 * SEQUENCER_PPQN)
+
+// Eventos de un patrón, guardados por columnas: las operaciones en bloque
+// (cuantización) recorren solo la columna de ticks contigua en memoria.
+// generation cambia con cada clear(): quien trabaja sobre una copia la
+// compara antes de escribir de vuelta por índice.
+struct MaschinePattern {
+    std::vector<uint32_t> ticks;
+    std::vector<uint8_t> pads;
+    std::vector<uint8_t> velocities;
+    uint32_t generation;
+
+    MaschinePattern() : generation(0) {}
+    void addEvent(uint32_t tick, int pad, int velocity);
+    void clear();
+    size_t size() const { return ticks.size(); }
+};
+
+// Swing aplicado al programar la salida.
+//
+// Los datos del patrón se guardan sin swing; el planificador pasa cada tick
+// por apply() y la grabación pasa la posición oída por unapply(), la
+// inversa. Las dos son una consulta a una tabla de desplazamientos
+// precalculada para la pareja de pasos actual (rejilla + cantidad). Al
+// cambiar la cantidad o la rejilla se reconstruye la tabla inactiva y se
+// publica con un contador de versión, así que el cambio se nota en el
+// siguiente paso sin re-renderizar nada. Los cambios llegan desde varios
+// hilos (entrada MIDI, encoders, bucle de eventos, CLI) y se serializan con
+// un mutex; los lectores no lo toman: si la versión cambió durante la
+// consulta, su tabla pudo reescribirse y repiten.
+class MaschineSwing {
+public:
+    MaschineSwing();
+
+    void setGrid(uint32_t gridTicks);
+    void setAmount(double amount);
+    void setEnabled(bool enabled);
+    uint32_t getGrid() const { return gridTicks; }
+    double getAmount() const { return amount; }
+    bool isEnabled() const { return enabled; }
+
+    uint32_t apply(uint32_t tick) const {
+        while (true) {
+            uint32_t version = published.load(std::memory_order_acquire);
+            const SwingTable& table = tables[version & 1];
+            int32_t offset = table.offsets[tick % table.period];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (published.load(std::memory_order_relaxed) == version) {
+                return tick + offset;
+            }
+        }
+    }
+
+    uint32_t unapply(uint32_t tick) const {
+        while (true) {
+            uint32_t version = published.load(std::memory_order_acquire);
+            const SwingTable& table = tables[version & 1];
+            int32_t offset = table.inverse[tick % table.period];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (published.load(std::memory_order_relaxed) == version) {
+                return tick + offset;
+            }
+        }
+    }
+
+private:
+    struct SwingTable {
+        uint32_t period;
+        int32_t offsets[SWING_MAX_PERIOD];
+        int32_t inverse[SWING_MAX_PERIOD];
+    };
+
+    // Con writerMutex tomado
+    void rebuild();
+
+    SwingTable tables[2];
+    std::atomic<uint32_t> published;    // la tabla activa es published & 1
+    std::mutex writerMutex;
+    std::atomic<uint32_t> gridTicks;
+    std::atomic<double> amount;
+    std::atomic<bool> enabled;
+};
+
+// Carril de automatización de un parámetro.
+//
+// Los puntos (tick, valor) se guardan codificados en delta: el incremento de
+// tick como varint sin signo y el del valor como varint zigzag, así que una
+// curva densa ocupa 2-3 bytes por punto. thin() elimina los puntos que se
+// pueden reconstruir por interpolación lineal dentro de una tolerancia.
+// valueAt() mantiene un cursor para que la reproducción, que avanza en
+// orden, decodifique cada punto una sola vez.
+class MaschineAutomationLane {
+public:
+    MaschineAutomationLane();
+
+    void clear();
+    void addPoint(uint32_t tick, uint16_t value);
+
+    // Devuelve el número de puntos eliminados
+    size_t thin(uint16_t tolerance);
+
+    // Valor interpolado en tick; false si el carril está vacío
+    bool valueAt(uint32_t tick, uint16_t* value);
+    void rewind();
+
+    size_t getPointCount() const { return points; }
+    size_t getByteSize() const { return data.size(); }
+    uint32_t getLastTick() const { return lastTick; }
+
+private:
+    bool readPoint(size_t* pos, uint32_t* tick, uint16_t* value) const;
+
+    std::vector<uint8_t> data;
+    size_t points;
+    uint32_t lastTick;
+    uint16_t lastValue;
+
+    // Cursor de reproducción
+    size_t cursorPos;
+    bool cursorValid;
+    bool hasNext;
+    uint32_t prevTick, nextTick;
+    uint16_t prevValue, nextValue;
+};
+
+#endif // MASCHINE_SEQUENCER_H
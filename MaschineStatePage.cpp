@@ -0,0 +1,130 @@
+#include "MaschineStatePage.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+
+MaschineStateExport::MaschineStateExport() {
+    page = NULL;
+    shmName[0] = '\0';
+}
+
+MaschineStateExport::~MaschineStateExport() {
+    close();
+}
+
+bool MaschineStateExport::open(const char* name) {
+    close();
+    snprintf(shmName, sizeof(shmName), "%s", name);
+
+    // Una página previa puede venir de un driver caído
+    shm_unlink(shmName);
+    int fd = shm_open(shmName, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    // Legible por cualquier monitor aunque la umask diga otra cosa
+    fchmod(fd, 0644);
+    if (ftruncate(fd, sizeof(MaschineStatePage)) != 0) {
+        ::close(fd);
+        shm_unlink(shmName);
+        return false;
+    }
+
+    void* memory = mmap(NULL, sizeof(MaschineStatePage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        shm_unlink(shmName);
+        return false;
+    }
+
+    page = (MaschineStatePage*)memory;
+    page->version = MASCHINE_STATE_VERSION;
+    page->size = sizeof(MaschineStateSnapshot);
+    page->sequence = 0;
+    __atomic_store_n(&page->magic, MASCHINE_STATE_MAGIC, __ATOMIC_RELEASE);
+    return true;
+}
+
+void MaschineStateExport::close() {
+    if (page) {
+        // Los lectores que sigan mapeados ven que la página ya no es válida
+        __atomic_store_n(&page->magic, 0, __ATOMIC_RELEASE);
+        munmap(page, sizeof(MaschineStatePage));
+        page = NULL;
+        shm_unlink(shmName);
+    }
+}
+
+MaschineStateSnapshot* MaschineStateExport::beginWrite() {
+    if (!page) {
+        return NULL;
+    }
+    maschineStateBeginWrite(page);
+    return &page->state;
+}
+
+void MaschineStateExport::endWrite() {
+    if (page) {
+        maschineStateEndWrite(page);
+    }
+}
+
+MaschineStateReader::MaschineStateReader() {
+    page = NULL;
+    mappedSize = 0;
+}
+
+MaschineStateReader::~MaschineStateReader() {
+    close();
+}
+
+bool MaschineStateReader::open(const char* name) {
+    close();
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < offsetof(MaschineStatePage, state)) {
+        ::close(fd);
+        return false;
+    }
+
+    // Mapear todo el segmento: una versión más nueva puede ser más grande
+    void* memory = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+
+    const MaschineStatePage* mapped = (const MaschineStatePage*)memory;
+    if (__atomic_load_n(&mapped->magic, __ATOMIC_ACQUIRE) != MASCHINE_STATE_MAGIC ||
+        mapped->version < 1 || offsetof(MaschineStatePage, state) + mapped->size > (size_t)info.st_size) {
+        munmap(memory, (size_t)info.st_size);
+        return false;
+    }
+
+    page = mapped;
+    mappedSize = (size_t)info.st_size;
+    return true;
+}
+
+void MaschineStateReader::close() {
+    if (page) {
+        munmap((void*)page, mappedSize);
+        page = NULL;
+        mappedSize = 0;
+    }
+}
+
+bool MaschineStateReader::read(MaschineStateSnapshot* snapshot) const {
+    // Un driver que se cerró invalida la página: hay que volver a abrirla
+    if (!page || __atomic_load_n(&page->magic, __ATOMIC_ACQUIRE) != MASCHINE_STATE_MAGIC) {
+        return false;
+    }
+    return maschineStateRead(page, snapshot) != 0;
+}
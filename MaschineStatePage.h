@@ -0,0 +1,153 @@
+#ifndef MASCHINE_STATE_PAGE_H
+#define MASCHINE_STATE_PAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Página de estado en vivo para monitores externos.
+//
+// El driver (user-space vía POSIX shm, el kext vía clientMemoryForType)
+// publica una página de solo lectura con el estado actual y contadores.
+// Las escrituras van bajo un seqlock: la secuencia es impar mientras se
+// escribe, y el lector copia la instantánea y la descarta si la secuencia
+// cambió entre medias. Leer no hace llamadas al sistema ni toca nada que
+// el driver tenga que esperar.
+//
+// Versionado: los campos nuevos solo se añaden al final de
+// MaschineStateSnapshot y se sube MASCHINE_STATE_VERSION. "size" dice
+// cuántos bytes de instantánea son válidos, así un lector antiguo sigue
+// funcionando con una página más nueva.
+#define MASCHINE_STATE_PAGE_NAME      "/maschine-mikro-state"
+#define MASCHINE_STATE_MAGIC          0x4D4B5354  // 'MKST'
+#define MASCHINE_STATE_VERSION        1
+#define MASCHINE_STATE_PAGE_TYPE      0           // tipo para clientMemoryForType
+#define MASCHINE_STATE_READ_RETRIES   64
+
+// Bits de MaschineStateSnapshot::flags
+#define MASCHINE_STATE_PLAYING        (1u << 0)
+#define MASCHINE_STATE_RECORDING      (1u << 1)
+#define MASCHINE_STATE_SHIFT          (1u << 2)
+#define MASCHINE_STATE_SOLO           (1u << 3)
+#define MASCHINE_STATE_MUTE           (1u << 4)
+#define MASCHINE_STATE_AUTOMATION     (1u << 5)
+#define MASCHINE_STATE_CLOCK_SLAVE    (1u << 6)
+#define MASCHINE_STATE_CLOCK_LOCKED   (1u << 7)
+#define MASCHINE_STATE_HOST_CONNECTED (1u << 8)
+#define MASCHINE_STATE_DEVICE_OPEN    (1u << 9)
+
+struct MaschineStateSnapshot {
+    uint64_t timestampNs;
+
+    // Modo y selección
+    int32_t mode;
+    int32_t group;
+    int32_t sound;
+    int32_t pattern;
+    int32_t scene;
+
+    // Transporte
+    int32_t tempoMilli;
+    int32_t swing;
+    uint32_t flags;
+
+    // Pads, botones y LEDs (un bit por elemento)
+    uint16_t padStates;
+    uint16_t padLEDs;
+    uint8_t buttonStates;
+    uint8_t buttonLEDs;
+    uint8_t encoderLEDs[2];
+    uint8_t padVelocities[16];
+
+    // Contadores
+    uint64_t padEvents;
+    uint64_t buttonEvents;
+    uint64_t encoderEvents;
+    uint64_t midiMessagesIn;
+    uint64_t midiMessagesOut;
+    uint64_t commandsSent;
+    uint64_t hostDropped;
+    uint64_t usbReads;
+    uint64_t usbErrors;
+};
+
+struct MaschineStatePage {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t sequence;
+    struct MaschineStateSnapshot state;
+};
+
+// Un único escritor (el llamador serializa). Entre begin y end se modifica
+// page->state directamente.
+static inline void maschineStateBeginWrite(struct MaschineStatePage* page) {
+    uint32_t sequence = __atomic_load_n(&page->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&page->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void maschineStateEndWrite(struct MaschineStatePage* page) {
+    uint32_t sequence = __atomic_load_n(&page->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&page->sequence, sequence + 1, __ATOMIC_RELEASE);
+}
+
+// Copia una instantánea coherente; devuelve 0 si el escritor no dejó de
+// escribir en MASCHINE_STATE_READ_RETRIES intentos
+static inline int maschineStateRead(const struct MaschineStatePage* page, struct MaschineStateSnapshot* out) {
+    uint32_t size = page->size < sizeof(*out) ? page->size : (uint32_t)sizeof(*out);
+    for (int attempt = 0; attempt < MASCHINE_STATE_READ_RETRIES; ++attempt) {
+        uint32_t before = __atomic_load_n(&page->sequence, __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            continue;
+        }
+        __builtin_memset(out, 0, sizeof(*out));
+        __builtin_memcpy(out, &page->state, size);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&page->sequence, __ATOMIC_RELAXED) == before) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+#ifndef KERNEL
+
+// Lado user-space: el driver crea la página y los monitores la abren en
+// solo lectura (PROT_READ; el segmento es 0644).
+class MaschineStateExport {
+public:
+    MaschineStateExport();
+    ~MaschineStateExport();
+
+    bool open(const char* name = MASCHINE_STATE_PAGE_NAME);
+    void close();
+    bool isOpen() const { return page != NULL; }
+
+    MaschineStateSnapshot* beginWrite();
+    void endWrite();
+
+private:
+    MaschineStatePage* page;
+    char shmName[64];
+};
+
+class MaschineStateReader {
+public:
+    MaschineStateReader();
+    ~MaschineStateReader();
+
+    bool open(const char* name = MASCHINE_STATE_PAGE_NAME);
+    void close();
+    bool isOpen() const { return page != NULL; }
+    uint32_t getVersion() const { return page ? page->version : 0; }
+
+    bool read(MaschineStateSnapshot* snapshot) const;
+
+private:
+    const MaschineStatePage* page;
+    size_t mappedSize;
+};
+
+#endif // KERNEL
+
+#endif // MASCHINE_STATE_PAGE_H
@@ -0,0 +1,466 @@
+#include "MaschineTiming.h"
+#include <cmath>
+#include <chrono>
+
+// Ganancias del PLL: adquisición rápida y seguimiento con poco ancho de banda
+#define CLOCK_ACQUIRE_TICKS       MIDI_CLOCK_PPQN
+#define CLOCK_ACQUIRE_KP          0.5
+#define CLOCK_ACQUIRE_KI          0.0625
+#define CLOCK_TRACK_KP            0.1
+#define CLOCK_TRACK_KI            0.0025
+
+// Un pulso fuera de ±50% del período se considera jitter y se descarta;
+// tres seguidos se interpretan como cambio brusco de tempo
+#define CLOCK_REJECT_WINDOW       0.5
+#define CLOCK_MAX_OUTLIERS        3
+
+// Un hueco de más de 8 pulsos (reloj detenido por el maestro) re-adquiere
+#define CLOCK_GAP_TICKS           8
+
+// Enganchado: la corrección de período se mantiene < 0.1% durante una negra
+#define CLOCK_LOCK_TOLERANCE      0.001
+#define CLOCK_LOCK_TICKS          MIDI_CLOCK_PPQN
+
+// Tap tempo: una pausa de 2 s reinicia, tolerancia de ±20% sobre el pulso
+// esperado y peso que decae por cada toque de antigüedad
+#define TAP_RESET_NS              2000000000ULL
+#define TAP_TOLERANCE             0.2
+#define TAP_DECAY                 0.8
+
+// Cuantización: fuerza en punto fijo y tamaño de bloque del bucle en bloque
+#define QUANTIZE_STRENGTH_ONE     65536
+#define QUANTIZE_BLOCK            64
+
+// Tiempo virtual: espera máxima (real) a que los hilos registrados vuelvan
+// a dormir en waitUntil()
+#define VIRTUAL_SETTLE_TIMEOUT_MS 1000
+
+// Límites de período aceptados (20-300 BPM)
+#define CLOCK_MIN_PERIOD_NS       (60.0e9 / (300.0 * MIDI_CLOCK_PPQN))
+#define CLOCK_MAX_PERIOD_NS       (60.0e9 / (20.0 * MIDI_CLOCK_PPQN))
+
+MaschineVirtualClock::MaschineVirtualClock(uint64_t newStartNs) {
+    current = newStartNs;
+    startNs = newStartNs;
+    waiterCount = 0;
+}
+
+uint64_t MaschineVirtualClock::now() {
+    return current.load(std::memory_order_acquire);
+}
+
+void MaschineVirtualClock::sleepFor(uint64_t ns) {
+    advance(ns);
+}
+
+MaschineVirtualClock::Waiter* MaschineVirtualClock::findWaiter(std::condition_variable* condition) {
+    for (int i = 0; i < waiterCount; ++i) {
+        if (waiters[i].condition == condition) {
+            return &waiters[i];
+        }
+    }
+    return NULL;
+}
+
+void MaschineVirtualClock::addWaiter(std::mutex& mutex, std::condition_variable& condition) {
+    std::lock_guard<std::mutex> guard(waitersMutex);
+    if (findWaiter(&condition) || waiterCount == MASCHINE_VIRTUAL_WAITERS) {
+        return;
+    }
+    // Ocupado hasta su primera espera: advance() no se le adelanta al arrancar
+    Waiter& waiter = waiters[waiterCount++];
+    waiter.mutex = &mutex;
+    waiter.condition = &condition;
+    waiter.deadlineNs = UINT64_MAX;
+    waiter.waiting = false;
+}
+
+void MaschineVirtualClock::removeWaiter(std::condition_variable& condition) {
+    std::lock_guard<std::mutex> guard(waitersMutex);
+    Waiter* waiter = findWaiter(&condition);
+    if (waiter) {
+        *waiter = waiters[--waiterCount];
+        settledCondition.notify_all();
+    }
+}
+
+void MaschineVirtualClock::waitUntil(std::unique_lock<std::mutex>& lock, std::condition_variable& condition,
+                                     uint64_t deadlineNs) {
+    bool registered = false;
+    {
+        // La hora se lee bajo waitersMutex, el mismo que toma advance() para
+        // moverla: o se ve la hora nueva, o advance() nos ve dormidos y
+        // notifica con nuestro mutex, que no se suelta hasta el wait
+        std::lock_guard<std::mutex> guard(waitersMutex);
+        if (now() >= deadlineNs) {
+            return;
+        }
+        Waiter* waiter = findWaiter(&condition);
+        if (waiter) {
+            waiter->deadlineNs = deadlineNs;
+            waiter->waiting = true;
+            registered = true;
+            settledCondition.notify_all();
+        }
+    }
+    
+    condition.wait(lock);
+    
+    if (registered) {
+        // Despertado por el llamador: ocupado hasta la próxima espera. El
+        // hueco pudo moverse si otro hilo se dio de baja mientras tanto
+        std::lock_guard<std::mutex> guard(waitersMutex);
+        Waiter* waiter = findWaiter(&condition);
+        if (waiter) {
+            waiter->waiting = false;
+        }
+    }
+}
+
+bool MaschineVirtualClock::settled() const {
+    for (int i = 0; i < waiterCount; ++i) {
+        if (!waiters[i].waiting) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void MaschineVirtualClock::advance(uint64_t ns) {
+    Waiter due[MASCHINE_VIRTUAL_WAITERS];
+    int dueCount = 0;
+    uint64_t nowNs;
+    {
+        // Un hilo recién lanzado o despertado por un notify del llamador
+        // termina lo suyo a la hora actual antes de mover el reloj
+        std::unique_lock<std::mutex> guard(waitersMutex);
+        settledCondition.wait_for(guard, std::chrono::milliseconds(VIRTUAL_SETTLE_TIMEOUT_MS),
+                                  [this] { return settled(); });
+        nowNs = current.fetch_add(ns, std::memory_order_acq_rel) + ns;
+        for (int i = 0; i < waiterCount; ++i) {
+            if (waiters[i].waiting && waiters[i].deadlineNs <= nowNs) {
+                // Cuenta como ocupado desde ya, antes de que llegue a despertar
+                waiters[i].waiting = false;
+                due[dueCount++] = waiters[i];
+            }
+        }
+        if (dueCount == 0) {
+            return;
+        }
+    }
+    
+    // El mutex del que espera garantiza que el notify no se pierde entre su
+    // lectura de la hora y el wait
+    for (int i = 0; i < dueCount; ++i) {
+        std::lock_guard<std::mutex> guard(*due[i].mutex);
+        due[i].condition->notify_all();
+    }
+    
+    // Los despertados, de vuelta en waitUntil(). El plazo solo salta si uno
+    // se bloquea fuera de él
+    std::unique_lock<std::mutex> guard(waitersMutex);
+    settledCondition.wait_for(guard, std::chrono::milliseconds(VIRTUAL_SETTLE_TIMEOUT_MS),
+                              [this] { return settled(); });
+}
+
+MaschineClockTracker::MaschineClockTracker() {
+    reset();
+}
+
+void MaschineClockTracker::reset() {
+    running = false;
+    startPending = false;
+    locked = false;
+    songPositionTicks = 0;
+    ticksSinceAcquire = 0;
+    lastTimestampNs = 0;
+    period = 0.0;
+    predicted = 0.0;
+    consecutiveOutliers = 0;
+    stableTicks = 0;
+    convergenceTicks = -1;
+    rejectedTicks = 0;
+    errorSquaredAvg = 0.0;
+}
+
+void MaschineClockTracker::acquire(uint64_t timestampNs) {
+    ticksSinceAcquire = 1;
+    lastTimestampNs = timestampNs;
+    period = 0.0;
+    predicted = 0.0;
+    consecutiveOutliers = 0;
+    stableTicks = 0;
+    convergenceTicks = -1;
+    errorSquaredAvg = 0.0;
+    locked = false;
+}
+
+void MaschineClockTracker::clockTick(uint64_t timestampNs) {
+    // La posición avanza en todos los pulsos salvo el primero tras Start/Continue
+    if (running) {
+        if (startPending) {
+            startPending = false;
+        } else {
+            songPositionTicks++;
+        }
+    }
+
+    if (ticksSinceAcquire == 0 || timestampNs <= lastTimestampNs) {
+        acquire(timestampNs);
+        return;
+    }
+
+    double interval = (double)(timestampNs - lastTimestampNs);
+
+    if (ticksSinceAcquire >= 2) {
+        if (interval > CLOCK_GAP_TICKS * period) {
+            acquire(timestampNs);
+            return;
+        }
+
+        double error = (double)timestampNs - predicted;
+
+        if (std::fabs(error) <= CLOCK_REJECT_WINDOW * period) {
+            consecutiveOutliers = 0;
+            updateLoop(timestampNs, error);
+            return;
+        }
+
+        rejectedTicks++;
+        if (++consecutiveOutliers < CLOCK_MAX_OUTLIERS) {
+            // Jitter: seguir en rueda libre sin corregir
+            predicted += period;
+            lastTimestampNs = timestampNs;
+            return;
+        }
+
+        // Salto real de tempo: re-anclar en el pulso anterior, que también
+        // fue rechazado (el más reciente antes de este); el intervalo hasta
+        // este da la primera estimación del período nuevo
+        acquire(lastTimestampNs);
+    }
+
+    // Segundo pulso tras adquirir: primera estimación del período
+    if (interval < CLOCK_MIN_PERIOD_NS || interval > CLOCK_MAX_PERIOD_NS) {
+        acquire(timestampNs);
+        return;
+    }
+    period = interval;
+    predicted = (double)timestampNs + period;
+    lastTimestampNs = timestampNs;
+    ticksSinceAcquire = 2;
+}
+
+void MaschineClockTracker::updateLoop(uint64_t timestampNs, double error) {
+    bool acquiring = ticksSinceAcquire < CLOCK_ACQUIRE_TICKS;
+    double kp = acquiring ? CLOCK_ACQUIRE_KP : CLOCK_TRACK_KP;
+    double ki = acquiring ? CLOCK_ACQUIRE_KI : CLOCK_TRACK_KI;
+
+    double correction = ki * error;
+    period += correction;
+    if (period < CLOCK_MIN_PERIOD_NS) period = CLOCK_MIN_PERIOD_NS;
+    if (period > CLOCK_MAX_PERIOD_NS) period = CLOCK_MAX_PERIOD_NS;
+    predicted += period + kp * error;
+
+    lastTimestampNs = timestampNs;
+    ticksSinceAcquire++;
+    errorSquaredAvg = 0.95 * errorSquaredAvg + 0.05 * error * error;
+
+    if (std::fabs(correction) < CLOCK_LOCK_TOLERANCE * period) {
+        if (++stableTicks >= CLOCK_LOCK_TICKS && !locked) {
+            locked = true;
+            convergenceTicks = ticksSinceAcquire;
+        }
+    } else {
+        stableTicks = 0;
+    }
+}
+
+void MaschineClockTracker::start() {
+    running = true;
+    startPending = true;
+    songPositionTicks = 0;
+}
+
+void MaschineClockTracker::resume() {
+    running = true;
+    startPending = true;
+}
+
+void MaschineClockTracker::stop() {
+    running = false;
+    startPending = false;
+}
+
+void MaschineClockTracker::setSongPosition(int sixteenths) {
+    // Song Position Pointer: cada semicorchea son 6 pulsos
+    if (sixteenths >= 0) {
+        songPositionTicks = (uint64_t)sixteenths * (MIDI_CLOCK_PPQN / 4);
+    }
+}
+
+double MaschineClockTracker::getTempo() const {
+    if (period <= 0.0) {
+        return 0.0;
+    }
+    return 60.0e9 / (period * MIDI_CLOCK_PPQN);
+}
+
+double MaschineClockTracker::getSteadyStateErrorUs() const {
+    return std::sqrt(errorSquaredAvg) / 1000.0;
+}
+
+MaschineTapTempo::MaschineTapTempo() {
+    reset();
+}
+
+void MaschineTapTempo::reset() {
+    head = 0;
+    count = 0;
+    tempo = 0.0;
+}
+
+bool MaschineTapTempo::tap(uint64_t timestampNs) {
+    if (count > 0) {
+        uint64_t last = taps[(head + TAP_TEMPO_WINDOW - 1) % TAP_TEMPO_WINDOW];
+        if (timestampNs <= last || timestampNs - last > TAP_RESET_NS) {
+            reset();
+        }
+    }
+
+    taps[head] = timestampNs;
+    head = (head + 1) % TAP_TEMPO_WINDOW;
+    if (count < TAP_TEMPO_WINDOW) {
+        count++;
+    }
+    if (count < 2) {
+        return false;
+    }
+
+    // Toques en orden cronológico
+    uint64_t ordered[TAP_TEMPO_WINDOW];
+    int first = (head + TAP_TEMPO_WINDOW - count) % TAP_TEMPO_WINDOW;
+    for (int i = 0; i < count; ++i) {
+        ordered[i] = taps[(first + i) % TAP_TEMPO_WINDOW];
+    }
+
+    // Mediana de los intervalos (como mucho 7: ordenación por inserción)
+    double intervals[TAP_TEMPO_WINDOW];
+    int numIntervals = count - 1;
+    for (int i = 0; i < numIntervals; ++i) {
+        double value = (double)(ordered[i + 1] - ordered[i]);
+        int j = i;
+        while (j > 0 && intervals[j - 1] > value) {
+            intervals[j] = intervals[j - 1];
+            j--;
+        }
+        intervals[j] = value;
+    }
+    double median = (numIntervals % 2) ? intervals[numIntervals / 2]
+                  : 0.5 * (intervals[numIntervals / 2 - 1] + intervals[numIntervals / 2]);
+    if (median <= 0.0) {
+        return false;
+    }
+
+    // Asignar número de pulso a cada toque y acumular la regresión ponderada
+    double sumW = 0.0, sumK = 0.0, sumT = 0.0, sumKK = 0.0, sumKT = 0.0;
+    int accepted = 0;
+    bool newestAccepted = false;
+    double beat = 0.0;
+    uint64_t lastAccepted = ordered[0];
+    for (int i = 0; i < count; ++i) {
+        if (i > 0) {
+            double ratio = (double)(ordered[i] - lastAccepted) / median;
+            double beats = std::floor(ratio + 0.5);
+            if (beats < 1.0 || std::fabs(ratio - beats) > TAP_TOLERANCE) {
+                continue;
+            }
+            beat += beats;
+            lastAccepted = ordered[i];
+        }
+        // Tiempos relativos al primer toque para conservar precisión
+        double w = std::pow(TAP_DECAY, count - 1 - i);
+        double t = (double)(ordered[i] - ordered[0]);
+        sumW += w;
+        sumK += w * beat;
+        sumT += w * t;
+        sumKK += w * beat * beat;
+        sumKT += w * beat * t;
+        accepted++;
+        newestAccepted = (i == count - 1);
+    }
+
+    if (accepted < 2 || !newestAccepted) {
+        return false;
+    }
+
+    double denominator = sumW * sumKK - sumK * sumK;
+    if (denominator <= 0.0) {
+        return false;
+    }
+    double period = (sumW * sumKT - sumK * sumT) / denominator;
+    if (period <= 0.0) {
+        return false;
+    }
+
+    tempo = 60.0e9 / period;
+    return true;
+}
+
+MaschineQuantizer::MaschineQuantizer() {
+    // Por defecto semicorcheas al 100%
+    settings.store(((uint64_t)(SEQUENCER_PPQN / 4) << 32) | QUANTIZE_STRENGTH_ONE);
+}
+
+void MaschineQuantizer::setGrid(uint32_t gridTicks) {
+    if (gridTicks == 0) {
+        return;
+    }
+    uint64_t current = settings.load();
+    uint64_t updated;
+    do {
+        updated = ((uint64_t)gridTicks << 32) | (current & 0xFFFFFFFFULL);
+    } while (!settings.compare_exchange_weak(current, updated));
+}
+
+void MaschineQuantizer::setStrength(double strength) {
+    if (strength < 0.0) strength = 0.0;
+    if (strength > 1.0) strength = 1.0;
+    uint64_t fixed = (uint64_t)(strength * QUANTIZE_STRENGTH_ONE + 0.5);
+    uint64_t current = settings.load();
+    uint64_t updated;
+    do {
+        updated = (current & 0xFFFFFFFF00000000ULL) | fixed;
+    } while (!settings.compare_exchange_weak(current, updated));
+}
+
+uint32_t MaschineQuantizer::getGrid() const {
+    return (uint32_t)(settings.load() >> 32);
+}
+
+double MaschineQuantizer::getStrength() const {
+    return (double)(settings.load() & 0xFFFFFFFFULL) / QUANTIZE_STRENGTH_ONE;
+}
+
+uint32_t MaschineQuantizer::quantize(uint32_t tick) const {
+    uint32_t tmp = tick;
+    quantizeTicks(&tmp, 1);
+    return tmp;
+}
+
+void MaschineQuantizer::quantizeTicks(uint32_t* ticks, size_t count) const {
+    uint64_t current = settings.load(std::memory_order_relaxed);
+    const double grid = (double)(current >> 32);
+    const double invGrid = 1.0 / grid;
+    const double strength = (double)(current & 0xFFFFFFFFULL) / QUANTIZE_STRENGTH_ONE;
+
+    // Ticks < 2^31: la conversión vía int32 y el redondeo son exactos en double
+    for (size_t base = 0; base < count; base += QUANTIZE_BLOCK) {
+        size_t end = (count - base < QUANTIZE_BLOCK) ? count : base + QUANTIZE_BLOCK;
+        for (size_t i = base; i < end; ++i) {
+            double t = (double)(int32_t)ticks[i];
+            double snapped = std::floor(t * invGrid + 0.5) * grid;
+            ticks[i] = (uint32_t)(int32_t)(t + (snapped - t) * strength + 0.5);
+        }
+    }
+}
@@ -0,0 +1,214 @@
+#ifndef MASCHINE_TIMING_H
+#define MASCHINE_TIMING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+// Reloj MIDI: 24 pulsos por negra
+#define MIDI_CLOCK_PPQN           24
+
+// Mensajes MIDI de tiempo real / sistema común
+#define MIDI_SONG_POSITION        0xF2
+#define MIDI_TIMING_CLOCK         0xF8
+#define MIDI_CLOCK_START          0xFA
+#define MIDI_CLOCK_CONTINUE       0xFB
+#define MIDI_CLOCK_STOP           0xFC
+
+// Resolución interna del secuenciador (ticks por negra)
+#define SEQUENCER_PPQN            960
+
+// Rango de tempo aceptado por el driver
+#define MASCHINE_MIN_TEMPO        60.0
+#define MASCHINE_MAX_TEMPO        200.0
+
+// Reloj inyectable.
+//
+// Las rutas del driver que dependen del tiempo (tap tempo, secuenciador,
+// automatización, coalescencia de encoders, flashes de LED y las esperas de
+// las suites de prueba) leen la hora y duermen a través de un MaschineClock.
+// Los hilos de fondo (planificador, coalescencia de encoders) se registran
+// con addWaiter() al arrancar y esperan sus plazos con waitUntil(), nunca
+// con wait_for() directo.
+// Por defecto el driver usa el reloj del host, en la misma base que los
+// timestamps de CoreMIDI. Las pruebas inyectan un MaschineVirtualClock.
+class MaschineClock {
+public:
+    virtual ~MaschineClock() {}
+
+    virtual uint64_t now() = 0;                 // ns
+    virtual void sleepFor(uint64_t ns) = 0;
+
+    // Hilo de fondo que esperará sobre condition; antes de lanzarlo y tras
+    // el join. El reloj del host no necesita llevar la cuenta
+    virtual void addWaiter(std::mutex& mutex, std::condition_variable& condition) {}
+    virtual void removeWaiter(std::condition_variable& condition) {}
+
+    // Espera sobre condition (con lock tomado) hasta deadlineNs o un
+    // notify. UINT64_MAX espera sin plazo. Puede volver antes de tiempo:
+    // el llamador re-evalúa su condición en bucle
+    virtual void waitUntil(std::unique_lock<std::mutex>& lock, std::condition_variable& condition,
+                           uint64_t deadlineNs) = 0;
+};
+
+// Tiempo virtual: sleepFor() no espera, avanza el reloj y vuelve al
+// instante. Pensado para un único hilo que conduce la prueba. Al avanzar
+// despierta a los hilos registrados cuyo plazo venció y espera a que todos
+// vuelvan a dormir en waitUntil(), así lo que tocaba hacer en ese intervalo
+// ya está hecho cuando sleepFor() retorna. Un hilo despertado por un notify
+// directo del llamador cuenta como dormido hasta que llega a ejecutarse.
+#define MASCHINE_VIRTUAL_WAITERS     4
+
+class MaschineVirtualClock : public MaschineClock {
+public:
+    explicit MaschineVirtualClock(uint64_t startNs = 0);
+
+    virtual uint64_t now();
+    virtual void sleepFor(uint64_t ns);
+    virtual void addWaiter(std::mutex& mutex, std::condition_variable& condition);
+    virtual void removeWaiter(std::condition_variable& condition);
+    virtual void waitUntil(std::unique_lock<std::mutex>& lock, std::condition_variable& condition,
+                           uint64_t deadlineNs);
+    void advance(uint64_t ns);
+
+    // Tiempo simulado desde la creación
+    uint64_t getElapsed() const { return current.load() - startNs; }
+
+private:
+    struct Waiter {
+        std::mutex* mutex;
+        std::condition_variable* condition;
+        uint64_t deadlineNs;
+        bool waiting;           // dormido en waitUntil() hasta deadlineNs
+    };
+
+    Waiter* findWaiter(std::condition_variable* condition);
+    bool settled() const;
+
+    std::atomic<uint64_t> current;
+    uint64_t startNs;
+
+    // Un hueco por hilo registrado; fijo para no reservar memoria al esperar
+    std::mutex waitersMutex;
+    std::condition_variable settledCondition;
+    Waiter waiters[MASCHINE_VIRTUAL_WAITERS];
+    int waiterCount;
+};
+
+// Seguimiento de reloj MIDI esclavo.
+//
+// PLL de segundo orden sobre los timestamps de cada 0xF8: la fase predice el
+// próximo pulso y el período (ns por pulso) se corrige con el error de fase.
+// Al arrancar usa ganancias altas para enganchar rápido y luego baja el ancho
+// de banda para filtrar el jitter de entrega USB. Un pulso cuyo error supera
+// la ventana de rechazo se descarta; varios seguidos indican un salto real de
+// tempo y fuerzan una re-adquisición.
+class MaschineClockTracker {
+public:
+    MaschineClockTracker();
+
+    void reset();
+
+    // Eventos de reloj, con timestamp en nanosegundos
+    void clockTick(uint64_t timestampNs);
+    void start();
+    void resume();
+    void stop();
+    void setSongPosition(int sixteenths);
+
+    bool isLocked() const { return locked; }
+    bool isRunning() const { return running; }
+    double getTempo() const;
+    uint64_t getSongPositionTicks() const { return songPositionTicks; }
+    double getSongPositionBeats() const { return (double)songPositionTicks / MIDI_CLOCK_PPQN; }
+
+    // Métricas: pulsos hasta enganchar y error de fase RMS en régimen
+    int getConvergenceTicks() const { return convergenceTicks; }
+    double getSteadyStateErrorUs() const;
+    uint64_t getRejectedTicks() const { return rejectedTicks; }
+
+private:
+    void acquire(uint64_t timestampNs);
+    void updateLoop(uint64_t timestampNs, double error);
+
+    bool running;
+    bool startPending;
+    bool locked;
+    uint64_t songPositionTicks;
+
+    // Estado del PLL (en ns)
+    int ticksSinceAcquire;
+    uint64_t lastTimestampNs;
+    double period;
+    double predicted;
+
+    int consecutiveOutliers;
+    int stableTicks;
+    int convergenceTicks;
+    uint64_t rejectedTicks;
+
+    // Error de fase cuadrático medio (media exponencial)
+    double errorSquaredAvg;
+};
+
+// Tap tempo: ventana deslizante de los últimos toques
+#define TAP_TEMPO_WINDOW          8
+
+// Estimador de tap tempo.
+//
+// Guarda los timestamps de los últimos toques en un anillo fijo (sin
+// reservar memoria). Cada toque se asigna a un número de pulso respecto al
+// último toque aceptado usando la mediana de los intervalos, de modo que un
+// pulso saltado cuenta como dos y un toque doble o fuera de tiempo se
+// descarta. El período sale de una regresión lineal ponderada (más peso a
+// los toques recientes) sobre la ventana, así que el coste por toque es
+// constante. Una pausa larga reinicia la medición.
+class MaschineTapTempo {
+public:
+    MaschineTapTempo();
+
+    void reset();
+
+    // Devuelve true si el toque produjo una nueva estimación
+    bool tap(uint64_t timestampNs);
+
+    double getTempo() const { return tempo; }
+    int getTapCount() const { return count; }
+
+private:
+    uint64_t taps[TAP_TEMPO_WINDOW];
+    int head;
+    int count;
+    double tempo;
+};
+
+// Cuantización de eventos.
+//
+// La rejilla (en ticks) y la fuerza se guardan empaquetadas en un único
+// atómico: la interfaz puede cambiarlas con el secuenciador en marcha y el
+// hilo de entrada siempre lee una pareja coherente sin tomar ningún lock.
+// quantizeTicks() recorre la columna de ticks de un patrón en bloques sin
+// ramas para que el compilador pueda vectorizar el bucle.
+class MaschineQuantizer {
+public:
+    MaschineQuantizer();
+
+    void setGrid(uint32_t gridTicks);
+    void setStrength(double strength);
+    uint32_t getGrid() const;
+    double getStrength() const;
+
+    // Cuantización de un evento grabado en vivo
+    uint32_t quantize(uint32_t tick) const;
+
+    // Cuantización en bloque de una columna de ticks
+    void quantizeTicks(uint32_t* ticks, size_t count) const;
+
+private:
+    // Rejilla en los 32 bits altos, fuerza en 1/65536 en los bajos
+    std::atomic<uint64_t> settings;
+};
+
+#endif // MASCHINE_TIMING_H
@@ -0,0 +1,849 @@
+#include "MaschineUSB.h"
+
+MaschineReadPipeline::MaschineReadPipeline() {
+    buffers = 0;
+    bufferSize = 0;
+    depth = 0;
+    submitFunction = 0;
+    deliverFunction = 0;
+    context = 0;
+    running = false;
+    generation = 0;
+    for (int i = 0; i < MASCHINE_READ_PIPELINE_MAX; ++i) {
+        queued[i] = false;
+        slotGeneration[i] = 0;
+    }
+    inFlight = 0;
+    minInFlight = 0;
+    consecutiveErrors = 0;
+    completions = 0;
+    errors = 0;
+    submitFailures = 0;
+    starvations = 0;
+    bytes = 0;
+}
+
+bool MaschineReadPipeline::configure(uint8_t* newBuffers, uint32_t newBufferSize, int newDepth,
+                                     SubmitFunction submit, DeliverFunction deliver, void* newContext) {
+    if (running || !newBuffers || newBufferSize == 0 || newDepth < 1 || newDepth > MASCHINE_READ_PIPELINE_MAX ||
+        !submit || !deliver) {
+        return false;
+    }
+    buffers = newBuffers;
+    bufferSize = newBufferSize;
+    depth = newDepth;
+    submitFunction = submit;
+    deliverFunction = deliver;
+    context = newContext;
+    return true;
+}
+
+bool MaschineReadPipeline::submit(int slot) {
+    // Marcar antes de encolar: la finalización puede llegar en otro hilo
+    // antes de que la función de envío vuelva. Si start() y una finalización
+    // intentan reenviar el mismo buffer a la vez, solo uno lo consigue
+    bool idle = false;
+    if (!__atomic_compare_exchange_n(&queued[slot], &idle, true, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        return false;
+    }
+    slotGeneration[slot] = generation;
+    __atomic_add_fetch(&inFlight, 1, __ATOMIC_ACQ_REL);
+    if (submitFunction(context, slot) != 0) {
+        __atomic_store_n(&queued[slot], false, __ATOMIC_SEQ_CST);
+        __atomic_sub_fetch(&inFlight, 1, __ATOMIC_ACQ_REL);
+        __atomic_add_fetch(&submitFailures, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+    return true;
+}
+
+int MaschineReadPipeline::start() {
+    if (!submitFunction || running) {
+        return getInFlight();
+    }
+    consecutiveErrors = 0;
+    minInFlight = depth;
+    generation++;
+    __atomic_store_n(&running, true, __ATOMIC_SEQ_CST);
+    // Los buffers aún en vuelo del stop() anterior se reenvían al terminar
+    for (int slot = 0; slot < depth; ++slot) {
+        submit(slot);
+    }
+    return getInFlight();
+}
+
+void MaschineReadPipeline::stop() {
+    __atomic_store_n(&running, false, __ATOMIC_SEQ_CST);
+}
+
+void MaschineReadPipeline::complete(int slot, MaschineReadStatus status, uint32_t length) {
+    if (slot < 0 || slot >= depth || !__atomic_load_n(&queued[slot], __ATOMIC_SEQ_CST)) {
+        return;
+    }
+    
+    // Abortada por un stop() anterior al start() en curso: start() no pudo
+    // reenviarla porque seguía en vuelo, se reenvía ahora. Sigue contando
+    // como en vuelo, así que no pasa por submit()
+    if (status == MASCHINE_READ_ABORTED && __atomic_load_n(&running, __ATOMIC_SEQ_CST) &&
+        slotGeneration[slot] != generation) {
+        slotGeneration[slot] = generation;
+        if (submitFunction(context, slot) != 0) {
+            __atomic_store_n(&queued[slot], false, __ATOMIC_SEQ_CST);
+            __atomic_sub_fetch(&inFlight, 1, __ATOMIC_ACQ_REL);
+            __atomic_add_fetch(&submitFailures, 1, __ATOMIC_RELAXED);
+        }
+        return;
+    }
+    
+    __atomic_store_n(&queued[slot], false, __ATOMIC_SEQ_CST);
+    int remaining = __atomic_sub_fetch(&inFlight, 1, __ATOMIC_ACQ_REL);
+    completions++;
+
+    // Cola vacía: a partir de aquí un frame del dispositivo puede no tener lectura
+    if (remaining < minInFlight) {
+        minInFlight = remaining;
+    }
+    if (remaining == 0 && running) {
+        starvations++;
+    }
+
+    if (status == MASCHINE_READ_OK) {
+        consecutiveErrors = 0;
+        if (length > bufferSize) {
+            length = bufferSize;
+        }
+        if (length > 0) {
+            bytes += length;
+            deliverFunction(context, getBuffer(slot), length);
+        }
+    } else if (status == MASCHINE_READ_ERROR) {
+        errors++;
+        consecutiveErrors++;
+    }
+
+    // El buffer ya se consumió: vuelve a la cola salvo abortos o errores persistentes
+    if (__atomic_load_n(&running, __ATOMIC_SEQ_CST) && status != MASCHINE_READ_ABORTED && consecutiveErrors < MASCHINE_READ_MAX_ERRORS) {
+        submit(slot);
+    }
+}
+
+MaschineMIDIBatch::MaschineMIDIBatch() {
+    segmentCount = 0;
+    segmentOpen = false;
+    length = 0;
+    messageCount = 0;
+    timestamp = 0;
+    deliveries = 0;
+    messages = 0;
+    dropped = 0;
+}
+
+void MaschineMIDIBatch::begin(uint64_t newTimestamp) {
+    segmentCount = 0;
+    segmentOpen = false;
+    length = 0;
+    messageCount = 0;
+    timestamp = newTimestamp;
+}
+
+bool MaschineMIDIBatch::add(const uint8_t* message, uint32_t messageLength) {
+    // Un SysEx siempre abre su propio segmento y lo deja cerrado
+    bool sysex = (message[0] == 0xF0);
+    bool newSegment = sysex || !segmentOpen;
+    if (messageLength == 0 || messageLength > MASCHINE_MIDI_BATCH_SIZE - length ||
+        (newSegment && segmentCount == MASCHINE_MIDI_BATCH_SEGMENTS)) {
+        dropped++;
+        return false;
+    }
+    for (uint32_t i = 0; i < messageLength; ++i) {
+        data[length + i] = message[i];
+    }
+    length += messageLength;
+    if (newSegment) {
+        segmentCount++;
+    }
+    segmentEnd[segmentCount - 1] = (uint16_t)length;
+    segmentOpen = !sysex;
+    messageCount++;
+    return true;
+}
+
+const uint8_t* MaschineMIDIBatch::getSegment(uint32_t index, uint32_t* segmentLength) const {
+    uint32_t start = index > 0 ? segmentEnd[index - 1] : 0;
+    *segmentLength = segmentEnd[index] - start;
+    return data + start;
+}
+
+bool MaschineMIDIBatch::finish() {
+    if (length == 0) {
+        return false;
+    }
+    deliveries++;
+    messages += messageCount;
+    return true;
+}
+
+// Tipos de paquete según el CIN
+enum {
+    CIN_IGNORE = 0,     // reservados (0x0, 0x1)
+    CIN_MESSAGE,        // mensaje completo de "length" bytes
+    CIN_SYSEX,          // SysEx empieza o continúa (3 bytes)
+    CIN_SYSEX_END,      // SysEx termina con "length" bytes
+    CIN_SINGLE          // 0x5 (fin de SysEx o común de 1 byte) y 0xF (1 byte suelto)
+};
+
+static const struct {
+    uint8_t length;
+    uint8_t kind;
+} kCINTable[16] = {
+    { 0, CIN_IGNORE },      // 0x0 misc
+    { 0, CIN_IGNORE },      // 0x1 cable events
+    { 2, CIN_MESSAGE },     // 0x2 común de 2 bytes (MTC, song select)
+    { 3, CIN_MESSAGE },     // 0x3 común de 3 bytes (song position)
+    { 3, CIN_SYSEX },       // 0x4 SysEx empieza/continúa
+    { 1, CIN_SINGLE },      // 0x5 común de 1 byte o SysEx termina con 1
+    { 2, CIN_SYSEX_END },   // 0x6 SysEx termina con 2
+    { 3, CIN_SYSEX_END },   // 0x7 SysEx termina con 3
+    { 3, CIN_MESSAGE },     // 0x8 note off
+    { 3, CIN_MESSAGE },     // 0x9 note on
+    { 3, CIN_MESSAGE },     // 0xA poly key pressure
+    { 3, CIN_MESSAGE },     // 0xB control change
+    { 2, CIN_MESSAGE },     // 0xC program change
+    { 2, CIN_MESSAGE },     // 0xD channel pressure
+    { 3, CIN_MESSAGE },     // 0xE pitch bend
+    { 1, CIN_SINGLE }       // 0xF byte suelto (tiempo real)
+};
+
+MaschineUSBMIDIDecoder::MaschineUSBMIDIDecoder() {
+    sysexLength = 0;
+    sysexCable = 0;
+    sysexActive = false;
+    sysexOverflow = false;
+    packets = 0;
+    emptyPackets = 0;
+    messages = 0;
+    sysexMessages = 0;
+    sysexDropped = 0;
+    invalidPackets = 0;
+}
+
+void MaschineUSBMIDIDecoder::reset() {
+    if (sysexActive) {
+        sysexDropped++;
+    }
+    sysexActive = false;
+    sysexOverflow = false;
+    sysexLength = 0;
+}
+
+bool MaschineUSBMIDIDecoder::appendSysEx(uint8_t cable, const uint8_t* bytes, uint32_t count) {
+    if (bytes[0] == 0xF0) {
+        // Un inicio nuevo corta el SysEx anterior sin terminar
+        if (sysexActive) {
+            sysexDropped++;
+        }
+        sysexActive = true;
+        sysexOverflow = false;
+        sysexLength = 0;
+        sysexCable = cable;
+    } else if (!sysexActive || cable != sysexCable) {
+        return false;
+    }
+
+    if (sysexLength + count > MASCHINE_SYSEX_MAX) {
+        sysexOverflow = true;
+    } else {
+        for (uint32_t i = 0; i < count; ++i) {
+            sysex[sysexLength + i] = bytes[i];
+        }
+        sysexLength += count;
+    }
+    return true;
+}
+
+bool MaschineUSBMIDIDecoder::endSysEx(MessageFunction function, void* context) {
+    bool complete = !sysexOverflow && sysex[sysexLength - 1] == 0xF7;
+    sysexActive = false;
+    if (!complete) {
+        sysexDropped++;
+        return false;
+    }
+    sysexMessages++;
+    messages++;
+    function(context, sysexCable, sysex, sysexLength);
+    return true;
+}
+
+uint32_t MaschineUSBMIDIDecoder::decode(const uint8_t* data, uint32_t length, MessageFunction function, void* context) {
+    uint32_t delivered = 0;
+    uint32_t end = length & ~(uint32_t)(MASCHINE_USB_MIDI_PACKET - 1);
+
+    for (uint32_t offset = 0; offset < end; offset += MASCHINE_USB_MIDI_PACKET) {
+        // Vía rápida: dos paquetes vacíos (relleno) en una sola comparación
+        if (offset + 2 * MASCHINE_USB_MIDI_PACKET <= end) {
+            uint64_t pair;
+            __builtin_memcpy(&pair, data + offset, sizeof(pair));
+            if (pair == 0) {
+                packets += 2;
+                emptyPackets += 2;
+                offset += MASCHINE_USB_MIDI_PACKET;
+                continue;
+            }
+        }
+
+        const uint8_t* packet = data + offset;
+        uint8_t cable = packet[0] >> 4;
+        uint8_t cin = packet[0] & 0x0F;
+        packets++;
+        if (packet[0] == 0 && packet[1] == 0) {
+            emptyPackets++;
+            continue;
+        }
+
+        switch (kCINTable[cin].kind) {
+            case CIN_MESSAGE:
+                // Sin running status en USB-MIDI: el primer byte debe ser de estado
+                if (!(packet[1] & 0x80)) {
+                    invalidPackets++;
+                    break;
+                }
+                messages++;
+                delivered++;
+                function(context, cable, packet + 1, kCINTable[cin].length);
+                break;
+
+            case CIN_SYSEX:
+                if (!appendSysEx(cable, packet + 1, 3)) {
+                    invalidPackets++;
+                }
+                break;
+
+            case CIN_SYSEX_END:
+                if (!appendSysEx(cable, packet + 1, kCINTable[cin].length)) {
+                    invalidPackets++;
+                } else if (endSysEx(function, context)) {
+                    delivered++;
+                }
+                break;
+
+            case CIN_SINGLE:
+                if (packet[1] >= 0xF8 || (cin == 0x5 && packet[1] > 0xF0 && packet[1] < 0xF7)) {
+                    // Tiempo real o común de 1 byte: no interrumpe un SysEx en curso
+                    messages++;
+                    delivered++;
+                    function(context, cable, packet + 1, 1);
+                } else if (packet[1] == 0xF7 || (cin == 0xF && !(packet[1] & 0x80))) {
+                    // Fin de SysEx con 1 byte, o byte de datos suelto dentro del SysEx
+                    if (!appendSysEx(cable, packet + 1, 1)) {
+                        invalidPackets++;
+                    } else if (packet[1] == 0xF7 && endSysEx(function, context)) {
+                        delivered++;
+                    }
+                } else {
+                    invalidPackets++;
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return delivered;
+}
+
+uint32_t encodeUSBMIDIMessage(const uint8_t* message, uint32_t length, uint8_t* packets, uint32_t capacity) {
+    if (!message || length == 0 || !(message[0] & 0x80)) {
+        return 0;
+    }
+    uint8_t status = message[0];
+
+    if (status == 0xF0) {
+        if (length < 2 || message[length - 1] != 0xF7) {
+            return 0;
+        }
+        for (uint32_t i = 1; i + 1 < length; ++i) {
+            if (message[i] & 0x80) {
+                return 0;
+            }
+        }
+        uint32_t size = MASCHINE_USB_SYSEX_SIZE(length);
+        if (!packets) {
+            return size;
+        }
+        if (size > capacity) {
+            return 0;
+        }
+        uint8_t* packet = packets;
+        for (uint32_t i = 0; i < length; i += 3, packet += MASCHINE_USB_MIDI_PACKET) {
+            uint32_t count = length - i < 3 ? length - i : 3;
+            packet[0] = (i + count == length) ? (uint8_t)(0x4 + count) : 0x4;
+            packet[1] = message[i];
+            packet[2] = count > 1 ? message[i + 1] : 0;
+            packet[3] = count > 2 ? message[i + 2] : 0;
+        }
+        return size;
+    }
+
+    // Mensajes de un solo paquete: CIN y longitud según el estado
+    uint8_t cin;
+    uint32_t expected;
+    if (status < 0xF0) {
+        cin = status >> 4;
+        expected = kCINTable[cin].length;
+    } else if (status == 0xF1 || status == 0xF3) {
+        cin = 0x2;
+        expected = 2;
+    } else if (status == 0xF2) {
+        cin = 0x3;
+        expected = 3;
+    } else if (status == 0xF6) {
+        cin = 0x5;
+        expected = 1;
+    } else if (status >= 0xF8) {
+        cin = 0xF;
+        expected = 1;
+    } else {
+        return 0;
+    }
+    if (length != expected) {
+        return 0;
+    }
+    for (uint32_t i = 1; i < length; ++i) {
+        if (message[i] & 0x80) {
+            return 0;
+        }
+    }
+    if (!packets) {
+        return MASCHINE_USB_MIDI_PACKET;
+    }
+    if (capacity < MASCHINE_USB_MIDI_PACKET) {
+        return 0;
+    }
+    packets[0] = cin;
+    packets[1] = status;
+    packets[2] = length > 1 ? message[1] : 0;
+    packets[3] = length > 2 ? message[2] : 0;
+    return MASCHINE_USB_MIDI_PACKET;
+}
+
+MaschineWriteQueue::MaschineWriteQueue() {
+    buffers = 0;
+    bufferSize = 0;
+    depth = 0;
+    submitFunction = 0;
+    context = 0;
+    for (int i = 0; i < MASCHINE_WRITE_QUEUE_MAX; ++i) {
+        slotState[i] = SLOT_FREE;
+    }
+    nextSlot = 0;
+    openSlot = -1;
+    openLength = 0;
+    inFlight = 0;
+    held = false;
+    readyCount = 0;
+    messages = 0;
+    transfers = 0;
+    bytes = 0;
+    fullFlushes = 0;
+    deadlineFlushes = 0;
+    rejected = 0;
+    errors = 0;
+}
+
+bool MaschineWriteQueue::configure(uint8_t* newBuffers, uint32_t newBufferSize, int newDepth,
+                                   SubmitFunction submit, void* newContext) {
+    if (!newBuffers || newBufferSize < MASCHINE_USB_MIDI_PACKET || newBufferSize % MASCHINE_USB_MIDI_PACKET != 0 ||
+        newDepth < 1 || newDepth > MASCHINE_WRITE_QUEUE_MAX || !submit) {
+        return false;
+    }
+    buffers = newBuffers;
+    bufferSize = newBufferSize;
+    depth = newDepth;
+    submitFunction = submit;
+    context = newContext;
+    reset();
+    return true;
+}
+
+bool MaschineWriteQueue::open() {
+    // Cualquier buffer libre sirve: el orden lo da el momento del envío
+    for (int i = 0; i < depth; ++i) {
+        int slot = (nextSlot + i) % depth;
+        if (slotState[slot] == SLOT_FREE) {
+            slotState[slot] = SLOT_OPEN;
+            openSlot = slot;
+            openLength = 0;
+            nextSlot = (slot + 1) % depth;
+            return true;
+        }
+    }
+    return false;
+}
+
+void MaschineWriteQueue::submit() {
+    int slot = openSlot;
+    uint32_t length = openLength;
+    openSlot = -1;
+    openLength = 0;
+
+    if (held) {
+        slotState[slot] = SLOT_READY;
+        readySlots[readyCount] = slot;
+        readyLength[readyCount] = length;
+        readyCount++;
+        return;
+    }
+    send(slot, length);
+}
+
+void MaschineWriteQueue::send(int slot, uint32_t length) {
+    slotState[slot] = SLOT_IN_FLIGHT;
+    inFlight++;
+    transfers++;
+    bytes += length;
+    if (submitFunction(context, slot, length) != 0) {
+        // Los mensajes de este buffer se pierden
+        slotState[slot] = SLOT_FREE;
+        inFlight--;
+        errors++;
+    }
+}
+
+bool MaschineWriteQueue::append(const uint8_t* message, uint32_t length, bool* armTimer) {
+    *armTimer = false;
+    uint32_t size = encodeUSBMIDIMessage(message, length, 0, 0);
+    if (!submitFunction || size == 0 || size > bufferSize) {
+        rejected++;
+        return false;
+    }
+
+    // Sus paquetes no caben en el buffer abierto: se envía tal cual y se abre otro
+    if (openSlot >= 0 && openLength + size > bufferSize) {
+        fullFlushes++;
+        submit();
+    }
+    if (openSlot < 0) {
+        if (!open()) {
+            rejected++;
+            return false;
+        }
+        *armTimer = true;
+    }
+
+    encodeUSBMIDIMessage(message, length, getBuffer(openSlot) + openLength, bufferSize - openLength);
+    openLength += size;
+    messages++;
+
+    // Lleno justo: no tiene sentido esperar al plazo
+    if (openLength == bufferSize) {
+        fullFlushes++;
+        submit();
+        *armTimer = false;
+    }
+    return true;
+}
+
+bool MaschineWriteQueue::flush() {
+    if (openSlot < 0 || openLength == 0) {
+        return false;
+    }
+    deadlineFlushes++;
+    submit();
+    return true;
+}
+
+void MaschineWriteQueue::complete(int slot, bool success) {
+    if (slot < 0 || slot >= depth || slotState[slot] != SLOT_IN_FLIGHT) {
+        return;
+    }
+    slotState[slot] = SLOT_FREE;
+    inFlight--;
+    if (!success) {
+        errors++;
+    }
+}
+
+void MaschineWriteQueue::reset() {
+    for (int i = 0; i < MASCHINE_WRITE_QUEUE_MAX; ++i) {
+        slotState[i] = SLOT_FREE;
+    }
+    nextSlot = 0;
+    openSlot = -1;
+    openLength = 0;
+    inFlight = 0;
+    held = false;
+    readyCount = 0;
+}
+
+void MaschineWriteQueue::hold() {
+    held = true;
+}
+
+void MaschineWriteQueue::release() {
+    held = false;
+    for (int i = 0; i < readyCount; ++i) {
+        send(readySlots[i], readyLength[i]);
+    }
+    readyCount = 0;
+}
+
+MaschineSysExSender::MaschineSysExSender() {
+    pool = 0;
+    slotSize = 0;
+    slots = 0;
+    chunkSize = 0;
+    window = 0;
+    submitFunction = 0;
+    doneFunction = 0;
+    exclusiveFunction = 0;
+    context = 0;
+    queued = 0;
+    exclusive = false;
+    nextID = 1;
+    for (int i = 0; i < MASCHINE_SYSEX_POOL; ++i) {
+        jobs[i].id = 0;
+        order[i] = 0;
+    }
+    for (int i = 0; i < MASCHINE_SYSEX_WINDOW_MAX; ++i) {
+        chunkLength[i] = 0;
+    }
+    chunksInFlight = 0;
+    messages = 0;
+    bytes = 0;
+    chunks = 0;
+    failures = 0;
+    rejected = 0;
+    busyNs = 0;
+}
+
+bool MaschineSysExSender::configure(uint8_t* newPool, uint32_t newSlotSize, int newSlots, uint32_t newChunkSize,
+                                    int newWindow, SubmitFunction submit, DoneFunction done,
+                                    ExclusiveFunction exclusiveChanged, void* newContext) {
+    if (!newPool || newSlotSize < MASCHINE_USB_MIDI_PACKET || newSlots < 1 || newSlots > MASCHINE_SYSEX_POOL ||
+        newChunkSize == 0 || newChunkSize % MASCHINE_USB_MIDI_PACKET != 0 ||
+        newWindow < 1 || newWindow > MASCHINE_SYSEX_WINDOW_MAX || !submit || !done || !exclusiveChanged || queued > 0) {
+        return false;
+    }
+    pool = newPool;
+    slotSize = newSlotSize;
+    slots = newSlots;
+    chunkSize = newChunkSize;
+    window = newWindow;
+    submitFunction = submit;
+    doneFunction = done;
+    exclusiveFunction = exclusiveChanged;
+    context = newContext;
+    return true;
+}
+
+bool MaschineSysExSender::validate(const uint8_t* payload, uint32_t length) {
+    for (uint32_t i = 0; i < length; ++i) {
+        if (payload[i] & 0x80) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t MaschineSysExSender::enqueue(const uint8_t* payload, uint32_t length, void* reference, uint64_t nowNs) {
+    if (!submitFunction || length == 0 || MASCHINE_USB_SYSEX_SIZE(length + 2) > slotSize || queued == slots ||
+        !validate(payload, length)) {
+        rejected++;
+        return 0;
+    }
+
+    // Primer slot del pool que no está en cola
+    int slot = 0;
+    while (jobs[slot].id != 0) {
+        slot++;
+    }
+
+    // F0, payload y F7 repartidos en paquetes de 3 bytes
+    uint8_t* packet = pool + (size_t)slot * slotSize;
+    uint32_t total = length + 2;
+    for (uint32_t i = 0; i < total; i += 3, packet += MASCHINE_USB_MIDI_PACKET) {
+        uint32_t count = total - i < 3 ? total - i : 3;
+        packet[0] = (i + count == total) ? (uint8_t)(0x4 + count) : 0x4;
+        for (uint32_t j = 0; j < 3; ++j) {
+            uint32_t position = i + j;
+            uint8_t value = 0;
+            if (j < count) {
+                value = position == 0 ? 0xF0 : (position == total - 1 ? 0xF7 : payload[position - 1]);
+            }
+            packet[1 + j] = value;
+        }
+    }
+
+    Job& job = jobs[slot];
+    job.id = nextID++;
+    if (nextID == 0) {
+        nextID = 1;
+    }
+    job.length = MASCHINE_USB_SYSEX_SIZE(total);
+    job.midiLength = total;
+    job.sent = 0;
+    job.acked = 0;
+    job.status = MASCHINE_SYSEX_OK;
+    job.startNs = nowNs;
+    job.reference = reference;
+    order[queued++] = slot;
+
+    uint32_t id = job.id;
+    if (queued == 1) {
+        pump(nowNs);
+    }
+    return id;
+}
+
+void MaschineSysExSender::pump(uint64_t nowNs) {
+    while (queued > 0) {
+        Job& job = jobs[order[0]];
+        if (!exclusive) {
+            exclusive = true;
+            exclusiveFunction(context, true);
+        }
+
+        while (job.status == MASCHINE_SYSEX_OK && job.sent < job.length && chunksInFlight < window) {
+            int chunk = 0;
+            while (chunkLength[chunk] != 0) {
+                chunk++;
+            }
+            uint32_t length = job.length - job.sent;
+            if (length > chunkSize) {
+                length = chunkSize;
+            }
+
+            chunkLength[chunk] = length;
+            chunksInFlight++;
+            const uint8_t* data = pool + (size_t)order[0] * slotSize + job.sent;
+            job.sent += length;
+            if (submitFunction(context, chunk, data, length) != 0) {
+                chunkLength[chunk] = 0;
+                chunksInFlight--;
+                job.status = MASCHINE_SYSEX_FAILED;
+            } else {
+                chunks++;
+            }
+        }
+
+        // Sigue en curso hasta que vuelvan todos sus trozos
+        if (chunksInFlight > 0 || (job.status == MASCHINE_SYSEX_OK && job.acked < job.length)) {
+            return;
+        }
+        finish(nowNs);
+    }
+}
+
+void MaschineSysExSender::finish(uint64_t nowNs) {
+    int slot = order[0];
+    Job job = jobs[slot];
+    jobs[slot].id = 0;
+    queued--;
+    for (int i = 0; i < queued; ++i) {
+        order[i] = order[i + 1];
+    }
+
+    // Entre mensajes el pipe vuelve a quedar libre para el resto de la salida
+    if (exclusive) {
+        exclusive = false;
+        exclusiveFunction(context, false);
+    }
+
+    uint64_t duration = nowNs > job.startNs ? nowNs - job.startNs : 0;
+    if (job.status == MASCHINE_SYSEX_OK) {
+        messages++;
+        bytes += job.midiLength;
+        busyNs += duration;
+    } else {
+        failures++;
+    }
+    // Bytes MIDI de los paquetes confirmados (el último puede llevar relleno)
+    uint32_t delivered = job.acked / MASCHINE_USB_MIDI_PACKET * 3;
+    if (delivered > job.midiLength) {
+        delivered = job.midiLength;
+    }
+    doneFunction(context, job.id, job.status, delivered, duration, job.reference);
+}
+
+void MaschineSysExSender::complete(int chunk, bool success, uint64_t nowNs) {
+    if (chunk < 0 || chunk >= window || chunkLength[chunk] == 0 || queued == 0) {
+        return;
+    }
+    Job& job = jobs[order[0]];
+    if (success) {
+        job.acked += chunkLength[chunk];
+    } else if (job.status == MASCHINE_SYSEX_OK) {
+        job.status = MASCHINE_SYSEX_FAILED;
+    }
+    chunkLength[chunk] = 0;
+    chunksInFlight--;
+    pump(nowNs);
+}
+
+void MaschineSysExSender::abort(uint64_t nowNs) {
+    for (int i = 0; i < MASCHINE_SYSEX_WINDOW_MAX; ++i) {
+        chunkLength[i] = 0;
+    }
+    chunksInFlight = 0;
+    while (queued > 0) {
+        jobs[order[0]].status = MASCHINE_SYSEX_ABORTED;
+        finish(nowNs);
+    }
+}
+
+MaschineDeviceCounters::MaschineDeviceCounters() {
+    reset();
+}
+
+void MaschineDeviceCounters::reset() {
+    readsCompleted = 0;
+    readErrors = 0;
+    bytesIn = 0;
+    bytesOut = 0;
+    messagesDecoded = 0;
+    decodeErrors = 0;
+    inputOverflows = 0;
+    outputOverflows = 0;
+    writeErrors = 0;
+    latencySamples = 0;
+    latencyTotalNs = 0;
+    latencyMinNs = UINT64_MAX;
+    latencyMaxNs = 0;
+}
+
+void MaschineDeviceCounters::latency(uint64_t nanoseconds) {
+    add(&latencySamples, 1);
+    add(&latencyTotalNs, nanoseconds);
+
+    // Mínimo y máximo con CAS: solo reintenta si otro hilo mejoró el valor
+    uint64_t current = __atomic_load_n(&latencyMinNs, __ATOMIC_RELAXED);
+    while (nanoseconds < current &&
+           !__atomic_compare_exchange_n(&latencyMinNs, &current, nanoseconds, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+    current = __atomic_load_n(&latencyMaxNs, __ATOMIC_RELAXED);
+    while (nanoseconds > current &&
+           !__atomic_compare_exchange_n(&latencyMaxNs, &current, nanoseconds, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+void MaschineDeviceCounters::snapshot(MaschineDeviceStatus* status) const {
+    status->version = MASCHINE_DEVICE_STATUS_VERSION;
+    status->size = sizeof(*status);
+    status->readsCompleted = __atomic_load_n(&readsCompleted, __ATOMIC_RELAXED);
+    status->readErrors = __atomic_load_n(&readErrors, __ATOMIC_RELAXED);
+    status->bytesIn = __atomic_load_n(&bytesIn, __ATOMIC_RELAXED);
+    status->bytesOut = __atomic_load_n(&bytesOut, __ATOMIC_RELAXED);
+    status->messagesDecoded = __atomic_load_n(&messagesDecoded, __ATOMIC_RELAXED);
+    status->decodeErrors = __atomic_load_n(&decodeErrors, __ATOMIC_RELAXED);
+    status->inputOverflows = __atomic_load_n(&inputOverflows, __ATOMIC_RELAXED);
+    status->outputOverflows = __atomic_load_n(&outputOverflows, __ATOMIC_RELAXED);
+    status->writeErrors = __atomic_load_n(&writeErrors, __ATOMIC_RELAXED);
+
+    uint64_t samples = __atomic_load_n(&latencySamples, __ATOMIC_RELAXED);
+    uint64_t total = __atomic_load_n(&latencyTotalNs, __ATOMIC_RELAXED);
+    status->latencySamples = samples;
+    status->latencyMinNs = samples ? __atomic_load_n(&latencyMinNs, __ATOMIC_RELAXED) : 0;
+    status->latencyAvgNs = samples ? total / samples : 0;
+    status->latencyMaxNs = __atomic_load_n(&latencyMaxNs, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,461 @@
+#ifndef MASCHINE_USB_H
+#define MASCHINE_USB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Lógica USB portable compartida por el kext y las herramientas de
+// user-space. Sin dependencias de IOKit ni de la biblioteca estándar (no
+// reserva memoria ni lanza excepciones), para poder compilarla dentro del
+// kernel y probarla contra un pipe simulado en cualquier plataforma.
+
+// Tamaño de paquete del endpoint de entrada y profundidad de la cola de lecturas
+#define MASCHINE_USB_PACKET_SIZE      64
+#define MASCHINE_READ_PIPELINE_MAX    8
+#define MASCHINE_READ_PIPELINE_DEPTH  4
+
+// Tras tantos errores seguidos (sin contar abortos) el pipeline deja de
+// reenviar lecturas hasta el próximo start()
+#define MASCHINE_READ_MAX_ERRORS      8
+
+enum MaschineReadStatus {
+    MASCHINE_READ_OK = 0,
+    MASCHINE_READ_ABORTED,      // pipe abortado (stop / desconexión)
+    MASCHINE_READ_ERROR
+};
+
+// Cola de lecturas asíncronas sobre buffers preasignados.
+//
+// Mantiene hasta "depth" lecturas encoladas en el pipe de entrada para que
+// siempre haya una esperando en cada frame USB. Cada finalización entrega
+// los datos de su buffer y vuelve a encolar ese mismo buffer, así que no
+// hace falta ningún temporizador ni reservar memoria por transferencia.
+// El llamador aporta las funciones de envío (encolar el buffer "slot" en el
+// pipe) y de entrega. Las finalizaciones de un mismo pipe llegan en serie;
+// la clase no toma locks: start() puede solaparse con las finalizaciones,
+// así que el estado de cada buffer y el de marcha son atómicos. Una lectura
+// abortada por un stop() anterior que termina después del siguiente start()
+// se reenvía, así la profundidad se recupera tras cada ciclo stop/start.
+class MaschineReadPipeline {
+public:
+    // Devuelve 0 si la lectura quedó encolada
+    typedef int (*SubmitFunction)(void* context, int slot);
+    typedef void (*DeliverFunction)(void* context, const uint8_t* data, uint32_t length);
+
+    MaschineReadPipeline();
+
+    // buffers: depth * bufferSize bytes, propiedad del llamador
+    bool configure(uint8_t* buffers, uint32_t bufferSize, int depth,
+                   SubmitFunction submit, DeliverFunction deliver, void* context);
+
+    // Encola todos los buffers; devuelve cuántos quedaron en vuelo
+    int start();
+    // Las finalizaciones posteriores ya no se reenvían (el llamador aborta el pipe)
+    void stop();
+
+    // Llamar desde la finalización de la lectura del buffer "slot"
+    void complete(int slot, MaschineReadStatus status, uint32_t length);
+
+    uint8_t* getBuffer(int slot) const { return buffers + (size_t)slot * bufferSize; }
+    uint32_t getBufferSize() const { return bufferSize; }
+    int getDepth() const { return depth; }
+    bool isRunning() const { return running; }
+
+    // Estadísticas
+    int getInFlight() const { return __atomic_load_n(&inFlight, __ATOMIC_ACQUIRE); }
+    int getMinInFlight() const { return minInFlight; }
+    uint64_t getCompletions() const { return completions; }
+    uint64_t getErrors() const { return errors; }
+    uint64_t getSubmitFailures() const { return __atomic_load_n(&submitFailures, __ATOMIC_RELAXED); }
+    uint64_t getStarvations() const { return starvations; }
+    uint64_t getBytes() const { return bytes; }
+
+private:
+    bool submit(int slot);
+
+    uint8_t* buffers;
+    uint32_t bufferSize;
+    int depth;
+    SubmitFunction submitFunction;
+    DeliverFunction deliverFunction;
+    void* context;
+
+    bool running;
+    bool queued[MASCHINE_READ_PIPELINE_MAX];
+    uint32_t generation;                                // start() que envió cada buffer
+    uint32_t slotGeneration[MASCHINE_READ_PIPELINE_MAX];
+    int inFlight;
+    int minInFlight;
+    int consecutiveErrors;
+
+    uint64_t completions;
+    uint64_t errors;
+    uint64_t submitFailures;
+    uint64_t starvations;
+    uint64_t bytes;
+};
+
+// Mensajes MIDI de una transferencia, empaquetados para entregarlos con
+// un solo MIDIReceived. Todos comparten la marca de tiempo de la
+// finalización. Los mensajes normales se concatenan en un mismo segmento
+// (un MIDIPacket); cada SysEx va en un segmento propio, porque CoreMIDI no
+// admite otros eventos en el paquete de un SysEx. Una transferencia de 64
+// bytes más un SysEx completo (MASCHINE_SYSEX_MAX) siempre caben, así que
+// add() solo falla ante entradas corruptas (el mensaje se descarta y se
+// cuenta).
+#define MASCHINE_MIDI_BATCH_SIZE      1024
+#define MASCHINE_MIDI_BATCH_SEGMENTS  48
+
+class MaschineMIDIBatch {
+public:
+    MaschineMIDIBatch();
+
+    void begin(uint64_t timestamp);
+    bool add(const uint8_t* message, uint32_t length);
+    // Cierra el lote: devuelve false si no hay nada que entregar
+    bool finish();
+
+    bool isEmpty() const { return length == 0; }
+    uint32_t getLength() const { return length; }
+    uint32_t getSegmentCount() const { return segmentCount; }
+    const uint8_t* getSegment(uint32_t index, uint32_t* segmentLength) const;
+    uint32_t getMessageCount() const { return messageCount; }
+    uint64_t getTimestamp() const { return timestamp; }
+
+    // Estadísticas acumuladas
+    uint64_t getDeliveries() const { return deliveries; }
+    uint64_t getMessages() const { return messages; }
+    uint64_t getDropped() const { return dropped; }
+
+private:
+    uint8_t data[MASCHINE_MIDI_BATCH_SIZE];
+    uint16_t segmentEnd[MASCHINE_MIDI_BATCH_SEGMENTS];
+    uint32_t segmentCount;
+    bool segmentOpen;               // el último segmento admite más mensajes
+    uint32_t length;
+    uint32_t messageCount;
+    uint64_t timestamp;
+
+    uint64_t deliveries;
+    uint64_t messages;
+    uint64_t dropped;
+};
+
+// Decodificador de paquetes USB-MIDI (clase compliant): 4 bytes por evento,
+// cable en el nibble alto del primer byte y Code Index Number (CIN) en el
+// bajo. Una tabla indexada por CIN da la longitud y el tipo de cada
+// paquete. Los SysEx llegan repartidos en paquetes CIN 0x4 y terminan con
+// 0x5/0x6/0x7; se acumulan hasta MASCHINE_SYSEX_MAX bytes y se entregan
+// enteros (los más largos se descartan y se cuentan). Los mensajes de
+// tiempo real pueden intercalarse en un SysEx sin cortarlo.
+//
+// Las transferencias suelen traer pocos eventos y el resto relleno con
+// ceros: se comprueban dos paquetes a la vez con una palabra de 64 bits y
+// los vacíos se saltan sin pasar por la tabla. (El kext no puede usar
+// registros vectoriales, así que la vía rápida es SWAR y no SSE/NEON.)
+#define MASCHINE_USB_MIDI_PACKET      4
+#define MASCHINE_SYSEX_MAX            512
+
+class MaschineUSBMIDIDecoder {
+public:
+    typedef void (*MessageFunction)(void* context, uint8_t cable, const uint8_t* message, uint32_t length);
+
+    MaschineUSBMIDIDecoder();
+
+    // Descarta un SysEx a medias (reconexión)
+    void reset();
+    // Procesa length / 4 paquetes; devuelve cuántos mensajes entregó
+    uint32_t decode(const uint8_t* data, uint32_t length, MessageFunction function, void* context);
+
+    // Estadísticas
+    uint64_t getPackets() const { return packets; }
+    uint64_t getEmptyPackets() const { return emptyPackets; }
+    uint64_t getMessages() const { return messages; }
+    uint64_t getSysExMessages() const { return sysexMessages; }
+    uint64_t getSysExDropped() const { return sysexDropped; }
+    uint64_t getInvalidPackets() const { return invalidPackets; }
+
+private:
+    bool appendSysEx(uint8_t cable, const uint8_t* bytes, uint32_t count);
+    bool endSysEx(MessageFunction function, void* context);
+
+    uint8_t sysex[MASCHINE_SYSEX_MAX];
+    uint32_t sysexLength;
+    uint8_t sysexCable;
+    bool sysexActive;
+    bool sysexOverflow;
+
+    uint64_t packets;
+    uint64_t emptyPackets;
+    uint64_t messages;
+    uint64_t sysexMessages;
+    uint64_t sysexDropped;
+    uint64_t invalidPackets;
+};
+
+// Codificador USB-MIDI para la salida: un mensaje completo (de canal,
+// común, tiempo real o SysEx con F0...F7) en paquetes de 4 bytes por el
+// cable 0, con el CIN en el nibble bajo del primer byte. Los SysEx van en
+// paquetes CIN 0x4 y el último en 0x5/0x6/0x7 según le queden 1, 2 o 3
+// bytes. Devuelve los bytes de paquetes escritos, o 0 si el mensaje no es
+// válido o no cabe en capacity. Con packets a NULL solo calcula el tamaño.
+#define MASCHINE_USB_SYSEX_SIZE(bytes)  (((bytes) + 2) / 3 * MASCHINE_USB_MIDI_PACKET)
+
+uint32_t encodeUSBMIDIMessage(const uint8_t* message, uint32_t length, uint8_t* packets, uint32_t capacity);
+
+// Cola de salida que agrupa mensajes MIDI en transferencias completas.
+//
+// Cada mensaje se codifica como paquetes USB-MIDI en el buffer abierto de
+// un anillo de buffers preasignados (un buffer de 64 bytes lleva 16
+// paquetes); cuando ya no caben los paquetes del siguiente mensaje (o se
+// llena) el buffer se envía entero. Si el buffer abierto no se llena, el llamador
+// lo envía con flush() al vencer un plazo corto (MASCHINE_WRITE_FLUSH_US),
+// que debe armar cuando append() lo indica. Los mensajes nunca se parten
+// entre transferencias. Sin buffers libres, append() rechaza el mensaje
+// (contrapresión). Mientras se envía un SysEx por trozos, hold() retiene
+// los buffers cerrados para no intercalarlos en él; release() los envía en
+// orden. La clase no toma locks: el llamador serializa todas las llamadas.
+#define MASCHINE_WRITE_QUEUE_MAX      16
+#define MASCHINE_WRITE_QUEUE_DEPTH    8
+#define MASCHINE_WRITE_FLUSH_US       1000
+
+class MaschineWriteQueue {
+public:
+    // Devuelve 0 si la transferencia quedó encolada
+    typedef int (*SubmitFunction)(void* context, int slot, uint32_t length);
+
+    MaschineWriteQueue();
+
+    // buffers: depth * bufferSize bytes, propiedad del llamador
+    bool configure(uint8_t* buffers, uint32_t bufferSize, int depth, SubmitFunction submit, void* context);
+
+    // armTimer: el mensaje abrió un buffer nuevo que queda pendiente de plazo
+    bool append(const uint8_t* message, uint32_t length, bool* armTimer);
+    // Envía el buffer abierto; devuelve false si estaba vacío
+    bool flush();
+    // Llamar desde la finalización de la escritura del buffer "slot"
+    void complete(int slot, bool success);
+    // Tras abortar el pipe: todos los buffers vuelven a estar libres
+    void reset();
+
+    void hold();
+    void release();
+    bool isHeld() const { return held; }
+
+    uint8_t* getBuffer(int slot) const { return buffers + (size_t)slot * bufferSize; }
+    uint32_t getPendingLength() const { return openSlot >= 0 ? openLength : 0; }
+
+    // Estadísticas
+    int getInFlight() const { return inFlight; }
+    uint64_t getMessages() const { return messages; }
+    uint64_t getTransfers() const { return transfers; }
+    uint64_t getBytes() const { return bytes; }
+    uint64_t getFullFlushes() const { return fullFlushes; }
+    uint64_t getDeadlineFlushes() const { return deadlineFlushes; }
+    uint64_t getRejected() const { return rejected; }
+    uint64_t getErrors() const { return errors; }
+
+private:
+    enum { SLOT_FREE = 0, SLOT_OPEN, SLOT_READY, SLOT_IN_FLIGHT };
+
+    bool open();
+    void submit();
+    void send(int slot, uint32_t length);
+
+    uint8_t* buffers;
+    uint32_t bufferSize;
+    int depth;
+    SubmitFunction submitFunction;
+    void* context;
+
+    uint8_t slotState[MASCHINE_WRITE_QUEUE_MAX];
+    int nextSlot;
+    int openSlot;
+    uint32_t openLength;
+    int inFlight;
+    bool held;
+
+    // Buffers cerrados durante hold(), en orden de cierre
+    int readySlots[MASCHINE_WRITE_QUEUE_MAX];
+    uint32_t readyLength[MASCHINE_WRITE_QUEUE_MAX];
+    int readyCount;
+
+    uint64_t messages;
+    uint64_t transfers;
+    uint64_t bytes;
+    uint64_t fullFlushes;
+    uint64_t deadlineFlushes;
+    uint64_t rejected;
+    uint64_t errors;
+};
+
+// Envío de SysEx grandes (volcados, frames de pantalla) por trozos del
+// tamaño del endpoint.
+//
+// Cada mensaje se codifica con F0/F7 en paquetes USB-MIDI (CIN 0x4 y el
+// final 0x5/0x6/0x7) en un buffer de un pool fijo y se envía en trozos de
+// chunkSize (múltiplo de 4, así ningún paquete queda partido); nunca hay más de "window" trozos en vuelo y el
+// siguiente sale desde la finalización del anterior, así que el ritmo lo
+// marca el propio pipe. Los mensajes se envían de uno en uno y en orden;
+// mientras uno está en curso el llamador tiene el pipe en exclusiva
+// (ExclusiveFunction), para no intercalar otros mensajes dentro del SysEx.
+// Al terminar cada mensaje se avisa con su estado, bytes MIDI entregados
+// (con F0/F7, no los de los paquetes) y duración.
+// Los tiempos los aporta el llamador (ns). La clase no toma locks.
+#define MASCHINE_SYSEX_OUT_MAX        8192    // bytes de paquetes USB-MIDI por mensaje
+#define MASCHINE_SYSEX_PAYLOAD_MAX    (MASCHINE_SYSEX_OUT_MAX / 4 * 3 - 2)  // sin F0/F7
+#define MASCHINE_SYSEX_POOL           4       // mensajes en cola a la vez
+#define MASCHINE_SYSEX_WINDOW_MAX     8
+#define MASCHINE_SYSEX_WINDOW         2       // trozos en vuelo
+
+enum MaschineSysExStatus {
+    MASCHINE_SYSEX_OK = 0,
+    MASCHINE_SYSEX_FAILED,          // una escritura falló; el resto no se envía
+    MASCHINE_SYSEX_ABORTED          // pipe abortado (stop)
+};
+
+class MaschineSysExSender {
+public:
+    // Encola el trozo en el buffer de envío "chunk"; devuelve 0 si quedó en vuelo
+    typedef int (*SubmitFunction)(void* context, int chunk, const uint8_t* data, uint32_t length);
+    typedef void (*DoneFunction)(void* context, uint32_t id, MaschineSysExStatus status,
+                                 uint32_t bytes, uint64_t durationNs, void* reference);
+    typedef void (*ExclusiveFunction)(void* context, bool exclusive);
+
+    MaschineSysExSender();
+
+    // pool: slots * slotSize bytes, propiedad del llamador
+    bool configure(uint8_t* pool, uint32_t slotSize, int slots, uint32_t chunkSize, int window,
+                   SubmitFunction submit, DoneFunction done, ExclusiveFunction exclusive, void* context);
+
+    // Copia el payload (sin F0/F7) al pool; devuelve el id del mensaje o 0 si
+    // no cabe o no es válido
+    uint32_t enqueue(const uint8_t* payload, uint32_t length, void* reference, uint64_t nowNs);
+    // Payload de 7 bits: un byte con el bit alto cortaría el mensaje en el destino
+    static bool validate(const uint8_t* payload, uint32_t length);
+    // Llamar desde la finalización del trozo "chunk"
+    void complete(int chunk, bool success, uint64_t nowNs);
+    // Tras abortar el pipe: descarta los trozos en vuelo y termina todos los mensajes
+    void abort(uint64_t nowNs);
+
+    bool isBusy() const { return queued > 0; }
+    int getQueued() const { return queued; }
+
+    // Estadísticas
+    uint64_t getMessages() const { return messages; }
+    uint64_t getBytes() const { return bytes; }
+    uint64_t getChunks() const { return chunks; }
+    uint64_t getFailures() const { return failures; }
+    uint64_t getRejected() const { return rejected; }
+    uint64_t getBusyNs() const { return busyNs; }
+
+private:
+    struct Job {
+        uint32_t id;
+        uint32_t length;        // bytes de paquetes en el pool
+        uint32_t midiLength;    // bytes del mensaje con F0/F7
+        uint32_t sent;
+        uint32_t acked;
+        MaschineSysExStatus status;
+        uint64_t startNs;
+        void* reference;
+    };
+
+    void pump(uint64_t nowNs);
+    void finish(uint64_t nowNs);
+
+    uint8_t* pool;
+    uint32_t slotSize;
+    int slots;
+    uint32_t chunkSize;
+    int window;
+    SubmitFunction submitFunction;
+    DoneFunction doneFunction;
+    ExclusiveFunction exclusiveFunction;
+    void* context;
+
+    Job jobs[MASCHINE_SYSEX_POOL];
+    int order[MASCHINE_SYSEX_POOL];     // slots en orden de llegada
+    int queued;
+    bool exclusive;
+    uint32_t nextID;
+
+    uint32_t chunkLength[MASCHINE_SYSEX_WINDOW_MAX];   // 0 = libre
+    int chunksInFlight;
+
+    uint64_t messages;
+    uint64_t bytes;
+    uint64_t chunks;
+    uint64_t failures;
+    uint64_t rejected;
+    uint64_t busyNs;
+};
+
+// Contadores del kext para kGetDeviceStatus. Se actualizan con atómicos
+// desde las finalizaciones USB y las llamadas de los clientes, sin locks;
+// snapshot() copia cada campo por separado, así que dos campos pueden
+// diferir en los eventos que llegaron durante la copia. La latencia va de
+// la finalización de la lectura USB a la entrega (MIDIReceived y cola de
+// entrada) de sus mensajes.
+//
+// Versionado como la página de estado: los campos nuevos van al final y
+// "size" dice cuántos bytes son válidos.
+#define MASCHINE_DEVICE_STATUS_VERSION 1
+
+struct MaschineDeviceStatus {
+    uint32_t version;
+    uint32_t size;
+
+    uint64_t readsCompleted;
+    uint64_t readErrors;
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    uint64_t messagesDecoded;
+    uint64_t decodeErrors;          // paquetes USB-MIDI inválidos y SysEx descartados
+    uint64_t inputOverflows;        // eventos perdidos con la cola de entrada llena
+    uint64_t outputOverflows;       // mensajes rechazados con la cola de salida llena
+    uint64_t writeErrors;
+
+    uint64_t latencySamples;
+    uint64_t latencyMinNs;
+    uint64_t latencyAvgNs;
+    uint64_t latencyMaxNs;
+};
+
+class MaschineDeviceCounters {
+public:
+    MaschineDeviceCounters();
+
+    void reset();
+
+    void readCompleted(uint32_t length) { add(&readsCompleted, 1); add(&bytesIn, length); }
+    void readFailed() { add(&readErrors, 1); }
+    void written(uint32_t length) { add(&bytesOut, length); }
+    void writeFailed() { add(&writeErrors, 1); }
+    void decoded(uint64_t messages, uint64_t errors) { add(&messagesDecoded, messages); add(&decodeErrors, errors); }
+    void inputOverflow() { add(&inputOverflows, 1); }
+    void outputOverflow() { add(&outputOverflows, 1); }
+    void latency(uint64_t nanoseconds);
+
+    void snapshot(MaschineDeviceStatus* status) const;
+
+private:
+    static void add(uint64_t* counter, uint64_t value) { __atomic_fetch_add(counter, value, __ATOMIC_RELAXED); }
+
+    uint64_t readsCompleted;
+    uint64_t readErrors;
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    uint64_t messagesDecoded;
+    uint64_t decodeErrors;
+    uint64_t inputOverflows;
+    uint64_t outputOverflows;
+    uint64_t writeErrors;
+
+    uint64_t latencySamples;
+    uint64_t latencyTotalNs;
+    uint64_t latencyMinNs;
+    uint64_t latencyMaxNs;
+};
+
+#endif // MASCHINE_USB_H
@@ -0,0 +1,260 @@
+#include "MaschineVirtualDevice.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// SysEx de LED que envía el driver: F0 00 20 3C 02 00 <tipo> <índice> <valor> F7
+#define VIRTUAL_LED_LENGTH   10
+#define VIRTUAL_LED_PAD      0x00
+
+// Estado del dispositivo con la misma cabecera NI: F0 00 20 3C 02 01 F7
+#define VIRTUAL_STATUS_LENGTH 7
+
+MaschineVirtualDeviceConfig::MaschineVirtualDeviceConfig() {
+    rate = 1000.0;
+    arrivals = MASCHINE_VIRTUAL_POISSON;
+    burstSize = 1;
+    padWeight = 70;
+    buttonWeight = 5;
+    encoderWeight = 20;
+    statusWeight = 4;
+    sysexWeight = 1;
+    padMask = 0xFFFF;
+    queueDepth = 1024;
+    seed = 1;
+}
+
+MaschineVirtualDevice::MaschineVirtualDevice(const MaschineVirtualDeviceConfig& newConfig)
+    : config(newConfig), random(newConfig.seed) {
+    if (config.burstSize < 1) {
+        config.burstSize = 1;
+    }
+    uint32_t depth = 1;
+    while (depth < config.queueDepth) {
+        depth <<= 1;
+    }
+    config.queueDepth = depth;
+    totalWeight = config.padWeight + config.buttonWeight + config.encoderWeight +
+                  config.statusWeight + config.sysexWeight;
+    if (totalWeight <= 0) {
+        config.padWeight = 1;
+        totalWeight = 1;
+    }
+    if (config.padMask == 0) {
+        config.padMask = 0xFFFF;
+    }
+
+    for (int i = 0; i < 16; ++i) {
+        padHeld[i] = false;
+    }
+    for (int i = 0; i < 8; ++i) {
+        buttonHeld[i] = false;
+    }
+    encoderDirection[0] = 1;
+    encoderDirection[1] = 1;
+
+    ring.resize(config.queueDepth);
+    head = 0;
+    tail = 0;
+    generated = 0;
+    delivered = 0;
+    dropped = 0;
+    ledMessages = 0;
+}
+
+uint64_t MaschineVirtualDevice::nowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Separación entre ráfagas que mantiene la tasa media configurada
+uint64_t MaschineVirtualDevice::nextGap() {
+    double mean = 1.0e9 * config.burstSize / config.rate;
+    if (config.arrivals == MASCHINE_VIRTUAL_POISSON) {
+        std::exponential_distribution<double> exponential(1.0 / mean);
+        return (uint64_t)exponential(random);
+    }
+    return (uint64_t)mean;
+}
+
+void MaschineVirtualDevice::generate(MaschineVirtualMessage* message) {
+    int pick = (int)(random() % (uint32_t)totalWeight);
+    uint8_t* data = message->data;
+
+    if ((pick -= config.padWeight) < 0) {
+        // Un pad pulsado se suelta antes de volver a sonar
+        int pad;
+        do {
+            pad = (int)(random() % 16);
+        } while (!(config.padMask & (1 << pad)));
+        if (padHeld[pad]) {
+            data[0] = 0x80;
+            data[2] = 0;
+        } else {
+            data[0] = 0x90;
+            data[2] = (uint8_t)(1 + random() % 127);
+        }
+        data[1] = (uint8_t)(36 + pad);
+        message->length = 3;
+    } else if ((pick -= config.buttonWeight) < 0) {
+        int button = (int)(random() % 8);
+        data[0] = 0xB0;
+        data[1] = (uint8_t)(16 + button);
+        data[2] = buttonHeld[button] ? 0 : 127;
+        message->length = 3;
+    } else if ((pick -= config.encoderWeight) < 0) {
+        // Barridos: la dirección cambia de vez en cuando, como una mano real
+        int encoder = (int)(random() % 2);
+        if (random() % 32 == 0) {
+            encoderDirection[encoder] = -encoderDirection[encoder];
+        }
+        data[0] = 0xB0;
+        data[1] = (uint8_t)(24 + encoder);
+        data[2] = encoderDirection[encoder] > 0 ? 65 : 63;
+        message->length = 3;
+    } else if ((pick -= config.statusWeight) < 0) {
+        data[0] = 0x74;
+        data[1] = 0x10;
+        data[2] = (uint8_t)(random() % 128);
+        message->length = 3;
+    } else {
+        // Estado del dispositivo (comando 0x01 de handleMaschineSysEx)
+        data[0] = 0xF0;
+        data[1] = 0x00;
+        data[2] = 0x20;
+        data[3] = 0x3C;
+        data[4] = 0x02;
+        data[5] = 0x01;
+        data[6] = 0xF7;
+        message->length = VIRTUAL_STATUS_LENGTH;
+    }
+}
+
+void MaschineVirtualDevice::press(const MaschineVirtualMessage& message) {
+    const uint8_t* data = message.data;
+    if (data[0] == 0x90 || data[0] == 0x80) {
+        padHeld[data[1] - 36] = data[0] == 0x90;
+    } else if (data[0] == 0xB0 && data[1] >= 16 && data[1] < 24) {
+        buttonHeld[data[1] - 16] = data[2] > 0;
+    }
+}
+
+void MaschineVirtualDevice::run(uint64_t durationNs, Delivery deliver) {
+    std::atomic<bool> generating(true);
+    uint32_t mask = config.queueDepth - 1;
+
+    // Hilo de entrega: el equivalente al hilo de lectura de CoreMIDI
+    std::thread delivery([&]() {
+        std::vector<uint64_t> latencies;
+        latencies.reserve(1 << 16);
+        while (true) {
+            uint32_t position = tail.load(std::memory_order_relaxed);
+            if (position == head.load(std::memory_order_acquire)) {
+                if (!generating) {
+                    break;
+                }
+                std::this_thread::yield();
+                continue;
+            }
+            MaschineVirtualMessage message = ring[position & mask];
+            latencies.push_back(nowNanos() - message.timestampNs);
+            deliver(message);
+            tail.store(position + 1, std::memory_order_release);
+            delivered++;
+        }
+        std::lock_guard<std::mutex> lock(pendingMutex);
+        deliveryLatencies.insert(deliveryLatencies.end(), latencies.begin(), latencies.end());
+    });
+
+    uint64_t start = nowNanos();
+    uint64_t end = start + durationNs;
+    uint64_t due = start;
+    while (due < end) {
+        uint64_t now = nowNanos();
+        if (now < due) {
+            // Esperas cortas cediendo la CPU: sleep_for no baja de decenas de µs
+            if (due - now > 200000) {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(due - now - 100000));
+            } else {
+                std::this_thread::yield();
+            }
+            continue;
+        }
+
+        for (int i = 0; i < config.burstSize; ++i) {
+            MaschineVirtualMessage message;
+            generate(&message);
+            generated++;
+
+            uint32_t position = head.load(std::memory_order_relaxed);
+            if (position - tail.load(std::memory_order_acquire) >= config.queueDepth) {
+                // Buffer lleno: el driver no da abasto y el mensaje se pierde.
+                // El pad o botón sigue como estaba: el próximo evento repite
+                // la pulsación en vez de soltar algo que el driver no vio
+                dropped++;
+                continue;
+            }
+            press(message);
+            message.timestampNs = nowNanos();
+            if (message.data[0] == 0x90) {
+                std::lock_guard<std::mutex> lock(pendingMutex);
+                pendingPresses[message.data[1] - 36].push_back(message.timestampNs);
+            }
+            ring[position & mask] = message;
+            head.store(position + 1, std::memory_order_release);
+        }
+        due += nextGap();
+    }
+
+    generating = false;
+    delivery.join();
+}
+
+void MaschineVirtualDevice::receive(const uint8_t* data, size_t length) {
+    if (length < VIRTUAL_LED_LENGTH || data[0] != 0xF0 || data[5] != 0x00) {
+        return;
+    }
+    ledMessages++;
+    if (data[6] != VIRTUAL_LED_PAD || data[7] >= 16 || data[8] == 0) {
+        return;
+    }
+
+    uint64_t now = nowNanos();
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    std::deque<uint64_t>& pending = pendingPresses[data[7]];
+    if (!pending.empty()) {
+        roundTrips.push_back(now - pending.front());
+        pending.pop_front();
+    }
+}
+
+uint64_t MaschineVirtualDevice::getUnanswered() {
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    uint64_t count = 0;
+    for (int i = 0; i < 16; ++i) {
+        count += pendingPresses[i].size();
+    }
+    return count;
+}
+
+MaschineLatencySummary MaschineVirtualDevice::summarize(std::vector<uint64_t>& samples) {
+    MaschineLatencySummary summary = { samples.size(), 0, 0, 0 };
+    if (samples.empty()) {
+        return summary;
+    }
+    std::sort(samples.begin(), samples.end());
+    summary.p50 = samples[samples.size() / 2];
+    summary.p99 = samples[samples.size() * 99 / 100];
+    summary.max = samples.back();
+    return summary;
+}
+
+MaschineLatencySummary MaschineVirtualDevice::getDeliveryLatency() {
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    return summarize(deliveryLatencies);
+}
+
+MaschineLatencySummary MaschineVirtualDevice::getRoundTripLatency() {
+    std::lock_guard<std::mutex> lock(pendingMutex);
+    return summarize(roundTrips);
+}
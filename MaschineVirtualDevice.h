@@ -0,0 +1,118 @@
+#ifndef MASCHINE_VIRTUAL_DEVICE_H
+#define MASCHINE_VIRTUAL_DEVICE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <vector>
+
+// Maschine Mikro sintética para generar carga sin hardware.
+//
+// Habla el mismo protocolo que handleMIDIInput: note on/off 36-51 (pads),
+// CC 16-23 (botones), CC 24-25 (encoders), estado 0x74 y SysEx de NI. Un
+// hilo entrega los mensajes al driver a través de un buffer acotado, como
+// el de CoreMIDI/USB; si el driver no da abasto el buffer se llena y el
+// mensaje se descarta (y se cuenta). receive() recibe la salida del driver:
+// cada SysEx de LED de pad encendido se empareja con la pulsación pendiente
+// más antigua de ese pad para medir el viaje completo pad -> LED.
+#define MASCHINE_VIRTUAL_UNIFORM   0   // llegadas periódicas
+#define MASCHINE_VIRTUAL_POISSON   1   // llegadas exponenciales
+
+#define MASCHINE_VIRTUAL_MESSAGE   8   // bytes máximos por mensaje
+
+struct MaschineVirtualDeviceConfig {
+    double rate;                // eventos por segundo
+    int arrivals;               // MASCHINE_VIRTUAL_UNIFORM / POISSON
+    int burstSize;              // eventos seguidos por ráfaga (1 = sin ráfagas)
+
+    // Mezcla de eventos (pesos relativos)
+    int padWeight;
+    int buttonWeight;
+    int encoderWeight;
+    int statusWeight;
+    int sysexWeight;
+    uint16_t padMask;           // pads que se tocan (bit n = pad n)
+
+    uint32_t queueDepth;        // buffer de entrega, potencia de 2
+    uint32_t seed;
+
+    MaschineVirtualDeviceConfig();
+};
+
+struct MaschineVirtualMessage {
+    uint64_t timestampNs;       // momento en que el dispositivo lo emite
+    uint8_t length;
+    uint8_t data[MASCHINE_VIRTUAL_MESSAGE];
+};
+
+// Percentiles de una serie de latencias (ns)
+struct MaschineLatencySummary {
+    size_t count;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t max;
+};
+
+class MaschineVirtualDevice {
+public:
+    typedef std::function<void(const MaschineVirtualMessage&)> Delivery;
+
+    explicit MaschineVirtualDevice(const MaschineVirtualDeviceConfig& config);
+
+    // Genera durante durationNs y entrega cada mensaje desde un hilo propio.
+    // Vuelve cuando se ha entregado todo lo que entró en el buffer
+    void run(uint64_t durationNs, Delivery deliver);
+
+    // Salida MIDI del driver hacia el dispositivo
+    void receive(const uint8_t* data, size_t length);
+
+    uint64_t getGenerated() const { return generated; }
+    uint64_t getDelivered() const { return delivered; }
+    uint64_t getDropped() const { return dropped; }
+    uint64_t getLEDMessages() const { return ledMessages; }
+    // Pulsaciones cuyo LED no llegó
+    uint64_t getUnanswered();
+
+    MaschineLatencySummary getDeliveryLatency();
+    MaschineLatencySummary getRoundTripLatency();
+
+    static uint64_t nowNanos();
+
+private:
+    void generate(MaschineVirtualMessage* message);
+    // Pads y botones cambian de estado solo si el mensaje entró en el buffer
+    void press(const MaschineVirtualMessage& message);
+    uint64_t nextGap();
+    static MaschineLatencySummary summarize(std::vector<uint64_t>& samples);
+
+    MaschineVirtualDeviceConfig config;
+    std::mt19937 random;
+    int totalWeight;
+
+    // Estado físico simulado
+    bool padHeld[16];
+    bool buttonHeld[8];
+    int encoderDirection[2];
+
+    // Buffer de entrega SPSC (generador -> hilo de entrega)
+    std::vector<MaschineVirtualMessage> ring;
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+
+    std::atomic<uint64_t> generated;
+    std::atomic<uint64_t> delivered;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> ledMessages;
+
+    // Pulsaciones pendientes de su LED, por pad
+    std::mutex pendingMutex;
+    std::deque<uint64_t> pendingPresses[16];
+    std::vector<uint64_t> roundTrips;
+    std::vector<uint64_t> deliveryLatencies;
+};
+
+#endif // MASCHINE_VIRTUAL_DEVICE_H
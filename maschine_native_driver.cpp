@@ -1,9 +1,141 @@
 #include "MaschineMikroDriver_User.h"
+#include "MaschineUSB.h"
+#include "MaschineInputQueue.h"
+#include "MaschineCommandRing.h"
+#include "MaschineConfig.h"
+#include "MaschineVirtualDevice.h"
 #include <iostream>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
 #include <cstring>
+#include <new>
+#include <atomic>
+#include <cstdlib>
+#include <cstddef>
 #include <thread>
 #include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <signal.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <mach/mach_time.h>
+
+// Contador de reservas de memoria de todo el proceso para --bench-alloc;
+// solo cuenta mientras la medición está activa. Se reemplaza el juego
+// completo de operator new/delete (array, nothrow, alineado y con tamaño)
+// para que ninguna forma escape al contador ni mezcle asignadores
+static std::atomic<bool> countAllocations(false);
+static std::atomic<uint64_t> allocationCount(0);
+
+static void* countedAllocate(size_t size, size_t alignment) {
+    if (countAllocations.load(std::memory_order_relaxed)) {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (size == 0) {
+        size = 1;
+    }
+    if (alignment <= alignof(std::max_align_t)) {
+        return malloc(size);
+    }
+    void* memory = NULL;
+    return posix_memalign(&memory, alignment, size) == 0 ? memory : NULL;
+}
+
+static void* countedAllocateOrThrow(size_t size, size_t alignment) {
+    void* memory = countedAllocate(size, alignment);
+    if (!memory) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void* operator new(size_t size) {
+    return countedAllocateOrThrow(size, 0);
+}
+
+void* operator new[](size_t size) {
+    return countedAllocateOrThrow(size, 0);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, 0);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, 0);
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept {
+    free(memory);
+}
+
+#ifdef __cpp_aligned_new
+void* operator new(size_t size, std::align_val_t alignment) {
+    return countedAllocateOrThrow(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return countedAllocateOrThrow(size, (size_t)alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, (size_t)alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return countedAllocate(size, (size_t)alignment);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+    free(memory);
+}
+
+void operator delete(void* memory, size_t, std::align_val_t) noexcept {
+    free(memory);
+}
+
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept {
+    free(memory);
+}
+#endif
 
 void showMainMenu() {
     std::cout << "\n🎹 === MASCHINE MIKRO DRIVER - MODO NATIVO ===" << std::endl;
@@ -73,6 +205,7 @@ void showTempoMenu() {
     std::cout << "2. Cambiar swing" << std::endl;
     std::cout << "3. Tap tempo" << std::endl;
     std::cout << "4. Mostrar tempo actual" << std::endl;
+    std::cout << "5. Modo esclavo de reloj MIDI (on/off)" << std::endl;
     std::cout << "0. Volver" << std::endl;
 }
 
@@ -98,6 +231,23 @@ void showHelp() {
     std::cout << "  --test-connection    Probar conexión" << std::endl;
     std::cout << "  --maschine-mode      Iniciar modo Maschine" << std::endl;
     std::cout << "  --midi-mode          Iniciar modo MIDI" << std::endl;
+    std::cout << "  --host-monitor       Adjuntarse al canal como host y mostrar comandos" << std::endl;
+    std::cout << "  --subscribe [MÁSCARA] Suscribirse al socket de eventos (máscara hex de opcodes)" << std::endl;
+    std::cout << "  --state [HZ]         Leer la página de estado en vivo (una vez o HZ veces por segundo)" << std::endl;
+    std::cout << "  --bench-usb-reads [FRAMES] Simular el pipeline de lecturas USB del kext" << std::endl;
+    std::cout << "  --bench-midi-batch [N] Comparar un MIDIReceived por mensaje frente a uno por transferencia" << std::endl;
+    std::cout << "  --bench-usb-midi [N] Medir el decodificador USB-MIDI sobre buffers de 64 bytes" << std::endl;
+    std::cout << "  --bench-usb-writes [N] Simular la cola de salida del kext con ráfagas de LEDs" << std::endl;
+    std::cout << "  --bench-sysex        Medir bytes/s del envío de SysEx grandes por trozos" << std::endl;
+    std::cout << "  --bench-input-queue [N] Productor/consumidor de la cola de eventos de entrada del kext" << std::endl;
+    std::cout << "  --bench-command-ring [N] Anillo de comandos del kext con entradas malformadas y salida atascada" << std::endl;
+    std::cout << "  --bench-clock [N]    Convergencia y error del reloj MIDI esclavo con jitter, rampas y saltos" << std::endl;
+    std::cout << "  --bench-alloc [N]    Contar reservas de memoria en el camino de pads, botones, encoders y LEDs" << std::endl;
+    std::cout << "  --startup-profile    Desglose del tiempo de arranque hasta el primer evento" << std::endl;
+    std::cout << "  --daemon [CONFIG]    Servicio sin interacción configurado por fichero (SIGHUP recarga)" << std::endl;
+    std::cout << "  --test-virtual [N]   Suites de prueba en tiempo virtual contra el transporte loopback" << std::endl;
+    std::cout << "  --virtual-device [TASA] [RÁFAGA] [uniform|poisson] Carga de una Mikro sintética (descartes y latencia)" << std::endl;
+    std::cout << "  --test-pad-latency [N] [P99_US] [ENCODERS/S] [ANIMACIÓN_HZ] Regresión de latencia pad -> LED bajo carga" << std::endl;
     std::cout << "" << std::endl;
     std::cout << "Sin argumentos: Modo interactivo completo" << std::endl;
 }
@@ -142,10 +292,26 @@ void testConnection() {
     driver.printMaschineStatus();
 }
 
+// Bucle de eventos compartido por los modos sin menú: duerme hasta que hay
+// trabajo y sale limpio con Ctrl+C (los destructores cierran el canal)
+void runEventLoop(MaschineMikroDriverUser& driver) {
+    MaschineEventLoop loop;
+    loop.stopOnSignal(SIGINT);
+    loop.stopOnSignal(SIGTERM);
+    
+    driver.attachEventLoop(loop);
+    loop.run();
+    driver.detachEventLoop(loop);
+    
+    std::cout << "\n👋 Saliendo: " << loop.getWakeups() << " despertares ("
+              << loop.getWakeupsPerSecond() << "/s)" << std::endl;
+}
+
 void debugMode() {
     MaschineMikroDriverUser driver;
     
     std::cout << "🐛 Iniciando modo debug..." << std::endl;
+    driver.setDebugMode(true);
     
     if (!driver.initialize()) {
         std::cout << "❌ Error al inicializar el driver" << std::endl;
@@ -157,14 +323,13 @@ void debugMode() {
         return;
     }
     
+    driver.startStateExport();
+    
     std::cout << "✅ Driver inicializado y dispositivo conectado" << std::endl;
     std::cout << "🎯 Modo debug activo - Presiona Ctrl+C para salir" << std::endl;
     
-    // Loop de debug
-    while (true) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        // El driver maneja los inputs automáticamente
-    }
+    // Los inputs MIDI llegan por CoreMIDI; el bucle atiende al host y las señales
+    runEventLoop(driver);
 }
 
 void maschineMode() {
@@ -182,14 +347,14 @@ void maschineMode() {
         return;
     }
     
+    driver.startStateExport();
+    
     driver.initializeMaschine();
+    driver.startEventServer();
     std::cout << "✅ Modo Maschine activado" << std::endl;
     
-    // Loop del modo Maschine
-    while (true) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        // El driver maneja la lógica de Maschine automáticamente
-    }
+    // Los inputs MIDI llegan por CoreMIDI; el bucle atiende al host y las señales
+    runEventLoop(driver);
 }
 
 void midiMode() {
@@ -207,63 +372,1312 @@ void midiMode() {
         return;
     }
     
+    driver.startStateExport();
+    
     std::cout << "✅ Modo MIDI activado" << std::endl;
     
-    // Loop del modo MIDI
+    // Los inputs MIDI llegan por CoreMIDI; el bucle atiende al host y las señales
+    runEventLoop(driver);
+}
+
+// Arranque normal (modo MIDI) midiendo cada fase hasta el primer evento
+// del dispositivo; el desglose se imprime al llegar ese evento y al salir
+void startupProfileMode() {
+    MaschineMikroDriverUser driver;
+    driver.enableStartupProfile();
+    driver.markStartup("main");
+    
+    if (!driver.initialize()) {
+        std::cout << "❌ Error al inicializar el driver" << std::endl;
+        return;
+    }
+    
+    if (!driver.connectDevice()) {
+        std::cout << "❌ Error al conectar el dispositivo" << std::endl;
+        return;
+    }
+    
+    driver.startStateExport();
+    driver.markStartup("página de estado");
+    
+    std::cout << "⏱️  Esperando el primer evento (pulsa un pad) - Ctrl+C para salir" << std::endl;
+    driver.markStartup("bucle de eventos");
+    runEventLoop(driver);
+    
+    driver.printStartupProfile();
+}
+
+// Aplica lo recargable de la configuración: log, mapeos, prioridades y
+// temporizadores. Corre en el hilo del bucle; CoreMIDI sigue entregando
+// eventos en el suyo mientras tanto, así que no se pierde ninguno
+static void applyDaemonConfig(MaschineMikroDriverUser& driver, MaschineEventLoop& loop,
+                              const MaschineDaemonConfig& config, int* ledTimer, int* statsTimer) {
+    driver.setLogLevel(config.logLevel);
+    driver.setInputMapping(config.padMap, config.buttonMap);
+    driver.setThreadPriorities(config.schedulerPriority, config.encoderPriority);
+    if (!setMaschineThreadPriority(pthread_self(), config.eventLoopPriority) &&
+        config.logLevel >= MASCHINE_LOG_WARNING) {
+        std::cout << "[Warning] No se pudo fijar la prioridad del bucle de eventos ("
+                  << config.eventLoopPriority << ")" << std::endl;
+    }
+    
+    if (*ledTimer) {
+        loop.removeTimer(*ledTimer);
+        *ledTimer = 0;
+    }
+    if (config.ledRefreshHz > 0) {
+        uint64_t interval = 1000000000ULL / config.ledRefreshHz;
+        *ledTimer = loop.addTimer(interval, interval, [&driver]() { driver.refreshLEDs(); });
+    }
+    
+    if (*statsTimer) {
+        loop.removeTimer(*statsTimer);
+        *statsTimer = 0;
+    }
+    if (config.statsInterval > 0 && config.logLevel >= MASCHINE_LOG_INFO) {
+        uint64_t interval = (uint64_t)config.statsInterval * 1000000000ULL;
+        *statsTimer = loop.addTimer(interval, interval, [&driver]() { driver.printStats(); });
+    }
+}
+
+// Servicio sin terminal: todo sale del fichero de configuración, nunca se
+// lee stdin. Las estadísticas están en la página de estado (--state), en
+// una línea periódica del log y a demanda con SIGUSR1. Devuelve false si la
+// configuración no es válida o el driver no arranca
+bool daemonMode(const char* configPath) {
+    const char* path = configPath ? configPath : MASCHINE_DAEMON_CONFIG;
+    MaschineDaemonConfig config;
+    std::string error;
+    if (!loadMaschineDaemonConfig(path, &config, &error)) {
+        std::cout << "[Error] Configuración: " << error << std::endl;
+        return false;
+    }
+    
+    // Un launchd/systemd sin terminal no debe bloquear a nadie en una lectura
+    int devNull = open("/dev/null", O_RDONLY);
+    if (devNull >= 0) {
+        dup2(devNull, STDIN_FILENO);
+        close(devNull);
+    }
+    
+    MaschineMikroDriverUser driver;
+    driver.setLogLevel(config.logLevel);
+    std::cout << "[Maschine] Daemon iniciado con " << path << " (log: "
+              << maschineLogLevelName(config.logLevel) << ")" << std::endl;
+    
+    if (!driver.initialize() || !driver.connectDevice()) {
+        std::cout << "[Error] No se pudo inicializar el driver" << std::endl;
+        return false;
+    }
+    if (!config.statePage.empty()) {
+        driver.startStateExport(config.statePage.c_str());
+    }
+    if (config.transports & MASCHINE_TRANSPORT_CHANNEL) {
+        driver.initializeMaschine();
+    }
+    if (config.transports & MASCHINE_TRANSPORT_SOCKET) {
+        driver.startEventServer(config.eventSocket.c_str());
+    }
+    
+    MaschineEventLoop loop;
+    loop.stopOnSignal(SIGINT);
+    loop.stopOnSignal(SIGTERM);
+    
+    int ledTimer = 0;
+    int statsTimer = 0;
+    applyDaemonConfig(driver, loop, config, &ledTimer, &statsTimer);
+    
+    loop.onSignal(SIGHUP, [&]() {
+        MaschineDaemonConfig reloaded;
+        std::string reloadError;
+        if (!loadMaschineDaemonConfig(path, &reloaded, &reloadError)) {
+            std::cout << "[Error] Recarga descartada, se mantiene la configuración: " << reloadError << std::endl;
+            return;
+        }
+        if (reloaded.transports != config.transports || reloaded.eventSocket != config.eventSocket ||
+            reloaded.statePage != config.statePage) {
+            std::cout << "[Warning] transport, event_socket y state_page solo cambian al reiniciar" << std::endl;
+        }
+        // Los transportes abiertos se conservan hasta el reinicio
+        reloaded.transports = config.transports;
+        reloaded.eventSocket = config.eventSocket;
+        reloaded.statePage = config.statePage;
+        config = reloaded;
+        applyDaemonConfig(driver, loop, config, &ledTimer, &statsTimer);
+        if (config.logLevel >= MASCHINE_LOG_INFO) {
+            std::cout << "[Maschine] Configuración recargada (log: " << maschineLogLevelName(config.logLevel)
+                      << ", LEDs: " << config.ledRefreshHz << " Hz)" << std::endl;
+        }
+    });
+    loop.onSignal(SIGUSR1, [&driver]() { driver.printStats(); });
+    
+    driver.attachEventLoop(loop);
+    loop.run();
+    driver.detachEventLoop(loop);
+    
+    if (config.logLevel >= MASCHINE_LOG_INFO) {
+        driver.printStats();
+        std::cout << "[Maschine] Daemon detenido: " << loop.getWakeups() << " despertares ("
+                  << loop.getWakeupsPerSecond() << "/s)" << std::endl;
+    }
+    return true;
+}
+
+void hostMonitorMode() {
+    MaschineChannel channel;
+    MaschineEventLoop loop;
+    loop.stopOnSignal(SIGINT);
+    loop.stopOnSignal(SIGTERM);
+    
+    std::cout << "🔗 Esperando canal del driver (" << MASCHINE_CHANNEL_NAME << ")..." << std::endl;
+    
+    MaschineEventLoop::Handler drain = [&channel]() {
+        uint8_t encoded[MASCHINE_COMMAND_SIZE];
+        MaschineCommand command;
+        char text[64];
+        do {
+            channel.drainWake();
+            while (channel.receive(encoded)) {
+                if (decodeMaschineCommand(encoded, &command)) {
+                    formatMaschineCommand(command, text, sizeof(text));
+                    std::cout << "📨 " << text << std::endl;
+                }
+            }
+        } while (!channel.prepareWait());
+    };
+    
+    MaschineEventLoop::Handler attach = [&]() {
+        if (channel.isOpen() && channel.isPeerAlive()) {
+            return;
+        }
+        // El driver no existe todavía o se reinició: volver a adjuntarse
+        if (channel.isOpen()) {
+            loop.removeDescriptor(channel.getWakeFd());
+            channel.close();
+        }
+        if (!channel.open(MaschineChannel::ROLE_HOST)) {
+            return;
+        }
+        std::cout << "✅ Adjuntado al canal del driver" << std::endl;
+        loop.addDescriptor(channel.getWakeFd(), drain);
+        drain();
+    };
+    
+    // Los comandos despiertan por el timbre; el driver se vigila una vez por segundo
+    attach();
+    loop.addTimer(1000000000ULL, 1000000000ULL, attach);
+    loop.run();
+    
+    std::cout << "\n👋 Saliendo: " << loop.getWakeups() << " despertares ("
+              << loop.getWakeupsPerSecond() << "/s)" << std::endl;
+}
+
+void subscribeMode(const char* maskText) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, MASCHINE_EVENT_SOCKET, sizeof(address.sun_path) - 1);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        std::cout << "❌ No hay servidor de eventos en " << MASCHINE_EVENT_SOCKET << std::endl;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    
+    if (maskText) {
+        // Máscara de opcodes en little endian (bit n = opcode n)
+        uint64_t mask = strtoull(maskText, NULL, 16);
+        uint8_t request[8];
+        for (int i = 0; i < 8; ++i) {
+            request[i] = (uint8_t)(mask >> (8 * i));
+        }
+        ssize_t ignored = write(fd, request, sizeof(request));
+        (void)ignored;
+    }
+    std::cout << "📡 Suscrito a " << MASCHINE_EVENT_SOCKET << std::endl;
+    
+    MaschineEventLoop loop;
+    loop.stopOnSignal(SIGINT);
+    loop.stopOnSignal(SIGTERM);
+    
+    uint8_t pending[MASCHINE_COMMAND_SIZE];
+    size_t pendingLength = 0;
+    loop.addDescriptor(fd, [&]() {
+        uint8_t data[4096];
+        ssize_t received = read(fd, data, sizeof(data));
+        if (received <= 0) {
+            std::cout << "🔌 El driver cerró el socket" << std::endl;
+            loop.stop();
+            return;
+        }
+        // Un read puede partir un comando: reensamblar de 8 en 8
+        for (ssize_t i = 0; i < received; ++i) {
+            pending[pendingLength++] = data[i];
+            if (pendingLength == MASCHINE_COMMAND_SIZE) {
+                pendingLength = 0;
+                MaschineCommand command;
+                char text[64];
+                if (decodeMaschineCommand(pending, &command)) {
+                    formatMaschineCommand(command, text, sizeof(text));
+                    std::cout << "📨 " << text << std::endl;
+                }
+            }
+        }
+    });
+    loop.run();
+    
+    loop.removeDescriptor(fd);
+    close(fd);
+}
+
+void printStateSnapshot(const MaschineStateSnapshot& state) {
+    std::cout << "🎛️  Modo " << (state.mode == MASCHINE_MODE_NATIVE ? "Maschine" : "MIDI")
+              << " | Grupo " << state.group << " Sonido " << state.sound
+              << " Patrón " << state.pattern << " Escena " << state.scene
+              << " | " << state.tempoMilli / 1000.0 << " BPM swing " << state.swing << "%"
+              << ((state.flags & MASCHINE_STATE_PLAYING) ? " ▶" : " ■")
+              << ((state.flags & MASCHINE_STATE_RECORDING) ? " ●" : "") << std::endl;
+    
+    std::cout << "   Pads ";
+    for (int i = 0; i < 16; ++i) {
+        std::cout << ((state.padStates & (1 << i)) ? "█" : ((state.padLEDs & (1 << i)) ? "▒" : "·"));
+    }
+    std::cout << " | Host " << ((state.flags & MASCHINE_STATE_HOST_CONNECTED) ? "sí" : "no")
+              << " | Dispositivo " << ((state.flags & MASCHINE_STATE_DEVICE_OPEN) ? "sí" : "no") << std::endl;
+    
+    std::cout << "   Eventos: " << state.padEvents << " pads, " << state.buttonEvents << " botones, "
+              << state.encoderEvents << " encoders | MIDI " << state.midiMessagesIn << " in / "
+              << state.midiMessagesOut << " out | " << state.commandsSent << " comandos ("
+              << state.hostDropped << " perdidos)" << std::endl;
+}
+
+void stateMode(const char* rateText) {
+    MaschineStateReader reader;
+    if (!reader.open()) {
+        std::cout << "❌ No hay página de estado en " << MASCHINE_STATE_PAGE_NAME << " (¿driver en marcha?)" << std::endl;
+        exit(1);
+    }
+    
+    MaschineStateSnapshot state;
+    if (!rateText) {
+        if (!reader.read(&state)) {
+            std::cout << "❌ Página de estado no válida" << std::endl;
+            exit(1);
+        }
+        printStateSnapshot(state);
+        return;
+    }
+    
+    int rate = atoi(rateText);
+    if (rate <= 0) {
+        rate = 10;
+    }
+    
+    // Cada lectura es una copia de memoria: ninguna llamada al driver
+    MaschineEventLoop loop;
+    loop.stopOnSignal(SIGINT);
+    loop.stopOnSignal(SIGTERM);
+    loop.addTimer(0, 1000000000ULL / rate, [&]() {
+        if (!reader.read(&state) && !(reader.open() && reader.read(&state))) {
+            std::cout << "⏳ Esperando al driver..." << std::endl;
+            return;
+        }
+        printStateSnapshot(state);
+    });
+    loop.run();
+}
+
+// Pipe de entrada simulado en tiempo virtual (µs). El dispositivo genera un
+// paquete por frame USB de 1 ms y solo puede retener uno si no hay lectura
+// encolada; el manejador de cada finalización tarda un tiempo variable, con
+// bloqueos ocasionales, y el buffer no vuelve a la cola hasta que termina.
+struct SimulatedReadPipe {
+    MaschineReadPipeline pipeline;
+    uint8_t buffers[MASCHINE_READ_PIPELINE_MAX * MASCHINE_USB_PACKET_SIZE];
+    std::vector<std::pair<int, uint64_t>> reads;    // (slot, listo desde)
+    uint64_t now = 0;
+    uint32_t lastPacket = 0;
+    uint64_t outOfOrder = 0;
+    
+    static int submit(void* context, int slot) {
+        SimulatedReadPipe* pipe = (SimulatedReadPipe*)context;
+        pipe->reads.push_back(std::make_pair(slot, pipe->now));
+        return 0;
+    }
+    
+    static void deliver(void* context, const uint8_t* data, uint32_t length) {
+        SimulatedReadPipe* pipe = (SimulatedReadPipe*)context;
+        uint32_t packet;
+        memcpy(&packet, data, sizeof(packet));
+        if (packet <= pipe->lastPacket) {
+            pipe->outOfOrder++;
+        }
+        pipe->lastPacket = packet;
+        (void)length;
+    }
+};
+
+void benchUSBReadsMode(const char* framesText) {
+    int frames = framesText ? atoi(framesText) : 0;
+    if (frames <= 0) {
+        frames = 100000;
+    }
+    
+    std::cout << "🧪 Pipeline de lecturas USB: " << frames << " frames de 1 ms, manejador 50-250 µs"
+              << " con bloqueos de 3 ms (2%)" << std::endl;
+    std::cout << "   (profundidad 1 = una sola lectura encolada, como el sondeo anterior)" << std::endl;
+    
+    const int depths[] = { 1, 2, 4, 8 };
+    for (int depth : depths) {
+        SimulatedReadPipe pipe;
+        pipe.pipeline.configure(pipe.buffers, MASCHINE_USB_PACKET_SIZE, depth,
+                                &SimulatedReadPipe::submit, &SimulatedReadPipe::deliver, &pipe);
+        pipe.pipeline.start();
+        
+        std::vector<std::pair<int, uint64_t>> completed;   // (slot, instante del paquete)
+        std::vector<uint64_t> deviceQueue;                 // paquetes retenidos por el dispositivo
+        uint64_t cpuFree = 0;
+        uint64_t dropped = 0;
+        uint64_t latencyTotal = 0;
+        uint64_t latencyMax = 0;
+        uint64_t delivered = 0;
+        uint32_t random = 12345;
+        uint32_t packet = 0;
+        
+        auto handle = [&](uint64_t until) {
+            // Finalizaciones cuyo manejador empieza antes de "until", en orden
+            size_t next = 0;
+            while (next < completed.size()) {
+                uint64_t start = std::max(cpuFree, completed[next].second);
+                if (start >= until) {
+                    break;
+                }
+                random = random * 1103515245 + 12345;
+                uint64_t cost = 50 + (random >> 16) % 200;
+                if ((random >> 8) % 100 < 2) {
+                    cost += 3000;
+                }
+                cpuFree = start + cost;
+                pipe.now = cpuFree;
+                
+                uint64_t latency = cpuFree - completed[next].second;
+                latencyTotal += latency;
+                latencyMax = std::max(latencyMax, latency);
+                delivered++;
+                pipe.pipeline.complete(completed[next].first, MASCHINE_READ_OK, MASCHINE_USB_PACKET_SIZE);
+                next++;
+            }
+            completed.erase(completed.begin(), completed.begin() + next);
+        };
+        
+        for (int frame = 0; frame < frames; ++frame) {
+            uint64_t now = (uint64_t)frame * 1000;
+            handle(now);
+            
+            if (deviceQueue.empty()) {
+                deviceQueue.push_back(now);
+            } else {
+                dropped++;
+            }
+            
+            // El pipe es FIFO: solo la lectura en cabeza puede recibir el paquete
+            if (!pipe.reads.empty() && pipe.reads.front().second <= now) {
+                int slot = pipe.reads.front().first;
+                pipe.reads.erase(pipe.reads.begin());
+                ++packet;
+                memcpy(pipe.pipeline.getBuffer(slot), &packet, sizeof(packet));
+                completed.push_back(std::make_pair(slot, deviceQueue.front()));
+                deviceQueue.clear();
+            }
+        }
+        handle(UINT64_MAX);
+        
+        std::cout << "   Profundidad " << depth << ": " << delivered << " entregados, " << dropped
+                  << " perdidos, latencia media " << (delivered ? latencyTotal / delivered : 0)
+                  << " µs, máx " << latencyMax << " µs, cola vacía " << pipe.pipeline.getStarvations()
+                  << " veces, desorden " << pipe.outOfOrder << std::endl;
+    }
+}
+
+// Entrega los mensajes de N transferencias a una fuente virtual propia, uno
+// por MIDIReceived (como hacía el kext) o agrupados con MaschineMIDIBatch
+void benchMIDIBatchMode(const char* transfersText) {
+    int transfers = transfersText ? atoi(transfersText) : 0;
+    if (transfers <= 0) {
+        transfers = 20000;
+    }
+    
+    MIDIClientRef client = 0;
+    MIDIEndpointRef source = 0;
+    if (MIDIClientCreate(CFSTR("Maschine Mikro Bench"), NULL, NULL, &client) != noErr ||
+        MIDISourceCreate(client, CFSTR("Maschine Mikro Bench"), &source) != noErr) {
+        std::cout << "❌ No se pudo crear la fuente MIDI de prueba" << std::endl;
+        exit(1);
+    }
+    
+    // Una transferencia llena trae 21 mensajes de 3 bytes (notas y CC alternados)
+    uint8_t transfer[63];
+    for (int m = 0; m < 21; ++m) {
+        transfer[m * 3] = (m & 1) ? 0xB0 : 0x90;
+        transfer[m * 3 + 1] = (uint8_t)(36 + m % 16);
+        transfer[m * 3 + 2] = (uint8_t)(1 + m);
+    }
+    
+    std::cout << "🧪 Entrega MIDI: " << transfers << " transferencias por caso" << std::endl;
+    
+    const int counts[] = { 1, 4, 21 };
+    for (int count : counts) {
+        auto start = std::chrono::steady_clock::now();
+        uint64_t calls = 0;
+        for (int t = 0; t < transfers; ++t) {
+            for (int m = 0; m < count; ++m) {
+                MIDIPacketList packetList;
+                MIDIPacket* packet = MIDIPacketListInit(&packetList);
+                packet = MIDIPacketListAdd(&packetList, sizeof(packetList), packet, mach_absolute_time(), 3, transfer + m * 3);
+                if (packet) {
+                    MIDIReceived(source, &packetList);
+                    calls++;
+                }
+            }
+        }
+        double perMessage = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        
+        MaschineMIDIBatch batch;
+        start = std::chrono::steady_clock::now();
+        for (int t = 0; t < transfers; ++t) {
+            batch.begin(mach_absolute_time());
+            for (int m = 0; m < count; ++m) {
+                batch.add(transfer + m * 3, 3);
+            }
+            if (batch.finish()) {
+                MIDIPacketList packetList;
+                MIDIPacket* packet = MIDIPacketListInit(&packetList);
+                uint32_t length;
+                const uint8_t* data = batch.getSegment(0, &length);
+                packet = MIDIPacketListAdd(&packetList, sizeof(packetList), packet, batch.getTimestamp(), length, data);
+                if (packet) {
+                    MIDIReceived(source, &packetList);
+                }
+            }
+        }
+        double batched = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        
+        uint64_t messages = (uint64_t)transfers * count;
+        std::cout << "   " << count << " mensajes/transferencia: por mensaje "
+                  << (double)calls / transfers << " llamadas, " << (uint64_t)(perMessage / messages) << " ns/mensaje"
+                  << " | agrupado " << (double)batch.getDeliveries() / transfers << " llamadas, "
+                  << (uint64_t)(batched / messages) << " ns/mensaje" << std::endl;
+    }
+    
+    MIDIEndpointDispose(source);
+    MIDIClientDispose(client);
+}
+
+static void countDecodedMessage(void* context, uint8_t cable, const uint8_t* message, uint32_t length) {
+    (*(uint64_t*)context) += length;
+    (void)cable;
+    (void)message;
+}
+
+// Rendimiento del decodificador de paquetes USB-MIDI sobre un buffer de
+// endpoint completo con distintos contenidos
+void benchUSBMIDIMode(const char* transfersText) {
+    int transfers = transfersText ? atoi(transfersText) : 0;
+    if (transfers <= 0) {
+        transfers = 1000000;
+    }
+    
+    struct Case {
+        const char* name;
+        uint8_t data[MASCHINE_USB_PACKET_SIZE];
+    } cases[3];
+    memset(cases, 0, sizeof(cases));
+    
+    // 16 eventos de canal (buffer lleno)
+    cases[0].name = "16 notas/CC";
+    for (int p = 0; p < 16; ++p) {
+        uint8_t* packet = cases[0].data + p * MASCHINE_USB_MIDI_PACKET;
+        packet[0] = (p & 1) ? 0x0B : 0x09;
+        packet[1] = (p & 1) ? 0xB0 : 0x90;
+        packet[2] = (uint8_t)(36 + p);
+        packet[3] = (uint8_t)(1 + p);
+    }
+    
+    // 2 eventos y 14 paquetes de relleno (lo habitual al tocar un pad)
+    cases[1].name = "2 eventos + relleno";
+    memcpy(cases[1].data, cases[0].data, 2 * MASCHINE_USB_MIDI_PACKET);
+    
+    // SysEx de 45 bytes repartido en 15 paquetes y cerrado en el último
+    cases[2].name = "SysEx 45 bytes";
+    for (int p = 0; p < 16; ++p) {
+        uint8_t* packet = cases[2].data + p * MASCHINE_USB_MIDI_PACKET;
+        packet[0] = (p == 15) ? 0x07 : 0x04;
+        packet[1] = (p == 0) ? 0xF0 : (uint8_t)p;
+        packet[2] = (uint8_t)p;
+        packet[3] = (p == 15) ? 0xF7 : (uint8_t)p;
+    }
+    
+    std::cout << "🧪 Decodificador USB-MIDI: " << transfers << " transferencias de "
+              << MASCHINE_USB_PACKET_SIZE << " bytes por caso" << std::endl;
+    
+    for (const Case& test : cases) {
+        MaschineUSBMIDIDecoder decoder;
+        uint64_t bytes = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (int t = 0; t < transfers; ++t) {
+            decoder.decode(test.data, MASCHINE_USB_PACKET_SIZE, &countDecodedMessage, &bytes);
+        }
+        double elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        
+        std::cout << "   " << test.name << ": " << elapsed / transfers << " ns/transferencia, "
+                  << (uint64_t)(transfers * (double)MASCHINE_USB_PACKET_SIZE / elapsed * 1000.0) << " MB/s, "
+                  << decoder.getMessages() / transfers << " mensajes, "
+                  << decoder.getEmptyPackets() / transfers << " paquetes vacíos saltados por transferencia" << std::endl;
+    }
+}
+
+// Pipe de salida simulado en tiempo virtual (µs): una transferencia por
+// frame de 1 ms, completadas en orden
+struct SimulatedWritePipe {
+    MaschineWriteQueue queue;
+    uint8_t buffers[MASCHINE_WRITE_QUEUE_DEPTH * MASCHINE_USB_PACKET_SIZE];
+    std::vector<std::pair<int, uint64_t>> inFlight;     // (slot, fin)
+    uint64_t now = 0;
+    uint64_t busyUntil = 0;
+    
+    static int submit(void* context, int slot, uint32_t length) {
+        SimulatedWritePipe* pipe = (SimulatedWritePipe*)context;
+        pipe->busyUntil = std::max(pipe->busyUntil, pipe->now) + 1000;
+        pipe->inFlight.push_back(std::make_pair(slot, pipe->busyUntil));
+        (void)length;
+        return 0;
+    }
+};
+
+void benchUSBWritesMode(const char* burstsText) {
+    int bursts = burstsText ? atoi(burstsText) : 0;
+    if (bursts <= 0) {
+        bursts = 10000;
+    }
+    
+    struct Scenario {
+        const char* name;
+        int messagesPerBurst;
+        uint64_t burstInterval;     // µs
+    } scenarios[] = {
+        { "ráfaga de LEDs (16 pads + 8 botones)", 24, 20000 },
+        { "respuesta a un pad (2 mensajes)", 2, 5000 },
+        { "mensajes aislados", 1, 5000 },
+        { "sobrecarga (200 seguidos)", 200, 100000 }
+    };
+    
+    std::cout << "🧪 Cola de salida USB: " << bursts << " ráfagas por caso, plazo "
+              << MASCHINE_WRITE_FLUSH_US << " µs, " << MASCHINE_WRITE_QUEUE_DEPTH << " buffers" << std::endl;
+    std::cout << "   (antes: una transferencia y un descriptor nuevo por mensaje)" << std::endl;
+    
+    for (const Scenario& scenario : scenarios) {
+        SimulatedWritePipe pipe;
+        pipe.queue.configure(pipe.buffers, MASCHINE_USB_PACKET_SIZE, MASCHINE_WRITE_QUEUE_DEPTH,
+                             &SimulatedWritePipe::submit, &pipe);
+        uint64_t deadline = UINT64_MAX;
+        
+        // Finalizaciones y plazo vencidos hasta "until", en orden
+        auto advance = [&](uint64_t until) {
+            while (true) {
+                uint64_t completion = pipe.inFlight.empty() ? UINT64_MAX : pipe.inFlight.front().second;
+                uint64_t next = std::min(completion, deadline);
+                if (next > until) {
+                    break;
+                }
+                pipe.now = next;
+                if (completion <= deadline) {
+                    pipe.queue.complete(pipe.inFlight.front().first, true);
+                    pipe.inFlight.erase(pipe.inFlight.begin());
+                } else {
+                    pipe.queue.flush();
+                    deadline = UINT64_MAX;
+                }
+            }
+            pipe.now = until;
+        };
+        
+        const uint8_t message[3] = { 0xB0, 0x10, 0x7F };
+        for (int burst = 0; burst < bursts; ++burst) {
+            advance((uint64_t)burst * scenario.burstInterval);
+            for (int m = 0; m < scenario.messagesPerBurst; ++m) {
+                bool armTimer;
+                pipe.queue.append(message, sizeof(message), &armTimer);
+                if (armTimer) {
+                    deadline = pipe.now + MASCHINE_WRITE_FLUSH_US;
+                }
+            }
+        }
+        advance(UINT64_MAX - 1);
+        
+        uint64_t messages = pipe.queue.getMessages();
+        uint64_t transfers = pipe.queue.getTransfers();
+        std::cout << "   " << scenario.name << ": " << messages << " mensajes en " << transfers
+                  << " transferencias (" << (transfers ? (double)messages / transfers : 0) << " por transferencia, "
+                  << (transfers ? pipe.queue.getBytes() / transfers : 0) << " bytes = "
+                  << (transfers ? pipe.queue.getBytes() / transfers / MASCHINE_USB_MIDI_PACKET : 0) << " paquetes USB-MIDI), "
+                  << pipe.queue.getDeadlineFlushes() << " por plazo, " << pipe.queue.getRejected() << " rechazados" << std::endl;
+    }
+}
+
+// Pipe de salida para SysEx en tiempo virtual (ns): cada trozo ocupa un
+// frame de 1 ms a partir del siguiente frame libre, y su finalización llega
+// 300 µs después de terminar
+struct SimulatedSysExPipe {
+    MaschineSysExSender sender;
+    uint8_t pool[MASCHINE_SYSEX_POOL * MASCHINE_SYSEX_OUT_MAX];
+    std::vector<std::pair<int, uint64_t>> inFlight;     // (trozo, finalización)
+    uint64_t now = 0;
+    uint64_t lastEnd = 0;
+    uint32_t bytes = 0;
+    uint64_t durationNs = 0;
+    
+    static int submit(void* context, int chunk, const uint8_t* data, uint32_t length) {
+        SimulatedSysExPipe* pipe = (SimulatedSysExPipe*)context;
+        uint64_t frame = (pipe->now + 999999) / 1000000 * 1000000;
+        uint64_t start = std::max(frame, pipe->lastEnd);
+        pipe->lastEnd = start + 1000000;
+        pipe->inFlight.push_back(std::make_pair(chunk, pipe->lastEnd + 300000));
+        (void)data;
+        (void)length;
+        return 0;
+    }
+    
+    static void done(void* context, uint32_t id, MaschineSysExStatus status, uint32_t bytes,
+                     uint64_t durationNs, void* reference) {
+        SimulatedSysExPipe* pipe = (SimulatedSysExPipe*)context;
+        pipe->bytes = bytes;
+        pipe->durationNs = durationNs;
+        (void)id;
+        (void)status;
+        (void)reference;
+    }
+    
+    static void exclusive(void* context, bool active) {
+        (void)context;
+        (void)active;
+    }
+};
+
+void benchSysExMode() {
+    std::cout << "🧪 SysEx por trozos de " << MASCHINE_USB_PACKET_SIZE
+              << " bytes (un trozo por frame de 1 ms, finalización +300 µs)" << std::endl;
+    
+    static uint8_t payload[MASCHINE_SYSEX_OUT_MAX];
+    for (size_t i = 0; i < sizeof(payload); ++i) {
+        payload[i] = (uint8_t)(i & 0x7F);
+    }
+    
+    const uint32_t sizes[] = { 1024, 4096, MASCHINE_SYSEX_PAYLOAD_MAX };
+    const int windows[] = { 1, MASCHINE_SYSEX_WINDOW, 4 };
+    for (uint32_t size : sizes) {
+        std::cout << "   " << size << " bytes:";
+        for (int window : windows) {
+            SimulatedSysExPipe* pipe = new SimulatedSysExPipe();
+            pipe->sender.configure(pipe->pool, MASCHINE_SYSEX_OUT_MAX, MASCHINE_SYSEX_POOL, MASCHINE_USB_PACKET_SIZE,
+                                   window, &SimulatedSysExPipe::submit, &SimulatedSysExPipe::done,
+                                   &SimulatedSysExPipe::exclusive, pipe);
+            pipe->sender.enqueue(payload, size, NULL, 0);
+            while (!pipe->inFlight.empty()) {
+                std::pair<int, uint64_t> next = pipe->inFlight.front();
+                pipe->inFlight.erase(pipe->inFlight.begin());
+                pipe->now = next.second;
+                pipe->sender.complete(next.first, true, pipe->now);
+            }
+            
+            std::cout << " ventana " << window << " → "
+                      << (uint64_t)(pipe->bytes * 1e9 / std::max<uint64_t>(pipe->durationNs, 1)) << " B/s"
+                      << " (" << pipe->durationNs / 1000000 << " ms)";
+            delete pipe;
+        }
+        std::cout << std::endl;
+    }
+}
+
+// Cola de entrada del kext con un productor que simula transferencias cada
+// 100 µs y un consumidor que solo despierta cuando commit() lo pide. La
+// condition variable hace de wake port de kArmInputNotification.
+void benchInputQueueMode(const char* transfersText) {
+    int transfers = transfersText ? atoi(transfersText) : 0;
+    if (transfers <= 0) {
+        transfers = 20000;
+    }
+    
+    static MaschineInputQueue queue;
+    MaschineInputProducer producer;
+    producer.initialize(&queue);
+    
+    std::mutex mutex;
+    std::condition_variable wake;
+    uint64_t wakeups = 0;
+    bool finished = false;
+    
+    std::cout << "🧪 Cola de entrada: " << transfers << " transferencias de 1-8 mensajes cada 100 µs" << std::endl;
+    
+    std::thread kext([&]() {
+        auto next = std::chrono::steady_clock::now();
+        for (int t = 0; t < transfers; ++t) {
+            next += std::chrono::microseconds(100);
+            std::this_thread::sleep_until(next);
+            
+            uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            producer.begin(now);
+            for (int m = 0; m < 1 + t % 8; ++m) {
+                uint8_t message[3] = { 0x90, (uint8_t)(36 + m), (uint8_t)(1 + t % 127) };
+                producer.push(0, message, 3);
+            }
+            if (producer.commit()) {
+                std::lock_guard<std::mutex> lock(mutex);
+                wakeups++;
+                wake.notify_one();
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        wake.notify_one();
+    });
+    
+    std::vector<uint64_t> latencies;
+    latencies.reserve((size_t)transfers * 8);
+    uint64_t seen = 0;
+    uint64_t sleeps = 0;
     while (true) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        // El driver maneja los mensajes MIDI automáticamente
+        MaschineInputEvent event;
+        while (maschineInputQueuePop(&queue, &event)) {
+            uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            latencies.push_back(now - event.timestamp);
+        }
+        
+        // Armar y volver a vaciar si ya había eventos; si no, dormir hasta el aviso
+        if (producer.arm() != 0) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&]() { return wakeups != seen || finished; });
+        if (wakeups == seen && finished) {
+            break;
+        }
+        seen = wakeups;
+        sleeps++;
+    }
+    kext.join();
+    
+    MaschineInputEvent event;
+    while (maschineInputQueuePop(&queue, &event)) {
+        latencies.push_back(0);
+    }
+    
+    std::sort(latencies.begin(), latencies.end());
+    size_t count = latencies.size();
+    std::cout << "   Eventos: " << count << " de " << producer.getPublished()
+              << " (desbordes " << queue.overflows << ")" << std::endl;
+    std::cout << "   Despertares: " << sleeps << " para " << queue.batches << " transferencias ("
+              << (double)sleeps / std::max<uint32_t>(queue.batches, 1) << " por transferencia)" << std::endl;
+    if (count > 0) {
+        std::cout << "   Latencia transfer → consumidor: p50 " << latencies[count / 2] / 1000 << " µs, p99 "
+                  << latencies[count * 99 / 100] / 1000 << " µs, máx " << latencies[count - 1] / 1000 << " µs" << std::endl;
     }
 }
 
-int main(int argc, char* argv[]) {
-    // Procesar argumentos de línea de comandos
-    if (argc > 1) {
-        if (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0) {
-            showHelp();
-            return 0;
-        } else if (strcmp(argv[1], "--debug") == 0 || strcmp(argv[1], "-d") == 0) {
-            debugMode();
-            return 0;
-        } else if (strcmp(argv[1], "--list-sources") == 0) {
-            listMidiSources();
-            return 0;
-        } else if (strcmp(argv[1], "--list-destinations") == 0) {
-            listMidiDestinations();
-            return 0;
-        } else if (strcmp(argv[1], "--test-connection") == 0) {
-            testConnection();
-            return 0;
-        } else if (strcmp(argv[1], "--maschine-mode") == 0) {
-            maschineMode();
-            return 0;
-        } else if (strcmp(argv[1], "--midi-mode") == 0) {
-            midiMode();
-            return 0;
-        } else {
-            std::cout << "❌ Opción desconocida: " << argv[1] << std::endl;
-            showHelp();
-            return 1;
+// Salida USB simulada para --bench-command-ring: acepta hasta "room"
+// mensajes y después rechaza, como una cola de escrituras llena
+struct CommandRingSink {
+    std::vector<MaschineMIDICommand> delivered;
+    uint32_t room;
+};
+
+static int commandRingSend(void* context, const uint8_t* message, uint32_t length) {
+    CommandRingSink* sink = (CommandRingSink*)context;
+    if (sink->room == 0) {
+        return 1;
+    }
+    sink->room--;
+    MaschineMIDICommand command = { (uint8_t)length, { 0, 0, 0 } };
+    memcpy(command.data, message, length);
+    sink->delivered.push_back(command);
+    return 0;
+}
+
+// Entrada escrita a mano, sin pasar por la validación de maschineCommandRingPush
+static void commandRingWrite(MaschineCommandRing* ring, uint8_t length, uint8_t b0, uint8_t b1, uint8_t b2) {
+    MaschineMIDICommand* entry = &ring->entries[ring->head & (ring->capacity - 1)];
+    entry->length = length;
+    entry->data[0] = b0;
+    entry->data[1] = b1;
+    entry->data[2] = b2;
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+// Anillo de comandos del kext contra una salida simulada: rondas de LEDs
+// con entradas malformadas intercaladas (longitud 0 o 4, bytes de datos con
+// el bit alto, SysEx, longitud que no corresponde al estado), atascos de
+// la salida, un tail pisado por user-space y un head imposible. Comprueba
+// que solo salen los mensajes válidos, en orden, y que los malformados se
+// cuentan. Devuelve false si algo no cuadra
+bool benchCommandRingMode(const char* roundsText) {
+    int rounds = roundsText ? atoi(roundsText) : 0;
+    if (rounds <= 0) {
+        rounds = 2000;
+    }
+    
+    static MaschineCommandRing ring;
+    MaschineCommandDispatcher dispatcher;
+    CommandRingSink sink;
+    sink.room = UINT32_MAX;
+    sink.delivered.reserve((size_t)rounds * 64);
+    dispatcher.configure(commandRingSend, &sink);
+    dispatcher.initializeRing(&ring);
+    
+    std::cout << "🧪 Anillo de comandos: " << rounds << " rondas de 64 LEDs con 4 entradas malformadas" << std::endl;
+    
+    bool passed = true;
+    std::vector<MaschineMIDICommand> expected;
+    expected.reserve((size_t)rounds * 64);
+    uint64_t malformed = 0;
+    uint64_t drainNs = 0;
+    for (int r = 0; r < rounds; ++r) {
+        for (int i = 0; i < 64; ++i) {
+            uint8_t message[3] = { 0x90, (uint8_t)(i % 16), (uint8_t)((r + i) & 0x7F) };
+            maschineCommandRingPush(&ring, message, 3);
+            MaschineMIDICommand command = { 3, { message[0], message[1], message[2] } };
+            expected.push_back(command);
+            if (i % 16 == 7) {
+                switch ((r + i / 16) % 5) {
+                    case 0: commandRingWrite(&ring, 0, 0x90, 0, 0); break;
+                    case 1: commandRingWrite(&ring, 4, 0x90, 1, 1); break;
+                    case 2: commandRingWrite(&ring, 3, 0x90, 0x80, 1); break;
+                    case 3: commandRingWrite(&ring, 3, 0xF0, 0x7E, 0xF7); break;
+                    default: commandRingWrite(&ring, 3, 0xC0, 1, 1); break;
+                }
+                malformed++;
+            }
+        }
+        
+        // Cada cuarta ronda la salida se atasca a medias: el resto espera
+        sink.room = r % 4 == 3 ? 20 : UINT32_MAX;
+        auto start = std::chrono::steady_clock::now();
+        dispatcher.drain(&ring);
+        drainNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        if (sink.room == 0) {
+            // Un tail pisado por user-space no cambia lo pendiente
+            uint32_t before = dispatcher.pending(&ring);
+            ring.tail = ring.head;
+            if (before == 0 || dispatcher.pending(&ring) != before) {
+                passed = false;
+            }
+            sink.room = UINT32_MAX;
+            dispatcher.drain(&ring);
+        }
+        if (dispatcher.pending(&ring) != 0) {
+            passed = false;
         }
     }
     
-    // Modo interactivo (sin argumentos)
+    bool ordered = sink.delivered.size() == expected.size();
+    for (size_t i = 0; ordered && i < expected.size(); ++i) {
+        ordered = memcmp(&sink.delivered[i], &expected[i], sizeof(MaschineMIDICommand)) == 0;
+    }
+    if (!ordered || dispatcher.getInvalid() != malformed || ring.rejected != malformed) {
+        passed = false;
+    }
+    
+    // Un head imposible se descarta entero sin enviar nada
+    uint64_t sentBefore = dispatcher.getSent();
+    uint32_t rejectedBefore = ring.rejected;
+    ring.head += MASCHINE_COMMAND_RING_ENTRIES + 5;
+    if (dispatcher.pending(&ring) != 0 || dispatcher.drain(&ring) != 0 || dispatcher.getSent() != sentBefore ||
+        ring.rejected != rejectedBefore + 1 || ring.tail != ring.head) {
+        passed = false;
+    }
+    
+    // El lote por structureInput pasa por la misma validación
+    MaschineMIDICommand batch[4] = { { 3, { 0xB0, 7, 100 } }, { 2, { 0x90, 1, 0 } },
+                                     { 2, { 0xC0, 5, 0 } }, { 1, { 0xF8, 0, 0 } } };
+    size_t deliveredBefore = sink.delivered.size();
+    if (dispatcher.dispatch(batch, 4) != 4 || sink.delivered.size() != deliveredBefore + 3) {
+        passed = false;
+    }
+    
+    std::cout << "   Enviados: " << dispatcher.getSent() << ", malformados descartados: " << dispatcher.getInvalid()
+              << " (anillo " << ring.rejected << "), atascos: " << dispatcher.getStalls() << std::endl;
+    std::cout << "   Drenado: " << (uint64_t)(expected.size() * 1e9 / std::max<uint64_t>(drainNs, 1))
+              << " mensajes/s" << std::endl;
+    if (!passed) {
+        std::cout << "❌ El anillo entregó, perdió o aceptó mensajes que no debía" << std::endl;
+        return false;
+    }
+    std::cout << "✅ Solo salieron los mensajes válidos, en orden" << std::endl;
+    return true;
+}
+
+// Reservas de memoria en el camino de eventos: pads, botones, encoders y
+// LEDs en modo Maschine contra el transporte loopback. Una pasada de
+// calentamiento crea los hilos y tablas perezosas; después se cuentan todas
+// las reservas del proceso (hilos de fondo incluidos) durante N rondas
+void benchAllocMode(const char* roundsText) {
+    int rounds = roundsText ? atoi(roundsText) : 0;
+    if (rounds <= 0) {
+        rounds = 10000;
+    }
+    
+    std::cout << "🧪 Reservas en el camino de eventos: " << rounds
+              << " rondas (pad, botón, encoder y los 16 LEDs de pad)" << std::endl;
+    
+    uint64_t events = 0;
+    uint64_t allocations = 0;
+    std::streambuf* console = std::cout.rdbuf(NULL);
+    {
+        MaschineMikroDriverUser driver;
+        driver.setLogLevel(MASCHINE_LOG_ERROR);
+        driver.setMaschineInput(true);
+        uint64_t sent = 0;
+        driver.setOutputSink([&sent](const MIDIPacketList* packetList) {
+            sent += packetList->numPackets;
+        });
+        
+        auto inject = [&driver](Byte status, Byte data1, Byte data2) {
+            Byte message[3] = { status, data1, data2 };
+            MIDIPacketList packetList;
+            MIDIPacket* packet = MIDIPacketListInit(&packetList);
+            MIDIPacketListAdd(&packetList, sizeof(packetList), packet, 0, sizeof(message), message);
+            driver.injectMIDIInput(&packetList);
+        };
+        auto round = [&](int i) {
+            int pad = 4 + i % 12;
+            inject(0x90, (Byte)(36 + pad), 100);
+            inject(0x80, (Byte)(36 + pad), 0);
+            inject(0xB0, 16 + BUTTON_SELECT, 127);
+            inject(0xB0, 16 + BUTTON_SELECT, 0);
+            inject(0xB0, 24 + ENCODER_SWING, (i / 8) % 2 ? 63 : 65);
+            driver.setAllPadLEDs(i % 2 == 0);
+        };
+        
+        for (int i = 0; i < 64; ++i) {
+            round(i);
+        }
+        
+        countAllocations = true;
+        for (int i = 0; i < rounds; ++i) {
+            round(i);
+        }
+        countAllocations = false;
+        allocations = allocationCount;
+        events = (uint64_t)rounds * (5 + NUM_PADS);
+    }
+    std::cout.rdbuf(console);
+    std::cout.clear();
+    
+    std::cout << "   " << events << " eventos y LEDs: " << allocations << " reservas ("
+              << (double)allocations / events << " por evento)" << std::endl;
+    if (allocations == 0) {
+        std::cout << "✅ El camino de eventos no reserva memoria" << std::endl;
+    } else {
+        std::cout << "❌ El camino de eventos reserva memoria" << std::endl;
+    }
+}
+
+// PLL del reloj MIDI esclavo con flujos 0xF8 sintéticos: tempo fijo con
+// distintos niveles de jitter, una rampa y un salto. Cada caso se repite con
+// N semillas; la convergencia cuenta pulsos desde la última adquisición
+void benchClockMode(const char* runsText) {
+    int runs = runsText ? atoi(runsText) : 0;
+    if (runs <= 0) {
+        runs = 100;
+    }
+    
+    struct Scenario {
+        const char* name;
+        double startBpm;
+        double endBpm;
+        int rampTicks;          // pulsos de transición (0 = salto)
+        double jitterUs;        // jitter uniforme ±
+    } scenarios[] = {
+        { "120 BPM sin jitter", 120.0, 120.0, 0, 0.0 },
+        { "120 BPM, jitter ±500 µs", 120.0, 120.0, 0, 500.0 },
+        { "120 BPM, jitter ±2 ms", 120.0, 120.0, 0, 2000.0 },
+        { "rampa 100 -> 140 BPM en 8 compases, ±1 ms", 100.0, 140.0, 8 * 4 * MIDI_CLOCK_PPQN, 1000.0 },
+        { "salto 120 -> 90 BPM, ±1 ms", 120.0, 90.0, 0, 1000.0 }
+    };
+    // 16 compases antes de la transición y 16 después
+    const int leadTicks = 16 * 4 * MIDI_CLOCK_PPQN;
+    
+    std::cout << "🧪 Reloj MIDI esclavo: " << runs << " semillas por caso, "
+              << 2 * leadTicks / MIDI_CLOCK_PPQN << " negras más la transición" << std::endl;
+    
+    for (const Scenario& scenario : scenarios) {
+        uint64_t convergenceTotal = 0;
+        int convergenceMax = 0;
+        int unlocked = 0;
+        double errorTotal = 0.0;
+        double tempoErrorMax = 0.0;
+        uint64_t rejected = 0;
+        
+        for (int run = 0; run < runs; ++run) {
+            MaschineClockTracker tracker;
+            uint32_t random = 12345 + run * 7919;
+            double ideal = 1.0e9;
+            int ticks = 2 * leadTicks + scenario.rampTicks;
+            for (int tick = 0; tick < ticks; ++tick) {
+                double bpm = scenario.startBpm;
+                if (tick >= leadTicks + scenario.rampTicks) {
+                    bpm = scenario.endBpm;
+                } else if (tick >= leadTicks) {
+                    bpm += (scenario.endBpm - scenario.startBpm) * (tick - leadTicks) / scenario.rampTicks;
+                }
+                ideal += 60.0e9 / (bpm * MIDI_CLOCK_PPQN);
+                
+                random = random * 1103515245 + 12345;
+                double jitter = ((random >> 8) / 8388608.0 - 1.0) * scenario.jitterUs * 1000.0;
+                tracker.clockTick((uint64_t)(ideal + jitter));
+            }
+            
+            if (tracker.isLocked()) {
+                convergenceTotal += tracker.getConvergenceTicks();
+                convergenceMax = std::max(convergenceMax, tracker.getConvergenceTicks());
+            } else {
+                unlocked++;
+            }
+            errorTotal += tracker.getSteadyStateErrorUs();
+            tempoErrorMax = std::max(tempoErrorMax, std::fabs(tracker.getTempo() - scenario.endBpm));
+            rejected += tracker.getRejectedTicks();
+        }
+        
+        int locked = runs - unlocked;
+        std::cout << "   " << scenario.name << ": convergencia media "
+                  << (locked ? (double)convergenceTotal / locked : 0.0) << " pulsos (máx " << convergenceMax
+                  << "), error de fase RMS " << errorTotal / runs << " µs, error de tempo máx "
+                  << tempoErrorMax << " BPM, " << (double)rejected / runs << " pulsos rechazados";
+        if (unlocked > 0) {
+            std::cout << ", " << unlocked << " sin enganchar";
+        }
+        std::cout << std::endl;
+    }
+}
+
+// Suites de prueba del driver en tiempo virtual contra el transporte
+// loopback: las esperas de 100-500 ms avanzan el reloj al instante y los
+// LEDs salen a un contador en vez de a CoreMIDI. Cada iteración corre las
+// seis suites (todos los pads/botones/encoders y una prueba individual de
+// cada tipo) y comprueba que cada pulsación de pad encendió y apagó su LED.
+// Devuelve false si alguna iteración falló
+bool virtualTestMode(const char* iterationsText) {
+    int iterations = iterationsText ? atoi(iterationsText) : 0;
+    if (iterations <= 0) {
+        iterations = 1000;
+    }
+    
+    MaschineVirtualClock clock;
     MaschineMikroDriverUser driver;
+    driver.setClock(&clock);
+    driver.setLogLevel(MASCHINE_LOG_ERROR);
     
-    std::cout << "🎹 Iniciando Maschine Mikro Driver en modo nativo..." << std::endl;
+    uint64_t ledMessages = 0;
+    uint64_t padLEDs = 0;
+    driver.setOutputSink([&](const MIDIPacketList* packetList) {
+        const MIDIPacket* packet = &packetList->packet[0];
+        for (UInt32 i = 0; i < packetList->numPackets; ++i) {
+            if (packet->length >= 10 && packet->data[0] == 0xF0 && packet->data[5] == 0x00) {
+                ledMessages++;
+                if (packet->data[6] == 0x00) {
+                    padLEDs++;
+                }
+            }
+            packet = MIDIPacketNext(packet);
+        }
+    });
     
-    if (!driver.initialize()) {
-        std::cout << "❌ Error al inicializar el driver" << std::endl;
-        return 1;
+    std::cout << "🧪 Suites en tiempo virtual: " << iterations << " iteraciones de 6 suites" << std::endl;
+    
+    // Las suites imprimen cada paso: silenciadas mientras corren
+    std::streambuf* console = std::cout.rdbuf(NULL);
+    // 16 pads más la prueba individual, encendido y apagado
+    const uint64_t expected = 2 * (NUM_PADS + 1);
+    int failures = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; ++i) {
+        uint64_t before = padLEDs;
+        driver.testAllPads();
+        driver.testAllButtons();
+        driver.testAllEncoders();
+        driver.testIndividualPad(i % NUM_PADS);
+        driver.testIndividualButton(i % NUM_BUTTONS);
+        driver.testIndividualEncoder(i % 2);
+        
+        if (padLEDs - before != expected) {
+            failures++;
+        }
     }
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout.rdbuf(console);
+    std::cout.clear();
     
-    if (!driver.connectDevice()) {
-        std::cout << "❌ Error al conectar el dispositivo" << std::endl;
-        return 1;
+    double virtualSeconds = clock.getElapsed() / 1.0e9;
+    std::cout << "   Escenarios: " << iterations * 6 << " en " << wallSeconds * 1000.0 << " ms ("
+              << (int)(iterations * 6 / std::max(wallSeconds, 1.0e-9)) << "/s)" << std::endl;
+    std::cout << "   Tiempo virtual: " << virtualSeconds << " s (" << (int)(virtualSeconds / std::max(wallSeconds, 1.0e-9))
+              << "x tiempo real)" << std::endl;
+    std::cout << "   Mensajes de LED: " << ledMessages << " (" << padLEDs << " de pads)" << std::endl;
+    if (failures > 0) {
+        std::cout << "❌ " << failures << " iteraciones sin los " << expected << " LEDs de pad esperados" << std::endl;
+    } else {
+        std::cout << "✅ Todas las iteraciones encendieron y apagaron cada LED de pad" << std::endl;
+    }
+    return failures == 0;
+}
+
+// Conecta el dispositivo virtual a un driver nuevo en modo Maschine, con la
+// salida MIDI de vuelta al dispositivo. Con animationHz > 0 un segundo hilo
+// anima LEDs a la vez (pads 8-15 y botones), como lo haría el host
+static void driveVirtualDevice(MaschineVirtualDevice& device, double seconds, int animationHz) {
+    // Los manejadores imprimen cada cambio de estado: silenciados mientras
+    // corre, incluidos los hilos del driver hasta que se destruye
+    std::streambuf* console = std::cout.rdbuf(NULL);
+    {
+        MaschineMikroDriverUser driver;
+        driver.setLogLevel(MASCHINE_LOG_ERROR);
+        driver.setMaschineInput(true);
+        driver.setOutputSink([&device](const MIDIPacketList* packetList) {
+            const MIDIPacket* packet = &packetList->packet[0];
+            for (UInt32 i = 0; i < packetList->numPackets; ++i) {
+                device.receive(packet->data, packet->length);
+                packet = MIDIPacketNext(packet);
+            }
+        });
+        
+        std::atomic<bool> animating(animationHz > 0);
+        std::thread animation([&]() {
+            auto next = std::chrono::steady_clock::now();
+            for (int step = 0; animating; ++step) {
+                next += std::chrono::microseconds(1000000 / std::max(animationHz, 1));
+                std::this_thread::sleep_until(next);
+                driver.setPadLED(8 + step % 8, (step / 8) % 2 == 0);
+                driver.setButtonLED(step % 8, (step / 8) % 2 == 0);
+            }
+        });
+        
+        device.run((uint64_t)(seconds * 1.0e9), [&driver](const MaschineVirtualMessage& message) {
+            MIDIPacketList packetList;
+            MIDIPacket* packet = MIDIPacketListInit(&packetList);
+            MIDIPacketListAdd(&packetList, sizeof(packetList), packet, 0, message.length, message.data);
+            driver.injectMIDIInput(&packetList);
+        });
+        animating = false;
+        animation.join();
     }
+    std::cout.rdbuf(console);
+    std::cout.clear();
+}
+
+// Una pasada del dispositivo virtual a una tasa
+static void runVirtualDevice(const MaschineVirtualDeviceConfig& config, double seconds) {
+    MaschineVirtualDevice device(config);
+    driveVirtualDevice(device, seconds, 0);
     
-    std::cout << "✅ Driver inicializado y dispositivo conectado" << std::endl;
+    MaschineLatencySummary delivery = device.getDeliveryLatency();
+    MaschineLatencySummary roundTrip = device.getRoundTripLatency();
+    uint64_t generated = device.getGenerated();
+    std::cout << "   " << (int)config.rate << " eventos/s: " << generated << " generados, "
+              << device.getDropped() << " descartados ("
+              << (generated ? 100.0 * device.getDropped() / generated : 0.0) << "%)" << std::endl;
+    std::cout << "      Entrega al driver: p50 " << delivery.p50 / 1000.0 << " µs, p99 "
+              << delivery.p99 / 1000.0 << " µs, máx " << delivery.max / 1000.0 << " µs" << std::endl;
+    std::cout << "      Pad -> LED: " << roundTrip.count << " viajes, p50 " << roundTrip.p50 / 1000.0
+              << " µs, p99 " << roundTrip.p99 / 1000.0 << " µs, máx " << roundTrip.max / 1000.0
+              << " µs (" << device.getUnanswered() << " sin LED)" << std::endl;
+}
+
+// Carga sintética sin hardware: el dispositivo virtual habla el protocolo
+// de la Mikro y contesta a los SysEx de LED. Sin tasa, recorre 1k, 10k y
+// 100k eventos/s
+void virtualDeviceMode(const char* rateText, const char* burstText, const char* arrivalsText) {
+    MaschineVirtualDeviceConfig config;
+    if (burstText) {
+        config.burstSize = std::max(1, atoi(burstText));
+    }
+    if (arrivalsText && strcmp(arrivalsText, "uniform") == 0) {
+        config.arrivals = MASCHINE_VIRTUAL_UNIFORM;
+    }
+    
+    std::vector<double> rates;
+    int rate = rateText ? atoi(rateText) : 0;
+    if (rate > 0) {
+        rates.push_back(rate);
+    } else {
+        rates.push_back(1000.0);
+        rates.push_back(10000.0);
+        rates.push_back(100000.0);
+    }
+    
+    std::cout << "🧪 Dispositivo virtual: llegadas "
+              << (config.arrivals == MASCHINE_VIRTUAL_POISSON ? "Poisson" : "uniformes")
+              << ", ráfagas de " << config.burstSize << ", buffer de " << config.queueDepth
+              << " mensajes, 2 s por tasa" << std::endl;
+    for (size_t i = 0; i < rates.size(); ++i) {
+        config.rate = rates[i];
+        runVirtualDevice(config, 2.0);
+    }
+}
+
+// Regresión de latencia pad -> LED: pulsaciones en los pads 0-7 bajo
+// barridos de encoder y una animación de LEDs, midiendo desde que el
+// dispositivo emite el note on hasta que recibe el SysEx del LED. Falla si
+// el p99 supera el presupuesto o alguna pulsación se queda sin LED
+bool padLatencyTestMode(const char* iterationsText, const char* budgetText,
+                        const char* encoderRateText, const char* animationText) {
+    int iterations = iterationsText ? atoi(iterationsText) : 0;
+    if (iterations <= 0) {
+        iterations = 5000;
+    }
+    double budgetUs = budgetText ? atof(budgetText) : 0.0;
+    if (budgetUs <= 0.0) {
+        budgetUs = 1000.0;
+    }
+    int encoderRate = encoderRateText ? atoi(encoderRateText) : 5000;
+    int animationHz = animationText ? atoi(animationText) : 500;
+    
+    // 1000 eventos de pad por segundo: la mitad son pulsaciones
+    const int padRate = 1000;
+    MaschineVirtualDeviceConfig config;
+    config.rate = padRate + std::max(encoderRate, 0);
+    config.padWeight = padRate;
+    config.buttonWeight = 0;
+    config.encoderWeight = std::max(encoderRate, 0);
+    config.statusWeight = 0;
+    config.sysexWeight = 0;
+    config.padMask = 0x00FF;
+    double seconds = 2.0 * iterations / padRate * 1.05;
+    
+    std::cout << "🧪 Latencia pad -> LED: ~" << iterations << " pulsaciones, encoders a " << encoderRate
+              << " eventos/s, animación de LEDs a " << animationHz << " Hz, presupuesto p99 "
+              << budgetUs << " µs" << std::endl;
+    
+    MaschineVirtualDevice device(config);
+    driveVirtualDevice(device, seconds, animationHz);
     
+    MaschineLatencySummary roundTrip = device.getRoundTripLatency();
+    uint64_t unanswered = device.getUnanswered();
+    std::cout << "   " << roundTrip.count << " viajes: p50 " << roundTrip.p50 / 1000.0 << " µs, p99 "
+              << roundTrip.p99 / 1000.0 << " µs, máx " << roundTrip.max / 1000.0 << " µs" << std::endl;
+    std::cout << "   Descartes: " << device.getDropped() << ", pulsaciones sin LED: " << unanswered << std::endl;
+    
+    if (roundTrip.count == 0 || unanswered > 0 || roundTrip.p99 / 1000.0 > budgetUs) {
+        std::cout << "❌ Regresión de latencia pad -> LED" << std::endl;
+        return false;
+    }
+    std::cout << "✅ p99 dentro del presupuesto" << std::endl;
+    return true;
+}
+
+// Menú interactivo; corre fuera del hilo del bucle de eventos
+void interactiveMenu(MaschineMikroDriverUser& driver) {
     int choice;
     do {
         showMainMenu();
@@ -463,7 +1877,7 @@ int main(int argc, char* argv[]) {
                         }
                         case 2: {
                             double swing;
-                            std::cout << "Ingresa el nuevo swing (0.0-1.0): ";
+                            std::cout << "Ingresa el nuevo swing (0-100%): ";
                             std::cin >> swing;
                             driver.setSwing(swing);
                             break;
@@ -475,6 +1889,13 @@ int main(int argc, char* argv[]) {
                             std::cout << "Tempo actual: " << driver.getTempo() << " BPM" << std::endl;
                             std::cout << "Swing actual: " << driver.getSwing() << std::endl;
                             break;
+                        case 5:
+                            if (driver.isClockSlaveMode()) {
+                                driver.disableClockSlaveMode();
+                            } else {
+                                driver.enableClockSlaveMode();
+                            }
+                            break;
                     }
                 } while (tempoChoice != 0);
                 break;
@@ -539,6 +1960,123 @@ int main(int argc, char* argv[]) {
         }
         
     } while (choice != 0);
+}
+
+int main(int argc, char* argv[]) {
+    // Procesar argumentos de línea de comandos
+    if (argc > 1) {
+        if (strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0) {
+            showHelp();
+            return 0;
+        } else if (strcmp(argv[1], "--debug") == 0 || strcmp(argv[1], "-d") == 0) {
+            debugMode();
+            return 0;
+        } else if (strcmp(argv[1], "--list-sources") == 0) {
+            listMidiSources();
+            return 0;
+        } else if (strcmp(argv[1], "--list-destinations") == 0) {
+            listMidiDestinations();
+            return 0;
+        } else if (strcmp(argv[1], "--test-connection") == 0) {
+            testConnection();
+            return 0;
+        } else if (strcmp(argv[1], "--maschine-mode") == 0) {
+            maschineMode();
+            return 0;
+        } else if (strcmp(argv[1], "--midi-mode") == 0) {
+            midiMode();
+            return 0;
+        } else if (strcmp(argv[1], "--host-monitor") == 0) {
+            hostMonitorMode();
+            return 0;
+        } else if (strcmp(argv[1], "--subscribe") == 0) {
+            subscribeMode(argc > 2 ? argv[2] : NULL);
+            return 0;
+        } else if (strcmp(argv[1], "--state") == 0) {
+            stateMode(argc > 2 ? argv[2] : NULL);
+            return 0;
+        } else if (strcmp(argv[1], "--bench-usb-reads") == 0) {
+            benchUSBReadsMode(argc > 2 ? argv[2] : NULL);
+            return 0;
+        } else if (strcmp(argv[1], "--bench-midi-batch") == 0) {
+            benchMIDIBatchMode(argc > 2 ? argv[2] : NULL);
+            return 0;
+        } else if (strcmp(argv[1], "--bench-usb-midi") == 0) {
+            benchUSBMIDIMode(argc > 2 ? argv[2] : NULL);
+            return 0;
+        } else if (strcmp(argv[1], "--bench-usb-writes") == 0) {
+            benchUSBWritesMode(argc > 2 ? argv[2] : NULL);
+            return 0;
+        } else if (strcmp(argv[1], "--bench-sysex") == 0) {
+            benchSysExMode();
+            return 0;
+        } else if (strcmp(argv[1], "--startup-profile") == 0) {
+            startupProfileMode();
+            return 0;
+        } else if (strcmp(argv[1], "--daemon") == 0) {
+            bool started = daemonMode(argc > 2 ? argv[2] : NULL);
+            return started ? 0 : 1;
+        } else if (strcmp(argv[1], "--test-virtual") == 0) {
+            bool passed = virtualTestMode(argc > 2 ? argv[2] : NULL);
+            return passed ? 0 : 1;
+        } else if (strcmp(argv[1], "--virtual-device") == 0) {
+            virtualDeviceMode(argc > 2 ? argv[2] : NULL, argc > 3 ? argv[3] : NULL, argc > 4 ? argv[4] : NULL);
+            return 0;
+        } else if (strcmp(argv[1], "--test-pad-latency") == 0) {
+            bool passed = padLatencyTestMode(argc > 2 ? argv[2] : NULL, argc > 3 ? argv[3] : NULL,
+                                             argc > 4 ? argv[4] : NULL, argc > 5 ? argv[5] : NULL);
+            return passed ? 0 : 1;
+        } else if (strcmp(argv[1], "--bench-input-queue") == 0) {
+            benchInputQueueMode(argc > 2 ? argv[2] : NULL);
+            return 0;
+        } else if (strcmp(argv[1], "--bench-command-ring") == 0) {
+            bool passed = benchCommandRingMode(argc > 2 ? argv[2] : NULL);
+            return passed ? 0 : 1;
+        } else if (strcmp(argv[1], "--bench-clock") == 0) {
+            benchClockMode(argc > 2 ? argv[2] : NULL);
+            return 0;
+        } else if (strcmp(argv[1], "--bench-alloc") == 0) {
+            benchAllocMode(argc > 2 ? argv[2] : NULL);
+            return 0;
+        } else {
+            std::cout << "❌ Opción desconocida: " << argv[1] << std::endl;
+            showHelp();
+            return 1;
+        }
+    }
+    
+    // Modo interactivo (sin argumentos)
+    MaschineMikroDriverUser driver;
+    
+    std::cout << "🎹 Iniciando Maschine Mikro Driver en modo nativo..." << std::endl;
+    
+    if (!driver.initialize()) {
+        std::cout << "❌ Error al inicializar el driver" << std::endl;
+        return 1;
+    }
+    
+    if (!driver.connectDevice()) {
+        std::cout << "❌ Error al conectar el dispositivo" << std::endl;
+        return 1;
+    }
+    
+    driver.startStateExport();
+    
+    std::cout << "✅ Driver inicializado y dispositivo conectado" << std::endl;
+    
+    // El menú lee stdin en su propio hilo. Este hilo creó el cliente de
+    // CoreMIDI y atiende su CFRunLoop: por ahí llegan las altas y bajas del
+    // dispositivo y el refresco de la página de estado. Ctrl+C sigue
+    // terminando el proceso como siempre
+    MaschineEventLoop loop;
+    driver.attachEventLoop(loop);
+    std::thread menu([&]() {
+        interactiveMenu(driver);
+        loop.stop();
+    });
+    loop.run();
+    driver.detachEventLoop(loop);
+    menu.join();
     
     return 0;
 } 
\ No newline at end of file
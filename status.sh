@@ -88,6 +88,25 @@ fi
 
 echo
 
+# Live driver state (read from the shared state page, no system_profiler needed)
+echo -e "${BLUE}Live Driver State:${NC}"
+DRIVER_BIN=$(command -v maschine_driver || true)
+if [[ -z "$DRIVER_BIN" && -x "./maschine_driver" ]]; then
+    DRIVER_BIN="./maschine_driver"
+fi
+LIVE_STATE=""
+if [[ -n "$DRIVER_BIN" ]]; then
+    LIVE_STATE=$("$DRIVER_BIN" --state 2>/dev/null || true)
+fi
+if [[ "$LIVE_STATE" == *"Modo"* ]]; then
+    echo -e "  ${GREEN}✓${NC} Driver running"
+    echo "$LIVE_STATE" | sed 's/^/    /'
+else
+    echo -e "  ${YELLOW}⚠${NC} Driver not running (no state page)"
+fi
+
+echo
+
 # Check device detection
 echo -e "${BLUE}Device Detection:${NC}"
 USB_DEVICE=$(system_profiler SPUSBDataType | grep -A 5 -B 5 -i "maschine\|native instruments" | grep -E "(Product ID|Vendor ID)" || true)